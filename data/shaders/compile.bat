@@ -1,11 +1,16 @@
 %VK_SDK_PATH%/Bin32/glslc.exe pbr.vert -o pbr.vert.spv
+%VK_SDK_PATH%/Bin32/glslc.exe -DINSTANCED pbr.vert -o pbr_instanced.vert.spv
 %VK_SDK_PATH%/Bin32/glslc.exe pbr.frag -o pbr.frag.spv
+%VK_SDK_PATH%/Bin32/glslc.exe -DBINDLESS pbr.frag -o pbr_bindless.frag.spv
 %VK_SDK_PATH%/Bin32/glslc.exe skybox.vert -o skybox.vert.spv
 %VK_SDK_PATH%/Bin32/glslc.exe skybox.frag -o skybox.frag.spv
 %VK_SDK_PATH%/Bin32/glslc.exe equirect2cube.comp -o equirect2cube.comp.spv
 %VK_SDK_PATH%/Bin32/glslc.exe irmap.comp -o irmap.comp.spv
 %VK_SDK_PATH%/Bin32/glslc.exe spbrdf.comp -o spbrdf.comp.spv
 %VK_SDK_PATH%/Bin32/glslc.exe spmap.comp -o spmap.comp.spv
+%VK_SDK_PATH%/Bin32/glslc.exe downsample.comp -o downsample.comp.spv
+%VK_SDK_PATH%/Bin32/glslc.exe virtual_texture_plane.vert -o virtual_texture_plane.vert.spv
+%VK_SDK_PATH%/Bin32/glslc.exe virtual_texture_plane.frag -o virtual_texture_plane.frag.spv
 %VK_SDK_PATH%/Bin32/glslc.exe debug_draw.vert -o debug_draw.vert.spv
 %VK_SDK_PATH%/Bin32/glslc.exe debug_draw.frag -o debug_draw.frag.spv
 pause
@@ -1,4 +1,7 @@
 #version 450
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout (location = 0) in vec3 inWorldPos;
 layout (location = 1) in vec3 inNormal;
@@ -24,10 +27,52 @@ layout (set = 0, binding = 1) uniform UBOParams {
 	float debugBone;
 } uboParams;
 
-//layout (set = 0, binding = 2) uniform samplerCube samplerIrradiance;
-//layout (set = 0, binding = 3) uniform samplerCube prefilteredMap;
-//layout (set = 0, binding = 4) uniform sampler2D samplerBRDFLUT;
+// Computed by ImageBasedLighting, all three hold linear radiance
+layout (set = 0, binding = 2) uniform samplerCube samplerIrradiance;
+layout (set = 0, binding = 3) uniform samplerCube prefilteredMap;
+layout (set = 0, binding = 4) uniform sampler2D samplerBRDFLUT;
 
+#ifdef BINDLESS
+// Every material and texture of the model, indexed by the material of the draw
+struct MaterialData {
+	vec4 baseColorFactor;
+	vec4 emissiveFactor;
+	vec4 diffuseFactor;
+	vec4 specularFactor;
+	float workflow;
+	int baseColorTextureSet;
+	int physicalDescriptorTextureSet;
+	int normalTextureSet;
+	int occlusionTextureSet;
+	int emissiveTextureSet;
+	float metallicFactor;
+	float roughnessFactor;
+	float alphaMask;
+	float alphaMaskCutoff;
+	int baseColorTexture;
+	int physicalDescriptorTexture;
+	int normalTexture;
+	int occlusionTexture;
+	int emissiveTexture;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer Materials {
+	MaterialData materials[];
+};
+layout (set = 1, binding = 1) uniform sampler2D textures[];
+
+layout (push_constant) uniform PushConsts {
+	uint materialIndex;
+} pushConsts;
+
+#define material materials[pushConsts.materialIndex]
+// Unused maps are never sampled, their set is -1
+#define colorMap textures[max(material.baseColorTexture, 0)]
+#define physicalDescriptorMap textures[max(material.physicalDescriptorTexture, 0)]
+#define normalMap textures[max(material.normalTexture, 0)]
+#define aoMap textures[max(material.occlusionTexture, 0)]
+#define emissiveMap textures[max(material.emissiveTexture, 0)]
+#else
 // Material bindings
 layout (set = 1, binding = 0) uniform sampler2D colorMap;
 layout (set = 1, binding = 1) uniform sampler2D physicalDescriptorMap;
@@ -51,6 +96,7 @@ layout (push_constant) uniform Material {
 	float alphaMask;	
 	float alphaMaskCutoff;
 } material;
+#endif
 
 layout (location = 0) out vec4 outColor;
 
@@ -142,18 +188,13 @@ vec3 getIBLContribution(PBRInfo pbrInputs, vec3 n, vec3 reflection)
 {
 	float lod = (pbrInputs.perceptualRoughness * uboParams.prefilteredCubeMipLevels);
 	// retrieve a scale and bias to F0. See [1], Figure 3
-	
-	//vec3 brdf = (texture(samplerBRDFLUT, vec2(pbrInputs.NdotV, 1.0 - pbrInputs.perceptualRoughness))).rgb;
-	
-	//vec3 diffuseLight = SRGBtoLINEAR(tonemap(texture(samplerIrradiance, n))).rgb;
-	vec3 diffuseLight = vec3(0.5f);
-	
-	//vec3 specularLight = SRGBtoLINEAR(tonemap(textureLod(prefilteredMap, reflection, lod))).rgb;
-	vec3 specularLight = vec3(0.3f);
+	vec3 brdf = (texture(samplerBRDFLUT, vec2(pbrInputs.NdotV, 1.0 - pbrInputs.perceptualRoughness))).rgb;
+	// The irradiance cube is already divided by PI
+	vec3 diffuseLight = texture(samplerIrradiance, n).rgb;
+	vec3 specularLight = textureLod(prefilteredMap, reflection, lod).rgb;
 
 	vec3 diffuse = diffuseLight * pbrInputs.diffuseColor;
-	//vec3 specular = specularLight * (pbrInputs.specularColor * brdf.x + brdf.y);
-	vec3 specular = specularLight;
+	vec3 specular = specularLight * (pbrInputs.specularColor * brdf.x + brdf.y);
 	
 	// For presentation, this allows us to disable IBL terms
 	diffuse *= uboParams.scaleIBLAmbient;
@@ -345,7 +386,7 @@ void main()
 	vec3 color = NdotL * u_LightColor * (diffuseContrib + specContrib);
 
 	// Calculate lighting contribution from image based lighting source (IBL)
-	//color += getIBLContribution(pbrInputs, n, reflection);
+	color += getIBLContribution(pbrInputs, n, reflection);
 
 	const float u_OcclusionStrength = 1.0f;
 	// Apply optional PBR terms for additional (optional) shading
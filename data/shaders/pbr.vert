@@ -6,6 +6,10 @@ layout (location = 2) in vec2 inUV0;
 layout (location = 3) in vec2 inUV1;
 layout (location = 4) in vec4 inJoint0;
 layout (location = 5) in vec4 inWeight0;
+#ifdef INSTANCED
+// World matrix of the node, one instance per node drawing a shared mesh
+layout (location = 6) in mat4 inInstanceMatrix;
+#endif
 
 layout (set = 0, binding = 0) uniform UBO 
 {
@@ -15,14 +19,20 @@ layout (set = 0, binding = 0) uniform UBO
 	vec3 camPos;
 } ubo;
 
+#ifndef INSTANCED
 #define MAX_NUM_JOINTS 128
 
 layout (set = 2, binding = 0) uniform UBONode {
 	mat4 matrix;
-	mat4 jointMatrix[MAX_NUM_JOINTS];
 	float jointCount;
 } node;
 
+// Only valid when jointCount > 0
+layout (set = 2, binding = 1) uniform UBOSkin {
+	mat4 jointMatrix[MAX_NUM_JOINTS];
+} skin;
+#endif
+
 layout (location = 0) out vec3 outWorldPos;
 layout (location = 1) out vec3 outNormal;
 layout (location = 2) out vec2 outUV0;
@@ -36,19 +46,24 @@ out gl_PerVertex
 void main() 
 {
 	vec4 locPos;
+#ifdef INSTANCED
+	locPos = ubo.model * inInstanceMatrix * vec4(inPos, 1.0);
+	outNormal = normalize(transpose(inverse(mat3(ubo.model * inInstanceMatrix))) * inNormal);
+#else
 	if (node.jointCount > 0.0) {
 		// Mesh is skinned
 		mat4 skinMat = 
-			inWeight0.x * node.jointMatrix[int(inJoint0.x)] +
-			inWeight0.y * node.jointMatrix[int(inJoint0.y)] +
-			inWeight0.z * node.jointMatrix[int(inJoint0.z)] +
-			inWeight0.w * node.jointMatrix[int(inJoint0.w)];
+			inWeight0.x * skin.jointMatrix[int(inJoint0.x)] +
+			inWeight0.y * skin.jointMatrix[int(inJoint0.y)] +
+			inWeight0.z * skin.jointMatrix[int(inJoint0.z)] +
+			inWeight0.w * skin.jointMatrix[int(inJoint0.w)];
 		locPos = ubo.model * node.matrix * skinMat * vec4(inPos, 1.0);
 		outNormal = normalize(transpose(inverse(mat3(ubo.model * node.matrix * skinMat))) * inNormal);
 	} else {
 		locPos = ubo.model * node.matrix * vec4(inPos, 1.0);
 		outNormal = normalize(transpose(inverse(mat3(ubo.model * node.matrix))) * inNormal);
 	}
+#endif
 	locPos.y = -locPos.y;
 	outWorldPos = locPos.xyz / locPos.w;
 	outUV0 = inUV0;
@@ -0,0 +1,48 @@
+// Lookups into a VirtualTexture, include after defining VT_SET and VT_BINDING. The four bindings from VT_BINDING
+// on are the ones VirtualTexture::getLayoutBindings returns. Fragment shaders only, the feedback is written there.
+
+layout (set = VT_SET, binding = VT_BINDING) uniform sampler2D vtCache;
+layout (set = VT_SET, binding = VT_BINDING + 1) uniform usampler2D vtPageTable;
+layout (std430, set = VT_SET, binding = VT_BINDING + 2) buffer VtFeedback {
+	uint vtRequests[];
+};
+layout (set = VT_SET, binding = VT_BINDING + 3) uniform VtParams {
+	// Level 0 width and height in texels, page size, last level
+	vec4 virtualSize;
+	// Reciprocal cache size, padded page size, border
+	vec4 cacheLayout;
+	// Level 0 width and height in pages, frame counter
+	uvec4 pages;
+	// x is the first feedback entry of the level
+	uvec4 levelOffsets[16];
+} vtParams;
+
+float vtLevel(vec2 uv)
+{
+	vec2 texels = uv * vtParams.virtualSize.xy;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	return clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, vtParams.virtualSize.w);
+}
+
+// Bilinear within the level the derivatives ask for, or the closest coarser one that is resident
+vec4 vtSample(vec2 uv)
+{
+	uint level = uint(vtLevel(uv));
+	uv = fract(uv);
+	uvec2 levelPages = max(vtParams.pages.xy >> level, uvec2(1));
+	uvec2 page = min(uvec2(uv * vec2(levelPages)), levelPages - 1u);
+
+	// One fragment of every 4x4 block reports its page, which one rotates every frame
+	uvec2 pixel = uvec2(gl_FragCoord.xy) & 3u;
+	if (pixel.x + pixel.y * 4u == (vtParams.pages.z & 15u)) {
+		vtRequests[vtParams.levelOffsets[level].x + page.y * levelPages.x + page.x] = 1u;
+	}
+
+	// rg is the cache slot, b the level it holds
+	uvec4 entry = texelFetch(vtPageTable, ivec2(page), int(level));
+	uvec2 residentPages = max(vtParams.pages.xy >> entry.b, uvec2(1));
+	vec2 inPage = fract(uv * vec2(residentPages)) * vtParams.virtualSize.z;
+	vec2 texel = vec2(entry.rg) * vtParams.cacheLayout.z + vtParams.cacheLayout.w + inPage;
+	return textureLod(vtCache, texel * vtParams.cacheLayout.xy, 0.0);
+}
@@ -0,0 +1,16 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#define VT_SET 0
+#define VT_BINDING 0
+#include "virtual_texture.glsl"
+
+layout (location = 0) in vec2 inUV;
+layout (location = 0) out vec4 outColor;
+
+void main()
+{
+	// The swap chain is UNORM, the cache decodes sRGB on fetch
+	vec4 color = vtSample(inUV);
+	outColor = vec4(pow(color.rgb, vec3(1.0 / 2.2)), color.a);
+}
@@ -0,0 +1,26 @@
+#version 450
+
+// Plane on y = 0 from -1 to 1, drawn without vertex buffers
+layout (push_constant) uniform PushConsts {
+	mat4 mvp;
+	float uvScale;
+} push;
+
+layout (location = 0) out vec2 outUV;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+const vec2 corners[6] = vec2[](
+	vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+	vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+void main()
+{
+	vec2 corner = corners[gl_VertexIndex];
+	outUV = (corner * 0.5 + 0.5) * push.uvScale;
+	gl_Position = push.mvp * vec4(corner.x, 0.0, corner.y, 1.0);
+}
@@ -9,14 +9,19 @@
 
 VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset)
 {
-    return vkMapMemory(device, memory, offset, size, 0, &mapped);
+    // Host visible allocations stay mapped, only the pointer is handed out
+    if (allocation.mapped == nullptr) {
+        return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+    memory::map(allocation, offset, size, &mapped);
+    return VK_SUCCESS;
 }
 
 void Buffer::unmap()
 {
     if (mapped)
     {
-        vkUnmapMemory(device, memory);
+        memory::unmap(allocation);
         mapped = nullptr;
     }
 }
@@ -29,25 +34,116 @@ void Buffer::updateDescriptor(VkDeviceSize size, VkDeviceSize offset)
 }
 
 void Buffer::flush(VkDeviceSize size, VkDeviceSize offset) {
-    VkMappedMemoryRange mappedRange{};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    vkFlushMappedMemoryRanges(device, 1, &mappedRange);
+    memory::flush(allocation, offset, size);
 }
 
 void Buffer::destroy()
 {
-    if (mapped) {
-        memory::unmap(device, memory);
-    }
+    mapped = nullptr;
     if(buffer)
         vkDestroyBuffer(device, buffer, nullptr);
-    if(memory)
-        vkFreeMemory(device, memory, nullptr);
+    memory::free(allocation);
     buffer = VK_NULL_HANDLE;
-    memory = VK_NULL_HANDLE;
+}
+
+void UploadBatch::begin(Device* device, VkDeviceSize blockSize)
+{
+    this->device = device;
+    this->blockSize = blockSize;
+    commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->getCommandPool(), true);
+}
+
+UploadBatch::Allocation UploadBatch::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    assert(commandBuffer != VK_NULL_HANDLE);
+
+    if (!blocks.empty()) {
+        Block& block = blocks.back();
+        VkDeviceSize offset = (block.offset + alignment - 1) / alignment * alignment;
+        if (offset + size <= block.size) {
+            block.offset = offset + size;
+            bytesStaged += size;
+            return { block.buffer, offset, block.mapped + offset };
+        }
+    }
+
+    // Out of space, oversized requests get a block of their own
+    Block block;
+    block.size = std::max(blockSize, size);
+    buffer::createBuffer(
+        device,
+        block.size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        &block.buffer,
+        &block.allocation);
+    block.mapped = block.allocation.mapped;
+    block.offset = size;
+    blocks.push_back(block);
+    bytesStaged += size;
+    return { block.buffer, 0, block.mapped };
+}
+
+UploadBatch::Allocation UploadBatch::stage(const void* data, VkDeviceSize size, VkDeviceSize alignment)
+{
+    Allocation allocation = allocate(size, alignment);
+    memcpy(allocation.mapped, data, size);
+    return allocation;
+}
+
+void UploadBatch::copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+    Allocation allocation = stage(data, size);
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = allocation.offset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, allocation.buffer, dstBuffer, 1, &copyRegion);
+}
+
+void UploadBatch::submit(VkQueue queue)
+{
+    fence = device->submitCommandBufferAsync(commandBuffer, queue);
+}
+
+bool UploadBatch::isComplete() const
+{
+    return fence != VK_NULL_HANDLE && device->isFenceSignaled(fence);
+}
+
+void UploadBatch::wait()
+{
+    if (fence != VK_NULL_HANDLE) {
+        vkWaitForFences(device->getDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
+    }
+}
+
+void UploadBatch::deferDestroy(std::function<void()> release)
+{
+    deferred.push_back(std::move(release));
+}
+
+void UploadBatch::destroy()
+{
+    for (auto& release : deferred) {
+        release();
+    }
+    deferred.clear();
+    for (auto& block : blocks) {
+        vkDestroyBuffer(device->getDevice(), block.buffer, nullptr);
+        memory::free(block.allocation);
+    }
+    blocks.clear();
+    if (fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device->getDevice(), fence, nullptr);
+        fence = VK_NULL_HANDLE;
+    }
+    if (commandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(device->getDevice(), device->getCommandPool(), 1, &commandBuffer);
+        commandBuffer = VK_NULL_HANDLE;
+    }
+    bytesStaged = 0;
 }
 
 namespace buffer {
@@ -92,45 +188,24 @@ namespace buffer {
             throw std::runtime_error("failed to create buffer!");
         }
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements(device->getDevice(), buffer.buffer, &memReqs);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, memoryFlags);
-
         // If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also need to enable the appropriate flag during allocation
-        VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR };
-        if (memoryFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-            allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-            allocInfo.pNext = &allocFlagsInfo;
-        }
-
-        if (vkAllocateMemory(device->getDevice(), &allocInfo, nullptr, &buffer.memory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
+        const VkMemoryAllocateFlags allocateFlags = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+        buffer.allocation = memory::allocate(device, buffer.buffer, memoryFlags, allocateFlags, memory::getBufferTag(usage));
+        buffer.memoryTypeIndex = buffer.allocation.memoryTypeIndex;
 
-        // If a pointer to the buffer data has been passed, map the buffer and copy over the data
+        // If a pointer to the buffer data has been passed, copy it over through the persistent mapping
         if (data != nullptr)
         {
-            memory::map(device->getDevice(), buffer.memory, 0, size, &buffer.mapped);
-            memcpy(buffer.mapped, data, size);
+            memcpy(buffer.allocation.mapped, data, size);
 
             // If host coherency hasn't been requested, do a manual flush to make writes visible
             if ((memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
             {
                 buffer.flush(size, 0);
             }
-            memory::unmap(device->getDevice(), buffer.memory);
         }
         buffer.bufferSize = size;
         buffer.updateDescriptor();
-
-        
-        if (vkBindBufferMemory(device->getDevice(), buffer.buffer, buffer.memory, 0)) {
-            throw std::runtime_error("failed to bind buffer memory!");
-        }
         return buffer;
     }
 
@@ -140,7 +215,7 @@ namespace buffer {
         VkMemoryPropertyFlags memoryFlags,
         VkSharingMode sharingMode,
         VkBuffer* buffer,
-        VkDeviceMemory* memory,
+        memory::Allocation* allocation,
         void* data
     ) {
         VkBufferCreateInfo bufferInfo{};
@@ -153,43 +228,18 @@ namespace buffer {
             throw std::runtime_error("failed to create buffer!");
         }
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements(device->getDevice(), *buffer, &memReqs);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, memoryFlags);
-
-        // If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also need to enable the appropriate flag during allocation
-        VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR };
-        if (memoryFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-            allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-            allocInfo.pNext = &allocFlagsInfo;
-        }
-
-        if (vkAllocateMemory(device->getDevice(), &allocInfo, nullptr, memory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate uniform buffer memory!");
-        }
+        const VkMemoryAllocateFlags allocateFlags = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+        *allocation = memory::allocate(device, *buffer, memoryFlags, allocateFlags, memory::getBufferTag(usage));
 
-        // If a pointer to the buffer data has been passed, map the buffer and copy over the data
         if (data != nullptr)
         {
-            void* mapped;
-            memory::map(device->getDevice(), *memory, 0, size, &mapped);
-            memcpy(mapped, data, size);
+            memcpy(allocation->mapped, data, size);
 
             // If host coherency hasn't been requested, do a manual flush to make writes visible
             if ((memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
             {
-                VkMappedMemoryRange mappedRange{};
-                mappedRange.memory = *memory;
-                mappedRange.offset = 0;
-                mappedRange.size = size;
-                vkFlushMappedMemoryRanges(device->getDevice(), 1, &mappedRange);
+                memory::flush(*allocation, 0, size);
             }
-            memory::unmap(device->getDevice(), *memory);
         }
-        vkBindBufferMemory(device->getDevice(), *buffer, *memory, 0);
     }
 }
\ No newline at end of file
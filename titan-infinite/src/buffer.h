@@ -11,7 +11,7 @@ struct Buffer
 {
     VkDevice device;
     VkBuffer buffer = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    memory::Allocation allocation;
     VkDeviceSize bufferSize = 0;
     uint32_t memoryTypeIndex;
     VkDescriptorBufferInfo descriptor;
@@ -23,6 +23,44 @@ struct Buffer
     void destroy();
 };
 
+// Staging memory shared by a group of uploads. Everything is recorded into one command buffer
+// and submitted once, guarded by a single fence.
+struct UploadBatch
+{
+    struct Block {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        memory::Allocation allocation;
+        uint8_t* mapped = nullptr;
+        VkDeviceSize size = 0;
+        VkDeviceSize offset = 0;
+    };
+
+    struct Allocation {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        void* mapped;
+    };
+
+    Device* device = nullptr;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkDeviceSize blockSize = 0;
+    VkDeviceSize bytesStaged = 0;
+    std::vector<Block> blocks;
+    std::vector<std::function<void()>> deferred;
+
+    void begin(Device* device, VkDeviceSize blockSize = 64 * 1024 * 1024);
+    Allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+    Allocation stage(const void* data, VkDeviceSize size, VkDeviceSize alignment = 16);
+    void copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+    // Runs release in destroy(), for objects the recorded commands still use
+    void deferDestroy(std::function<void()> release);
+    void submit(VkQueue queue);
+    bool isComplete() const;
+    void wait();
+    void destroy();
+};
+
 namespace buffer {
 
     VkBuffer createBuffer(
@@ -49,7 +87,7 @@ namespace buffer {
         VkMemoryPropertyFlags memoryFlags,
         VkSharingMode sharingMode,
         VkBuffer* buffer,
-        VkDeviceMemory* memory,
+        memory::Allocation* allocation,
         void* data = nullptr
     );
 }
\ No newline at end of file
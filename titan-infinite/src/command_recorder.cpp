@@ -0,0 +1,165 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "command_recorder.h"
+
+void CommandRecorder::create(Device* device, uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t threadCount)
+{
+    m_device = device->getDevice();
+    m_frameIndex = 0;
+    m_stop = false;
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Transient, every buffer is recorded once per reset of its pool
+    VkCommandPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+    m_pools.resize(frameCount);
+    for (std::vector<Pool>& framePools : m_pools) {
+        framePools.resize(threadCount);
+        for (Pool& pool : framePools) {
+            VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &pool.pool));
+        }
+    }
+
+    for (uint32_t i = 1; i < threadCount; i++) {
+        m_workers.emplace_back(&CommandRecorder::work, this, i);
+    }
+}
+
+void CommandRecorder::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+
+    // Destroying a pool frees its buffers
+    for (std::vector<Pool>& framePools : m_pools) {
+        for (Pool& pool : framePools) {
+            vkDestroyCommandPool(m_device, pool.pool, nullptr);
+        }
+    }
+    m_pools.clear();
+}
+
+void CommandRecorder::reset(uint32_t frameIndex)
+{
+    assert(frameIndex < m_pools.size());
+    m_frameIndex = frameIndex;
+    for (Pool& pool : m_pools[frameIndex]) {
+        VK_CHECK(vkResetCommandPool(m_device, pool.pool, 0));
+        pool.used = 0;
+    }
+}
+
+void CommandRecorder::record(VkCommandBuffer primary, const VkCommandBufferInheritanceInfo& inheritance, uint32_t count, const RecordFunction& recordChunk, uint32_t minChunkSize)
+{
+    if (count == 0) {
+        return;
+    }
+    minChunkSize = std::max(minChunkSize, 1u);
+    const uint32_t chunkCount = std::max(std::min(getThreadCount(), count / minChunkSize), 1u);
+    m_recordChunk = &recordChunk;
+    m_inheritance = &inheritance;
+    m_count = count;
+    m_chunkSize = (count + chunkCount - 1) / chunkCount;
+    m_chunkCount = (count + m_chunkSize - 1) / m_chunkSize;
+    m_secondaries.assign(m_chunkCount, VK_NULL_HANDLE);
+    m_nextChunk = 0;
+    m_error = nullptr;
+
+    // A single chunk is recorded right here
+    const bool parallel = m_chunkCount > 1 && !m_workers.empty();
+    if (parallel) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_generation++;
+            m_busyWorkers = static_cast<uint32_t>(m_workers.size());
+        }
+        m_start.notify_all();
+    }
+    recordChunks(0);
+    if (parallel) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&]() { return m_busyWorkers == 0; });
+    }
+    m_recordChunk = nullptr;
+    m_inheritance = nullptr;
+
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+    vkCmdExecuteCommands(primary, m_chunkCount, m_secondaries.data());
+}
+
+void CommandRecorder::work(uint32_t threadIndex)
+{
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_start.wait(lock, [&]() { return m_stop || m_generation != generation; });
+        if (m_stop) {
+            return;
+        }
+        generation = m_generation;
+
+        lock.unlock();
+        recordChunks(threadIndex);
+        lock.lock();
+
+        if (--m_busyWorkers == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+void CommandRecorder::recordChunks(uint32_t threadIndex)
+{
+    for (uint32_t chunk = m_nextChunk++; chunk < m_chunkCount; chunk = m_nextChunk++) {
+        try {
+            VkCommandBuffer commandBuffer = acquire(threadIndex);
+            VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = m_inheritance;
+            VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+            const uint32_t begin = chunk * m_chunkSize;
+            (*m_recordChunk)(commandBuffer, begin, std::min(begin + m_chunkSize, m_count));
+            VK_CHECK(vkEndCommandBuffer(commandBuffer));
+            m_secondaries[chunk] = commandBuffer;
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_error) {
+                m_error = std::current_exception();
+            }
+        }
+    }
+}
+
+VkCommandBuffer CommandRecorder::acquire(uint32_t threadIndex)
+{
+    // Only ever touched by its own thread
+    Pool& pool = m_pools[m_frameIndex][threadIndex];
+    if (pool.used == pool.commandBuffers.size()) {
+        VkCommandBufferAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        allocateInfo.commandPool = pool.pool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocateInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        VK_CHECK(vkAllocateCommandBuffers(m_device, &allocateInfo, &commandBuffer));
+        pool.commandBuffers.push_back(commandBuffer);
+    }
+    return pool.commandBuffers[pool.used++];
+}
@@ -0,0 +1,73 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <condition_variable>
+
+struct Device;
+
+// Records a draw list into secondary command buffers on worker threads and executes them from a primary. Every thread has
+// a command pool per frame in flight, reset() drops the pools of a frame at once when its fence has signaled.
+// Secondaries continue the subpass of the primary, which begins its render pass with
+// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Nothing bound in the primary carries over, every chunk binds its own
+// pipeline, descriptor sets and dynamic state
+class CommandRecorder {
+
+public:
+    // Records the draws [begin, end) into commandBuffer, called concurrently for different chunks
+    using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end)>;
+
+    CommandRecorder() = default;
+    CommandRecorder(const CommandRecorder&) = delete;
+    CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+    // threadCount 0 picks one thread per core, the caller of record() included
+    void create(Device* device, uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t threadCount = 0);
+    void destroy();
+
+    // Call once the fence of frameIndex was waited for, the secondaries recorded the last time that frame was are gone
+    void reset(uint32_t frameIndex);
+    // Splits count draws into a chunk per thread, none smaller than minChunkSize, and executes them from primary in draw
+    // order. From one thread at a time, rethrows the first failure of a chunk
+    void record(VkCommandBuffer primary, const VkCommandBufferInheritanceInfo& inheritance, uint32_t count, const RecordFunction& recordChunk, uint32_t minChunkSize = 256);
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1; }
+
+private:
+    struct Pool {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> commandBuffers;
+        uint32_t used = 0;
+    };
+
+    void work(uint32_t threadIndex);
+    void recordChunks(uint32_t threadIndex);
+    VkCommandBuffer acquire(uint32_t threadIndex);
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    // [frame][thread], the caller of record() is thread 0
+    std::vector<std::vector<Pool>> m_pools;
+    uint32_t m_frameIndex = 0;
+    std::vector<std::thread> m_workers;
+
+    // The record() in progress
+    const RecordFunction* m_recordChunk = nullptr;
+    const VkCommandBufferInheritanceInfo* m_inheritance = nullptr;
+    uint32_t m_count = 0;
+    uint32_t m_chunkSize = 0;
+    uint32_t m_chunkCount = 0;
+    std::vector<VkCommandBuffer> m_secondaries;
+    std::atomic<uint32_t> m_nextChunk{ 0 };
+    std::exception_ptr m_error;
+
+    uint64_t m_generation = 0;
+    uint32_t m_busyWorkers = 0;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+};
@@ -37,6 +37,12 @@ void Device::create(Window* window, const std::unordered_map<const char*, bool>&
     // Require enable features
     if(func) func();
     checkDeviceExtensionSupport(m_physicalDevice);
+    // Optional, without it the allocator estimates heap budgets from its own usage
+    m_memoryBudgetSupported = isDeviceExtensionAvailable(m_physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (m_memoryBudgetSupported && std::find_if(m_enabledExtensions.begin(), m_enabledExtensions.end(),
+        [](const char* name) { return strcmp(name, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0; }) == m_enabledExtensions.end()) {
+        m_enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
     
     VkPhysicalDeviceFeatures deviceFeatures{VK_FALSE};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
@@ -44,29 +50,46 @@ void Device::create(Window* window, const std::unordered_map<const char*, bool>&
     deviceFeatures.largePoints = VK_TRUE;
 
     createLogicalDevice(m_physicalDevice, m_surface, deviceFeatures);
+    m_pipelineCache.create(m_physicalDevice, m_device, pipelineCachePath);
+    m_pipelineQueue.create(this);
+    m_allocator.create(m_physicalDevice, m_device, m_memoryBudgetSupported);
+    m_frameAllocator.create(this, frameAllocatorSize, renderAhead);
 
     createSwapChain(m_physicalDevice, m_device, m_surface);
-    m_commandPool = createCommandPool(m_device, vkHelper::findQueueFamilies(m_physicalDevice, m_surface).graphicsFamily.value());
+    m_commandPool = createCommandPool(m_device, m_queueFamilies.graphicsFamily.value());
     m_commandBuffers = createCommandBuffers(m_device, m_commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, (uint32_t)m_images.size());
+    m_frames.resize(renderAhead);
+    for (FrameContext& frame : m_frames) {
+        // Buffers are never reset on their own, only the whole pool
+        VkCommandPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = m_queueFamilies.graphicsFamily.value();
+        VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &frame.commandPool));
+        frame.commandBuffer = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, frame.commandPool);
+    }
+    m_stagingBelt.create(this, stagingBeltSize);
+    m_commandRecorder.create(this, m_queueFamilies.graphicsFamily.value(), renderAhead);
 
     createDepthbuffer();
     createRenderPass();
     createFramebuffer();
-    // Pipeline Cache
-    {
-        VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
-        pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-        vkCreatePipelineCache(m_device, &pipelineCacheCreateInfo, nullptr, &m_pipelineCache);
-    }
 }
 
 void Device::destroy() {
     vkDestroyImageView(m_device, m_depthbuffer.imageView, nullptr);
     vkDestroyImage(m_device, m_depthbuffer.image, nullptr);
-    vkFreeMemory(m_device, m_depthbuffer.imageMemory, nullptr);
+    memory::free(m_depthbuffer.allocation);
     for (auto framebuffer : m_framebuffers)
         vkDestroyFramebuffer(m_device, framebuffer, nullptr);
     vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
+    if (!m_staticCommands.commandBuffers.empty()) {
+        vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_staticCommands.commandBuffers.size()), m_staticCommands.commandBuffers.data());
+        m_staticCommands.commandBuffers.clear();
+    }
+    for (FrameContext& frame : m_frames) {
+        vkDestroyCommandPool(m_device, frame.commandPool, nullptr);
+    }
+    m_frames.clear();
     vkDestroyRenderPass(m_device, m_renderPass, nullptr);
     destroySwapChain();
     destroyDescriptorPool();
@@ -76,7 +99,27 @@ void Device::destroy() {
         vkDestroySemaphore(m_device, m_imageAvailableSemaphores[i], nullptr);
     for (int i = 0; i < m_renderFinishedSemaphores.size(); i++)
         vkDestroySemaphore(m_device, m_renderFinishedSemaphores[i], nullptr);
+    if (m_defragmentation.fence != VK_NULL_HANDLE) {
+        vkWaitForFences(m_device, 1, &m_defragmentation.fence, VK_TRUE, UINT64_MAX);
+        vkDestroyFence(m_device, m_defragmentation.fence, nullptr);
+        m_allocator.endDefragmentation(0);
+    }
+    if (m_defragmentation.commandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_defragmentation.commandBuffer);
+    }
+    m_defragmentation = {};
+    if (m_mipGenerator) {
+        m_mipGenerator->destroy();
+        delete m_mipGenerator;
+        m_mipGenerator = nullptr;
+    }
+    m_stagingBelt.destroy();
+    m_commandRecorder.destroy();
+    m_pipelineQueue.destroy();
+    m_pipelineCache.destroy();
     destroyCommandPool();
+    m_frameAllocator.destroy();
+    m_allocator.destroy();
     vkDestroyDevice(m_device, nullptr);
     if (enableValidationLayers) {
         vkHelper::DestroyDebugUtilsMessengerEXT(m_instance, debugMessenger, nullptr);
@@ -196,6 +239,15 @@ void Device::createSwapChain(const VkPhysicalDevice& physicalDevice, VkDevice de
     }
 }
 
+MipGenerator* Device::getMipGenerator()
+{
+    if (!m_mipGenerator && m_dynamicImageIndexingSupported) {
+        m_mipGenerator = new MipGenerator();
+        m_mipGenerator->create(this);
+    }
+    return m_mipGenerator;
+}
+
 void Device::destroySwapChain() {
     for (auto imageView : m_imageViews) {
         vkDestroyImageView(m_device, imageView, nullptr);
@@ -220,9 +272,10 @@ void Device::destroyCommandPool() {
     vkDestroyCommandPool(m_device, m_commandPool, NULL);
 }
 
-VkDescriptorPool Device::createDescriptorPool(const VkDevice& device, const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets) {
+VkDescriptorPool Device::createDescriptorPool(const VkDevice& device, const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets, VkDescriptorPoolCreateFlags flags) {
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = flags;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
     poolInfo.maxSets = maxSets;
@@ -307,9 +360,7 @@ void Device::createDepthbuffer() {
     auto depthFormat = vkHelper::findDepthFormat(m_physicalDevice);
     m_depthbuffer.image = createImage(m_device, 0, VK_IMAGE_TYPE_2D, depthFormat, { WIDTH, HEIGHT, 1 }, 1, 1, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_LAYOUT_UNDEFINED);
 
-    VkMemoryRequirements memRequirements = memory::getMemoryRequirements(m_device, m_depthbuffer.image);
-    m_depthbuffer.imageMemory = memory::allocate(m_device, memRequirements.size, findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
-    memory::bind(m_device, m_depthbuffer.imageMemory, 0, m_depthbuffer.image);
+    m_depthbuffer.allocation = memory::allocate(this, m_depthbuffer.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, memory::Tag::Attachment);
     m_depthbuffer.imageView = createImageView(
         m_device,
         m_depthbuffer.image,
@@ -446,6 +497,99 @@ void Device::flushCommandBuffer(const VkCommandBuffer& commandBuffer, const VkQu
     }
 }
 
+VkFence Device::submitCommandBufferAsync(const VkCommandBuffer& commandBuffer, const VkQueue& queue)
+{
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    // The caller owns the fence and polls it instead of waiting on the queue
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence;
+    if (vkCreateFence(getDevice(), &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload fence!");
+    }
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+        vkDestroyFence(getDevice(), fence, nullptr);
+        throw std::runtime_error("failed to submit command buffer!");
+    }
+    return fence;
+}
+
+void Device::beginFrame()
+{
+    vkWaitForFences(m_device, 1, &m_waitFences[m_currentFrame], VK_TRUE, UINT64_MAX);
+    VK_CHECK(vkResetCommandPool(m_device, m_frames[m_currentFrame].commandPool, 0));
+    m_frameAllocator.reset(static_cast<uint32_t>(m_currentFrame));
+    m_commandRecorder.reset(static_cast<uint32_t>(m_currentFrame));
+    m_frameNumber++;
+    m_stagingBelt.update();
+    m_pipelineCache.update();
+    defragmentMemory();
+}
+
+void Device::defragmentMemory()
+{
+    if (m_defragmentation.fence != VK_NULL_HANDLE) {
+        if (!isFenceSignaled(m_defragmentation.fence)) {
+            return;
+        }
+        vkDestroyFence(m_device, m_defragmentation.fence, nullptr);
+        m_defragmentation.fence = VK_NULL_HANDLE;
+        // Frames recorded up to now may still use the originals
+        m_allocator.endDefragmentation(m_frameNumber + renderAhead);
+    }
+    m_allocator.releaseRetired(m_frameNumber);
+
+    if (m_defragmentation.commandBuffer == VK_NULL_HANDLE) {
+        m_defragmentation.commandBuffer = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_commandPool);
+    }
+    VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(m_defragmentation.commandBuffer, &beginInfo));
+    if (!m_allocator.beginDefragmentation(m_defragmentation.commandBuffer, defragmentationThreshold, defragmentationBytesPerPass)) {
+        vkEndCommandBuffer(m_defragmentation.commandBuffer);
+        return;
+    }
+    m_defragmentation.fence = submitCommandBufferAsync(m_defragmentation.commandBuffer, m_graphicsQueue);
+}
+
+void Device::executeStaticCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex, const VkCommandBufferInheritanceInfo& inheritanceInfo, const std::function<void(VkCommandBuffer)>& record)
+{
+    if (m_staticCommands.commandBuffers.empty()) {
+        m_staticCommands.commandBuffers = createCommandBuffers(m_device, m_commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, static_cast<uint32_t>(m_images.size()));
+        m_staticCommands.recorded.assign(m_images.size(), false);
+    }
+
+    // Only ever executed for its own image, so the image fence covers the previous use when re-recording
+    VkCommandBuffer staticCommandBuffer = m_staticCommands.commandBuffers[imageIndex];
+    if (!m_staticCommands.recorded[imageIndex]) {
+        VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+        VK_CHECK(vkBeginCommandBuffer(staticCommandBuffer, &beginInfo));
+        record(staticCommandBuffer);
+        VK_CHECK(vkEndCommandBuffer(staticCommandBuffer));
+        m_staticCommands.recorded[imageIndex] = true;
+    }
+    vkCmdExecuteCommands(commandBuffer, 1, &staticCommandBuffer);
+}
+
+void Device::invalidateStaticCommands()
+{
+    m_staticCommands.recorded.assign(m_staticCommands.recorded.size(), false);
+}
+
+bool Device::isFenceSignaled(const VkFence& fence) const
+{
+    return vkGetFenceStatus(m_device, fence) == VK_SUCCESS;
+}
+
 VkCommandBuffer Device::beginImmediateCommandBuffer()
 {
     VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
@@ -643,6 +787,8 @@ ShaderStage Device::createRayTracingShader(const std::string& shaderFile, VkShad
 
 VkDescriptorSetLayout Device::createDescriptorSetLayout(const VkDevice& device, const std::vector<DescriptorSetLayoutBinding>& descriptorSetLayoutBindings) {
     std::vector<VkDescriptorSetLayoutBinding> convertedBindings;
+    std::vector<VkDescriptorBindingFlags> bindingFlags;
+    bool hasBindingFlags = false;
     for (const DescriptorSetLayoutBinding& binding : descriptorSetLayoutBindings) {
         VkDescriptorSetLayoutBinding convertedBinding;
         convertedBinding.binding = binding.binding;
@@ -652,12 +798,26 @@ VkDescriptorSetLayout Device::createDescriptorSetLayout(const VkDevice& device,
         convertedBinding.pImmutableSamplers = binding.pImmutableSamplers;
 
         convertedBindings.emplace_back(convertedBinding);
+        bindingFlags.push_back(binding.bindingFlags);
+        hasBindingFlags |= binding.bindingFlags != 0;
     }
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(descriptorSetLayoutBindings.size());
     layoutInfo.pBindings = convertedBindings.data();
 
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+    if (hasBindingFlags) {
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+        layoutInfo.pNext = &bindingFlagsInfo;
+        for (VkDescriptorBindingFlags flags : bindingFlags) {
+            if (flags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) {
+                layoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+            }
+        }
+    }
+
     VkDescriptorSetLayout descriptorSetLayout;
     if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor set layout!");
@@ -802,16 +962,31 @@ VkPipeline Device::createGraphicsPipeline(
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
     VkPipeline pipeline;
-    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    const auto start = std::chrono::steady_clock::now();
+    if (vkCreateGraphicsPipelines(device, pipelineCache != VK_NULL_HANDLE ? pipelineCache : m_pipelineCache.get(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
+    m_pipelineCache.recordPipeline(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
     return pipeline;
 }
 
 VkPipeline Device::createComputePipeline(const VkDevice& device, const std::string& computeShaderFile, VkPipelineLayout layout, const VkSpecializationInfo* specializationInfo)
 {
     ShaderStage computeShader = createShader(device, computeShaderFile);
+    VkPipeline pipeline;
+    try {
+        pipeline = createComputePipeline(device, VK_NULL_HANDLE, computeShader, layout, specializationInfo);
+    }
+    catch (...) {
+        vkDestroyShaderModule(device, computeShader.module, nullptr);
+        throw;
+    }
+    vkDestroyShaderModule(device, computeShader.module, nullptr);
+    return pipeline;
+}
 
+VkPipeline Device::createComputePipeline(const VkDevice& device, VkPipelineCache pipelineCache, const ShaderStage& computeShader, VkPipelineLayout layout, const VkSpecializationInfo* specializationInfo)
+{
     VkPipelineShaderStageCreateInfo pipelineShaderStage{};
     pipelineShaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     pipelineShaderStage.module = computeShader.module;
@@ -824,11 +999,11 @@ VkPipeline Device::createComputePipeline(const VkDevice& device, const std::stri
     createInfo.layout = layout;
 
     VkPipeline pipeline;
-    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &createInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    const auto start = std::chrono::steady_clock::now();
+    if (vkCreateComputePipelines(device, pipelineCache != VK_NULL_HANDLE ? pipelineCache : m_pipelineCache.get(), 1, &createInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create compute pipeline");
     }
-
-    vkDestroyShaderModule(device, computeShader.module, nullptr);
+    m_pipelineCache.recordPipeline(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
     return pipeline;
 }
 
@@ -939,6 +1114,21 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
+bool Device::isDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, extensionName) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool Device::checkValidationLayerSupport() {
     uint32_t layerCount;
     vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
@@ -966,9 +1156,10 @@ bool Device::checkValidationLayerSupport() {
 
 void Device::createLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPhysicalDeviceFeatures enabledFeatures) {
     QueueFamilyIndices indices = vkHelper::findQueueFamilies(physicalDevice, surface);
+    m_queueFamilies = indices;
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.computeFamily.value() };
+    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.computeFamily.value(), indices.transferFamily.value() };
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -989,10 +1180,32 @@ void Device::createLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR s
     VkPhysicalDeviceVulkan12Features features12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
     features12.bufferDeviceAddress = true;
     features12.descriptorIndexing = true;
+
+    // Descriptor indexing is core in 1.2, only its optional features have to be checked
+    VkPhysicalDeviceVulkan12Features supported12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    VkPhysicalDeviceFeatures2 supportedFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+    supportedFeatures.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+    m_bindlessSupported = supported12.runtimeDescriptorArray && supported12.descriptorBindingPartiallyBound &&
+        supported12.descriptorBindingVariableDescriptorCount && supported12.descriptorBindingSampledImageUpdateAfterBind &&
+        supported12.shaderSampledImageArrayNonUniformIndexing;
+    if (m_bindlessSupported) {
+        features12.runtimeDescriptorArray = true;
+        features12.descriptorBindingPartiallyBound = true;
+        features12.descriptorBindingVariableDescriptorCount = true;
+        features12.descriptorBindingSampledImageUpdateAfterBind = true;
+        features12.shaderSampledImageArrayNonUniformIndexing = true;
+    }
     features12.pNext = getPhysicalDeviceExtensionFeatureChain();
     
     VkPhysicalDeviceFeatures2 deviceFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
     deviceFeatures2.pNext = &features12;
+    // Feedback writes of virtual_texture.glsl
+    m_fragmentStoresSupported = supportedFeatures.features.fragmentStoresAndAtomics;
+    deviceFeatures2.features.fragmentStoresAndAtomics = supportedFeatures.features.fragmentStoresAndAtomics;
+    m_dynamicImageIndexingSupported = supportedFeatures.features.shaderSampledImageArrayDynamicIndexing && supportedFeatures.features.shaderStorageImageArrayDynamicIndexing;
+    deviceFeatures2.features.shaderSampledImageArrayDynamicIndexing = m_dynamicImageIndexingSupported;
+    deviceFeatures2.features.shaderStorageImageArrayDynamicIndexing = m_dynamicImageIndexingSupported;
 
     createInfo.pEnabledFeatures = nullptr;
     createInfo.pNext = &deviceFeatures2;
@@ -1015,6 +1228,7 @@ void Device::createLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR s
     vkGetDeviceQueue(m_device, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device, indices.presentFamily.value(), 0, &m_presentQueue);
     vkGetDeviceQueue(m_device, indices.computeFamily.value(), 0, &m_computeQueue);
+    vkGetDeviceQueue(m_device, indices.transferFamily.value(), 0, &m_transferQueue);
 }
 
 uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
@@ -18,6 +18,8 @@ const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
 };
 
+class MipGenerator;
+
 const uint32_t WIDTH = 1280;
 const uint32_t HEIGHT = 720;
 
@@ -54,6 +56,11 @@ struct Device {
 
     size_t m_currentFrame = 0;
     size_t getCurrentFrame() { return m_currentFrame; }
+    // Waits for the fence of the current frame, recycles its command pool and its part of the frame allocator and flushes
+    // the staging belt, call before recording
+    void beginFrame();
+    // Frames begun so far
+    uint64_t m_frameNumber = 0;
 
     // Synchronization
     std::vector<VkFence>       m_imagesInFlight;
@@ -63,10 +70,28 @@ struct Device {
 
     // Command Buffer
     VkCommandPool m_commandPool;
+    // One per swapchain image, for samples recording every image once up front
     std::vector<VkCommandBuffer> m_commandBuffers;
     const VkCommandPool& getCommandPool() const { return m_commandPool; }
     const std::vector<VkCommandBuffer>& getCommandBuffers() { return m_commandBuffers; }
-    VkCommandBuffer getCurrentCommandBuffer() { return m_commandBuffers[m_currentFrame]; }
+    // Per frame in flight, a transient pool reset as a whole by beginFrame() and the primary recorded from it for the
+    // image the frame draws. Only the frame being submitted is recorded
+    struct FrameContext {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    };
+    std::vector<FrameContext> m_frames;
+    VkCommandBuffer getCurrentCommandBuffer() { return m_frames[m_currentFrame].commandBuffer; }
+    // Content that stays the same from frame to frame, a secondary per framebuffer recorded the first time the
+    // framebuffer is drawn and executed from every later frame until invalidateStaticCommands()
+    struct StaticCommands {
+        std::vector<VkCommandBuffer> commandBuffers;
+        std::vector<bool> recorded;
+    } m_staticCommands;
+    // Within a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, after the fence of imageIndex was
+    // waited for
+    void executeStaticCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex, const VkCommandBufferInheritanceInfo& inheritanceInfo, const std::function<void(VkCommandBuffer)>& record);
+    void invalidateStaticCommands();
 
     // Descriptor
     VkDescriptorPool m_descriptorPool;
@@ -82,7 +107,7 @@ struct Device {
 
     struct Depthbuffer {
         VkImage image;
-        VkDeviceMemory imageMemory;
+        memory::Allocation allocation;
         VkImageView imageView;
     }m_depthbuffer;
 
@@ -92,11 +117,57 @@ struct Device {
     VkQueue m_graphicsQueue;
     VkQueue m_presentQueue;
     VkQueue m_computeQueue;
-    VkPipelineCache m_pipelineCache;
+    // Same queue as m_graphicsQueue when the device has no transfer only family
+    VkQueue m_transferQueue;
+    QueueFamilyIndices m_queueFamilies;
+    // Loaded at creation, saved from beginFrame() every saveInterval and at destruction
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    PipelineCache m_pipelineCache;
+    PipelineCache& getPersistentPipelineCache() { return m_pipelineCache; }
+    // Compiles pipelines on worker threads, see PipelineQueue
+    PipelineQueue m_pipelineQueue;
+    PipelineQueue& getPipelineQueue() { return m_pipelineQueue; }
     const uint32_t renderAhead = 2;
+    // Runtime sized, partially bound, update after bind sampler arrays, see VulkanglTFModel::createBindlessDescriptors
+    bool m_bindlessSupported = false;
+    bool supportsBindlessTextures() const { return m_bindlessSupported; }
+    bool m_fragmentStoresSupported = false;
+    bool supportsFragmentStores() const { return m_fragmentStoresSupported; }
+    // Sampled and storage image arrays indexed with dynamically uniform values, see MipGenerator
+    bool m_dynamicImageIndexingSupported = false;
+    bool supportsDynamicImageIndexing() const { return m_dynamicImageIndexingSupported; }
+    // Created on first use, nullptr without dynamic image indexing. Models loading after assigning it to
+    // VulkanglTFModel::mipGenerator write their mips with one compute pass per batch instead of blits
+    MipGenerator* m_mipGenerator = nullptr;
+    MipGenerator* getMipGenerator();
 
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDeviceMemoryProperties m_memoryProperties;
+    // Every buffer and image allocation is a range of one of its blocks
+    memory::Allocator m_allocator;
+    memory::Allocator& getAllocator() { return m_allocator; }
+    // Uniform and storage data of the frames in flight, bound with dynamic offsets
+    const VkDeviceSize frameAllocatorSize = VkDeviceSize(8) << 20;
+    FrameAllocator m_frameAllocator;
+    FrameAllocator& getFrameAllocator() { return m_frameAllocator; }
+    // Uploads to device local buffers and images, flushed without waiting
+    const VkDeviceSize stagingBeltSize = VkDeviceSize(64) << 20;
+    StagingBelt m_stagingBelt;
+    StagingBelt& getStagingBelt() { return m_stagingBelt; }
+    // Secondary command buffers recorded on worker threads, pools reset from beginFrame()
+    CommandRecorder m_commandRecorder;
+    CommandRecorder& getCommandRecorder() { return m_commandRecorder; }
+    bool m_memoryBudgetSupported = false;
+    bool supportsMemoryBudget() const { return m_memoryBudgetSupported; }
+
+    // Incremental compaction of device local memory from beginFrame(), one pass in flight at a time
+    const float defragmentationThreshold = 0.3f;
+    const VkDeviceSize defragmentationBytesPerPass = VkDeviceSize(16) << 20;
+    struct Defragmentation {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+    } m_defragmentation;
+    void defragmentMemory();
 
     //void* m_deviceCreatepNextChain{ nullptr };
     void* m_lastRequestedExtensionFeature{ nullptr };
@@ -109,11 +180,13 @@ struct Device {
     VkQueue getGraphicsQueue() const { return m_graphicsQueue; }
     VkQueue getPresentQueue() const { return m_presentQueue; }
     VkQueue getComputeQueue() const { return m_computeQueue; }
+    VkQueue getTransferQueue() const { return m_transferQueue; }
+    const QueueFamilyIndices& getQueueFamilies() const { return m_queueFamilies; }
     Window* getWindow() { return m_window; }
     VkRenderPass getRenderPass() { return m_renderPass; }
     const Depthbuffer& getDepthbuffer() const { return m_depthbuffer; }
     const std::vector<VkFramebuffer>& getFramebuffers() const { return m_framebuffers; }
-    VkPipelineCache getPipelineCache() const { return m_pipelineCache; }
+    VkPipelineCache getPipelineCache() const { return m_pipelineCache.get(); }
     void create(Window* window, const std::unordered_map<const char*, bool>& instanceExtensions = {}, const std::unordered_map<const char*, bool>& deviceExtensions = {}, std::function<void()> func = nullptr);
     void destroy();
 
@@ -127,13 +200,15 @@ struct Device {
     VkCommandPool createCommandPool(const VkDevice& device, uint32_t queueFamilyIndices);
     void destroyCommandPool();
     
-    VkDescriptorPool createDescriptorPool(const VkDevice& device, const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets);
+    VkDescriptorPool createDescriptorPool(const VkDevice& device, const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets, VkDescriptorPoolCreateFlags flags = 0);
     void destroyDescriptorPool();
 
     std::vector<VkCommandBuffer> createCommandBuffers(const VkDevice& device, VkCommandPool commandPool, VkCommandBufferLevel level, uint32_t commandBufferCount);
     VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, VkCommandPool commandPool, bool begin = false);
     void submitCommandBuffer(const VkQueue& queue, const VkSubmitInfo* submitInfo, const VkFence& fence);
     void flushCommandBuffer(const VkCommandBuffer& commandBuffer, const VkQueue& queue, bool free = true);
+    VkFence submitCommandBufferAsync(const VkCommandBuffer& commandBuffer, const VkQueue& queue);
+    bool isFenceSignaled(const VkFence& fence) const;
     VkCommandBuffer beginImmediateCommandBuffer();
     void executeImmediateCommandBuffer(VkCommandBuffer commandBuffer);
 
@@ -180,6 +255,7 @@ struct Device {
     VkDescriptorSetLayout createDescriptorSetLayout(const VkDevice& device, const std::vector<DescriptorSetLayoutBinding>& descriptorSetLayoutBindings);
     VkPipelineLayout createPipelineLayout(const VkDevice& device, const std::vector<VkDescriptorSetLayout>& descriptorSetLayout, const std::vector<VkPushConstantRange>& pushConstantRanges);
 
+    // The pipeline cache of the device is used when pipelineCache is null
     VkPipeline createGraphicsPipeline(
         const VkDevice& device,
         VkPipelineCache pipelineCache,
@@ -196,6 +272,8 @@ struct Device {
         const VkRenderPass& renderPass);
 
     VkPipeline createComputePipeline(const VkDevice& device, const std::string& computeShaderFile, VkPipelineLayout layout, const VkSpecializationInfo* specializationInfo = nullptr);
+    // Keeps the module of computeShader. The pipeline cache of the device is used when pipelineCache is null
+    VkPipeline createComputePipeline(const VkDevice& device, VkPipelineCache pipelineCache, const ShaderStage& computeShader, VkPipelineLayout layout, const VkSpecializationInfo* specializationInfo = nullptr);
     std::vector<VkDescriptorSet> createDescriptorSets(const VkDevice& device, const VkDescriptorPool& descriptorPool, const std::vector<VkDescriptorSetLayout>& descriptorSetLayout);
     VkDescriptorSet createDescriptorSet(const VkDevice& device, const VkDescriptorPool& descriptorPool, const VkDescriptorSetLayout& descriptorSetLayout);
 
@@ -251,6 +329,7 @@ struct Device {
 
     void pickPhysicalDevice();
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool isDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName);
     bool checkValidationLayerSupport();
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
     bool memoryTypeNeedsStaging(uint32_t memoryTypeIndex) const;
@@ -0,0 +1,79 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "frame_allocator.h"
+
+void FrameAllocator::create(Device* device, VkDeviceSize frameSize, uint32_t frameCount)
+{
+    m_device = device->getDevice();
+    m_frameCount = frameCount;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device->getPhysicalDevice(), &properties);
+    m_alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+    m_frameSize = (frameSize + m_alignment - 1) & ~(m_alignment - 1);
+    if (m_frameSize * frameCount > UINT32_MAX) {
+        throw std::runtime_error("frame allocator is too large for dynamic offsets!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_frameSize * frameCount;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_buffer));
+
+    m_allocation = memory::allocate(device, m_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, memory::Tag::Uniform);
+    m_mapped = m_allocation.mapped;
+    m_stats = {};
+    m_stats.frameSize = m_frameSize;
+    reset(0);
+}
+
+void FrameAllocator::destroy()
+{
+    if (m_buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(m_device, m_buffer, nullptr);
+        m_buffer = VK_NULL_HANDLE;
+    }
+    memory::free(m_allocation);
+    m_mapped = nullptr;
+}
+
+void FrameAllocator::reset(uint32_t frameIndex)
+{
+    assert(frameIndex < m_frameCount);
+    m_stats.peak = getStats().peak;
+    m_begin = m_frameSize * frameIndex;
+    m_head = m_begin;
+    m_allocations = 0;
+}
+
+FrameAllocator::Allocation FrameAllocator::allocate(VkDeviceSize size)
+{
+    const VkDeviceSize alignedSize = (size + m_alignment - 1) & ~(m_alignment - 1);
+    // A failed allocation leaves the head past the end, the frame is full either way
+    const VkDeviceSize offset = m_head.fetch_add(alignedSize, std::memory_order_relaxed);
+    if (offset + alignedSize > m_begin + m_frameSize) {
+        throw std::runtime_error("frame allocator is out of space for this frame!");
+    }
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    Allocation allocation;
+    allocation.data = m_mapped + offset;
+    allocation.offset = static_cast<uint32_t>(offset);
+    return allocation;
+}
+
+FrameAllocator::Stats FrameAllocator::getStats() const
+{
+    Stats stats = m_stats;
+    stats.used = std::min(m_head.load(std::memory_order_relaxed) - m_begin, m_frameSize);
+    stats.peak = std::max(stats.peak, stats.used);
+    stats.allocations = m_allocations.load(std::memory_order_relaxed);
+    return stats;
+}
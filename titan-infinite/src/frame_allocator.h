@@ -0,0 +1,67 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+struct Device;
+
+// Transient uniform, storage and per-instance vertex data written while recording. One persistently mapped buffer is split into a region per
+// frame in flight and each region is a bump allocator, so nothing is freed on its own: reset() drops the whole region
+// once the fence of its frame has signaled. Bindings use the DYNAMIC descriptor types and take the offset at bind time,
+// which lets a single descriptor set serve every object and every frame. allocate() may be called from several threads
+// recording the same frame.
+class FrameAllocator {
+
+public:
+    struct Allocation {
+        void* data = nullptr;
+        // Dynamic offset into getBuffer()
+        uint32_t offset = 0;
+    };
+
+    struct Stats {
+        VkDeviceSize frameSize = 0;
+        VkDeviceSize used = 0;
+        VkDeviceSize peak = 0;
+        uint32_t allocations = 0;
+    };
+
+    void create(Device* device, VkDeviceSize frameSize, uint32_t frameCount);
+    void destroy();
+
+    // Call once the fence of frameIndex was waited for, everything allocated the last time that frame was recorded is gone
+    void reset(uint32_t frameIndex);
+    // Aligned for uniform and storage buffer offsets, throws when the region of the frame is full. The offset doubles as a
+    // vertex buffer offset for getBuffer()
+    Allocation allocate(VkDeviceSize size);
+    template <typename T>
+    uint32_t push(const T& data)
+    {
+        Allocation allocation = allocate(sizeof(T));
+        memcpy(allocation.data, &data, sizeof(T));
+        return allocation.offset;
+    }
+
+    VkBuffer getBuffer() const { return m_buffer; }
+    // For UNIFORM_BUFFER_DYNAMIC and STORAGE_BUFFER_DYNAMIC bindings, range is the size of the block the shader declares
+    VkDescriptorBufferInfo getDescriptor(VkDeviceSize range) const { return { m_buffer, 0, range }; }
+    Stats getStats() const;
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    memory::Allocation m_allocation;
+    uint8_t* m_mapped = nullptr;
+    VkDeviceSize m_alignment = 256;
+    VkDeviceSize m_frameSize = 0;
+    uint32_t m_frameCount = 0;
+    VkDeviceSize m_begin = 0;
+    std::atomic<VkDeviceSize> m_head{ 0 };
+    std::atomic<uint32_t> m_allocations{ 0 };
+    // peak as of the last reset(), used and allocations are derived from m_head and m_allocations
+    Stats m_stats;
+};
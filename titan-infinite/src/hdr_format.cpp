@@ -0,0 +1,432 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "hdr_format.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HDR_FORMAT_SSE
+#endif
+
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#define HDR_FORMAT_F16C
+#endif
+
+namespace texture {
+
+    // Largest finite values of each format
+    static const float halfMax = 65504.0f;
+    static const float r11g11Max = 65024.0f;
+    static const float b10Max = 64512.0f;
+    static const float sharedExpMax = 65408.0f;
+
+    // Packed formats need a better RMS error than this, otherwise RGBA16F is used
+    static const float maxPackedError = 1.0f / 128.0f;
+
+    // Texels looked at when choosing a format
+    static const size_t maxSampledTexels = 64 * 1024;
+
+    static inline uint32_t floatBits(float f)
+    {
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        return u;
+    }
+
+    static inline float bitsFloat(uint32_t u)
+    {
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+
+    static inline float clampHdr(float f, float lo, float hi)
+    {
+        if (std::isnan(f)) {
+            return 0.0f;
+        }
+        return std::min(std::max(f, lo), hi);
+    }
+
+    // Round to nearest even, f is expected to be finite and in half range
+    static uint16_t floatToHalf(float f)
+    {
+        uint32_t x = floatBits(f);
+        const uint32_t sign = (x >> 16) & 0x8000;
+        x &= 0x7fffffff;
+
+        uint32_t h;
+        if (x < (113u << 23)) {
+            // Subnormal or zero, the add lines the mantissa up and rounds it
+            const float magic = bitsFloat(((127 - 15) + (23 - 10) + 1) << 23);
+            h = floatBits(bitsFloat(x) + magic) - floatBits(magic);
+        }
+        else {
+            const uint32_t mantissaOdd = (x >> 13) & 1;
+            x += ((15u - 127u) << 23) + 0xfff + mantissaOdd;
+            h = x >> 13;
+        }
+        return static_cast<uint16_t>(sign | h);
+    }
+
+    static float halfToFloat(uint16_t h)
+    {
+        const uint32_t shiftedExp = 0x7c00u << 13;
+        uint32_t o = (h & 0x7fffu) << 13;
+        const uint32_t exp = o & shiftedExp;
+        o += (127u - 15u) << 23;
+        if (exp == shiftedExp) {
+            o += (128u - 16u) << 23;
+        }
+        else if (exp == 0) {
+            o += 1u << 23;
+            o = floatBits(bitsFloat(o) - bitsFloat(113u << 23));
+        }
+        return bitsFloat(o | ((h & 0x8000u) << 16));
+    }
+
+    static void encodeRGBA16F(const float* rgba, size_t texelCount, uint16_t* dst)
+    {
+        size_t i = 0;
+#ifdef HDR_FORMAT_F16C
+        const __m128 lo = _mm_set1_ps(-halfMax);
+        const __m128 hi = _mm_set1_ps(halfMax);
+        for (; i < texelCount * 4; i += 4) {
+            // NaN is masked to 0 before the clamp
+            __m128 v = _mm_loadu_ps(rgba + i);
+            v = _mm_min_ps(_mm_max_ps(_mm_and_ps(v, _mm_cmpord_ps(v, v)), lo), hi);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+        }
+#endif
+        for (; i < texelCount * 4; ++i) {
+            dst[i] = floatToHalf(clampHdr(rgba[i], -halfMax, halfMax));
+        }
+    }
+
+    static void decodeRGBA16F(const uint16_t* src, size_t texelCount, float* rgba)
+    {
+        size_t i = 0;
+#ifdef HDR_FORMAT_F16C
+        for (; i < texelCount * 4; i += 4) {
+            _mm_storeu_ps(rgba + i, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i))));
+        }
+#endif
+        for (; i < texelCount * 4; ++i) {
+            rgba[i] = halfToFloat(src[i]);
+        }
+    }
+
+    // Same exponent bias as half, the mantissa is rounded to nearest 6 or 5 bits and clamped to the largest finite value
+    static inline uint32_t encodeSmallFloat(float f, float maxValue, uint32_t shift, uint32_t maxBits)
+    {
+        const uint32_t h = floatToHalf(clampHdr(f, 0.0f, maxValue));
+        return std::min((h + (1u << (shift - 1))) >> shift, maxBits);
+    }
+
+    static void encodeB10G11R11(const float* rgba, size_t texelCount, uint32_t* dst)
+    {
+        for (size_t i = 0; i < texelCount; ++i) {
+            const float* t = rgba + i * 4;
+            const uint32_t r = encodeSmallFloat(t[0], r11g11Max, 4, 0x7bf);
+            const uint32_t g = encodeSmallFloat(t[1], r11g11Max, 4, 0x7bf);
+            const uint32_t b = encodeSmallFloat(t[2], b10Max, 5, 0x3df);
+            dst[i] = r | (g << 11) | (b << 22);
+        }
+    }
+
+    static void decodeB10G11R11(const uint32_t* src, size_t texelCount, float* rgba)
+    {
+        for (size_t i = 0; i < texelCount; ++i) {
+            const uint32_t p = src[i];
+            rgba[i * 4 + 0] = halfToFloat(static_cast<uint16_t>((p & 0x7ff) << 4));
+            rgba[i * 4 + 1] = halfToFloat(static_cast<uint16_t>(((p >> 11) & 0x7ff) << 4));
+            rgba[i * 4 + 2] = halfToFloat(static_cast<uint16_t>(((p >> 22) & 0x3ff) << 5));
+            rgba[i * 4 + 3] = 1.0f;
+        }
+    }
+
+    // Shared exponent encoding from the Vulkan spec, 9 bit mantissas and a bias of 15
+    static uint32_t encodeSharedExp(float r, float g, float b)
+    {
+        r = clampHdr(r, 0.0f, sharedExpMax);
+        g = clampHdr(g, 0.0f, sharedExpMax);
+        b = clampHdr(b, 0.0f, sharedExpMax);
+        const float maxc = std::max(r, std::max(g, b));
+
+        // floor(log2(maxc)) from the float exponent, 0 and denormals come out below -16
+        int exp = std::max(static_cast<int>((floatBits(maxc) >> 23) & 0xff) - 127, -16) + 16;
+        float scale = bitsFloat(static_cast<uint32_t>(127 + 24 - exp) << 23);
+        if (static_cast<uint32_t>(maxc * scale + 0.5f) == 512) {
+            ++exp;
+            scale *= 0.5f;
+        }
+        const uint32_t rs = static_cast<uint32_t>(r * scale + 0.5f);
+        const uint32_t gs = static_cast<uint32_t>(g * scale + 0.5f);
+        const uint32_t bs = static_cast<uint32_t>(b * scale + 0.5f);
+        return rs | (gs << 9) | (bs << 18) | (static_cast<uint32_t>(exp) << 27);
+    }
+
+    static void encodeE5B9G9R9(const float* rgba, size_t texelCount, uint32_t* dst)
+    {
+        size_t i = 0;
+#ifdef HDR_FORMAT_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 maxValue = _mm_set1_ps(sharedExpMax);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128i minExp = _mm_set1_epi32(127 - 16);
+        const __m128i overflow = _mm_set1_epi32(512);
+        for (; i + 4 <= texelCount; i += 4) {
+            __m128 r = _mm_loadu_ps(rgba + i * 4 + 0);
+            __m128 g = _mm_loadu_ps(rgba + i * 4 + 4);
+            __m128 b = _mm_loadu_ps(rgba + i * 4 + 8);
+            __m128 a = _mm_loadu_ps(rgba + i * 4 + 12);
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            r = _mm_min_ps(_mm_max_ps(r, zero), maxValue);
+            g = _mm_min_ps(_mm_max_ps(g, zero), maxValue);
+            b = _mm_min_ps(_mm_max_ps(b, zero), maxValue);
+            const __m128 maxc = _mm_max_ps(r, _mm_max_ps(g, b));
+
+            // Biased float exponent, clamped to -16, so exp is that plus 16 - 127
+            __m128i biased = _mm_srli_epi32(_mm_castps_si128(maxc), 23);
+            const __m128i low = _mm_cmplt_epi32(biased, minExp);
+            biased = _mm_or_si128(_mm_and_si128(low, minExp), _mm_andnot_si128(low, biased));
+
+            // 2^(24 - exp), built straight from the exponent bits
+            __m128i scaleBits = _mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127 + 24 + 127 - 16), biased), 23);
+            __m128 scale = _mm_castsi128_ps(scaleBits);
+            const __m128i maxs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxc, scale), half));
+            const __m128i bump = _mm_cmpeq_epi32(maxs, overflow);
+            biased = _mm_sub_epi32(biased, bump);
+            scale = _mm_castsi128_ps(_mm_add_epi32(scaleBits, _mm_slli_epi32(bump, 23)));
+
+            const __m128i rs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+            const __m128i gs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+            const __m128i bs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+            const __m128i exp = _mm_sub_epi32(biased, _mm_set1_epi32(127 - 16));
+            __m128i packed = _mm_or_si128(rs, _mm_slli_epi32(gs, 9));
+            packed = _mm_or_si128(packed, _mm_slli_epi32(bs, 18));
+            packed = _mm_or_si128(packed, _mm_slli_epi32(exp, 27));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+        }
+#endif
+        for (; i < texelCount; ++i) {
+            dst[i] = encodeSharedExp(rgba[i * 4 + 0], rgba[i * 4 + 1], rgba[i * 4 + 2]);
+        }
+    }
+
+    static void decodeE5B9G9R9(const uint32_t* src, size_t texelCount, float* rgba)
+    {
+        for (size_t i = 0; i < texelCount; ++i) {
+            const uint32_t p = src[i];
+            const float scale = bitsFloat((127 + (p >> 27) - 24) << 23);
+            rgba[i * 4 + 0] = static_cast<float>(p & 0x1ff) * scale;
+            rgba[i * 4 + 1] = static_cast<float>((p >> 9) & 0x1ff) * scale;
+            rgba[i * 4 + 2] = static_cast<float>((p >> 18) & 0x1ff) * scale;
+            rgba[i * 4 + 3] = 1.0f;
+        }
+    }
+
+    uint32_t hdrTexelSize(VkFormat format)
+    {
+        switch (format) {
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return 8;
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+        case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    void encodeHdr(const float* rgba, size_t texelCount, VkFormat format, void* dst)
+    {
+        switch (format) {
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            memcpy(dst, rgba, texelCount * 4 * sizeof(float));
+            break;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            encodeRGBA16F(rgba, texelCount, static_cast<uint16_t*>(dst));
+            break;
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+            encodeB10G11R11(rgba, texelCount, static_cast<uint32_t*>(dst));
+            break;
+        case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+            encodeE5B9G9R9(rgba, texelCount, static_cast<uint32_t*>(dst));
+            break;
+        default:
+            throw std::runtime_error("Unsupported HDR format");
+        }
+    }
+
+    void decodeHdr(const void* src, size_t texelCount, VkFormat format, float* rgba)
+    {
+        switch (format) {
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            memcpy(rgba, src, texelCount * 4 * sizeof(float));
+            break;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            decodeRGBA16F(static_cast<const uint16_t*>(src), texelCount, rgba);
+            break;
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+            decodeB10G11R11(static_cast<const uint32_t*>(src), texelCount, rgba);
+            break;
+        case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+            decodeE5B9G9R9(static_cast<const uint32_t*>(src), texelCount, rgba);
+            break;
+        default:
+            throw std::runtime_error("Unsupported HDR format");
+        }
+    }
+
+    // Every stride-th texel, at most maxSampledTexels of them
+    static std::vector<float> sampleTexels(const float* rgba, size_t texelCount)
+    {
+        const size_t stride = std::max<size_t>(1, texelCount / maxSampledTexels);
+        std::vector<float> sample;
+        sample.reserve((texelCount / stride + 1) * 4);
+        for (size_t i = 0; i < texelCount; i += stride) {
+            sample.insert(sample.end(), rgba + i * 4, rgba + i * 4 + 4);
+        }
+        return sample;
+    }
+
+    static HdrRoundTripError roundTripError(const std::vector<float>& sample, VkFormat format)
+    {
+        const size_t texelCount = sample.size() / 4;
+        std::vector<unsigned char> encoded(texelCount * hdrTexelSize(format));
+        std::vector<float> decoded(sample.size());
+        encodeHdr(sample.data(), texelCount, format, encoded.data());
+        decodeHdr(encoded.data(), texelCount, format, decoded.data());
+
+        // Packed formats drop alpha, only RGB is compared
+        HdrRoundTripError error;
+        double sum = 0.0;
+        for (size_t i = 0; i < texelCount; ++i) {
+            const float* d = &decoded[i * 4];
+            float o[3];
+            for (int c = 0; c < 3; ++c) {
+                o[c] = clampHdr(sample[i * 4 + c], -halfMax, halfMax);
+            }
+            const float brightest = std::max(std::abs(o[0]), std::max(std::abs(o[1]), std::abs(o[2])));
+            for (int c = 0; c < 3; ++c) {
+                const float e = std::abs(d[c] - o[c]) / std::max(std::max(std::abs(o[c]), brightest / 256.0f), 1e-4f);
+                error.max = std::max(error.max, e);
+                sum += static_cast<double>(e) * e;
+            }
+        }
+        if (texelCount > 0) {
+            error.rms = static_cast<float>(std::sqrt(sum / (texelCount * 3)));
+        }
+        return error;
+    }
+
+    HdrRoundTripError measureHdrRoundTrip(const float* rgba, size_t texelCount, VkFormat format)
+    {
+        return roundTripError(sampleTexels(rgba, texelCount), format);
+    }
+
+    static bool isHdrFormatUsable(Device* device, VkFormat format)
+    {
+        const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(device->getPhysicalDevice(), format, &formatProperties);
+        return (formatProperties.optimalTilingFeatures & required) == required;
+    }
+
+    VkFormat chooseHdrFormat(Device* device, const float* rgba, size_t texelCount)
+    {
+        const VkFormat fallback = isHdrFormatUsable(device, VK_FORMAT_R16G16B16A16_SFLOAT) ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT;
+
+        // Alpha and negative values only fit the wider formats, this looks at every texel
+        for (size_t i = 0; i < texelCount; ++i) {
+            const float* t = rgba + i * 4;
+            if (t[3] != 1.0f || t[0] < 0.0f || t[1] < 0.0f || t[2] < 0.0f) {
+                return fallback;
+            }
+        }
+
+        const std::vector<float> sample = sampleTexels(rgba, texelCount);
+        VkFormat best = fallback;
+        float bestError = maxPackedError;
+        for (VkFormat format : { VK_FORMAT_E5B9G9R9_UFLOAT_PACK32, VK_FORMAT_B10G11R11_UFLOAT_PACK32 }) {
+            if (!isHdrFormatUsable(device, format)) {
+                continue;
+            }
+            const HdrRoundTripError error = roundTripError(sample, format);
+            if (error.rms <= bestError) {
+                best = format;
+                bestError = error.rms;
+            }
+        }
+        return best;
+    }
+
+    // 2x2 box, odd edges repeat the last row or column
+    static void downsampleHdr(const float* src, uint32_t srcWidth, uint32_t srcHeight, float* dst, uint32_t dstWidth, uint32_t dstHeight)
+    {
+        for (uint32_t y = 0; y < dstHeight; ++y) {
+            const float* row0 = src + static_cast<size_t>(std::min(y * 2, srcHeight - 1)) * srcWidth * 4;
+            const float* row1 = src + static_cast<size_t>(std::min(y * 2 + 1, srcHeight - 1)) * srcWidth * 4;
+            float* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+            for (uint32_t x = 0; x < dstWidth; ++x) {
+                const size_t x0 = std::min(x * 2, srcWidth - 1) * 4;
+                const size_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+#ifdef HDR_FORMAT_SSE
+                __m128 sum = _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1));
+                sum = _mm_add_ps(sum, _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+                _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+                for (int c = 0; c < 4; ++c) {
+                    out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+                }
+#endif
+            }
+        }
+    }
+
+    void buildHdrMipChain(const float* rgba, uint32_t width, uint32_t height, VkFormat format, MipChain& chain)
+    {
+        const uint32_t texelSize = hdrTexelSize(format);
+        if (texelSize == 0) {
+            throw std::runtime_error("Unsupported HDR format");
+        }
+
+        chain = MipChain{};
+        chain.format = format;
+        chain.width = width;
+        chain.height = height;
+
+        const uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+        VkDeviceSize size = 0;
+        for (uint32_t level = 0; level < mipLevels; ++level) {
+            const VkExtent2D extent = { std::max(1u, width >> level), std::max(1u, height >> level) };
+            chain.levelOffsets.push_back(size);
+            chain.levelExtents.push_back(extent);
+            size += static_cast<VkDeviceSize>(extent.width) * extent.height * texelSize;
+        }
+        chain.data.resize(static_cast<size_t>(size));
+
+        encodeHdr(rgba, static_cast<size_t>(width) * height, format, chain.data.data());
+
+        std::vector<float> previous;
+        std::vector<float> current;
+        const float* source = rgba;
+        for (uint32_t level = 1; level < mipLevels; ++level) {
+            const VkExtent2D src = chain.levelExtents[level - 1];
+            const VkExtent2D dst = chain.levelExtents[level];
+            current.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+            downsampleHdr(source, src.width, src.height, current.data(), dst.width, dst.height);
+            encodeHdr(current.data(), static_cast<size_t>(dst.width) * dst.height, format, chain.data.data() + chain.levelOffsets[level]);
+            previous.swap(current);
+            source = previous.data();
+        }
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+
+namespace texture {
+
+    struct HdrRoundTripError {
+        // Per channel error relative to the channel, floored at 1/256 of the brightest channel of the texel
+        float rms{ 0.0f };
+        float max{ 0.0f };
+    };
+
+    // Bytes per texel of R32G32B32A32_SFLOAT and the formats below, 0 for anything else
+    uint32_t hdrTexelSize(VkFormat format);
+
+    // RGBA32F texels to R16G16B16A16_SFLOAT, B10G11R11_UFLOAT_PACK32 or E5B9G9R9_UFLOAT_PACK32, out of range values are clamped
+    void encodeHdr(const float* rgba, size_t texelCount, VkFormat format, void* dst);
+    void decodeHdr(const void* src, size_t texelCount, VkFormat format, float* rgba);
+
+    // Encodes and decodes a sample of the texels and compares against the float input
+    HdrRoundTripError measureHdrRoundTrip(const float* rgba, size_t texelCount, VkFormat format);
+
+    // Smallest sampleable format that keeps the content, RGBA16F when alpha or negative values have to survive
+    VkFormat chooseHdrFormat(Device* device, const float* rgba, size_t texelCount);
+
+    // RGBA32F level 0 to a box filtered chain in format, every level is filtered in float before it is encoded
+    void buildHdrMipChain(const float* rgba, uint32_t width, uint32_t height, VkFormat format, MipChain& chain);
+}
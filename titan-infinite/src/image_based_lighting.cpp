@@ -0,0 +1,494 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "image_based_lighting.h"
+#include <filesystem>
+#include <gli.hpp>
+
+// Bump when the shaders or the sizes change, files written by older versions are then ignored
+static const uint32_t cacheVersion = 1;
+static const VkFormat iblFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+static const uint32_t groupSize = 8;
+
+static uint32_t mipLevelCount(uint32_t size)
+{
+	return static_cast<uint32_t>(std::floor(std::log2(size))) + 1;
+}
+
+static uint32_t groupCount(uint32_t size)
+{
+	return (size + groupSize - 1) / groupSize;
+}
+
+static void pipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const std::vector<VkImageMemoryBarrier>& barriers)
+{
+	vkCmdPipelineBarrier(commandBuffer,
+		srcStages, dstStages, 0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+// One region per face and level, at the offsets gli keeps them in memory
+static std::vector<VkBufferImageCopy> copyRegions(const gli::texture& texture)
+{
+	std::vector<VkBufferImageCopy> regions;
+	const uint8_t* base = static_cast<const uint8_t*>(texture.data());
+	for (uint32_t face = 0; face < texture.faces(); face++) {
+		for (uint32_t level = 0; level < texture.levels(); level++) {
+			VkBufferImageCopy region{};
+			region.bufferOffset = static_cast<const uint8_t*>(texture.data(0, face, level)) - base;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, face, 1 };
+			region.imageExtent = { static_cast<uint32_t>(texture.extent(level).x), static_cast<uint32_t>(texture.extent(level).y), 1 };
+			regions.push_back(region);
+		}
+	}
+	return regions;
+}
+
+void ImageBasedLighting::create(Device* device, const std::string& environmentFilename, const std::string& cacheDirectory)
+{
+	m_device = device;
+
+	std::string environmentFile, irradianceFile, prefilteredFile, brdfLutFile;
+	bool cached = false;
+	bool brdfLutCached = false;
+	if (!cacheDirectory.empty()) {
+		const std::vector<char> source = vkHelper::readFile(environmentFilename);
+		char key[17];
+		snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(TextureCache::hashContent(source.data(), source.size(), cacheVersion)));
+		const std::filesystem::path directory(cacheDirectory);
+		environmentFile = (directory / (std::string(key) + "_environment.ktx")).string();
+		irradianceFile = (directory / (std::string(key) + "_irradiance.ktx")).string();
+		prefilteredFile = (directory / (std::string(key) + "_prefiltered.ktx")).string();
+		// The LUT doesn't depend on the environment
+		brdfLutFile = (directory / ("brdf_lut_v" + std::to_string(cacheVersion) + ".ktx")).string();
+
+		cached = loadCache(environmentFile, environment) && loadCache(irradianceFile, irradiance) && loadCache(prefilteredFile, prefiltered);
+		brdfLutCached = loadCache(brdfLutFile, brdfLut);
+		if (!cached) {
+			for (TextureObject* texture : { &environment, &irradiance, &prefiltered }) {
+				texture->destroy(m_device->getDevice());
+				*texture = TextureObject{};
+			}
+		}
+	}
+	if (cached && brdfLutCached) {
+		return;
+	}
+
+	if (!cached) {
+		compute(environmentFilename, !brdfLutCached);
+	}
+	else {
+		compute(std::string(), true);
+	}
+
+	if (!cacheDirectory.empty()) {
+		std::vector<std::pair<std::string, TextureObject*>> files;
+		if (!cached) {
+			files.push_back({ environmentFile, &environment });
+			files.push_back({ irradianceFile, &irradiance });
+			files.push_back({ prefilteredFile, &prefiltered });
+		}
+		if (!brdfLutCached) {
+			files.push_back({ brdfLutFile, &brdfLut });
+		}
+		saveCache(files);
+	}
+}
+
+void ImageBasedLighting::destroy()
+{
+	for (TextureObject* texture : { &environment, &irradiance, &prefiltered, &brdfLut }) {
+		texture->destroy(m_device->getDevice());
+		*texture = TextureObject{};
+	}
+}
+
+TextureObject ImageBasedLighting::createTarget(uint32_t size, uint32_t mipLevels, uint32_t layers, VkImageUsageFlags usage)
+{
+	VkDevice device = m_device->getDevice();
+	const bool cube = layers == 6;
+
+	TextureObject texture{};
+	texture.device = m_device;
+	texture.width = size;
+	texture.height = size;
+	texture.mipLevels = mipLevels;
+	texture.layers = layers;
+	texture.format = iblFormat;
+	texture.is_hdr = true;
+	texture.image_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	texture.image = m_device->createImage(device,
+		cube ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0,
+		VK_IMAGE_TYPE_2D,
+		iblFormat,
+		{ size, size, 1 },
+		mipLevels,
+		layers,
+		VK_SAMPLE_COUNT_1_BIT,
+		VK_IMAGE_TILING_OPTIMAL,
+		usage,
+		VK_SHARING_MODE_EXCLUSIVE,
+		VK_IMAGE_LAYOUT_UNDEFINED);
+
+	texture.allocation = memory::allocate(m_device, texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	texture.buffer_size = texture.allocation.size;
+
+	texture.view = m_device->createImageView(device, texture.image, cube ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D, iblFormat,
+		{ VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
+		{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, layers });
+
+	texture.sampler = texture::createSampler(device,
+		VK_FILTER_LINEAR,
+		VK_FILTER_LINEAR,
+		VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		0.0f,
+		VK_FALSE,
+		1.0f,
+		VK_FALSE,
+		VK_COMPARE_OP_NEVER,
+		0.0f,
+		static_cast<float>(mipLevels),
+		VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+		VK_FALSE);
+	return texture;
+}
+
+TextureObject ImageBasedLighting::loadSource(const std::string& environmentFilename, bool& equirectangular)
+{
+	equirectangular = vkHelper::getFileExtension(environmentFilename) != "ktx";
+	if (!equirectangular) {
+		TextureObject source = texture::loadTextureCube(environmentFilename, VK_FORMAT_R8G8B8A8_UNORM, m_device, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(m_device->getPhysicalDevice(), source.format, &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT)) {
+			source.destroy(m_device->getDevice());
+			throw std::runtime_error("Environment cube format does not support blitting: " + environmentFilename);
+		}
+		return source;
+	}
+
+	TextureObject image = texture::loadTexture(environmentFilename);
+	if (image.data.empty()) {
+		throw std::runtime_error("Unsupported environment: " + environmentFilename);
+	}
+	// Linear filtering of RGBA32F is optional, panoramas are sampled from half floats. LDR ones are sRGB encoded
+	if (image.is_hdr) {
+		const size_t texelCount = static_cast<size_t>(image.width) * image.height;
+		std::vector<uint8_t> half(texelCount * texture::hdrTexelSize(iblFormat));
+		texture::encodeHdr(reinterpret_cast<const float*>(image.data.data()), texelCount, iblFormat, half.data());
+		return texture::loadTexture(half.data(), half.size(), iblFormat, image.width, image.height, m_device);
+	}
+	return texture::loadTexture(image.data.data(), image.data.size(), VK_FORMAT_R8G8B8A8_SRGB, image.width, image.height, m_device);
+}
+
+void ImageBasedLighting::compute(const std::string& environmentFilename, bool computeBrdfLut)
+{
+	VkDevice device = m_device->getDevice();
+	const bool computeEnvironment = !environmentFilename.empty();
+
+	const std::vector<DescriptorSetLayoutBinding> bindings = {
+		{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+	};
+	VkDescriptorSetLayout descriptorSetLayout = m_device->createDescriptorSetLayout(device, bindings);
+	const std::vector<VkPushConstantRange> pushConstantRanges = {
+		{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(float) },
+	};
+	VkPipelineLayout pipelineLayout = m_device->createPipelineLayout(device, { descriptorSetLayout }, pushConstantRanges);
+
+	// Compiled on the pipeline queue while the source loads and the targets are created
+	std::unordered_map<std::string, PipelineQueue::Handle> compiling;
+	auto submit = [&](const std::string& shader) {
+		PipelineQueue::ComputePipelineDesc desc;
+		desc.computeShaderFile = "../../data/shaders/" + shader + ".comp.spv";
+		desc.pipelineLayout = pipelineLayout;
+		compiling[shader] = m_device->getPipelineQueue().submit(desc);
+	};
+	if (computeEnvironment) {
+		submit("irmap");
+		submit("spmap");
+	}
+	if (computeBrdfLut) {
+		submit("spbrdf");
+	}
+
+	// Repeats around the equirectangular seam, cube lookups ignore the address modes
+	VkSampler sampler = texture::createSampler(device,
+		VK_FILTER_LINEAR,
+		VK_FILTER_LINEAR,
+		VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		0.0f,
+		VK_FALSE,
+		1.0f,
+		VK_FALSE,
+		VK_COMPARE_OP_NEVER,
+		0.0f,
+		VK_LOD_CLAMP_NONE,
+		VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+		VK_FALSE);
+
+	// Equirectangular, irradiance, one per prefiltered level and the LUT
+	const uint32_t prefilteredLevels = mipLevelCount(prefilteredSize);
+	const uint32_t maxSets = 3 + prefilteredLevels;
+	const std::vector<VkDescriptorPoolSize> poolSizes = {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxSets },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxSets },
+	};
+	VkDescriptorPool descriptorPool = m_device->createDescriptorPool(device, poolSizes, maxSets);
+
+	std::vector<VkImageView> views;
+	std::vector<VkPipeline> pipelines;
+	auto storageView = [&](TextureObject& texture, uint32_t level) {
+		VkImageView view = m_device->createImageView(device, texture.image, texture.layers == 6 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D, iblFormat,
+			{ VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
+			{ VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, texture.layers });
+		views.push_back(view);
+		return view;
+	};
+	auto descriptorSet = [&](VkImageView sampled, VkImageView storage) {
+		VkDescriptorSet set = m_device->createDescriptorSet(device, descriptorPool, descriptorSetLayout);
+		VkDescriptorImageInfo sampledInfo{ sampler, sampled, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		VkDescriptorImageInfo storageInfo{ VK_NULL_HANDLE, storage, VK_IMAGE_LAYOUT_GENERAL };
+		std::array<VkWriteDescriptorSet, 2> writes{};
+		for (auto& write : writes) {
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = set;
+			write.descriptorCount = 1;
+		}
+		writes[0].dstBinding = 1;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[0].pImageInfo = &storageInfo;
+		writes[1].dstBinding = 0;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[1].pImageInfo = &sampledInfo;
+		// spbrdf.comp reads nothing
+		vkUpdateDescriptorSets(device, sampled != VK_NULL_HANDLE ? 2 : 1, writes.data(), 0, nullptr);
+		return set;
+	};
+	auto dispatch = [&](VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet set, uint32_t size, uint32_t layers) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, nullptr);
+		vkCmdDispatch(commandBuffer, groupCount(size), groupCount(size), layers);
+	};
+	auto pipeline = [&](const std::string& shader) {
+		pipelines.push_back(compiling.at(shader).wait());
+		return pipelines.back();
+	};
+
+	TextureObject source{};
+	bool equirectangular = false;
+	if (computeEnvironment) {
+		source = loadSource(environmentFilename, equirectangular);
+		if (equirectangular) {
+			submit("equirect2cube");
+		}
+		const VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		environment = createTarget(environmentSize, mipLevelCount(environmentSize), 6, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+		irradiance = createTarget(irradianceSize, 1, 6, usage);
+		prefiltered = createTarget(prefilteredSize, prefilteredLevels, 6, usage);
+	}
+	if (computeBrdfLut) {
+		brdfLut = createTarget(brdfLutSize, 1, 1, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+	}
+
+	VkCommandBuffer commandBuffer = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_device->getCommandPool(), true);
+
+	if (computeEnvironment) {
+		// Level 0 of the environment, from the panorama through a compute pass or blitted from the source cube
+		if (equirectangular) {
+			pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {
+				ImageMemoryBarrier(environment, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL).mipLevels(0, 1),
+			});
+			dispatch(commandBuffer, pipeline("equirect2cube"), descriptorSet(source.view, storageView(environment, 0)), environmentSize, 6);
+			pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, {
+				ImageMemoryBarrier(environment, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).mipLevels(0, 1),
+				ImageMemoryBarrier(environment, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL).mipLevels(1),
+			});
+		}
+		else {
+			pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, {
+				ImageMemoryBarrier(source, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL),
+				ImageMemoryBarrier(environment, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL),
+			});
+			VkImageBlit region{};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 6 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 6 };
+			region.srcOffsets[1] = { static_cast<int32_t>(source.width), static_cast<int32_t>(source.height), 1 };
+			region.dstOffsets[1] = { static_cast<int32_t>(environmentSize), static_cast<int32_t>(environmentSize), 1 };
+			vkCmdBlitImage(commandBuffer,
+				source.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				environment.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &region, VK_FILTER_LINEAR);
+			pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, {
+				ImageMemoryBarrier(environment, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).mipLevels(0, 1),
+			});
+		}
+
+		// The rest of the chain by blits, all six faces at once. Convolutions read the levels matching their sample density
+		for (uint32_t level = 1; level < environment.mipLevels; level++) {
+			VkImageBlit region{};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 6 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 6 };
+			region.srcOffsets[1] = { static_cast<int32_t>(environmentSize >> (level - 1)), static_cast<int32_t>(environmentSize >> (level - 1)), 1 };
+			region.dstOffsets[1] = { static_cast<int32_t>(environmentSize >> level), static_cast<int32_t>(environmentSize >> level), 1 };
+			vkCmdBlitImage(commandBuffer,
+				environment.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				environment.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &region, VK_FILTER_LINEAR);
+			pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, {
+				ImageMemoryBarrier(environment, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).mipLevels(level, 1),
+			});
+		}
+		pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, {
+			ImageMemoryBarrier(environment, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			ImageMemoryBarrier(irradiance, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL),
+			ImageMemoryBarrier(prefiltered, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL),
+		});
+
+		dispatch(commandBuffer, pipeline("irmap"), descriptorSet(environment.view, storageView(irradiance, 0)), irradianceSize, 6);
+
+		// Roughness rises linearly with the level, pbr.frag picks the level from the roughness the same way
+		VkPipeline spmap = pipeline("spmap");
+		for (uint32_t level = 0; level < prefiltered.mipLevels; level++) {
+			const float roughness = static_cast<float>(level) / static_cast<float>(prefiltered.mipLevels - 1);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(roughness), &roughness);
+			dispatch(commandBuffer, spmap, descriptorSet(environment.view, storageView(prefiltered, level)), std::max(prefilteredSize >> level, 1u), 6);
+		}
+	}
+
+	std::vector<VkImageMemoryBarrier> barriers;
+	if (computeBrdfLut) {
+		pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {
+			ImageMemoryBarrier(brdfLut, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL),
+		});
+		dispatch(commandBuffer, pipeline("spbrdf"), descriptorSet(VK_NULL_HANDLE, storageView(brdfLut, 0)), brdfLutSize, 1);
+		barriers.push_back(ImageMemoryBarrier(brdfLut, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+	}
+	if (computeEnvironment) {
+		barriers.push_back(ImageMemoryBarrier(irradiance, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+		barriers.push_back(ImageMemoryBarrier(prefiltered, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+	}
+	pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, barriers);
+
+	m_device->flushCommandBuffer(commandBuffer, m_device->getGraphicsQueue());
+
+	source.destroy(device);
+	for (VkPipeline pipeline : pipelines) {
+		vkDestroyPipeline(device, pipeline, nullptr);
+	}
+	for (VkImageView view : views) {
+		vkDestroyImageView(device, view, nullptr);
+	}
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	vkDestroySampler(device, sampler, nullptr);
+	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+}
+
+bool ImageBasedLighting::loadCache(const std::string& filename, TextureObject& texture)
+{
+	if (!std::filesystem::exists(filename)) {
+		return false;
+	}
+	gli::texture file = gli::load(filename);
+	if (file.empty() || file.format() != static_cast<gli::format>(iblFormat)) {
+		return false;
+	}
+
+	texture = createTarget(static_cast<uint32_t>(file.extent().x), static_cast<uint32_t>(file.levels()), static_cast<uint32_t>(file.faces()),
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	Buffer staging = buffer::createBuffer(m_device, file.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_SHARING_MODE_EXCLUSIVE, file.data());
+
+	VkCommandBuffer commandBuffer = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_device->getCommandPool(), true);
+	pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, {
+		ImageMemoryBarrier(texture, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL),
+	});
+	const std::vector<VkBufferImageCopy> regions = copyRegions(file);
+	vkCmdCopyBufferToImage(commandBuffer, staging.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, {
+		ImageMemoryBarrier(texture, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+	});
+	m_device->flushCommandBuffer(commandBuffer, m_device->getGraphicsQueue());
+	staging.destroy();
+	return true;
+}
+
+void ImageBasedLighting::saveCache(const std::vector<std::pair<std::string, TextureObject*>>& files)
+{
+	if (files.empty()) {
+		return;
+	}
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(files.front().first).parent_path(), error);
+
+	std::vector<gli::texture> textures;
+	VkDeviceSize totalSize = 0;
+	for (const auto& file : files) {
+		const TextureObject& texture = *file.second;
+		const bool cube = texture.layers == 6;
+		textures.emplace_back(cube ? gli::TARGET_CUBE : gli::TARGET_2D, static_cast<gli::format>(texture.format),
+			gli::extent3d(texture.width, texture.height, 1), 1, cube ? 6 : 1, texture.mipLevels);
+		totalSize += textures.back().size();
+	}
+
+	Buffer readback = buffer::createBuffer(m_device, totalSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	VkCommandBuffer commandBuffer = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_device->getCommandPool(), true);
+	std::vector<VkImageMemoryBarrier> toTransfer;
+	std::vector<VkImageMemoryBarrier> toShader;
+	for (const auto& file : files) {
+		toTransfer.push_back(ImageMemoryBarrier(*file.second, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+	}
+	pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, toTransfer);
+	VkDeviceSize offset = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		std::vector<VkBufferImageCopy> regions = copyRegions(textures[i]);
+		for (VkBufferImageCopy& region : regions) {
+			region.bufferOffset += offset;
+		}
+		vkCmdCopyImageToBuffer(commandBuffer, files[i].second->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, static_cast<uint32_t>(regions.size()), regions.data());
+		toShader.push_back(ImageMemoryBarrier(*files[i].second, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+		offset += textures[i].size();
+	}
+	pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, toShader);
+	m_device->flushCommandBuffer(commandBuffer, m_device->getGraphicsQueue());
+
+	readback.map();
+	offset = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		memcpy(textures[i].data(), static_cast<uint8_t*>(readback.mapped) + offset, textures[i].size());
+		offset += textures[i].size();
+		// A missing cache only costs the next startup another convolution. Written next to the target and renamed over
+		// it, so a reader never sees a partial file
+		const std::string temporaryPath = files[i].first + ".tmp";
+		std::error_code error;
+		if (!gli::save_ktx(textures[i], temporaryPath)) {
+			std::cerr << "Failed to write " << temporaryPath << std::endl;
+			std::filesystem::remove(temporaryPath, error);
+			continue;
+		}
+		std::filesystem::rename(temporaryPath, files[i].first, error);
+		if (error) {
+			std::cerr << "Failed to replace " << files[i].first << ": " << error.message() << std::endl;
+			std::filesystem::remove(temporaryPath, error);
+		}
+	}
+	readback.unmap();
+	readback.destroy();
+}
@@ -0,0 +1,42 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+// Environment, diffuse irradiance and GGX prefiltered cubes plus the split sum BRDF LUT, computed by
+// equirect2cube.comp, irmap.comp, spmap.comp and spbrdf.comp. Results are written to a cache directory keyed
+// by a hash of the source file, later runs upload those instead of convolving again.
+class ImageBasedLighting {
+
+public:
+	static const uint32_t environmentSize = 1024;
+	static const uint32_t irradianceSize = 32;
+	static const uint32_t prefilteredSize = 256;
+	static const uint32_t brdfLutSize = 256;
+
+	// Source is a .ktx cube or an equirectangular .hdr, .png or .jpg. An empty cache directory disables the cache
+	void create(Device* device, const std::string& environmentFilename, const std::string& cacheDirectory);
+	void destroy();
+
+	// Highest level of the prefiltered cube, roughness 1 samples it
+	float prefilteredMaxLod() const { return static_cast<float>(prefiltered.mipLevels - 1); }
+
+	TextureObject environment;
+	TextureObject irradiance;
+	TextureObject prefiltered;
+	TextureObject brdfLut;
+
+private:
+	TextureObject createTarget(uint32_t size, uint32_t mipLevels, uint32_t layers, VkImageUsageFlags usage);
+	TextureObject loadSource(const std::string& environmentFilename, bool& equirectangular);
+	void compute(const std::string& environmentFilename, bool computeBrdfLut);
+
+	bool loadCache(const std::string& filename, TextureObject& texture);
+	void saveCache(const std::vector<std::pair<std::string, TextureObject*>>& files);
+
+	Device* m_device = nullptr;
+};
@@ -28,15 +28,14 @@ public:
 		vkDestroyPipelineLayout(m_device->getDevice(), m_pipelineLayout, nullptr);
 		vkDestroyPipeline(m_device->getDevice(), m_pipeline, nullptr);
 		vkDestroyBuffer(m_device->getDevice(), vertices.buffer, nullptr);
-		for (auto buffer : m_uniformBuffers)
-			buffer.destroy();
+		memory::free(vertices.allocation);
 	}
 
 
 	struct Vertices {
 		uint32_t count;
 		VkBuffer buffer;
-		VkDeviceMemory memory;
+		memory::Allocation allocation;
 	} vertices;
 
 private:
@@ -51,9 +50,8 @@ private:
 		glm::vec4 color;
 	}ubo;
 
-	std::vector<Buffer> m_uniformBuffers;
 	VkDescriptorSetLayout m_descriptorSetLayout;
-	std::vector<VkDescriptorSet> m_descriptorsets;
+	VkDescriptorSet m_descriptorSet;
 	VkPipelineLayout m_pipelineLayout;
 	VkPipeline m_pipeline;
 public:
@@ -66,23 +64,7 @@ public:
 		vertice.push_back(m_destination);
 		vertices.count = static_cast<uint32_t>(vertice.size() * sizeof(glm::vec3));
 
-		// Vertex Buffer
-		struct StagingBuffer
-		{
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-		} vertexStaging;
-
-		buffer::createBuffer(
-			m_device,
-			vertice.size() * sizeof(glm::vec3),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			VK_SHARING_MODE_EXCLUSIVE,
-			&vertexStaging.buffer,
-			&vertexStaging.memory,
-			vertice.data());
-
+		// Vertex Buffer, through the staging belt
 		buffer::createBuffer(
 			m_device,
 			vertice.size() * sizeof(glm::vec3),
@@ -90,49 +72,28 @@ public:
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			VK_SHARING_MODE_EXCLUSIVE,
 			&vertices.buffer,
-			&vertices.memory);
+			&vertices.allocation);
+		m_device->getStagingBelt().copyToBuffer(vertice.data(), vertice.size() * sizeof(glm::vec3), vertices.buffer);
+		m_device->getStagingBelt().flush();
 
-		// Copy from staging buffers
-		VkCommandBuffer copyCmd = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_device->getCommandPool(), true);
-		VkBufferCopy copyRegion{};
-		copyRegion.size = vertice.size() * sizeof(glm::vec3);
-		vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-		m_device->flushCommandBuffer(copyCmd, m_device->getGraphicsQueue());
-
-		vkDestroyBuffer(m_device->getDevice(), vertices.buffer, nullptr);
-		vkFreeMemory(m_device->getDevice(), vertices.memory, nullptr);
-
-		// Uniform Buffer
-		m_uniformBuffers.resize(m_device->getSwapChainimages().size());
-		for (auto& uniformBuffer : m_uniformBuffers) {
-			uniformBuffer = buffer::createBuffer(
-				m_device,
-				sizeof(ubo),
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-			);
-			memory::map(m_device->getDevice(), uniformBuffer.memory, 0, uniformBuffer.bufferSize, &uniformBuffer.mapped);
-		}
-
-		// Descriptor Set 
+		// Descriptor Set, the uniform block comes from the frame allocator
 		{
 			std::vector<DescriptorSetLayoutBinding> layoutBindings = {
-				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
+				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
 			};
 			m_descriptorSetLayout = m_device->createDescriptorSetLayout(m_device->getDevice(), { layoutBindings });
 		}
-
-		m_descriptorsets.resize(m_device->getSwapChainimages().size());
-		for (auto i = 0; i < m_descriptorsets.size(); ++i) {
-			m_descriptorsets[i] = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), m_descriptorSetLayout);
+		{
+			m_descriptorSet = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), m_descriptorSetLayout);
+			const VkDescriptorBufferInfo bufferInfo = m_device->getFrameAllocator().getDescriptor(sizeof(ubo));
 			std::array<VkWriteDescriptorSet, 1> writeDescriptorSets{};
 
 			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 			writeDescriptorSets[0].descriptorCount = 1;
-			writeDescriptorSets[0].dstSet = m_descriptorsets[i];
+			writeDescriptorSets[0].dstSet = m_descriptorSet;
 			writeDescriptorSets[0].dstBinding = 0;
-			writeDescriptorSets[0].pBufferInfo = &m_uniformBuffers[i].descriptor;
+			writeDescriptorSets[0].pBufferInfo = &bufferInfo;
 			vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 		}
 
@@ -207,12 +168,10 @@ public:
 		initialized = true;
 	}
 
+	// Picked up by the next draw
 	void updateUniformBuffer(Camera* camera, glm::mat4 model = glm::mat4(1.0)) {
 		ubo.mvp = camera->matrices.perspective * camera->matrices.view * model;
 		ubo.color = glm::vec4(0.0, 1.0, 0.0, 1.0);
-
-		auto imageIndex = m_device->getCurrentFrame();
-		memcpy(m_uniformBuffers[imageIndex].mapped, &ubo, sizeof(ubo));
 	}
 
 	void updateVertexBuffer(VkCommandBuffer commandBuffer, glm::vec3 origin, glm::vec3 destination) {
@@ -227,7 +186,8 @@ public:
 	void draw(VkCommandBuffer commandBuffer) {
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
 		const VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, m_descriptorsets.data(), 0, NULL);
+		const uint32_t dynamicOffset = m_device->getFrameAllocator().push(ubo);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 1, &dynamicOffset);
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
 		vkCmdDraw(commandBuffer, vertices.count, 1, 0, 0);
 	}
@@ -0,0 +1,104 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+#ifdef _WIN32
+void MappedFile::open(const std::string& filename)
+{
+	close();
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("failed to open file \"" + filename + "\"!");
+	}
+	m_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		close();
+		throw std::runtime_error("failed to map empty file \"" + filename + "\"!");
+	}
+
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping) {
+		close();
+		throw std::runtime_error("failed to map file \"" + filename + "\"!");
+	}
+
+	m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_data) {
+		close();
+		throw std::runtime_error("failed to map file \"" + filename + "\"!");
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+}
+
+void MappedFile::close()
+{
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+		m_data = nullptr;
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	if (m_file) {
+		CloseHandle(m_file);
+		m_file = nullptr;
+	}
+	m_size = 0;
+}
+#else
+void MappedFile::open(const std::string& filename)
+{
+	close();
+	m_file = ::open(filename.c_str(), O_RDONLY);
+	if (m_file < 0) {
+		throw std::runtime_error("failed to open file \"" + filename + "\"!");
+	}
+
+	struct stat info;
+	if (fstat(m_file, &info) != 0 || info.st_size == 0) {
+		close();
+		throw std::runtime_error("failed to map empty file \"" + filename + "\"!");
+	}
+
+	void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED) {
+		close();
+		throw std::runtime_error("failed to map file \"" + filename + "\"!");
+	}
+	m_data = static_cast<const unsigned char*>(data);
+	m_size = static_cast<size_t>(info.st_size);
+	madvise(data, m_size, MADV_SEQUENTIAL);
+}
+
+void MappedFile::close()
+{
+	if (m_data) {
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+		m_data = nullptr;
+	}
+	if (m_file >= 0) {
+		::close(m_file);
+		m_file = -1;
+	}
+	m_size = 0;
+}
+#endif
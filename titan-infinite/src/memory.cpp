@@ -7,10 +7,931 @@
 #include "pch.h"
 #include "memory.h"
 #include <mutex>
+#include <sstream>
 
 namespace memory {
-    std::mutex imageMutex;
-    std::mutex memMutex;
+    // Every range starts and ends on this granule, so alignments up to it cost nothing and
+    // granularities up to it never put two resources on one page
+    static const uint32_t minRangeLog2 = 8;
+    static const VkDeviceSize minRangeSize = VkDeviceSize(1) << minRangeLog2;
+    static const uint32_t secondLevelLog2 = 4;
+    static const uint32_t secondLevelCount = 1 << secondLevelLog2;
+    static const uint32_t firstLevelCount = 40;
+    static const uint32_t nullRange = UINT32_MAX;
+
+    static const VkDeviceSize defaultBlockSize = VkDeviceSize(64) << 20;
+    static const VkDeviceSize smallHeapSize = VkDeviceSize(1) << 30;
+
+    static uint32_t log2Floor(uint64_t value)
+    {
+        uint32_t result = 0;
+        while (value >>= 1) {
+            result++;
+        }
+        return result;
+    }
+
+    static uint32_t lowestBit(uint64_t value)
+    {
+        uint32_t result = 0;
+        while ((value & 1) == 0) {
+            value >>= 1;
+            result++;
+        }
+        return result;
+    }
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static void atomicMax(std::atomic<VkDeviceSize>& target, VkDeviceSize value)
+    {
+        VkDeviceSize current = target.load(std::memory_order_relaxed);
+        while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    static VkImageAspectFlags getAspectMask(VkFormat format)
+    {
+        switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+    }
+
+    const char* getTagName(Tag tag)
+    {
+        switch (tag) {
+        case Tag::Texture: return "textures";
+        case Tag::Mesh: return "meshes";
+        case Tag::Uniform: return "uniforms";
+        case Tag::Staging: return "staging";
+        case Tag::Attachment: return "attachments";
+        default: return "other";
+        }
+    }
+
+    // Two level segregated fit over one VkDeviceMemory. Free ranges are kept in lists by size class, the first
+    // level is the power of two, the second splits it linearly. Both levels have bitmaps so finding a list
+    // that fits is constant time, neighbours are merged on free.
+    class MemoryBlock {
+
+    public:
+        MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, uint8_t* mapped)
+            : memory(memory), size(size), mapped(mapped)
+        {
+            for (auto& heads : m_heads) {
+                std::fill(std::begin(heads), std::end(heads), nullRange);
+            }
+            const uint32_t range = newRange();
+            m_ranges[range].offset = 0;
+            m_ranges[range].size = size;
+            insertFree(range);
+        }
+
+        bool allocate(VkDeviceSize requestSize, VkDeviceSize alignment, uint32_t& range, VkDeviceSize& offset)
+        {
+            requestSize = alignUp(requestSize, minRangeSize);
+            alignment = std::max(alignment, minRangeSize);
+            range = findFree(requestSize + alignment - minRangeSize);
+            if (range == nullRange) {
+                return false;
+            }
+            removeFree(range);
+
+            // Front padding of larger alignments stays free
+            const VkDeviceSize padding = alignUp(m_ranges[range].offset, alignment) - m_ranges[range].offset;
+            if (padding > 0) {
+                const uint32_t front = newRange();
+                Range& current = m_ranges[range];
+                m_ranges[front].offset = current.offset;
+                m_ranges[front].size = padding;
+                m_ranges[front].prevPhysical = current.prevPhysical;
+                m_ranges[front].nextPhysical = range;
+                if (current.prevPhysical != nullRange) {
+                    m_ranges[current.prevPhysical].nextPhysical = front;
+                }
+                current.prevPhysical = front;
+                current.offset += padding;
+                current.size -= padding;
+                insertFree(front);
+            }
+            if (m_ranges[range].size > requestSize) {
+                const uint32_t back = newRange();
+                Range& current = m_ranges[range];
+                m_ranges[back].offset = current.offset + requestSize;
+                m_ranges[back].size = current.size - requestSize;
+                m_ranges[back].prevPhysical = range;
+                m_ranges[back].nextPhysical = current.nextPhysical;
+                if (current.nextPhysical != nullRange) {
+                    m_ranges[current.nextPhysical].prevPhysical = back;
+                }
+                current.nextPhysical = back;
+                current.size = requestSize;
+                insertFree(back);
+            }
+
+            m_ranges[range].free = false;
+            offset = m_ranges[range].offset;
+            used += requestSize;
+            allocations++;
+            return true;
+        }
+
+        void free(uint32_t range)
+        {
+            assert(!m_ranges[range].free);
+            used -= m_ranges[range].size;
+            allocations--;
+            m_ranges[range].free = true;
+
+            const uint32_t prev = m_ranges[range].prevPhysical;
+            if (prev != nullRange && m_ranges[prev].free) {
+                removeFree(prev);
+                m_ranges[prev].size += m_ranges[range].size;
+                m_ranges[prev].nextPhysical = m_ranges[range].nextPhysical;
+                if (m_ranges[range].nextPhysical != nullRange) {
+                    m_ranges[m_ranges[range].nextPhysical].prevPhysical = prev;
+                }
+                releaseRange(range);
+                range = prev;
+            }
+            const uint32_t next = m_ranges[range].nextPhysical;
+            if (next != nullRange && m_ranges[next].free) {
+                removeFree(next);
+                m_ranges[range].size += m_ranges[next].size;
+                m_ranges[range].nextPhysical = m_ranges[next].nextPhysical;
+                if (m_ranges[next].nextPhysical != nullRange) {
+                    m_ranges[m_ranges[next].nextPhysical].prevPhysical = range;
+                }
+                releaseRange(next);
+            }
+            insertFree(range);
+        }
+
+        void getFreeRanges(uint32_t& count, VkDeviceSize& largest) const
+        {
+            count = 0;
+            largest = 0;
+            for (size_t i = 0; i < m_ranges.size(); i++) {
+                if (m_ranges[i].free && m_ranges[i].size > 0) {
+                    count++;
+                    largest = std::max(largest, m_ranges[i].size);
+                }
+            }
+        }
+
+        const VkDeviceMemory memory;
+        const VkDeviceSize size;
+        uint8_t* const mapped;
+        VkDeviceSize used = 0;
+        uint32_t allocations = 0;
+
+    private:
+        struct Range {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            uint32_t prevPhysical = nullRange;
+            uint32_t nextPhysical = nullRange;
+            uint32_t prevFree = nullRange;
+            uint32_t nextFree = nullRange;
+            bool free = false;
+        };
+
+        static void mapping(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel)
+        {
+            const uint32_t log2 = log2Floor(size);
+            firstLevel = log2 - minRangeLog2;
+            secondLevel = static_cast<uint32_t>(size >> (log2 - secondLevelLog2)) - secondLevelCount;
+        }
+
+        uint32_t findFree(VkDeviceSize size) const
+        {
+            // Rounded up to the next class, every range in the list found is then large enough
+            size += (VkDeviceSize(1) << (log2Floor(size) - secondLevelLog2)) - 1;
+            uint32_t firstLevel, secondLevel;
+            mapping(size, firstLevel, secondLevel);
+            if (firstLevel >= firstLevelCount) {
+                return nullRange;
+            }
+
+            uint32_t secondLevelMap = m_secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+            if (secondLevelMap == 0) {
+                const uint64_t firstLevelMap = m_firstLevelBitmap & (~0ull << (firstLevel + 1));
+                if (firstLevelMap == 0) {
+                    return nullRange;
+                }
+                firstLevel = lowestBit(firstLevelMap);
+                secondLevelMap = m_secondLevelBitmaps[firstLevel];
+            }
+            return m_heads[firstLevel][lowestBit(secondLevelMap)];
+        }
+
+        void insertFree(uint32_t range)
+        {
+            uint32_t firstLevel, secondLevel;
+            mapping(m_ranges[range].size, firstLevel, secondLevel);
+            const uint32_t head = m_heads[firstLevel][secondLevel];
+            m_ranges[range].free = true;
+            m_ranges[range].prevFree = nullRange;
+            m_ranges[range].nextFree = head;
+            if (head != nullRange) {
+                m_ranges[head].prevFree = range;
+            }
+            m_heads[firstLevel][secondLevel] = range;
+            m_firstLevelBitmap |= 1ull << firstLevel;
+            m_secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+        }
+
+        void removeFree(uint32_t range)
+        {
+            uint32_t firstLevel, secondLevel;
+            mapping(m_ranges[range].size, firstLevel, secondLevel);
+            const Range& current = m_ranges[range];
+            if (current.prevFree != nullRange) {
+                m_ranges[current.prevFree].nextFree = current.nextFree;
+            }
+            else {
+                m_heads[firstLevel][secondLevel] = current.nextFree;
+            }
+            if (current.nextFree != nullRange) {
+                m_ranges[current.nextFree].prevFree = current.prevFree;
+            }
+            if (m_heads[firstLevel][secondLevel] == nullRange) {
+                m_secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+                if (m_secondLevelBitmaps[firstLevel] == 0) {
+                    m_firstLevelBitmap &= ~(1ull << firstLevel);
+                }
+            }
+        }
+
+        uint32_t newRange()
+        {
+            if (!m_unusedRanges.empty()) {
+                const uint32_t range = m_unusedRanges.back();
+                m_unusedRanges.pop_back();
+                m_ranges[range] = Range{};
+                return range;
+            }
+            m_ranges.push_back(Range{});
+            return static_cast<uint32_t>(m_ranges.size() - 1);
+        }
+
+        void releaseRange(uint32_t range)
+        {
+            m_ranges[range] = Range{};
+            m_unusedRanges.push_back(range);
+        }
+
+        std::vector<Range> m_ranges;
+        std::vector<uint32_t> m_unusedRanges;
+        uint64_t m_firstLevelBitmap = 0;
+        uint32_t m_secondLevelBitmaps[firstLevelCount] = {};
+        uint32_t m_heads[firstLevelCount][secondLevelCount];
+    };
+
+    Allocator::~Allocator()
+    {
+        destroy();
+    }
+
+    void Allocator::create(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget)
+    {
+        m_physicalDevice = physicalDevice;
+        m_device = device;
+        m_memoryBudgetSupported = memoryBudget;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_bufferImageGranularity = properties.limits.bufferImageGranularity;
+        m_nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+        m_maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+        m_deviceMemoryCount = 0;
+        m_deviceBytes = 0;
+        m_peakDeviceBytes = 0;
+        m_liveBytes = 0;
+        m_peakLiveBytes = 0;
+        m_movedAllocations = 0;
+        m_movedBytes = 0;
+        for (auto& bytes : m_heapBytes) {
+            bytes = 0;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(Tag::Count); i++) {
+            m_tagAllocations[i] = 0;
+            m_tagBytes[i] = 0;
+            m_tagPeakBytes[i] = 0;
+        }
+
+        m_pools.resize(m_memoryProperties.memoryTypeCount * 4);
+        for (uint32_t i = 0; i < m_pools.size(); i++) {
+            auto pool = std::make_unique<Pool>();
+            pool->index = i;
+            pool->memoryTypeIndex = i >> 2;
+            pool->kind = (i & 2) ? ResourceKind::Optimal : ResourceKind::Linear;
+            pool->flags = (i & 1) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+            // Small heaps are split in eight so one pool can't take all of it
+            const VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[pool->memoryTypeIndex].heapIndex].size;
+            pool->blockSize = heapSize <= smallHeapSize ? alignUp(heapSize / 8, minRangeSize) : defaultBlockSize;
+            m_pools[i] = std::move(pool);
+        }
+    }
+
+    void Allocator::destroy()
+    {
+        for (auto& pool : m_pools) {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            for (Move& move : pool->moves) {
+                vkDestroyBuffer(m_device, move.buffer, nullptr);
+                vkDestroyImage(m_device, move.image, nullptr);
+                freeLocked(*pool, move.destination);
+            }
+            pool->moves.clear();
+            pool->movables.clear();
+        }
+        m_defragmentedPool = nullptr;
+        releaseRetired(UINT64_MAX);
+
+        uint32_t allocations = 0;
+        for (auto& pool : m_pools) {
+            allocations += pool->allocations;
+            for (MemoryBlock* block : pool->blocks) {
+                freeMemory(block->memory, block->size, pool->memoryTypeIndex);
+                delete block;
+            }
+        }
+        if (allocations > 0) {
+            std::cerr << "Allocator destroyed with " << allocations << " live allocations" << std::endl;
+        }
+        m_pools.clear();
+    }
+
+    Allocation Allocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, ResourceKind kind, VkMemoryAllocateFlags flags, Tag tag)
+    {
+        Allocation allocation;
+        allocation.allocator = this;
+        allocation.pool = getPoolIndex(memoryTypeIndex, kind, flags);
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.size = requirements.size;
+        allocation.tag = tag;
+
+        VkDeviceSize alignment = requirements.alignment;
+        // Flushed ranges are widened to whole atoms, they must not reach into a neighbour
+        if (isHostVisible(memoryTypeIndex) && !isHostCoherent(memoryTypeIndex)) {
+            alignment = std::max(alignment, m_nonCoherentAtomSize);
+        }
+
+        Pool& pool = *m_pools[allocation.pool];
+        if (requirements.size <= pool.blockSize / 2) {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            for (MemoryBlock* block : pool.blocks) {
+                if (block->size - block->used >= requirements.size && block->allocate(requirements.size, alignment, allocation.range, allocation.offset)) {
+                    allocation.block = block;
+                    break;
+                }
+            }
+            if (allocation.block == nullptr) {
+                uint8_t* mapped = nullptr;
+                VkDeviceMemory memory = allocateMemory(pool.blockSize, memoryTypeIndex, flags, &mapped);
+                MemoryBlock* block = new MemoryBlock(memory, pool.blockSize, mapped);
+                pool.blocks.push_back(block);
+                block->allocate(requirements.size, alignment, allocation.range, allocation.offset);
+                allocation.block = block;
+            }
+            allocation.memory = allocation.block->memory;
+            allocation.mapped = allocation.block->mapped ? allocation.block->mapped + allocation.offset : nullptr;
+            pool.usedBytes += requirements.size;
+            pool.allocations++;
+        }
+        else {
+            allocation.memory = allocateMemory(requirements.size, memoryTypeIndex, flags, &allocation.mapped);
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.dedicatedAllocations++;
+            pool.dedicatedBytes += requirements.size;
+            pool.allocations++;
+        }
+        trackAllocation(allocation);
+        return allocation;
+    }
+
+    void Allocator::trackAllocation(const Allocation& allocation)
+    {
+        const size_t tag = static_cast<size_t>(allocation.tag);
+        atomicMax(m_peakLiveBytes, m_liveBytes.fetch_add(allocation.size, std::memory_order_relaxed) + allocation.size);
+        m_tagAllocations[tag].fetch_add(1, std::memory_order_relaxed);
+        atomicMax(m_tagPeakBytes[tag], m_tagBytes[tag].fetch_add(allocation.size, std::memory_order_relaxed) + allocation.size);
+    }
+
+    void Allocator::untrackAllocation(const Allocation& allocation)
+    {
+        const size_t tag = static_cast<size_t>(allocation.tag);
+        m_liveBytes.fetch_sub(allocation.size, std::memory_order_relaxed);
+        m_tagAllocations[tag].fetch_sub(1, std::memory_order_relaxed);
+        m_tagBytes[tag].fetch_sub(allocation.size, std::memory_order_relaxed);
+    }
+
+    void Allocator::free(Allocation& allocation)
+    {
+        if (!allocation.valid()) {
+            return;
+        }
+        Pool& pool = *m_pools[allocation.pool];
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        freeLocked(pool, allocation);
+    }
+
+    void Allocator::freeLocked(Pool& pool, Allocation& allocation)
+    {
+        if (allocation.block != nullptr) {
+            MemoryBlock* block = allocation.block;
+            const RangeKey key(block, allocation.range);
+            pool.movables.erase(key);
+            for (Move& move : pool.moves) {
+                if (move.source == key) {
+                    move.cancelled = true;
+                }
+            }
+            block->free(allocation.range);
+            pool.usedBytes -= allocation.size;
+
+            // Empty blocks go back to the driver, except the last one of a pool
+            if (block->allocations == 0 && pool.blocks.size() > 1) {
+                freeMemory(block->memory, block->size, pool.memoryTypeIndex);
+                pool.blocks.erase(std::find(pool.blocks.begin(), pool.blocks.end(), block));
+                delete block;
+            }
+        }
+        else {
+            freeMemory(allocation.memory, allocation.size, allocation.memoryTypeIndex);
+            pool.dedicatedAllocations--;
+            pool.dedicatedBytes -= allocation.size;
+        }
+        pool.allocations--;
+        untrackAllocation(allocation);
+        allocation = Allocation{};
+    }
+
+    void Allocator::flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (!allocation.valid() || !isHostVisible(allocation.memoryTypeIndex) || isHostCoherent(allocation.memoryTypeIndex)) {
+            return;
+        }
+        if (size == VK_WHOLE_SIZE) {
+            size = allocation.size - offset;
+        }
+        const VkDeviceSize begin = (allocation.offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+        const VkDeviceSize end = alignUp(allocation.offset + offset + size, m_nonCoherentAtomSize);
+        const VkDeviceSize memorySize = allocation.block ? allocation.block->size : allocation.size;
+
+        VkMappedMemoryRange mappedRange{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
+        mappedRange.memory = allocation.memory;
+        mappedRange.offset = begin;
+        mappedRange.size = end < memorySize ? end - begin : VK_WHOLE_SIZE;
+        VK_CHECK(vkFlushMappedMemoryRanges(m_device, 1, &mappedRange));
+    }
+
+    Allocator::Stats Allocator::getStats()
+    {
+        Stats stats;
+        for (auto& pool : m_pools) {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            stats.blocks += static_cast<uint32_t>(pool->blocks.size());
+            stats.blockBytes += pool->blocks.size() * pool->blockSize;
+            stats.allocations += pool->allocations;
+            stats.dedicatedAllocations += pool->dedicatedAllocations;
+            stats.usedBytes += pool->usedBytes;
+            stats.dedicatedBytes += pool->dedicatedBytes;
+        }
+        stats.peakUsedBytes = m_peakLiveBytes;
+        stats.peakDeviceBytes = m_peakDeviceBytes;
+        stats.deviceMemoryCount = m_deviceMemoryCount;
+        stats.movedAllocations = m_movedAllocations;
+        stats.movedBytes = m_movedBytes;
+        for (size_t i = 0; i < static_cast<size_t>(Tag::Count); i++) {
+            stats.tags[i].allocations = m_tagAllocations[i];
+            stats.tags[i].bytes = m_tagBytes[i];
+            stats.tags[i].peakBytes = m_tagPeakBytes[i];
+        }
+        return stats;
+    }
+
+    std::vector<Allocator::HeapBudget> Allocator::getHeapBudgets()
+    {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+        if (m_memoryBudgetSupported) {
+            VkPhysicalDeviceMemoryProperties2 properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+            properties.pNext = &budgetProperties;
+            vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &properties);
+        }
+
+        std::vector<HeapBudget> budgets(m_memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; i++) {
+            HeapBudget& budget = budgets[i];
+            budget.flags = m_memoryProperties.memoryHeaps[i].flags;
+            budget.size = m_memoryProperties.memoryHeaps[i].size;
+            budget.allocatorBytes = m_heapBytes[i];
+            if (m_memoryBudgetSupported) {
+                budget.usage = budgetProperties.heapUsage[i];
+                budget.budget = budgetProperties.heapBudget[i];
+            }
+            else {
+                budget.usage = budget.allocatorBytes;
+                budget.budget = budget.size / 10 * 8;
+            }
+        }
+        return budgets;
+    }
+
+    std::string Allocator::getMemoryReport()
+    {
+        const std::vector<HeapBudget> budgets = getHeapBudgets();
+        const Stats stats = getStats();
+
+        std::ostringstream report;
+        for (size_t i = 0; i < budgets.size(); i++) {
+            const HeapBudget& budget = budgets[i];
+            report << "Heap " << i << ((budget.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "") << ": "
+                << (budget.usage >> 20) << " of " << (budget.budget >> 20) << " MiB budget used, "
+                << (budget.allocatorBytes >> 20) << " MiB by this allocator, heap " << (budget.size >> 20) << " MiB"
+                << (m_memoryBudgetSupported ? "" : " (estimated)") << "\n";
+        }
+        report << "Allocations: " << stats.allocations << ", " << ((stats.usedBytes + stats.dedicatedBytes) >> 10)
+            << " KiB used, peak " << (stats.peakUsedBytes >> 10) << " KiB, device memory "
+            << ((stats.blockBytes + stats.dedicatedBytes) >> 10) << " KiB, peak " << (stats.peakDeviceBytes >> 10) << " KiB\n";
+        for (size_t i = 0; i < static_cast<size_t>(Tag::Count); i++) {
+            const TagStats& tag = stats.tags[i];
+            report << "  " << getTagName(static_cast<Tag>(i)) << ": " << tag.allocations << " allocations, "
+                << (tag.bytes >> 10) << " KiB, peak " << (tag.peakBytes >> 10) << " KiB\n";
+        }
+        if (stats.movedAllocations > 0) {
+            report << "Defragmentation moved " << stats.movedAllocations << " allocations, " << (stats.movedBytes >> 10) << " KiB\n";
+        }
+        return report.str();
+    }
+
+    std::string Allocator::getFragmentationReport()
+    {
+        const Stats stats = getStats();
+        std::ostringstream report;
+        report << "Device memory: " << stats.deviceMemoryCount << " of " << m_maxAllocationCount << " allocations, "
+            << stats.blocks << " blocks, " << stats.dedicatedAllocations << " dedicated ("
+            << (stats.dedicatedBytes >> 10) << " KiB)\n";
+        for (auto& entry : m_pools) {
+            Pool& pool = *entry;
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            if (pool.blocks.empty()) {
+                continue;
+            }
+            report << "  type " << pool.memoryTypeIndex << (pool.kind == ResourceKind::Linear ? " linear" : " optimal")
+                << (pool.flags ? " device address" : "") << ", " << pool.blocks.size() << " blocks of " << (pool.blockSize >> 20) << " MiB\n";
+            for (size_t i = 0; i < pool.blocks.size(); i++) {
+                const MemoryBlock* block = pool.blocks[i];
+                uint32_t freeRanges;
+                VkDeviceSize largestFree;
+                block->getFreeRanges(freeRanges, largestFree);
+                const VkDeviceSize freeBytes = block->size - block->used;
+                // Share of the free space not usable by a single request
+                const float fragmentation = freeBytes > 0 ? 1.0f - float(largestFree) / float(freeBytes) : 0.0f;
+                report << "    block " << i << ": " << block->allocations << " allocations, "
+                    << (block->used >> 10) << " of " << (block->size >> 10) << " KiB used, "
+                    << freeRanges << " free ranges, largest " << (largestFree >> 10) << " KiB, fragmentation "
+                    << static_cast<int>(fragmentation * 100.0f + 0.5f) << "%\n";
+            }
+        }
+        return report.str();
+    }
+
+    void Allocator::setMovable(const Allocation& allocation, const Movable& movable)
+    {
+        // Dedicated allocations have nothing to be compacted into
+        if (allocation.block == nullptr) {
+            return;
+        }
+        assert((movable.buffer != VK_NULL_HANDLE) != (movable.image != VK_NULL_HANDLE));
+        Pool& pool = *m_pools[allocation.pool];
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        MovableEntry entry{ allocation, movable };
+        entry.movable.bufferInfo.pNext = nullptr;
+        entry.movable.imageInfo.pNext = nullptr;
+        pool.movables[RangeKey(allocation.block, allocation.range)] = entry;
+    }
+
+    bool Allocator::beginDefragmentation(VkCommandBuffer commandBuffer, float threshold, VkDeviceSize maxBytes)
+    {
+        assert(m_defragmentedPool == nullptr);
+
+        // Share of the free space of a pool that no single request can use
+        Pool* source = nullptr;
+        float worst = threshold;
+        for (auto& entry : m_pools) {
+            Pool& pool = *entry;
+            if (isHostVisible(pool.memoryTypeIndex)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            VkDeviceSize freeBytes = 0;
+            VkDeviceSize largestFree = 0;
+            for (const MemoryBlock* block : pool.blocks) {
+                uint32_t freeRanges;
+                VkDeviceSize blockLargest;
+                block->getFreeRanges(freeRanges, blockLargest);
+                freeBytes += block->size - block->used;
+                largestFree = std::max(largestFree, blockLargest);
+            }
+            const float fragmentation = freeBytes > 0 ? 1.0f - float(largestFree) / float(freeBytes) : 0.0f;
+            if (fragmentation > worst) {
+                worst = fragmentation;
+                source = &pool;
+            }
+        }
+        if (source == nullptr) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(source->mutex);
+        // Emptying the least used block first, a block that ends up empty goes back to the driver
+        MemoryBlock* sourceBlock = nullptr;
+        for (MemoryBlock* block : source->blocks) {
+            auto it = source->movables.lower_bound(RangeKey(block, 0));
+            if (it != source->movables.end() && it->first.first == block && (sourceBlock == nullptr || block->used < sourceBlock->used)) {
+                sourceBlock = block;
+            }
+        }
+        if (sourceBlock == nullptr) {
+            return false;
+        }
+
+        VkDeviceSize movedBytes = 0;
+        for (auto it = source->movables.lower_bound(RangeKey(sourceBlock, 0)); it != source->movables.end() && it->first.first == sourceBlock; ++it) {
+            if (movedBytes + it->second.allocation.size > maxBytes && movedBytes > 0) {
+                break;
+            }
+            Move move;
+            move.source = it->first;
+            if (recordMove(commandBuffer, *source, it->second, move)) {
+                movedBytes += it->second.allocation.size;
+                source->moves.push_back(move);
+            }
+        }
+        if (source->moves.empty()) {
+            return false;
+        }
+        m_defragmentedPool = source;
+
+        // Later submissions read the copies
+        VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        return true;
+    }
+
+    bool Allocator::allocateMoveDestination(Pool& pool, const MovableEntry& entry, const VkMemoryRequirements& requirements, Allocation& destination)
+    {
+        if (((requirements.memoryTypeBits >> pool.memoryTypeIndex) & 1) == 0) {
+            return false;
+        }
+        const Allocation& source = entry.allocation;
+        destination = Allocation{};
+        destination.allocator = this;
+        destination.pool = pool.index;
+        destination.memoryTypeIndex = pool.memoryTypeIndex;
+        destination.size = requirements.size;
+        destination.tag = source.tag;
+
+        // Other blocks first, otherwise lower in the same block. Never a new block, that would only grow the pool
+        for (MemoryBlock* block : pool.blocks) {
+            if (block == source.block || block->size - block->used < requirements.size) {
+                continue;
+            }
+            if (block->allocate(requirements.size, requirements.alignment, destination.range, destination.offset)) {
+                destination.block = block;
+                break;
+            }
+        }
+        if (destination.block == nullptr) {
+            if (!source.block->allocate(requirements.size, requirements.alignment, destination.range, destination.offset)) {
+                return false;
+            }
+            if (destination.offset >= source.offset) {
+                source.block->free(destination.range);
+                return false;
+            }
+            destination.block = source.block;
+        }
+        destination.memory = destination.block->memory;
+        pool.usedBytes += requirements.size;
+        pool.allocations++;
+        trackAllocation(destination);
+        return true;
+    }
+
+    bool Allocator::recordMove(VkCommandBuffer commandBuffer, Pool& pool, const MovableEntry& entry, Move& move)
+    {
+        const Movable& movable = entry.movable;
+        VkMemoryRequirements requirements;
+        if (movable.buffer != VK_NULL_HANDLE) {
+            VK_CHECK(vkCreateBuffer(m_device, &movable.bufferInfo, nullptr, &move.buffer));
+            vkGetBufferMemoryRequirements(m_device, move.buffer, &requirements);
+        }
+        else {
+            VK_CHECK(vkCreateImage(m_device, &movable.imageInfo, nullptr, &move.image));
+            vkGetImageMemoryRequirements(m_device, move.image, &requirements);
+        }
+        if (!allocateMoveDestination(pool, entry, requirements, move.destination)) {
+            vkDestroyBuffer(m_device, move.buffer, nullptr);
+            vkDestroyImage(m_device, move.image, nullptr);
+            return false;
+        }
+
+        if (move.buffer != VK_NULL_HANDLE) {
+            VK_CHECK(vkBindBufferMemory(m_device, move.buffer, move.destination.memory, move.destination.offset));
+            VkBufferCopy region{ 0, 0, movable.bufferInfo.size };
+            vkCmdCopyBuffer(commandBuffer, movable.buffer, move.buffer, 1, &region);
+            return true;
+        }
+
+        VK_CHECK(vkBindImageMemory(m_device, move.image, move.destination.memory, move.destination.offset));
+        const VkImageCreateInfo& info = movable.imageInfo;
+        const VkImageAspectFlags aspectMask = getAspectMask(info.format);
+        const VkImageSubresourceRange range{ aspectMask, 0, info.mipLevels, 0, info.arrayLayers };
+
+        std::array<VkImageMemoryBarrier, 2> barriers{};
+        for (auto& barrier : barriers) {
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.subresourceRange = range;
+        }
+        barriers[0].image = movable.image;
+        barriers[0].oldLayout = movable.layout;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[1].image = move.image;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        std::vector<VkImageCopy> regions(info.mipLevels);
+        for (uint32_t level = 0; level < info.mipLevels; level++) {
+            VkImageCopy& region = regions[level];
+            region.srcSubresource = { aspectMask, level, 0, info.arrayLayers };
+            region.dstSubresource = region.srcSubresource;
+            region.extent.width = std::max(1u, info.extent.width >> level);
+            region.extent.height = std::max(1u, info.extent.height >> level);
+            region.extent.depth = std::max(1u, info.extent.depth >> level);
+        }
+        vkCmdCopyImage(commandBuffer, movable.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, move.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
+
+        // The original stays in use until the owner switched over
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].newLayout = movable.layout;
+        barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].newLayout = movable.layout;
+        barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+        return true;
+    }
+
+    void Allocator::endDefragmentation(uint64_t releaseFrame)
+    {
+        Pool* pool = m_defragmentedPool;
+        if (pool == nullptr) {
+            return;
+        }
+        std::vector<std::pair<Movable, Allocation>> moved;
+        {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            for (Move& move : pool->moves) {
+                if (move.cancelled) {
+                    vkDestroyBuffer(m_device, move.buffer, nullptr);
+                    vkDestroyImage(m_device, move.image, nullptr);
+                    freeLocked(*pool, move.destination);
+                    continue;
+                }
+                auto it = pool->movables.find(move.source);
+                MovableEntry entry = it->second;
+                pool->movables.erase(it);
+
+                Retired retired;
+                retired.buffer = entry.movable.buffer;
+                retired.image = entry.movable.image;
+                retired.allocation = entry.allocation;
+                retired.releaseFrame = releaseFrame;
+                m_retired.push_back(retired);
+                m_movedAllocations++;
+                m_movedBytes += entry.allocation.size;
+
+                entry.allocation = move.destination;
+                entry.movable.buffer = move.buffer;
+                entry.movable.image = move.image;
+                pool->movables[RangeKey(move.destination.block, move.destination.range)] = entry;
+                moved.emplace_back(entry.movable, entry.allocation);
+            }
+            pool->moves.clear();
+        }
+        m_defragmentedPool = nullptr;
+        for (auto& entry : moved) {
+            entry.first.moved(entry.first.buffer, entry.first.image, entry.second);
+        }
+    }
+
+    void Allocator::releaseRetired(uint64_t frame)
+    {
+        std::vector<Retired> released;
+        for (auto it = m_retired.begin(); it != m_retired.end();) {
+            if (it->releaseFrame > frame) {
+                ++it;
+                continue;
+            }
+            released.push_back(*it);
+            it = m_retired.erase(it);
+        }
+        for (Retired& retired : released) {
+            vkDestroyBuffer(m_device, retired.buffer, nullptr);
+            vkDestroyImage(m_device, retired.image, nullptr);
+            free(retired.allocation);
+        }
+    }
+
+    VkDeviceMemory Allocator::allocateMemory(VkDeviceSize size, uint32_t memoryTypeIndex, VkMemoryAllocateFlags flags, uint8_t** mapped)
+    {
+        if (m_deviceMemoryCount.fetch_add(1) >= m_maxAllocationCount) {
+            m_deviceMemoryCount--;
+            throw std::runtime_error("maxMemoryAllocationCount reached!");
+        }
+
+        VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+        VkMemoryAllocateFlagsInfo allocFlagsInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO };
+        if (flags != 0) {
+            allocFlagsInfo.flags = flags;
+            allocInfo.pNext = &allocFlagsInfo;
+        }
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            m_deviceMemoryCount--;
+            throw std::runtime_error("failed to allocate memory!");
+        }
+        m_heapBytes[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+        atomicMax(m_peakDeviceBytes, m_deviceBytes.fetch_add(size, std::memory_order_relaxed) + size);
+
+        *mapped = nullptr;
+        if (isHostVisible(memoryTypeIndex)) {
+            VK_CHECK(vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(mapped)));
+        }
+        return memory;
+    }
+
+    void Allocator::freeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex)
+    {
+        // Freeing implicitly unmaps
+        vkFreeMemory(m_device, memory, nullptr);
+        m_deviceMemoryCount--;
+        m_heapBytes[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] -= size;
+        m_deviceBytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    bool Allocator::isHostVisible(uint32_t memoryTypeIndex) const
+    {
+        return (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+    }
+
+    bool Allocator::isHostCoherent(uint32_t memoryTypeIndex) const
+    {
+        return (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+
+    uint32_t Allocator::getPoolIndex(uint32_t memoryTypeIndex, ResourceKind kind, VkMemoryAllocateFlags flags) const
+    {
+        // Kinds only need pools of their own when the granularity is coarser than the range granule
+        if (m_bufferImageGranularity <= minRangeSize) {
+            kind = ResourceKind::Linear;
+        }
+        return memoryTypeIndex << 2 | (kind == ResourceKind::Optimal ? 2u : 0u) | (flags != 0 ? 1u : 0u);
+    }
 
     VkMemoryRequirements getMemoryRequirements(const VkDevice& device, const VkImage& image) {
         VkMemoryRequirements requirements;
@@ -24,47 +945,72 @@ namespace memory {
         return requirements;
     }
 
-    VkDeviceMemory allocate(const VkDevice& device, VkDeviceSize allocationSize, uint32_t memoryTypeIndex) {
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = allocationSize;
-        allocInfo.memoryTypeIndex = memoryTypeIndex;
+    Allocation allocate(Device* device, const VkImage& image, VkMemoryPropertyFlags properties, VkImageTiling tiling, Tag tag) {
+        VkMemoryRequirements requirements = getMemoryRequirements(device->getDevice(), image);
+        Allocation allocation = device->getAllocator().allocate(
+            requirements,
+            device->findMemoryType(requirements.memoryTypeBits, properties),
+            tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear,
+            0,
+            tag);
+        bind(device->getDevice(), allocation, image);
+        return allocation;
+    }
 
-        VkDeviceMemory memory;
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate memory!");
-        }
-        return memory;
+    Allocation allocate(Device* device, const VkBuffer& buffer, VkMemoryPropertyFlags properties, VkMemoryAllocateFlags flags, Tag tag) {
+        VkMemoryRequirements requirements = getMemoryRequirements(device->getDevice(), buffer);
+        Allocation allocation = device->getAllocator().allocate(
+            requirements,
+            device->findMemoryType(requirements.memoryTypeBits, properties),
+            ResourceKind::Linear,
+            flags,
+            tag);
+        bind(device->getDevice(), allocation, buffer);
+        return allocation;
     }
 
-    void bind(const VkDevice& device, const VkDeviceMemory& memory, VkDeviceSize offset, const VkImage& image) {
-        {
-            std::lock_guard<std::mutex> lock(imageMutex);
-            vkBindImageMemory(device, image, memory, offset);
+    Tag getBufferTag(VkBufferUsageFlags usage) {
+        if (usage & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT)) {
+            return Tag::Mesh;
+        }
+        if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+            return Tag::Uniform;
+        }
+        if (usage == VK_BUFFER_USAGE_TRANSFER_SRC_BIT) {
+            return Tag::Staging;
         }
+        return Tag::Other;
     }
 
-    void bind(const VkDevice& device, const VkDeviceMemory& memory, VkDeviceSize offset, const VkBuffer& buffer) {
-        {
-            std::lock_guard<std::mutex> lock(imageMutex);
-            vkBindBufferMemory(device, buffer, memory, offset);
+    void free(Allocation& allocation) {
+        if (allocation.allocator != nullptr) {
+            allocation.allocator->free(allocation);
         }
     }
 
-    void map(const VkDevice& device, const VkDeviceMemory& memory, VkDeviceSize offset, VkDeviceSize size, void** data) {
-        {
-            assert(data);
+    void bind(const VkDevice& device, const Allocation& allocation, const VkImage& image) {
+        // Only the resource needs external synchronization, threads bind their own without waiting on each other
+        VK_CHECK(vkBindImageMemory(device, image, allocation.memory, allocation.offset));
+    }
 
-            std::lock_guard<std::mutex> lock(memMutex);
-            auto res = vkMapMemory(device, memory, offset, size, 0, data);
-            assert(res == VK_SUCCESS);
-        }
+    void bind(const VkDevice& device, const Allocation& allocation, const VkBuffer& buffer) {
+        VK_CHECK(vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset));
     }
 
-    void unmap(const VkDevice& device, const VkDeviceMemory& memory) {
-        {
-            std::lock_guard<std::mutex> lock(memMutex);
-            vkUnmapMemory(device, memory);
+    void map(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size, void** data) {
+        assert(data);
+        assert(allocation.mapped != nullptr);
+        assert(size == VK_WHOLE_SIZE || offset + size <= allocation.size);
+        *data = allocation.mapped + offset;
+    }
+
+    void unmap(const Allocation& allocation) {
+        // Stays mapped until it is freed
+    }
+
+    void flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+        if (allocation.allocator != nullptr) {
+            allocation.allocator->flush(allocation, offset, size);
         }
     }
-}
\ No newline at end of file
+}
@@ -7,12 +7,227 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 
+struct Device;
+
 namespace memory {
+
+    class Allocator;
+    class MemoryBlock;
+
+    // Buffers and linear images may not share a bufferImageGranularity page with optimal images
+    enum class ResourceKind {
+        Linear,
+        Optimal
+    };
+
+    // What an allocation is used for, the allocator keeps totals per tag
+    enum class Tag {
+        Other,
+        Texture,
+        Mesh,
+        Uniform,
+        Staging,
+        Attachment,
+        Count
+    };
+
+    const char* getTagName(Tag tag);
+
+    // Range of a block handed out by the allocator, or a dedicated VkDeviceMemory when block is null
+    struct Allocation {
+        Allocator* allocator = nullptr;
+        MemoryBlock* block = nullptr;
+        uint32_t range = 0;
+        // Pool of the allocator it came from, for blocks and dedicated memory alike
+        uint32_t pool = 0;
+        uint32_t memoryTypeIndex = 0;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        Tag tag = Tag::Other;
+        // Host visible memory stays mapped, this points at offset
+        uint8_t* mapped = nullptr;
+
+        bool valid() const { return memory != VK_NULL_HANDLE; }
+    };
+
+    // Large blocks per memory type, sub-allocated with a two level segregated fit allocator. Requests larger
+    // than half a block get memory of their own. Every pool has a lock of its own and the totals are atomic,
+    // so threads creating resources only wait for each other when they allocate from the same pool
+    class Allocator {
+
+    public:
+        struct TagStats {
+            uint32_t allocations = 0;
+            VkDeviceSize bytes = 0;
+            VkDeviceSize peakBytes = 0;
+        };
+
+        struct Stats {
+            uint32_t blocks = 0;
+            uint32_t allocations = 0;
+            uint32_t dedicatedAllocations = 0;
+            VkDeviceSize blockBytes = 0;
+            VkDeviceSize usedBytes = 0;
+            VkDeviceSize dedicatedBytes = 0;
+            // Highest usedBytes + dedicatedBytes and blockBytes + dedicatedBytes so far
+            VkDeviceSize peakUsedBytes = 0;
+            VkDeviceSize peakDeviceBytes = 0;
+            // vkAllocateMemory calls alive, counted against maxMemoryAllocationCount
+            uint32_t deviceMemoryCount = 0;
+            uint32_t movedAllocations = 0;
+            VkDeviceSize movedBytes = 0;
+            TagStats tags[static_cast<size_t>(Tag::Count)];
+        };
+
+        // From VK_EXT_memory_budget when the device has it. Without it usage is what this allocator holds
+        // and the budget is 80% of the heap
+        struct HeapBudget {
+            VkMemoryHeapFlags flags = 0;
+            VkDeviceSize size = 0;
+            VkDeviceSize usage = 0;
+            VkDeviceSize budget = 0;
+            // Device memory of this allocator in the heap, blocks and dedicated allocations
+            VkDeviceSize allocatorBytes = 0;
+        };
+
+        // How the defragmenter recreates a resource somewhere else. Buffers need TRANSFER_SRC and TRANSFER_DST usage,
+        // images are copied whole and are in layout whenever the frame isn't recording. Set either buffer or image,
+        // moved() hands the owner the new handle and allocation once the copy completed, the old ones belong to the
+        // allocator from then on
+        struct Movable {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkBufferCreateInfo bufferInfo{};
+            VkImage image = VK_NULL_HANDLE;
+            VkImageCreateInfo imageInfo{};
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            std::function<void(VkBuffer buffer, VkImage image, const Allocation& allocation)> moved;
+        };
+
+        Allocator() = default;
+        ~Allocator();
+        Allocator(const Allocator&) = delete;
+        Allocator& operator=(const Allocator&) = delete;
+
+        void create(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget = false);
+        void destroy();
+
+        Allocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, ResourceKind kind, VkMemoryAllocateFlags flags = 0, Tag tag = Tag::Other);
+        void free(Allocation& allocation);
+        // Rounds the range out to nonCoherentAtomSize, nothing to do for coherent memory
+        void flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+        Stats getStats();
+        std::vector<HeapBudget> getHeapBudgets();
+        // Budget and usage per heap, then live and peak bytes per tag
+        std::string getMemoryReport();
+        // One line per pool and block, with used bytes, free ranges and how much of the free space is usable at once
+        std::string getFragmentationReport();
+
+        // Lets the defragmenter move a device local allocation, until it is freed
+        void setMovable(const Allocation& allocation, const Movable& movable);
+        // Picks the device local pool whose free space is the most fragmented, if that is above threshold, and records
+        // copies of up to maxBytes of movable allocations out of its emptiest block. Returns false if nothing was recorded
+        bool beginDefragmentation(VkCommandBuffer commandBuffer, float threshold, VkDeviceSize maxBytes);
+        // Once commandBuffer completed. Owners switch to the copies, the originals are released by releaseRetired(releaseFrame)
+        void endDefragmentation(uint64_t releaseFrame);
+        void releaseRetired(uint64_t frame);
+
+    private:
+        using RangeKey = std::pair<MemoryBlock*, uint32_t>;
+
+        struct MovableEntry {
+            Allocation allocation;
+            Movable movable;
+        };
+
+        struct Move {
+            RangeKey source;
+            Allocation destination;
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkImage image = VK_NULL_HANDLE;
+            // The owner freed the original while it was being copied
+            bool cancelled = false;
+        };
+
+        struct Retired {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkImage image = VK_NULL_HANDLE;
+            Allocation allocation;
+            uint64_t releaseFrame = 0;
+        };
+
+        // Everything below is guarded by mutex
+        struct Pool {
+            uint32_t index = 0;
+            uint32_t memoryTypeIndex = 0;
+            ResourceKind kind = ResourceKind::Linear;
+            VkMemoryAllocateFlags flags = 0;
+            VkDeviceSize blockSize = 0;
+            std::vector<MemoryBlock*> blocks;
+            uint32_t allocations = 0;
+            uint32_t dedicatedAllocations = 0;
+            VkDeviceSize usedBytes = 0;
+            VkDeviceSize dedicatedBytes = 0;
+            std::map<RangeKey, MovableEntry> movables;
+            // Copies of the defragmentation pass in flight
+            std::vector<Move> moves;
+            std::mutex mutex;
+        };
+
+        void freeLocked(Pool& pool, Allocation& allocation);
+        bool allocateMoveDestination(Pool& pool, const MovableEntry& entry, const VkMemoryRequirements& requirements, Allocation& destination);
+        bool recordMove(VkCommandBuffer commandBuffer, Pool& pool, const MovableEntry& entry, Move& move);
+        void trackAllocation(const Allocation& allocation);
+        void untrackAllocation(const Allocation& allocation);
+        VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryTypeIndex, VkMemoryAllocateFlags flags, uint8_t** mapped);
+        void freeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex);
+        bool isHostVisible(uint32_t memoryTypeIndex) const;
+        bool isHostCoherent(uint32_t memoryTypeIndex) const;
+        uint32_t getPoolIndex(uint32_t memoryTypeIndex, ResourceKind kind, VkMemoryAllocateFlags flags) const;
+
+        VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+        VkDevice m_device = VK_NULL_HANDLE;
+        bool m_memoryBudgetSupported = false;
+        VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+        VkDeviceSize m_bufferImageGranularity = 1;
+        VkDeviceSize m_nonCoherentAtomSize = 1;
+        uint32_t m_maxAllocationCount = 4096;
+        // Four per memory type, with and without device address and per resource kind. Created up front, so finding
+        // the pool of a request needs no lock
+        std::vector<std::unique_ptr<Pool>> m_pools;
+
+        std::atomic<uint32_t> m_deviceMemoryCount{ 0 };
+        std::atomic<VkDeviceSize> m_heapBytes[VK_MAX_MEMORY_HEAPS];
+        std::atomic<VkDeviceSize> m_deviceBytes{ 0 };
+        std::atomic<VkDeviceSize> m_peakDeviceBytes{ 0 };
+        std::atomic<VkDeviceSize> m_liveBytes{ 0 };
+        std::atomic<VkDeviceSize> m_peakLiveBytes{ 0 };
+        std::atomic<uint32_t> m_tagAllocations[static_cast<size_t>(Tag::Count)];
+        std::atomic<VkDeviceSize> m_tagBytes[static_cast<size_t>(Tag::Count)];
+        std::atomic<VkDeviceSize> m_tagPeakBytes[static_cast<size_t>(Tag::Count)];
+
+        // Defragmentation state, only touched by the thread that records the frames
+        Pool* m_defragmentedPool = nullptr;
+        std::vector<Retired> m_retired;
+        std::atomic<uint32_t> m_movedAllocations{ 0 };
+        std::atomic<VkDeviceSize> m_movedBytes{ 0 };
+    };
+
     VkMemoryRequirements getMemoryRequirements(const VkDevice& device, const VkImage& image);
     VkMemoryRequirements getMemoryRequirements(const VkDevice& device, const VkBuffer& buffer);
-    VkDeviceMemory allocate(const VkDevice& device, VkDeviceSize allocationSize, uint32_t memoryTypeIndex);
-    void bind(const VkDevice& device, const VkDeviceMemory& memory, VkDeviceSize offset, const VkImage& image);
-    void bind(const VkDevice& device, const VkDeviceMemory& memory, VkDeviceSize offset, const VkBuffer& buffer);
-    void map(const VkDevice& device, const VkDeviceMemory& memory, VkDeviceSize offset, VkDeviceSize size, void** data);
-    void unmap(const VkDevice& device, const VkDeviceMemory& memory);
-}
\ No newline at end of file
+
+    // Memory from the allocator of the device, bound to the resource
+    Allocation allocate(Device* device, const VkImage& image, VkMemoryPropertyFlags properties, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL, Tag tag = Tag::Texture);
+    Allocation allocate(Device* device, const VkBuffer& buffer, VkMemoryPropertyFlags properties, VkMemoryAllocateFlags flags = 0, Tag tag = Tag::Other);
+    // Tag of a buffer going by how it is used
+    Tag getBufferTag(VkBufferUsageFlags usage);
+    void free(Allocation& allocation);
+
+    void bind(const VkDevice& device, const Allocation& allocation, const VkImage& image);
+    void bind(const VkDevice& device, const Allocation& allocation, const VkBuffer& buffer);
+    // Host visible allocations are mapped for their whole lifetime, these only hand out the pointer
+    void map(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size, void** data);
+    void unmap(const Allocation& allocation);
+    void flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+}
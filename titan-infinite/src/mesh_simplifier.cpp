@@ -0,0 +1,245 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "mesh_simplifier.h"
+#include <algorithm>
+
+namespace vkglTF {
+
+	namespace {
+		// Symmetric 4x4 matrix stored as its upper triangle, and the summed weight of its planes
+		struct Quadric {
+			double a2 = 0, ab = 0, ac = 0, ad = 0;
+			double b2 = 0, bc = 0, bd = 0;
+			double c2 = 0, cd = 0;
+			double d2 = 0;
+			double weight = 0;
+
+			void addPlane(const glm::dvec3& n, double d, double weight) {
+				a2 += n.x * n.x * weight; ab += n.x * n.y * weight; ac += n.x * n.z * weight; ad += n.x * d * weight;
+				b2 += n.y * n.y * weight; bc += n.y * n.z * weight; bd += n.y * d * weight;
+				c2 += n.z * n.z * weight; cd += n.z * d * weight;
+				d2 += d * d * weight;
+				this->weight += weight;
+			}
+
+			void add(const Quadric& q) {
+				a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+				b2 += q.b2; bc += q.bc; bd += q.bd;
+				c2 += q.c2; cd += q.cd;
+				d2 += q.d2;
+				weight += q.weight;
+			}
+
+			// Weighted mean of the squared distances to the planes, independent of the scale of the mesh
+			double evaluate(const glm::dvec3& p) const {
+				if (weight <= 0.0) {
+					return 0.0;
+				}
+				double r = a2 * p.x * p.x + 2.0 * ab * p.x * p.y + 2.0 * ac * p.x * p.z + 2.0 * ad * p.x
+					+ b2 * p.y * p.y + 2.0 * bc * p.y * p.z + 2.0 * bd * p.y
+					+ c2 * p.z * p.z + 2.0 * cd * p.z
+					+ d2;
+				return std::max(r / weight, 0.0);
+			}
+		};
+
+		struct Collapse {
+			uint32_t from;
+			uint32_t to;
+			double cost;
+		};
+
+		// Skinned vertices only merge with vertices bound to the same joints with similar weights
+		bool canCollapse(const Vertex& from, const Vertex& to)
+		{
+			return from.joint0 == to.joint0 && glm::length(from.weight0 - to.weight0) < 0.1f;
+		}
+	}
+
+	std::vector<uint32_t> simplifyIndices(
+		const std::vector<Vertex>& vertices,
+		const uint32_t* indices,
+		size_t indexCount,
+		size_t targetIndexCount,
+		float maxError,
+		float* resultError)
+	{
+		std::vector<uint32_t> result(indices, indices + indexCount);
+		if (resultError) {
+			*resultError = 0.0f;
+		}
+		if (indexCount < 3 || targetIndexCount >= indexCount) {
+			return result;
+		}
+
+		// Work on the vertex range this primitive uses
+		const uint32_t base = *std::min_element(result.begin(), result.end());
+		const size_t count = size_t(*std::max_element(result.begin(), result.end())) - base + 1;
+		auto position = [&](uint32_t local) { return glm::dvec3(vertices[base + local].pos); };
+		for (auto& index : result) {
+			index -= base;
+		}
+
+		// Edges used by a single triangle are mesh borders or attribute seams, their vertices stay in place
+		std::vector<bool> locked(count, false);
+		{
+			std::unordered_map<uint64_t, uint32_t> edgeUse;
+			for (size_t i = 0; i < result.size(); i += 3) {
+				for (int e = 0; e < 3; e++) {
+					uint32_t a = result[i + e];
+					uint32_t b = result[i + (e + 1) % 3];
+					edgeUse[(uint64_t(std::min(a, b)) << 32) | std::max(a, b)]++;
+				}
+			}
+			for (const auto& edge : edgeUse) {
+				if (edge.second == 1) {
+					locked[edge.first >> 32] = true;
+					locked[edge.first & 0xffffffff] = true;
+				}
+			}
+		}
+
+		// Area weighted plane quadrics per vertex
+		std::vector<Quadric> quadrics(count);
+		for (size_t i = 0; i < result.size(); i += 3) {
+			glm::dvec3 p0 = position(result[i]);
+			glm::dvec3 n = glm::cross(position(result[i + 1]) - p0, position(result[i + 2]) - p0);
+			double length = glm::length(n);
+			if (length == 0.0) {
+				continue;
+			}
+			n /= length;
+			Quadric q;
+			q.addPlane(n, -glm::dot(n, p0), length * 0.5);
+			for (int v = 0; v < 3; v++) {
+				quadrics[result[i + v]].add(q);
+			}
+		}
+
+		const double maxCost = double(maxError) * maxError;
+		double error = 0.0;
+		std::vector<uint32_t> triangleOffsets(count + 1);
+		std::vector<uint32_t> vertexTriangles;
+		std::vector<bool> touched(count);
+		std::vector<Collapse> collapses;
+		std::vector<uint32_t> remap(count);
+		for (uint32_t v = 0; v < count; v++) {
+			remap[v] = v;
+		}
+
+		while (result.size() > targetIndexCount) {
+			// Vertex to triangle adjacency for the flip test
+			std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+			for (uint32_t index : result) {
+				triangleOffsets[index + 1]++;
+			}
+			for (size_t v = 0; v < count; v++) {
+				triangleOffsets[v + 1] += triangleOffsets[v];
+			}
+			vertexTriangles.resize(result.size());
+			{
+				std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+				for (size_t i = 0; i < result.size(); i++) {
+					vertexTriangles[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			// Cheapest direction of every edge
+			collapses.clear();
+			for (size_t i = 0; i < result.size(); i += 3) {
+				for (int e = 0; e < 3; e++) {
+					uint32_t a = result[i + e];
+					uint32_t b = result[i + (e + 1) % 3];
+					if (a > b || !canCollapse(vertices[base + a], vertices[base + b])) {
+						continue;
+					}
+					Quadric q = quadrics[a];
+					q.add(quadrics[b]);
+					double costAB = locked[a] ? DBL_MAX : q.evaluate(position(b));
+					double costBA = locked[b] ? DBL_MAX : q.evaluate(position(a));
+					if (costAB == DBL_MAX && costBA == DBL_MAX) {
+						continue;
+					}
+					collapses.push_back(costAB <= costBA ? Collapse{ a, b, costAB } : Collapse{ b, a, costBA });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+			// Each vertex moves at most once per pass so the adjacency stays valid
+			std::fill(touched.begin(), touched.end(), false);
+			const size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+			size_t removed = 0;
+			bool collapsed = false;
+			for (const Collapse& c : collapses) {
+				if (c.cost > maxCost || removed >= trianglesToRemove) {
+					break;
+				}
+				if (touched[c.from] || touched[c.to]) {
+					continue;
+				}
+
+				// Reject collapses that would flip a neighbouring triangle
+				bool flips = false;
+				size_t shared = 0;
+				for (uint32_t t = triangleOffsets[c.from]; t < triangleOffsets[c.from + 1] && !flips; t++) {
+					const uint32_t* tri = &result[size_t(vertexTriangles[t]) * 3];
+					if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+						shared++;
+						continue;
+					}
+					glm::dvec3 p[3], q[3];
+					for (int v = 0; v < 3; v++) {
+						p[v] = position(tri[v]);
+						q[v] = tri[v] == c.from ? position(c.to) : p[v];
+					}
+					glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+					glm::dvec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+					flips = glm::dot(before, after) <= 0.0;
+				}
+				if (flips) {
+					continue;
+				}
+
+				for (uint32_t t = triangleOffsets[c.from]; t < triangleOffsets[c.from + 1]; t++) {
+					const uint32_t* tri = &result[size_t(vertexTriangles[t]) * 3];
+					touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+				}
+				remap[c.from] = c.to;
+				quadrics[c.to].add(quadrics[c.from]);
+				error = std::max(error, c.cost);
+				removed += shared;
+				collapsed = true;
+			}
+			if (!collapsed) {
+				break;
+			}
+
+			// Apply the collapses and drop degenerate triangles
+			size_t write = 0;
+			for (size_t i = 0; i < result.size(); i += 3) {
+				uint32_t a = remap[result[i]];
+				uint32_t b = remap[result[i + 1]];
+				uint32_t c = remap[result[i + 2]];
+				if (a != b && b != c && a != c) {
+					result[write++] = a;
+					result[write++] = b;
+					result[write++] = c;
+				}
+			}
+			result.resize(write);
+		}
+
+		for (auto& index : result) {
+			index += base;
+		}
+		if (resultError) {
+			*resultError = static_cast<float>(std::sqrt(error));
+		}
+		return result;
+	}
+}
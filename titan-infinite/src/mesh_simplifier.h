@@ -0,0 +1,21 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+
+namespace vkglTF {
+
+	// Quadric error edge collapse. Vertices are only ever collapsed onto other existing vertices, so the
+	// result indexes the same vertex buffer and keeps every attribute, including joints and weights.
+	// Collapses stop at targetIndexCount or once the error would exceed maxError (in model units).
+	std::vector<uint32_t> simplifyIndices(
+		const std::vector<Vertex>& vertices,
+		const uint32_t* indices,
+		size_t indexCount,
+		size_t targetIndexCount,
+		float maxError,
+		float* resultError = nullptr);
+}
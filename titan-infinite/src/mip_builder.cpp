@@ -0,0 +1,366 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "mip_builder.h"
+#include <filesystem>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_BUILDER_SSE
+#endif
+
+namespace texture {
+
+    // Bump when the builder or the BC encoder output changes so stale cache entries are not picked up
+    static const uint32_t cacheVersion = 2;
+
+    static const float pi = 3.14159265358979f;
+
+    // One RGBA texel, the four channels are filtered together
+#ifdef MIP_BUILDER_SSE
+    typedef __m128 Texel;
+    static inline Texel zeroTexel() { return _mm_setzero_ps(); }
+    static inline Texel loadTexel(const float* p) { return _mm_loadu_ps(p); }
+    static inline void storeTexel(float* p, Texel t) { _mm_storeu_ps(p, t); }
+    static inline Texel madd(Texel acc, Texel t, float w) { return _mm_add_ps(acc, _mm_mul_ps(t, _mm_set1_ps(w))); }
+    static inline Texel saturate(Texel t) { return _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+#else
+    struct Texel { float v[4]; };
+    static inline Texel zeroTexel() { return { { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+    static inline Texel loadTexel(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+    static inline void storeTexel(float* p, Texel t) { memcpy(p, t.v, sizeof(t.v)); }
+    static inline Texel madd(Texel acc, Texel t, float w)
+    {
+        for (int c = 0; c < 4; ++c) {
+            acc.v[c] += t.v[c] * w;
+        }
+        return acc;
+    }
+    static inline Texel saturate(Texel t)
+    {
+        for (int c = 0; c < 4; ++c) {
+            t.v[c] = std::min(std::max(t.v[c], 0.0f), 1.0f);
+        }
+        return t;
+    }
+#endif
+
+    static float sinc(float x)
+    {
+        if (std::abs(x) < 1e-5f) {
+            return 1.0f;
+        }
+        x *= pi;
+        return std::sin(x) / x;
+    }
+
+    static float bessel0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for (int k = 1; k < 32; ++k) {
+            float t = x / (2.0f * k);
+            term *= t * t;
+            sum += term;
+            if (term < sum * 1e-8f) {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    // Filter radius in destination texels
+    static float filterSupport(MipFilter filter)
+    {
+        switch (filter) {
+        case MipFilter::Kaiser:
+        case MipFilter::Lanczos:
+            return 3.0f;
+        default:
+            return 0.5f;
+        }
+    }
+
+    static float filterWeight(MipFilter filter, float t)
+    {
+        t = std::abs(t);
+        switch (filter) {
+        case MipFilter::Kaiser: {
+            // Windowed sinc, alpha 4
+            if (t >= 3.0f) {
+                return 0.0f;
+            }
+            const float alpha = 4.0f;
+            float x = t / 3.0f;
+            return sinc(t) * bessel0(alpha * std::sqrt(1.0f - x * x)) / bessel0(alpha);
+        }
+        case MipFilter::Lanczos:
+            return t < 3.0f ? sinc(t) * sinc(t / 3.0f) : 0.0f;
+        default:
+            return t <= 0.5f ? 1.0f : 0.0f;
+        }
+    }
+
+    // Source texels and weights for every destination texel along one axis, edges repeat the last texel
+    struct FilterKernel {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> indices;
+        std::vector<float> weights;
+    };
+
+    static void buildKernel(MipFilter filter, uint32_t srcSize, uint32_t dstSize, FilterKernel& kernel)
+    {
+        kernel.offsets.assign(1, 0);
+        kernel.indices.clear();
+        kernel.weights.clear();
+
+        const float scale = float(srcSize) / float(dstSize);
+        const float support = filterSupport(filter) * scale;
+        for (uint32_t dst = 0; dst < dstSize; ++dst) {
+            const float center = (dst + 0.5f) * scale;
+            const int first = int(std::floor(center - support));
+            const int last = int(std::ceil(center + support));
+            const size_t begin = kernel.weights.size();
+            float sum = 0.0f;
+            for (int i = first; i <= last; ++i) {
+                float w = filterWeight(filter, (i + 0.5f - center) / scale);
+                if (std::abs(w) < 1e-6f) {
+                    continue;
+                }
+                kernel.indices.push_back(uint32_t(std::min(std::max(i, 0), int(srcSize) - 1)));
+                kernel.weights.push_back(w);
+                sum += w;
+            }
+            for (size_t i = begin; i < kernel.weights.size(); ++i) {
+                kernel.weights[i] /= sum;
+            }
+            kernel.offsets.push_back(uint32_t(kernel.weights.size()));
+        }
+    }
+
+    static void parallelFor(uint32_t count, uint32_t threadCount, const std::function<void(uint32_t, uint32_t)>& body)
+    {
+        threadCount = std::min(threadCount, count);
+        if (threadCount <= 1) {
+            body(0, count);
+            return;
+        }
+        const uint32_t chunk = (count + threadCount - 1) / threadCount;
+        std::vector<std::future<void>> workers;
+        for (uint32_t begin = 0; begin < count; begin += chunk) {
+            workers.push_back(std::async(std::launch::async, body, begin, std::min(begin + chunk, count)));
+        }
+        for (auto& worker : workers) {
+            worker.get();
+        }
+    }
+
+    static const float* srgbToLinearTable()
+    {
+        static const std::vector<float> table = []() {
+            std::vector<float> t(256);
+            for (int i = 0; i < 256; ++i) {
+                float c = i / 255.0f;
+                t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return t;
+        }();
+        return table.data();
+    }
+
+    static const int linearToSrgbTableSize = 16384;
+
+    static const unsigned char* linearToSrgbTable()
+    {
+        static const std::vector<unsigned char> table = []() {
+            std::vector<unsigned char> t(linearToSrgbTableSize);
+            for (int i = 0; i < linearToSrgbTableSize; ++i) {
+                float c = i / float(linearToSrgbTableSize - 1);
+                float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                t[i] = static_cast<unsigned char>(s * 255.0f + 0.5f);
+            }
+            return t;
+        }();
+        return table.data();
+    }
+
+    static float alphaCoverage(const std::vector<float>& level, size_t texelCount, float cutoff, float scale)
+    {
+        size_t covered = 0;
+        for (size_t i = 0; i < texelCount; ++i) {
+            // Same test as the shader, texels below the cutoff are discarded
+            covered += level[i * 4 + 3] * scale >= cutoff;
+        }
+        return float(covered) / float(texelCount);
+    }
+
+    // Alpha scale that brings the coverage of the level back to the one of level 0
+    static float findAlphaScale(const std::vector<float>& level, size_t texelCount, float cutoff, float coverage)
+    {
+        float low = 0.0f;
+        float high = 4.0f;
+        float scale = 1.0f;
+        float bestScale = 1.0f;
+        float bestError = FLT_MAX;
+        for (int i = 0; i < 10; ++i) {
+            float current = alphaCoverage(level, texelCount, cutoff, scale);
+            // Coverage moves in steps, so the last guess is not necessarily the closest one
+            if (std::abs(current - coverage) < bestError) {
+                bestError = std::abs(current - coverage);
+                bestScale = scale;
+            }
+            if (current < coverage) {
+                low = scale;
+            }
+            else if (current > coverage) {
+                high = scale;
+            }
+            else {
+                break;
+            }
+            scale = (low + high) * 0.5f;
+        }
+        return bestScale;
+    }
+
+    void buildMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, const MipBuildOptions& options, MipChain& chain)
+    {
+        const uint32_t threadCount = options.threadCount ? options.threadCount : std::max(1u, std::thread::hardware_concurrency());
+        const float* toLinear = srgbToLinearTable();
+        const unsigned char* toSrgb = linearToSrgbTable();
+
+        chain.format = VK_FORMAT_R8G8B8A8_UNORM;
+        chain.width = width;
+        chain.height = height;
+        chain.levelOffsets.assign(1, 0);
+        chain.levelExtents.assign(1, { width, height });
+        // Level 0 is kept exactly as it came in
+        chain.data.assign(pixels, pixels + size_t(width) * height * 4);
+
+        std::vector<float> current(size_t(width) * height * 4);
+        parallelFor(height, threadCount, [&](uint32_t begin, uint32_t end) {
+            for (size_t i = size_t(begin) * width * 4; i < size_t(end) * width * 4; ++i) {
+                const bool color = (i & 3) != 3;
+                current[i] = options.srgb && color ? toLinear[pixels[i]] : pixels[i] / 255.0f;
+            }
+        });
+
+        const bool preserveCoverage = options.alphaCutoff >= 0.0f;
+        const float coverage = preserveCoverage ? alphaCoverage(current, size_t(width) * height, options.alphaCutoff, 1.0f) : 0.0f;
+
+        FilterKernel kernelX, kernelY;
+        std::vector<float> horizontal, next;
+        uint32_t srcWidth = width;
+        uint32_t srcHeight = height;
+        while (srcWidth > 1 || srcHeight > 1) {
+            const uint32_t dstWidth = std::max(srcWidth / 2, 1u);
+            const uint32_t dstHeight = std::max(srcHeight / 2, 1u);
+            buildKernel(options.filter, srcWidth, dstWidth, kernelX);
+            buildKernel(options.filter, srcHeight, dstHeight, kernelY);
+            // Not worth the threads for the last few levels
+            const uint32_t threads = size_t(srcWidth) * srcHeight >= 128 * 128 ? threadCount : 1;
+
+            // Separable, rows first then columns
+            horizontal.resize(size_t(dstWidth) * srcHeight * 4);
+            parallelFor(srcHeight, threads, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t y = begin; y < end; ++y) {
+                    const float* row = &current[size_t(y) * srcWidth * 4];
+                    float* out = &horizontal[size_t(y) * dstWidth * 4];
+                    for (uint32_t x = 0; x < dstWidth; ++x) {
+                        Texel acc = zeroTexel();
+                        for (uint32_t t = kernelX.offsets[x]; t < kernelX.offsets[x + 1]; ++t) {
+                            acc = madd(acc, loadTexel(row + kernelX.indices[t] * 4), kernelX.weights[t]);
+                        }
+                        storeTexel(out + x * 4, acc);
+                    }
+                }
+            });
+
+            next.resize(size_t(dstWidth) * dstHeight * 4);
+            parallelFor(dstHeight, threads, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t y = begin; y < end; ++y) {
+                    float* out = &next[size_t(y) * dstWidth * 4];
+                    for (uint32_t x = 0; x < dstWidth; ++x) {
+                        Texel acc = zeroTexel();
+                        for (uint32_t t = kernelY.offsets[y]; t < kernelY.offsets[y + 1]; ++t) {
+                            acc = madd(acc, loadTexel(&horizontal[(size_t(kernelY.indices[t]) * dstWidth + x) * 4]), kernelY.weights[t]);
+                        }
+                        // Kaiser and Lanczos ring, keep the level in range before it feeds the next one
+                        storeTexel(out + x * 4, saturate(acc));
+                    }
+                }
+            });
+
+            // The scale only applies to the stored level, the next level is filtered from the unscaled one
+            const size_t texelCount = size_t(dstWidth) * dstHeight;
+            const float alphaScale = preserveCoverage ? findAlphaScale(next, texelCount, options.alphaCutoff, coverage) : 1.0f;
+
+            const size_t offset = chain.data.size();
+            chain.data.resize(offset + texelCount * 4);
+            unsigned char* out = &chain.data[offset];
+            parallelFor(dstHeight, threads, [&](uint32_t begin, uint32_t end) {
+                for (size_t i = size_t(begin) * dstWidth; i < size_t(end) * dstWidth; ++i) {
+                    for (int c = 0; c < 3; ++c) {
+                        float v = next[i * 4 + c];
+                        out[i * 4 + c] = options.srgb ? toSrgb[int(v * (linearToSrgbTableSize - 1) + 0.5f)] : static_cast<unsigned char>(v * 255.0f + 0.5f);
+                    }
+                    float alpha = std::min(next[i * 4 + 3] * alphaScale, 1.0f);
+                    out[i * 4 + 3] = static_cast<unsigned char>(alpha * 255.0f + 0.5f);
+                }
+            });
+            chain.levelOffsets.push_back(offset);
+            chain.levelExtents.push_back({ dstWidth, dstHeight });
+
+            current.swap(next);
+            srcWidth = dstWidth;
+            srcHeight = dstHeight;
+        }
+    }
+
+    void buildMipChainCached(const unsigned char* pixels, uint32_t width, uint32_t height, const MipBuildOptions& options, bool compress, const std::string& cacheDirectory, MipChain& chain)
+    {
+        // FNV-1a over the pixels and everything that changes the output
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void* data, size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+        const uint32_t header[6] = { width, height, cacheVersion, uint32_t(options.filter), uint32_t(options.srgb), uint32_t(compress) };
+        mix(header, sizeof(header));
+        mix(&options.alphaCutoff, sizeof(options.alphaCutoff));
+        mix(pixels, size_t(width) * height * 4);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.dds", static_cast<unsigned long long>(hash));
+        const std::filesystem::path cachePath = std::filesystem::path(cacheDirectory) / name;
+
+        std::error_code error;
+        if (std::filesystem::exists(cachePath, error) && loadCompressedImage(cachePath.string(), chain)) {
+            return;
+        }
+
+        if (compress) {
+            MipChain rgba;
+            buildMipChain(pixels, width, height, options, rgba);
+            compressMipChain(rgba, chain);
+        }
+        else {
+            buildMipChain(pixels, width, height, options, chain);
+        }
+
+        // A cache that can't be written only costs the build next time
+        std::filesystem::create_directories(cacheDirectory, error);
+        try {
+            saveCompressedImage(cachePath.string(), chain);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+}
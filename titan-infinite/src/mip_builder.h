@@ -0,0 +1,46 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+
+// GPU ready image with its whole mip chain, levels packed back to back as they are uploaded
+struct MipChain
+{
+    VkFormat format{ VK_FORMAT_UNDEFINED };
+    uint32_t width{ 0 };
+    uint32_t height{ 0 };
+    std::vector<VkDeviceSize> levelOffsets;
+    std::vector<VkExtent2D> levelExtents;
+    std::vector<unsigned char> data;
+
+    bool empty() const { return data.empty(); }
+    uint32_t mipLevels() const { return static_cast<uint32_t>(levelOffsets.size()); }
+};
+
+namespace texture {
+
+    enum class MipFilter {
+        Box,
+        Kaiser,
+        Lanczos
+    };
+
+    struct MipBuildOptions {
+        MipFilter filter{ MipFilter::Kaiser };
+        // RGB holds sRGB data, filtering happens in linear space
+        bool srgb{ false };
+        // Alpha test threshold of ALPHAMODE_MASK materials, every level keeps the coverage of level 0. Negative disables
+        float alphaCutoff{ -1.0f };
+        // 0 uses every hardware thread
+        uint32_t threadCount{ 0 };
+    };
+
+    // RGBA8 pixels to a full RGBA8 mip chain, each level filtered from the previous one in float
+    void buildMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, const MipBuildOptions& options, MipChain& chain);
+
+    // Same, BC compressed when compress is set, and reused from cacheDirectory when it was built before
+    void buildMipChainCached(const unsigned char* pixels, uint32_t width, uint32_t height, const MipBuildOptions& options, bool compress, const std::string& cacheDirectory, MipChain& chain);
+}
@@ -0,0 +1,261 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "mip_generator.h"
+
+// Matches Texture of downsample.comp
+struct TextureParams {
+	int32_t width;
+	int32_t height;
+	uint32_t mipLevels;
+	uint32_t decodeSource;
+	uint32_t srgb;
+	uint32_t workGroupCount;
+	// The last workgroup of a texture is the one that sees all the others
+	uint32_t counter;
+	uint32_t padding;
+};
+
+// Every workgroup covers a 64x64 tile of level 0
+static const uint32_t tileSize = 64;
+
+void MipGenerator::Recording::destroy(VkDevice device)
+{
+	for (VkImageView view : views) {
+		vkDestroyImageView(device, view, nullptr);
+	}
+	views.clear();
+	if (descriptorPool != VK_NULL_HANDLE) {
+		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		descriptorPool = VK_NULL_HANDLE;
+	}
+	textures.destroy();
+}
+
+void MipGenerator::create(Device* device)
+{
+	m_device = device;
+
+	if (!m_device->supportsDynamicImageIndexing()) {
+		throw std::runtime_error("device does not support dynamically indexed image arrays!");
+	}
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_device->getPhysicalDevice(), &properties);
+	if (properties.limits.maxPerStageDescriptorStorageImages < batchSize * (maxMipLevels - 1)) {
+		throw std::runtime_error("device does not support enough storage images per stage for the mip generator!");
+	}
+
+	std::vector<DescriptorSetLayoutBinding> bindings = {
+		{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, batchSize, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, batchSize * (maxMipLevels - 1), VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+	};
+	m_descriptorSetLayout = m_device->createDescriptorSetLayout(m_device->getDevice(), bindings);
+
+	// Index of the first texture of the batch in the textures buffer
+	const std::vector<VkPushConstantRange> pushConstantRanges = {
+		{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) },
+	};
+	m_pipelineLayout = m_device->createPipelineLayout(m_device->getDevice(), { m_descriptorSetLayout }, pushConstantRanges);
+	m_pipeline = m_device->createComputePipeline(m_device->getDevice(), "../../data/shaders/downsample.comp.spv", m_pipelineLayout);
+
+	// Only read through texelFetch, the sampler is never used for filtering
+	m_sampler = texture::createSampler(m_device->getDevice(),
+		VK_FILTER_NEAREST,
+		VK_FILTER_NEAREST,
+		VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		0.0f,
+		VK_FALSE,
+		1.0f,
+		VK_FALSE,
+		VK_COMPARE_OP_NEVER,
+		0.0f,
+		0.0f,
+		VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+		VK_FALSE);
+}
+
+void MipGenerator::destroy()
+{
+	vkDestroySampler(m_device->getDevice(), m_sampler, nullptr);
+	vkDestroyPipeline(m_device->getDevice(), m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device->getDevice(), m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device->getDevice(), m_descriptorSetLayout, nullptr);
+}
+
+bool MipGenerator::isSupported(const TextureObject& texture) const
+{
+	if (texture.format != VK_FORMAT_R8G8B8A8_UNORM && texture.format != VK_FORMAT_R8G8B8A8_SRGB) {
+		return false;
+	}
+	return texture.layers == 1 && texture.mipLevels <= maxMipLevels;
+}
+
+void MipGenerator::record(VkCommandBuffer commandBuffer, const std::vector<TextureObject*>& textures, Recording& recording)
+{
+	VkDevice device = m_device->getDevice();
+
+	// A texture without mips only gets its layout changed, level 0 can't also be bound as storage
+	std::vector<TextureObject*> mipmapped;
+	std::vector<VkImageMemoryBarrier> barriers;
+	for (TextureObject* texture : textures) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = texture->image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers.push_back(barrier);
+		if (texture->mipLevels > 1) {
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 1, texture->mipLevels - 1, 0, 1 };
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barriers.push_back(barrier);
+			mipmapped.push_back(texture);
+		}
+		texture->image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
+	if (mipmapped.empty()) {
+		return;
+	}
+
+	const uint32_t textureCount = static_cast<uint32_t>(mipmapped.size());
+	const uint32_t batchCount = (textureCount + batchSize - 1) / batchSize;
+	const std::vector<VkDescriptorPoolSize> poolSizes = {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, batchCount * batchSize },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, batchCount * batchSize * (maxMipLevels - 1) },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, batchCount },
+	};
+	recording.descriptorPool = m_device->createDescriptorPool(device, poolSizes, batchCount);
+
+	// Written from the host, the submit makes it visible to the dispatches
+	std::vector<TextureParams> params(textureCount);
+	for (uint32_t i = 0; i < textureCount; i++) {
+		const TextureObject& texture = *mipmapped[i];
+		const bool srgbFormat = texture.format == VK_FORMAT_R8G8B8A8_SRGB;
+		params[i].width = static_cast<int32_t>(texture.width);
+		params[i].height = static_cast<int32_t>(texture.height);
+		params[i].mipLevels = texture.mipLevels;
+		// sRGB views already decode on fetch
+		params[i].decodeSource = texture.is_srgb && !srgbFormat;
+		params[i].srgb = texture.is_srgb || srgbFormat;
+		params[i].workGroupCount = ((texture.width + tileSize - 1) / tileSize) * ((texture.height + tileSize - 1) / tileSize);
+	}
+	const VkDeviceSize paramsSize = sizeof(TextureParams) * textureCount;
+	recording.textures = buffer::createBuffer(m_device, paramsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	VK_CHECK(recording.textures.map());
+	memcpy(recording.textures.mapped, params.data(), paramsSize);
+	recording.textures.unmap();
+	const VkDescriptorBufferInfo texturesInfo{ recording.textures.buffer, 0, VK_WHOLE_SIZE };
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	for (uint32_t firstTexture = 0; firstTexture < textureCount; firstTexture += batchSize) {
+		const uint32_t count = std::min(batchSize, textureCount - firstTexture);
+		VkDescriptorSet descriptorSet = m_device->createDescriptorSet(device, recording.descriptorPool, m_descriptorSetLayout);
+
+		std::vector<VkDescriptorImageInfo> sourceInfos;
+		std::vector<VkDescriptorImageInfo> mipInfos;
+		uint32_t groupsX = 1;
+		uint32_t groupsY = 1;
+		for (uint32_t i = 0; i < count; i++) {
+			const TextureObject& texture = *mipmapped[firstTexture + i];
+			groupsX = std::max(groupsX, (texture.width + tileSize - 1) / tileSize);
+			groupsY = std::max(groupsY, (texture.height + tileSize - 1) / tileSize);
+
+			VkImageView sourceView = m_device->createImageView(device, texture.image, VK_IMAGE_VIEW_TYPE_2D, texture.format,
+				{ VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+			recording.views.push_back(sourceView);
+			sourceInfos.push_back({ m_sampler, sourceView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+
+			// Storage views can't be sRGB, the shader encodes instead. Unused slots repeat the last level
+			for (uint32_t level = 1; level < maxMipLevels; level++) {
+				if (level < texture.mipLevels) {
+					VkImageView view = m_device->createImageView(device, texture.image, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R8G8B8A8_UNORM,
+						{ VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
+						{ VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 });
+					recording.views.push_back(view);
+					mipInfos.push_back({ VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_GENERAL });
+				}
+				else {
+					mipInfos.push_back(mipInfos.back());
+				}
+			}
+		}
+		// Slots past the end of the last batch repeat its first texture, no workgroup reads them
+		for (uint32_t i = count; i < batchSize; i++) {
+			sourceInfos.push_back(sourceInfos[0]);
+			mipInfos.insert(mipInfos.end(), mipInfos.begin(), mipInfos.begin() + (maxMipLevels - 1));
+		}
+
+		std::array<VkWriteDescriptorSet, 3> writes{};
+		for (auto& write : writes) {
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = descriptorSet;
+		}
+		writes[0].dstBinding = 0;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].descriptorCount = static_cast<uint32_t>(sourceInfos.size());
+		writes[0].pImageInfo = sourceInfos.data();
+		writes[1].dstBinding = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].descriptorCount = static_cast<uint32_t>(mipInfos.size());
+		writes[1].pImageInfo = mipInfos.data();
+		writes[2].dstBinding = 2;
+		writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[2].descriptorCount = 1;
+		writes[2].pBufferInfo = &texturesInfo;
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+		// Sized for the largest texture, workgroups past the edge of a smaller one return right away
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &firstTexture);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, count);
+	}
+
+	barriers.clear();
+	for (TextureObject* texture : mipmapped) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = texture->image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 1, texture->mipLevels - 1, 0, 1 };
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers.push_back(barrier);
+	}
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+void MipGenerator::record(UploadBatch& batch, const std::vector<TextureObject*>& textures)
+{
+	auto recording = std::make_shared<Recording>();
+	record(batch.commandBuffer, textures, *recording);
+	VkDevice device = m_device->getDevice();
+	batch.deferDestroy([recording, device]() { recording->destroy(device); });
+}
@@ -0,0 +1,44 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+// Compute downsampler writing every mip level of up to batchSize textures in one dispatch, see downsample.comp.
+// Textures need VK_IMAGE_USAGE_STORAGE_BIT, sRGB formats also VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT.
+// Needs Device::supportsDynamicImageIndexing.
+class MipGenerator {
+
+public:
+	static const uint32_t maxMipLevels = 13;
+	// Matches BATCH_SIZE of downsample.comp
+	static const uint32_t batchSize = 8;
+
+	// Views, descriptor sets and texture parameters used by one record call, destroy once its commands have completed
+	struct Recording {
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		std::vector<VkImageView> views;
+		Buffer textures;
+		void destroy(VkDevice device);
+	};
+
+	void create(Device* device);
+	void destroy();
+	bool isSupported(const TextureObject& texture) const;
+
+	// Expects level 0 in TRANSFER_DST_OPTIMAL and leaves every level in SHADER_READ_ONLY_OPTIMAL.
+	// All textures share one barrier before and one after their dispatches, one dispatch per batchSize textures
+	void record(VkCommandBuffer commandBuffer, const std::vector<TextureObject*>& textures, Recording& recording);
+	// Same, the recording is released with the batch
+	void record(UploadBatch& batch, const std::vector<TextureObject*>& textures);
+
+private:
+	Device* m_device = nullptr;
+	VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_pipeline = VK_NULL_HANDLE;
+	VkSampler m_sampler = VK_NULL_HANDLE;
+};
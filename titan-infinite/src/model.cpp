@@ -6,6 +6,7 @@
 
 #include "pch.h"
 #include "model.h"
+#include <filesystem>
 #include <glm/gtx/matrix_decompose.hpp>
 
 #define TINYGLTF_IMPLEMENTATION
@@ -18,6 +19,7 @@ using namespace vkglTF;
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
+VkDescriptorSetLayout vkglTF::descriptorSetLayoutBindless = VK_NULL_HANDLE;
 VkMemoryPropertyFlags vkglTF::memoryPropertyFlags = 0;
 
 BoundingBox BoundingBox::getAABB(glm::mat4 m) {
@@ -46,6 +48,20 @@ BoundingBox BoundingBox::getAABB(glm::mat4 m) {
 	return BoundingBox(min, max);
 }
 
+VkVertexInputBindingDescription vkglTF::getInstanceBindingDescription(uint32_t binding)
+{
+	return { binding, sizeof(glm::mat4), VK_VERTEX_INPUT_RATE_INSTANCE };
+}
+
+std::vector<VkVertexInputAttributeDescription> vkglTF::getInstanceAttributeDescriptions(uint32_t binding, uint32_t firstLocation)
+{
+	std::vector<VkVertexInputAttributeDescription> attributes;
+	for (uint32_t column = 0; column < 4; column++) {
+		attributes.push_back({ firstLocation + column, binding, VK_FORMAT_R32G32B32A32_SFLOAT, column * static_cast<uint32_t>(sizeof(glm::vec4)) });
+	}
+	return attributes;
+}
+
 /*
 	glTF primitive
 */
@@ -60,23 +76,51 @@ void vkglTF::Primitive::setBoundingBox(glm::vec3 min, glm::vec3 max) {
 vkglTF::Mesh::Mesh(Device* device, glm::mat4 matrix) {
 	this->device = device;
 	this->uniformBlock.matrix = matrix;
-	buffer::createBuffer(
-		device,
-		sizeof(uniformBlock),
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		VK_SHARING_MODE_EXCLUSIVE,
-		&uniformBuffer.buffer,
-		&uniformBuffer.memory,
-		&uniformBlock
-		);
-	VK_CHECK(vkMapMemory(device->getDevice(), uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
-	uniformBuffer.descriptor = { uniformBuffer.buffer, 0, sizeof(uniformBlock) };
 };
 
-vkglTF::Mesh::~Mesh() {
-	vkDestroyBuffer(device->getDevice(), uniformBuffer.buffer, nullptr);
-	vkFreeMemory(device->getDevice(), uniformBuffer.memory, nullptr);
+vkglTF::Mesh::DynamicOffsets vkglTF::Mesh::pushUniformBlock(const glm::mat4& matrix) const {
+	return pushUniformBlock(matrix, pushJoints());
+}
+
+vkglTF::Mesh::DynamicOffsets vkglTF::Mesh::pushUniformBlock(const glm::mat4& matrix, uint32_t jointsOffset) const {
+	const NodeBlock block{ matrix, uniformBlock.jointcount };
+	return { device->getFrameAllocator().push(block), jointsOffset };
+}
+
+uint32_t vkglTF::Mesh::pushJoints() const {
+	if (uniformBlock.jointcount <= 0.0f) {
+		return 0;
+	}
+	// The whole block is reserved since the descriptor range covers MAX_NUM_JOINTS
+	FrameAllocator::Allocation allocation = device->getFrameAllocator().allocate(sizeof(SkinBlock));
+	memcpy(allocation.data, uniformBlock.jointMatrix, sizeof(glm::mat4) * static_cast<size_t>(uniformBlock.jointcount));
+	return allocation.offset;
+}
+
+VkDeviceSize vkglTF::Mesh::pushInstances(uint32_t firstInstance, uint32_t count) const {
+	FrameAllocator::Allocation allocation = device->getFrameAllocator().allocate(sizeof(glm::mat4) * count);
+	memcpy(allocation.data, instances.data() + firstInstance, sizeof(glm::mat4) * count);
+	return allocation.offset;
+}
+
+VkDescriptorSet vkglTF::createNodeDescriptorSet(Device* device, VkDescriptorSetLayout descriptorSetLayout) {
+	VkDescriptorSet descriptorSet = device->createDescriptorSet(device->getDevice(), device->getDescriptorPool(), descriptorSetLayout);
+	const std::array<VkDescriptorBufferInfo, 2> bufferInfos = {
+		device->getFrameAllocator().getDescriptor(sizeof(Mesh::NodeBlock)),
+		device->getFrameAllocator().getDescriptor(sizeof(Mesh::SkinBlock)),
+	};
+
+	std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+	for (uint32_t i = 0; i < writeDescriptorSets.size(); i++) {
+		writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		writeDescriptorSets[i].descriptorCount = 1;
+		writeDescriptorSets[i].dstSet = descriptorSet;
+		writeDescriptorSets[i].dstBinding = i;
+		writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	return descriptorSet;
 }
 
 void vkglTF::Mesh::setBoundingBox(glm::vec3 min, glm::vec3 max) {
@@ -85,15 +129,6 @@ void vkglTF::Mesh::setBoundingBox(glm::vec3 min, glm::vec3 max) {
 	bb.valid = true;
 }
 
-vkglTF::Node::~Node() {
-	if (mesh) {
-		delete mesh;
-	}
-	for (auto& child : children) {
-		delete child;
-	}
-}
-
 glm::mat4 vkglTF::Node::localMatrix() {
 	return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
 }
@@ -115,34 +150,44 @@ glm::mat4 vkglTF::Skin::getSolverIK(unsigned int index)
 
 void vkglTF::Node::update() {
 	if (mesh) {
-		glm::mat4 globalMatrix = getGlobalMatrix();
-		if (skin) {
-			mesh->uniformBlock.matrix = globalMatrix;
-			// Update join matrices
-			glm::mat4 inverseGlobalMatrix = glm::inverse(globalMatrix);
-			for (size_t i = 0; i < skin->joints.size(); ++i) {
-				glm::mat4 joint_matrix;
-				// Update IK
-				if (skin->enableIK && skin->ccd_solver && skin->ccd_solver->size() > 0)
-					joint_matrix = skin->getSolverIK(i);
-				else 
-					joint_matrix = inverseGlobalMatrix * skin->joints[i]->getGlobalMatrix() * skin->inverseBindMatrices[i];
-				
-				// Update uniform buffer
-				mesh->uniformBlock.jointMatrix[i] = joint_matrix;
-			}
-			mesh->uniformBlock.jointcount = (float)skin->joints.size();
-			memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-		}
-		else {
-			memcpy(mesh->uniformBuffer.mapped, &globalMatrix, sizeof(glm::mat4));
-		}
+		updateMesh(getGlobalMatrix(), false);
 	}
-	for (auto& child : children) {
+	for (Node* child : children) {
 		child->update();
 	}
 }
 
+void vkglTF::Node::updateMesh(const glm::mat4& globalMatrix, bool cachedJoints) {
+	if (skin) {
+		// Update join matrices
+		glm::mat4 inverseGlobalMatrix = glm::inverse(globalMatrix);
+		for (size_t i = 0; i < skin->joints.size(); ++i) {
+			glm::mat4 joint_matrix;
+			// Update IK
+			if (skin->enableIK && skin->ccd_solver && skin->ccd_solver->size() > 0)
+				joint_matrix = skin->getSolverIK(i);
+			else 
+				joint_matrix = inverseGlobalMatrix * (cachedJoints ? skin->joints[i]->worldMatrix : skin->joints[i]->getGlobalMatrix()) * skin->inverseBindMatrices[i];
+			
+			// Update uniform buffer
+			mesh->uniformBlock.jointMatrix[i] = joint_matrix;
+		}
+		mesh->uniformBlock.jointcount = (float)skin->joints.size();
+	}
+	meshMatrix = globalMatrix;
+	glm::mat4* instances = mesh->instances.data() + firstInstance;
+	if (instanceMatrices.empty()) {
+		instances[0] = globalMatrix;
+	}
+	for (size_t i = 0; i < instanceMatrices.size(); i++) {
+		instances[i] = globalMatrix * instanceMatrices[i];
+	}
+}
+
+vkglTF::Mesh::DynamicOffsets vkglTF::Node::pushUniformBlock() const {
+	return mesh->pushUniformBlock(meshMatrix);
+}
+
 /*
 		glTF animation sampler
 	*/
@@ -257,12 +302,24 @@ VulkanglTFModel::~VulkanglTFModel()
 }
 void VulkanglTFModel::destroy()
 {
+	releaseAsyncLoad();
+	releaseTextureStreaming();
+	releaseBindlessDescriptors();
+	releaseMappedFile();
+	for (TextureObject& texture : textures) {
+		releaseTexture(texture);
+	}
+	textures.clear();
 	vkDestroyBuffer(device->getDevice(), vertices.buffer, nullptr);
-	vkFreeMemory(device->getDevice(), vertices.memory, nullptr);
+	memory::free(vertices.allocation);
 	if (indices.count > 0) {
 		vkDestroyBuffer(device->getDevice(), indices.buffer, nullptr);
-		vkFreeMemory(device->getDevice(), indices.memory, nullptr);
+		memory::free(indices.allocation);
 	}
+	nodes = {};
+	linearNodes = {};
+	meshes = {};
+	arena.release();
 	if (descriptorSetLayoutUbo != VK_NULL_HANDLE) {
 		vkDestroyDescriptorSetLayout(device->getDevice(), descriptorSetLayoutUbo, nullptr);
 		descriptorSetLayoutUbo = VK_NULL_HANDLE;
@@ -271,61 +328,265 @@ void VulkanglTFModel::destroy()
 		vkDestroyDescriptorSetLayout(device->getDevice(), descriptorSetLayoutImage, nullptr);
 		descriptorSetLayoutImage = VK_NULL_HANDLE;
 	}
+	if (descriptorSetLayoutBindless != VK_NULL_HANDLE) {
+		vkDestroyDescriptorSetLayout(device->getDevice(), descriptorSetLayoutBindless, nullptr);
+		descriptorSetLayoutBindless = VK_NULL_HANDLE;
+	}
 }
 
-void VulkanglTFModel::loadFromFile(const std::string& filename, Device* _device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale) {
-	tinygltf::Model    gltfModel;
-	tinygltf::TinyGLTF gltfContext;
-	std::string        error, warning;
-	bool binary = false;
+static bool isBinaryFile(const std::string& filename)
+{
 	size_t extpos = filename.rfind('.', filename.length());
 	if (extpos != std::string::npos) {
-		binary = (filename.substr(extpos + 1, filename.length() - extpos) == "glb");
+		return filename.substr(extpos + 1, filename.length() - extpos) == "glb";
 	}
+	return false;
+}
 
-	bool fileLoaded = binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename.c_str()) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename.c_str());
-	device = _device;
-	copyQueue = device->getGraphicsQueue();
+/*
+	glTF memory mapped binary loading
+*/
 
-	std::vector<uint32_t> indexBuffer;
-	std::vector<Vertex> vertexBuffer;
+// Stands in for data that lives in the BIN chunk so tinygltf does not copy it
+static const char* mappedStubUri = "data:application/octet-stream;base64,AAAA";
+static const size_t mappedStubSize = 3;
 
-	if (fileLoaded)
-	{
-		if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
-			loadTextureSamplers(gltfModel);
-			loadTextures(gltfModel, device, transferQueue);
-		}
-		loadMaterials(gltfModel);
-		const tinygltf::Scene& scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
-		for (size_t i = 0; i < scene.nodes.size(); i++) {
-			const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
-			loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
-		}
-		if (gltfModel.animations.size() > 0) {
-			loadAnimations(gltfModel);
+struct MappedImageLoader {
+	const std::vector<MappedRange>* images;
+	tinygltf::LoadImageDataFunction fallback;
+};
+
+static bool loadMappedImage(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData)
+{
+	const MappedImageLoader* loader = static_cast<const MappedImageLoader*>(userData);
+	if (size_t(imageIndex) < loader->images->size() && (*loader->images)[imageIndex].data) {
+		// Encoded bytes stay in the mapping until the image is decoded
+		return true;
+	}
+	return loader->fallback(image, imageIndex, error, warning, reqWidth, reqHeight, bytes, size, nullptr);
+}
+
+// DDS and KTX images are kept encoded and uploaded as they are, everything else goes through stb
+static bool loadImageData(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData)
+{
+	if (texture::isCompressedContainer(bytes, size_t(size))) {
+		image->image.assign(bytes, bytes + size);
+		image->as_is = true;
+		return true;
+	}
+	return tinygltf::LoadImageData(image, imageIndex, error, warning, reqWidth, reqHeight, bytes, size, userData);
+}
+
+bool VulkanglTFModel::loadMappedBinary(tinygltf::TinyGLTF& gltfContext, tinygltf::Model& gltfModel, const std::string& filename, tinygltf::LoadImageDataFunction imageLoader, std::string& error, std::string& warning)
+{
+	mappedFile.open(filename);
+	const unsigned char* bytes = mappedFile.data();
+	const size_t size = mappedFile.size();
+
+	// magic, version, length, JSON chunk length, JSON chunk type
+	uint32_t header[5];
+	if (size < sizeof(header)) {
+		error = "Too short data size for glTF Binary.";
+		return false;
+	}
+	memcpy(header, bytes, sizeof(header));
+	const size_t length = header[2];
+	const size_t jsonLength = header[3];
+	if (header[0] != 0x46546C67 || length > size || header[4] != 0x4E4F534A || 20 + jsonLength > length) {
+		error = "Invalid glTF binary.";
+		return false;
+	}
+
+	const unsigned char* bin = nullptr;
+	size_t binLength = 0;
+	const size_t binChunk = 20 + jsonLength;
+	if (binChunk + 8 <= length) {
+		uint32_t chunk[2];
+		memcpy(chunk, bytes + binChunk, sizeof(chunk));
+		if (chunk[1] == 0x004E4942 && binChunk + 8 + chunk[0] <= length) {
+			bin = bytes + binChunk + 8;
+			binLength = chunk[0];
 		}
-		loadSkins(gltfModel);
+	}
 
-		for (auto node : linearNodes) {
-			// Assign skins
-			if (node->skinIndex > -1) {
-				node->skin = skins[node->skinIndex];
+	nlohmann::json json = nlohmann::json::parse(bytes + 20, bytes + binChunk, nullptr, false);
+	if (json.is_discarded() || !json.is_object()) {
+		error = "Failed to parse JSON chunk of glTF binary.";
+		return false;
+	}
+
+	// A buffer without uri is the BIN chunk, tinygltf only gets a stub for it
+	auto buffers = json.find("buffers");
+	if (buffers != json.end() && buffers->is_array()) {
+		mappedBuffers.assign(buffers->size(), nullptr);
+		for (size_t i = 0; i < buffers->size(); i++) {
+			nlohmann::json& buffer = (*buffers)[i];
+			if (buffer.find("uri") != buffer.end()) {
+				continue;
 			}
-			// Initial pose
-			if (node->mesh) {
-				node->update();
+			if (!bin || buffer.value("byteLength", size_t(0)) > binLength) {
+				error = "Invalid binary data in `Buffer'.";
+				return false;
 			}
+			mappedBuffers[i] = bin;
+			buffer["uri"] = mappedStubUri;
+			buffer["byteLength"] = mappedStubSize;
 		}
+	}
 
-		setupIK();
+	// Same for images embedded through a buffer view into the BIN chunk
+	auto images = json.find("images");
+	auto bufferViews = json.find("bufferViews");
+	if (images != json.end() && images->is_array() && bufferViews != json.end() && bufferViews->is_array()) {
+		mappedImages.assign(images->size(), MappedRange{});
+		for (size_t i = 0; i < images->size(); i++) {
+			nlohmann::json& image = (*images)[i];
+			auto view = image.find("bufferView");
+			if (view == image.end() || view->get<size_t>() >= bufferViews->size()) {
+				continue;
+			}
+			const nlohmann::json& bufferView = (*bufferViews)[view->get<size_t>()];
+			const size_t buffer = bufferView.value("buffer", size_t(0));
+			if (buffer >= mappedBuffers.size() || !mappedBuffers[buffer]) {
+				continue;
+			}
+			const size_t offset = bufferView.value("byteOffset", size_t(0));
+			const size_t byteLength = bufferView.value("byteLength", size_t(0));
+			if (offset + byteLength > binLength) {
+				error = "Image buffer view exceeds the BIN chunk.";
+				return false;
+			}
+			mappedImages[i] = { mappedBuffers[buffer] + offset, byteLength };
+			image.erase("bufferView");
+			image.erase("mimeType");
+			image["uri"] = mappedStubUri;
+		}
 	}
-	else
+
+	MappedImageLoader loader{ &mappedImages, imageLoader };
+	gltfContext.SetImageLoader(loadMappedImage, &loader);
+
+	const std::string source = json.dump();
+	const size_t separator = filename.find_last_of("/\\");
+	const std::string baseDir = separator != std::string::npos ? filename.substr(0, separator) : "";
+	return gltfContext.LoadASCIIFromString(&gltfModel, &error, &warning, source.c_str(), static_cast<unsigned int>(source.size()), baseDir);
+}
+
+const unsigned char* VulkanglTFModel::getAccessorData(const tinygltf::Model& model, const tinygltf::Accessor& accessor) const
+{
+	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+	const unsigned char* data = size_t(bufferView.buffer) < mappedBuffers.size() && mappedBuffers[bufferView.buffer] ? mappedBuffers[bufferView.buffer] : model.buffers[bufferView.buffer].data.data();
+	return data + bufferView.byteOffset + accessor.byteOffset;
+}
+
+void VulkanglTFModel::releaseMappedFile()
+{
+	mappedFile.close();
+	mappedBuffers.clear();
+	mappedImages.clear();
+}
+
+void VulkanglTFModel::loadFromFile(const std::string& filename, Device* _device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale) {
+	tinygltf::Model    gltfModel;
+	tinygltf::TinyGLTF gltfContext;
+	std::string        error, warning;
+	bool binary = isBinaryFile(filename);
+	bool mapped = binary && !(fileLoadingFlags & FileLoadingFlags::DontMapFile);
+
+	device = _device;
+	copyQueue = device->getGraphicsQueue();
+	setLoadFlags(filename, fileLoadingFlags);
+
+	gltfContext.SetImageLoader(loadImageData, nullptr);
+	bool fileLoaded = mapped ? loadMappedBinary(gltfContext, gltfModel, filename, loadImageData, error, warning) :
+		binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename.c_str()) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename.c_str());
+
+	std::vector<uint32_t> indexBuffer;
+	std::vector<Vertex> vertexBuffer;
+
+	if (!fileLoaded)
 	{
+		releaseMappedFile();
 		assert(false);
 		return;
 	}
 
+	// All textures share one staging arena and one submit, the geometry goes through the staging belt
+	UploadBatch batch;
+	batch.begin(device);
+	if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
+		loadTextureSamplers(gltfModel);
+		loadTextures(gltfModel, batch);
+	}
+	loadScene(gltfModel, fileLoadingFlags, scale, indexBuffer, vertexBuffer);
+	releaseMappedFile();
+	recordGeometryUpload(indexBuffer, vertexBuffer);
+	device->getStagingBelt().flush();
+
+	// The batch contains mip blits, a dedicated transfer queue could not run them
+	batch.submit(device->getGraphicsQueue());
+	batch.wait();
+	batch.destroy();
+	setGeometryMovable();
+}
+
+void VulkanglTFModel::setLoadFlags(const std::string& filename, uint32_t fileLoadingFlags)
+{
+	loadFlags = fileLoadingFlags;
+	compressTextures = (fileLoadingFlags & FileLoadingFlags::CompressTextures) &&
+		texture::isFormatSupported(device, VK_FORMAT_BC1_RGB_UNORM_BLOCK) && texture::isFormatSupported(device, VK_FORMAT_BC3_UNORM_BLOCK);
+	textureCacheDirectory = (std::filesystem::path(filename).parent_path() / "texture_cache").string();
+
+	// Without linear filtering of RGBA8 the blits can't build the chains, the compute pass has to
+	if (!mipGenerator) {
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(device->getPhysicalDevice(), VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+			mipGenerator = device->getMipGenerator();
+		}
+	}
+}
+
+void VulkanglTFModel::loadScene(tinygltf::Model& gltfModel, uint32_t fileLoadingFlags, float scale, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer)
+{
+	loadMaterials(gltfModel);
+	const tinygltf::Scene& scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+	SceneArena::Counts counts;
+	std::set<int> sharedMeshes;
+	for (int node : scene.nodes) {
+		countNode(gltfModel.nodes[node], gltfModel, sharedMeshes, counts);
+	}
+	arena.reserve(counts);
+	nodes = arena.allocateNodes(static_cast<uint32_t>(scene.nodes.size()));
+	for (size_t i = 0; i < scene.nodes.size(); i++) {
+		const tinygltf::Node& node = gltfModel.nodes[scene.nodes[i]];
+		loadNode(nullptr, nodes[i], node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+	}
+	linearNodes = arena.getNodes();
+	meshes = arena.getMeshes();
+	meshCache.clear();
+	for (Mesh* mesh : meshes) {
+		mesh->instances.resize(mesh->instanceCount, glm::mat4(1.0f));
+	}
+	if (fileLoadingFlags & FileLoadingFlags::GenerateLods) {
+		generateLods(indexBuffer, vertexBuffer);
+	}
+	if (gltfModel.animations.size() > 0) {
+		loadAnimations(gltfModel);
+	}
+	loadSkins(gltfModel);
+
+	// Assign skins
+	for (Node* node : linearNodes) {
+		if (node->skinIndex > -1) {
+			node->skin = skins[node->skinIndex];
+		}
+	}
+	// Initial pose
+	updateNodes();
+
+	setupIK();
+
 	// Pre-Calculations for requested features
 	if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) || (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) || (fileLoadingFlags & FileLoadingFlags::FlipY)) {
 		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
@@ -357,106 +618,219 @@ void VulkanglTFModel::loadFromFile(const std::string& filename, Device* _device,
 		}
 	}
 	extensions = gltfModel.extensionsUsed;
-	{
-		// Create and upload vertex and index buffer
-		size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
-		size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
-		indices.count = static_cast<uint32_t>(indexBuffer.size());
+	indices.count = static_cast<uint32_t>(indexBuffer.size());
+	getSceneDimensions();
+}
 
-		struct StagingBuffer 
-		{
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-		} vertexStaging, indexStaging;
+static void setBufferMovable(Device* device, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, memory::Allocation& allocation)
+{
+	memory::Allocator::Movable movable;
+	movable.buffer = buffer;
+	movable.bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	movable.bufferInfo.size = size;
+	movable.bufferInfo.usage = usage;
+	movable.bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	movable.moved = [&buffer, &allocation](VkBuffer movedBuffer, VkImage, const memory::Allocation& movedAllocation) {
+		buffer = movedBuffer;
+		allocation = movedAllocation;
+	};
+	device->getAllocator().setMovable(allocation, movable);
+}
 
-		// Create host visible staging buffers (source)
-		buffer::createBuffer(
-			device,
-			vertexBufferSize,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			VK_SHARING_MODE_EXCLUSIVE,
-			&vertexStaging.buffer,
-			&vertexStaging.memory,
-			vertexBuffer.data());
-
-		// Index data
-		if (indexBufferSize > 0) {
-			buffer::createBuffer(
-				device,
-				indexBufferSize,
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				VK_SHARING_MODE_EXCLUSIVE,
-				&indexStaging.buffer,
-				&indexStaging.memory,
-				indexBuffer.data());
-		}
-		// Create device local buffers (target)
+// Once the upload completed. Geometry is bound by handle every time the model is recorded, so the defragmenter may move it
+void VulkanglTFModel::setGeometryMovable()
+{
+	const VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	setBufferMovable(device, VkDeviceSize(vertices.count) * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | transferUsage, vertices.buffer, vertices.allocation);
+	if (indices.count > 0) {
+		setBufferMovable(device, VkDeviceSize(indices.count) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | transferUsage, indices.buffer, indices.allocation);
+	}
+}
+
+void VulkanglTFModel::recordGeometryUpload(const std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer)
+{
+	size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
+	size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
+	vertices.count = static_cast<int>(vertexBuffer.size());
+	indices.count = static_cast<uint32_t>(indexBuffer.size());
+
+	// Create device local buffers (target), TRANSFER_SRC for the defragmenter
+	buffer::createBuffer(
+		device,
+		vertexBufferSize,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		VK_SHARING_MODE_EXCLUSIVE,
+		&vertices.buffer,
+		&vertices.allocation);
+	device->getStagingBelt().copyToBuffer(vertexBuffer.data(), vertexBufferSize, vertices.buffer);
+
+	if (indexBufferSize > 0) {
 		buffer::createBuffer(
 			device,
-			vertexBufferSize,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			indexBufferSize,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			VK_SHARING_MODE_EXCLUSIVE,
-			&vertices.buffer,
-			&vertices.memory);
+			&indices.buffer,
+			&indices.allocation);
+		device->getStagingBelt().copyToBuffer(indexBuffer.data(), indexBufferSize, indices.buffer);
+	}
+}
 
-		if (indexBufferSize > 0) {
-			buffer::createBuffer(
-				device,
-				indexBufferSize,
-				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				VK_SHARING_MODE_EXCLUSIVE,
-				&indices.buffer,
-				&indices.memory);
+// Returns tightly packed RGBA8 pixels, converting RGB images into scratch
+static const unsigned char* toRGBA(const tinygltf::Image& gltfimage, std::vector<unsigned char>& scratch)
+{
+	if (gltfimage.component != 3) {
+		return gltfimage.image.data();
+	}
+	scratch.resize(size_t(gltfimage.width) * gltfimage.height * 4);
+	unsigned char* rgba = scratch.data();
+	const unsigned char* rgb = gltfimage.image.data();
+	for (size_t i = 0; i < size_t(gltfimage.width) * gltfimage.height; ++i) {
+		for (int32_t j = 0; j < 3; ++j) {
+			rgba[j] = rgb[j];
 		}
+		rgba[3] = 255;
+		rgba += 4;
+		rgb += 3;
+	}
+	return scratch.data();
+}
 
-		// Copy from staging buffers
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->getCommandPool(), true);
+// MSFT_texture_dds points at a DDS version of the image, prefer it over the png or jpg
+static int getTextureSource(const tinygltf::Texture& tex)
+{
+	auto extension = tex.extensions.find("MSFT_texture_dds");
+	if (extension != tex.extensions.end() && extension->second.Has("source")) {
+		return extension->second.Get("source").Get<int>();
+	}
+	return tex.source;
+}
 
-		VkBufferCopy copyRegion = {};
+// Encoded bytes of an image, either in the mapped BIN chunk or kept by the image loader
+static bool getEncodedImage(const tinygltf::Image& gltfimage, const MappedRange& mapped, const unsigned char*& bytes, size_t& size)
+{
+	if (mapped.data) {
+		bytes = mapped.data;
+		size = mapped.size;
+		return true;
+	}
+	if (gltfimage.as_is) {
+		bytes = gltfimage.image.data();
+		size = gltfimage.image.size();
+		return true;
+	}
+	return false;
+}
 
-		copyRegion.size = vertexBufferSize;
-		vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
+void VulkanglTFModel::loadTextures(tinygltf::Model& gltfModel, UploadBatch& batch)
+{
+	findTextureUsages(gltfModel);
+	const bool streamTextures = loadFlags & FileLoadingFlags::StreamTextures;
+	if (streamTextures) {
+		streamedTextures.resize(gltfModel.textures.size());
+	}
+	// Pixels tinygltf decoded or kept encoded are freed as soon as the last texture using them is recorded
+	std::vector<uint32_t> imageUses(gltfModel.images.size());
+	for (const tinygltf::Texture& tex : gltfModel.textures) {
+		imageUses[getTextureSource(tex)]++;
+	}
+	auto releaseImage = [&gltfModel, &imageUses](int source) {
+		if (--imageUses[source] == 0) {
+			std::vector<unsigned char>().swap(gltfModel.images[source].image);
+		}
+	};
 
-		if (indexBufferSize > 0) {
-			copyRegion.size = indexBufferSize;
-			vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
+	std::vector<unsigned char> scratch;
+	for (size_t i = 0; i < gltfModel.textures.size(); i++) {
+		const tinygltf::Texture& tex = gltfModel.textures[i];
+		const int source = getTextureSource(tex);
+		const tinygltf::Image& image = gltfModel.images[source];
+		const MappedRange mapped = size_t(source) < mappedImages.size() ? mappedImages[source] : MappedRange{};
+
+		// Another texture or model built the same image already
+		const TextureCache::ImageKey key = getImageKey(image, mapped, i);
+		TextureObject cached;
+		if (TextureCache::instance().acquireImage(key, cached)) {
+			cached.sampler = createTextureSampler(getTextureSampler(tex));
+			textures.push_back(cached);
+			releaseImage(source);
+			continue;
 		}
 
-		device->flushCommandBuffer(copyCmd, transferQueue);
+		const unsigned char* encoded = nullptr;
+		size_t encodedSize = 0;
+		bool isEncoded = getEncodedImage(image, mapped, encoded, encodedSize);
+		if (isEncoded && texture::isCompressedContainer(encoded, encodedSize)) {
+			MipChain compressed;
+			if (!texture::loadCompressedImage(encoded, encodedSize, compressed)) {
+				throw std::runtime_error("failed to load compressed image \"" + image.name + "\"!");
+			}
+			textures.push_back(streamTextures ? recordStreamedTexture(i, compressed, getTextureSampler(tex), batch) : recordMipChainUpload(compressed, getTextureSampler(tex), batch));
+			TextureCache::instance().addImage(key, textures.back());
+			releaseImage(source);
+			continue;
+		}
 
-		vkDestroyBuffer(device->getDevice(), vertexStaging.buffer, nullptr);
-		vkFreeMemory(device->getDevice(), vertexStaging.memory, nullptr);
-		if (indexBufferSize > 0) {
-			vkDestroyBuffer(device->getDevice(), indexStaging.buffer, nullptr);
-			vkFreeMemory(device->getDevice(), indexStaging.memory, nullptr);
+		const unsigned char* pixels = nullptr;
+		uint32_t width = image.width;
+		uint32_t height = image.height;
+		stbi_uc* decoded = nullptr;
+		if (isEncoded) {
+			// Decode straight out of the mapped BIN chunk
+			int w, h, components;
+			decoded = stbi_load_from_memory(encoded, static_cast<int>(encodedSize), &w, &h, &components, 4);
+			if (!decoded) {
+				throw std::runtime_error("failed to decode image \"" + image.name + "\"!");
+			}
+			pixels = decoded;
+			width = static_cast<uint32_t>(w);
+			height = static_cast<uint32_t>(h);
+		}
+		else {
+			pixels = toRGBA(image, scratch);
 		}
-		getSceneDimensions();
-	}
-}
 
-void VulkanglTFModel::loadTextures(tinygltf::Model& gltfModel, Device* device, VkQueue transferQueue)
-{
-	for (tinygltf::Texture& tex : gltfModel.textures) {
-		tinygltf::Image image = gltfModel.images[tex.source];
-		TextureSampler textureSampler;
-		if (tex.sampler == -1) {
-			// No sampler specified, use a default one
-			textureSampler.magFilter = VK_FILTER_LINEAR;
-			textureSampler.minFilter = VK_FILTER_LINEAR;
-			textureSampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-			textureSampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-			textureSampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		MipChain chain;
+		if (buildMipChain(pixels, width, height, i, 0, chain)) {
+			textures.push_back(streamTextures ? recordStreamedTexture(i, chain, getTextureSampler(tex), batch) : recordMipChainUpload(chain, getTextureSampler(tex), batch));
 		}
 		else {
-			textureSampler = textureSamplers[tex.sampler];
+			textures.push_back(recordTextureUpload(pixels, width, height, getTextureSampler(tex), textureUsages[i].srgb, batch));
 		}
-		TextureObject texture = fromglTfImage(image, device, transferQueue, textureSampler);
-		textures.push_back(texture);
+		TextureCache::instance().addImage(key, textures.back());
+		if (decoded) {
+			stbi_image_free(decoded);
+		}
+		releaseImage(source);
+	}
+	std::vector<unsigned char>().swap(scratch);
+
+	if (mipGenerator) {
+		std::vector<TextureObject*> uploaded;
+		for (TextureObject& texture : textures) {
+			uploaded.push_back(&texture);
+		}
+		recordTextureMips(batch, uploaded);
+	}
+}
+
+TextureSampler VulkanglTFModel::getTextureSampler(const tinygltf::Texture& tex)
+{
+	TextureSampler textureSampler;
+	if (tex.sampler == -1) {
+		// No sampler specified, use a default one
+		textureSampler.magFilter = VK_FILTER_LINEAR;
+		textureSampler.minFilter = VK_FILTER_LINEAR;
+		textureSampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		textureSampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		textureSampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	}
+	else {
+		textureSampler = textureSamplers[tex.sampler];
 	}
+	return textureSampler;
 }
 
 void VulkanglTFModel::loadTextureSamplers(tinygltf::Model& gltfModel)
@@ -505,233 +879,1108 @@ VkFilter VulkanglTFModel::getVkFilterMode(int32_t filterMode)
 	}
 }
 
-TextureObject VulkanglTFModel::fromglTfImage(tinygltf::Image& gltfimage, Device* device, VkQueue copyQueue, TextureSampler sampler)
+TextureObject VulkanglTFModel::recordTextureUpload(const unsigned char* pixels, uint32_t width, uint32_t height, TextureSampler sampler, bool srgb, UploadBatch& batch)
+{
+	VkCommandBuffer commandBuffer = batch.commandBuffer;
+	TextureObject texObj;
+	VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	VkDeviceSize bufferSize = VkDeviceSize(width) * height * 4;
+
+	VkFormatProperties formatProperties;
+
+	texObj.device = device;
+	texObj.format = format;
+	texObj.width = width;
+	texObj.height = height;
+	texObj.mipLevels = static_cast<uint32_t>(floor(log2(std::max(texObj.width, texObj.height))) + 1.0);
+	texObj.is_srgb = srgb;
+	const bool computeMips = mipGenerator && mipGenerator->isSupported(texObj);
+
+	if (!computeMips) {
+		vkGetPhysicalDeviceFormatProperties(device->getPhysicalDevice(), format, &formatProperties);
+		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
+		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+	}
+
+	UploadBatch::Allocation staging = batch.stage(pixels, bufferSize);
+
+	VkImageCreateInfo imageCreateInfo{};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = format;
+	imageCreateInfo.mipLevels = texObj.mipLevels;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.extent = { texObj.width, texObj.height, 1 };
+	imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (computeMips) {
+		imageCreateInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+	VK_CHECK(vkCreateImage(device->getDevice(), &imageCreateInfo, nullptr, &texObj.image));
+	texObj.allocation = memory::allocate(device, texObj.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	texObj.buffer_size = texObj.allocation.size;
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.levelCount = 1;
+	subresourceRange.layerCount = 1;
+
+	{
+		VkImageMemoryBarrier imageMemoryBarrier{};
+		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageMemoryBarrier.srcAccessMask = 0;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarrier.image = texObj.image;
+		imageMemoryBarrier.subresourceRange = subresourceRange;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	}
+
+	VkBufferImageCopy bufferCopyRegion = {};
+	bufferCopyRegion.bufferOffset = staging.offset;
+	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	bufferCopyRegion.imageSubresource.mipLevel = 0;
+	bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+	bufferCopyRegion.imageSubresource.layerCount = 1;
+	bufferCopyRegion.imageExtent.width = texObj.width;
+	bufferCopyRegion.imageExtent.height = texObj.height;
+	bufferCopyRegion.imageExtent.depth = 1;
+
+	vkCmdCopyBufferToImage(commandBuffer, staging.buffer, texObj.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+
+	if (computeMips) {
+		// Level 0 stays in TRANSFER_DST_OPTIMAL, recordTextureMips writes the rest of the chain
+		texObj.image_layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	}
+	else {
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageMemoryBarrier.image = texObj.image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
+
+		// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
+		for (uint32_t i = 1; i < texObj.mipLevels; i++) {
+			VkImageBlit imageBlit{};
+
+			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageBlit.srcSubresource.layerCount = 1;
+			imageBlit.srcSubresource.mipLevel = i - 1;
+			imageBlit.srcOffsets[1].x = std::max(int32_t(texObj.width >> (i - 1)), 1);
+			imageBlit.srcOffsets[1].y = std::max(int32_t(texObj.height >> (i - 1)), 1);
+			imageBlit.srcOffsets[1].z = 1;
+
+			imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageBlit.dstSubresource.layerCount = 1;
+			imageBlit.dstSubresource.mipLevel = i;
+			imageBlit.dstOffsets[1].x = std::max(int32_t(texObj.width >> i), 1);
+			imageBlit.dstOffsets[1].y = std::max(int32_t(texObj.height >> i), 1);
+			imageBlit.dstOffsets[1].z = 1;
+
+			VkImageSubresourceRange mipSubRange = {};
+			mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			mipSubRange.baseMipLevel = i;
+			mipSubRange.levelCount = 1;
+			mipSubRange.layerCount = 1;
+
+			{
+				VkImageMemoryBarrier imageMemoryBarrier{};
+				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				imageMemoryBarrier.srcAccessMask = 0;
+				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				imageMemoryBarrier.image = texObj.image;
+				imageMemoryBarrier.subresourceRange = mipSubRange;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+			}
+
+			vkCmdBlitImage(commandBuffer, texObj.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texObj.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+
+			{
+				VkImageMemoryBarrier imageMemoryBarrier{};
+				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				imageMemoryBarrier.image = texObj.image;
+				imageMemoryBarrier.subresourceRange = mipSubRange;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+			}
+		}
+
+		subresourceRange.levelCount = texObj.mipLevels;
+		texObj.image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageMemoryBarrier.image = texObj.image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
+	}
+
+	texObj.sampler = createTextureSampler(sampler);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = texObj.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.levelCount = texObj.mipLevels;
+	VK_CHECK(vkCreateImageView(device->getDevice(), &viewInfo, nullptr, &texObj.view));
+
+	return texObj;
+}
+
+TextureObject VulkanglTFModel::recordMipChainUpload(const MipChain& image, TextureSampler sampler, UploadBatch& batch, uint32_t firstLevel)
+{
+	if (!texture::isFormatSupported(device, image.format)) {
+		throw std::runtime_error("texture format " + std::to_string(image.format) + " is not supported by the device!");
+	}
+	TextureObject texObj = texture::recordMipChainUpload(device, image, batch, firstLevel);
+	texObj.sampler = createTextureSampler(sampler);
+	return texObj;
+}
+
+VkSampler VulkanglTFModel::createTextureSampler(TextureSampler sampler)
+{
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = sampler.magFilter;
+	samplerInfo.minFilter = sampler.minFilter;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = sampler.addressModeU;
+	samplerInfo.addressModeV = sampler.addressModeV;
+	samplerInfo.addressModeW = sampler.addressModeW;
+	samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	// The view limits the levels, so textures with any number of them share the sampler
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerInfo.maxAnisotropy = 8.0f;
+	samplerInfo.anisotropyEnable = VK_TRUE;
+	return TextureCache::instance().acquireSampler(device->getDevice(), samplerInfo);
+}
+
+TextureCache::ImageKey VulkanglTFModel::getImageKey(const tinygltf::Image& gltfimage, const MappedRange& mapped, size_t textureIndex) const
+{
+	TextureCache::ImageKey key;
+	if (loadFlags & FileLoadingFlags::StreamTextures) {
+		return key;
+	}
+
+	// Everything between the content and the image, mips are filtered in sRGB with alpha coverage and may be BC encoded
+	uint64_t variant = 14695981039346656037ull;
+	auto mix = [&variant](const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			variant = (variant ^ bytes[i]) * 1099511628211ull;
+		}
+	};
+	const uint32_t options[4] = { uint32_t(textureUsages[textureIndex].srgb), uint32_t(compressTextures), loadFlags & FileLoadingFlags::BuildMipsOnCpu, uint32_t(mipFilter) };
+	mix(options, sizeof(options));
+	mix(&textureUsages[textureIndex].alphaCutoff, sizeof(float));
+
+	const unsigned char* encoded = nullptr;
+	size_t encodedSize = 0;
+	if (getEncodedImage(gltfimage, mapped, encoded, encodedSize)) {
+		key.contentHash = TextureCache::hashContent(encoded, encodedSize);
+		key.contentSize = encodedSize;
+	}
+	else {
+		// Decoded by tinygltf, the layout of the pixels is part of the content
+		const int32_t layout[4] = { 1, gltfimage.width, gltfimage.height, gltfimage.component };
+		mix(layout, sizeof(layout));
+		key.contentHash = TextureCache::hashContent(gltfimage.image.data(), gltfimage.image.size());
+		key.contentSize = gltfimage.image.size();
+	}
+	key.variant = variant;
+	return key;
+}
+
+void VulkanglTFModel::releaseTexture(TextureObject& texture)
+{
+	TextureCache::instance().release(device->getDevice(), texture);
+}
+
+void VulkanglTFModel::recordTextureMips(UploadBatch& batch, std::vector<TextureObject*> textures)
+{
+	// Only the textures recordTextureUpload left to the compute pass
+	textures.erase(std::remove_if(textures.begin(), textures.end(), [](TextureObject* texture) {
+		return texture->image_layout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	}), textures.end());
+	if (!textures.empty()) {
+		mipGenerator->record(batch, textures);
+	}
+}
+
+void VulkanglTFModel::findTextureUsages(const tinygltf::Model& gltfModel)
+{
+	// Resolved the same way loadMaterials looks the textures up
+	textureUsages.assign(gltfModel.textures.size(), TextureUsage());
+	auto mark = [this](int index, float alphaCutoff) {
+		if (index >= 0 && size_t(index) < textureUsages.size()) {
+			textureUsages[index].srgb = true;
+			textureUsages[index].alphaCutoff = std::max(textureUsages[index].alphaCutoff, alphaCutoff);
+		}
+	};
+	for (const tinygltf::Material& mat : gltfModel.materials) {
+		float alphaCutoff = -1.0f;
+		auto alphaMode = mat.additionalValues.find("alphaMode");
+		if (alphaMode != mat.additionalValues.end() && alphaMode->second.string_value == "MASK") {
+			auto cutoff = mat.additionalValues.find("alphaCutoff");
+			alphaCutoff = cutoff != mat.additionalValues.end() ? static_cast<float>(cutoff->second.Factor()) : 0.5f;
+		}
+		auto baseColor = mat.values.find("baseColorTexture");
+		if (baseColor != mat.values.end()) {
+			mark(gltfModel.textures[baseColor->second.TextureIndex()].source, alphaCutoff);
+		}
+		auto emissive = mat.additionalValues.find("emissiveTexture");
+		if (emissive != mat.additionalValues.end()) {
+			mark(gltfModel.textures[emissive->second.TextureIndex()].source, -1.0f);
+		}
+		auto ext = mat.extensions.find("KHR_materials_pbrSpecularGlossiness");
+		if (ext != mat.extensions.end()) {
+			if (ext->second.Has("diffuseTexture")) {
+				mark(ext->second.Get("diffuseTexture").Get("index").Get<int>(), alphaCutoff);
+			}
+			if (ext->second.Has("specularGlossinessTexture")) {
+				mark(ext->second.Get("specularGlossinessTexture").Get("index").Get<int>(), -1.0f);
+			}
+		}
+	}
+}
+
+bool VulkanglTFModel::buildMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, size_t textureIndex, uint32_t threadCount, MipChain& chain) const
+{
+	if (!compressTextures && !(loadFlags & (FileLoadingFlags::BuildMipsOnCpu | FileLoadingFlags::StreamTextures))) {
+		return false;
+	}
+	texture::MipBuildOptions options;
+	options.filter = mipFilter;
+	options.srgb = textureUsages[textureIndex].srgb;
+	options.alphaCutoff = textureUsages[textureIndex].alphaCutoff;
+	options.threadCount = threadCount;
+	texture::buildMipChainCached(pixels, width, height, options, compressTextures, textureCacheDirectory, chain);
+	return true;
+}
+
+/*
+	glTF asynchronous loading
+*/
+
+// Textures at most this size are uploaded with the geometry, larger ones get a proxy of this size first
+static const uint32_t proxyTextureSize = 64;
+
+// Image loader for tinygltf that keeps the encoded bytes, decoding happens later on worker threads
+static bool keepEncodedImage(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData)
+{
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+	return true;
+}
+
+void VulkanglTFModel::decodeImage(const tinygltf::Image& gltfimage, const MappedRange& mapped, size_t textureIndex, DecodedImage& decoded) const
+{
+	decoded.key = getImageKey(gltfimage, mapped, textureIndex);
+	if (TextureCache::instance().acquireImage(decoded.key, decoded.cached)) {
+		return;
+	}
+
+	const unsigned char* encoded = nullptr;
+	size_t encodedSize = 0;
+	bool isEncoded = getEncodedImage(gltfimage, mapped, encoded, encodedSize);
+	if (isEncoded && texture::isCompressedContainer(encoded, encodedSize)) {
+		if (!texture::loadCompressedImage(encoded, encodedSize, decoded.mipChain)) {
+			throw std::runtime_error("failed to load compressed image \"" + gltfimage.name + "\"!");
+		}
+		return;
+	}
+
+	if (isEncoded) {
+		int width, height, components;
+		stbi_uc* data = stbi_load_from_memory(encoded, static_cast<int>(encodedSize), &width, &height, &components, 4);
+		if (!data) {
+			throw std::runtime_error("failed to decode image \"" + gltfimage.name + "\"!");
+		}
+		decoded.width = static_cast<uint32_t>(width);
+		decoded.height = static_cast<uint32_t>(height);
+		decoded.pixels.assign(data, data + size_t(width) * height * 4);
+		stbi_image_free(data);
+	}
+	else {
+		std::vector<unsigned char> scratch;
+		const unsigned char* pixels = toRGBA(gltfimage, scratch);
+		decoded.width = static_cast<uint32_t>(gltfimage.width);
+		decoded.height = static_cast<uint32_t>(gltfimage.height);
+		decoded.pixels.assign(pixels, pixels + size_t(decoded.width) * decoded.height * 4);
+	}
+
+	// Already a worker per image, the chain is built on this thread. It needs no blits, so it goes up whole with the geometry
+	if (buildMipChain(decoded.pixels.data(), decoded.width, decoded.height, textureIndex, 1, decoded.mipChain)) {
+		std::vector<unsigned char>().swap(decoded.pixels);
+		return;
+	}
+
+	if (std::max(decoded.width, decoded.height) <= proxyTextureSize) {
+		// Small enough to go up with the geometry, nothing left to stream
+		decoded.proxyPixels = std::move(decoded.pixels);
+		decoded.pixels.clear();
+		decoded.proxyWidth = decoded.width;
+		decoded.proxyHeight = decoded.height;
+		return;
+	}
+
+	// 2x2 box filter down to the proxy size
+	std::vector<unsigned char> src = decoded.pixels;
+	uint32_t width = decoded.width;
+	uint32_t height = decoded.height;
+	while (std::max(width, height) > proxyTextureSize) {
+		uint32_t dstWidth = std::max(width / 2, 1u);
+		uint32_t dstHeight = std::max(height / 2, 1u);
+		std::vector<unsigned char> dst(size_t(dstWidth) * dstHeight * 4);
+		for (uint32_t y = 0; y < dstHeight; y++) {
+			uint32_t y0 = std::min(y * 2, height - 1);
+			uint32_t y1 = std::min(y * 2 + 1, height - 1);
+			for (uint32_t x = 0; x < dstWidth; x++) {
+				uint32_t x0 = std::min(x * 2, width - 1);
+				uint32_t x1 = std::min(x * 2 + 1, width - 1);
+				for (uint32_t c = 0; c < 4; c++) {
+					uint32_t sum = src[(size_t(y0) * width + x0) * 4 + c] + src[(size_t(y0) * width + x1) * 4 + c] +
+						src[(size_t(y1) * width + x0) * 4 + c] + src[(size_t(y1) * width + x1) * 4 + c];
+					dst[(size_t(y) * dstWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+		src.swap(dst);
+		width = dstWidth;
+		height = dstHeight;
+	}
+	decoded.proxyPixels = std::move(src);
+	decoded.proxyWidth = width;
+	decoded.proxyHeight = height;
+}
+
+void VulkanglTFModel::decodeImages(tinygltf::Model& gltfModel)
+{
+	const uint32_t count = static_cast<uint32_t>(gltfModel.textures.size());
+	findTextureUsages(gltfModel);
+	asyncLoad->images.resize(count);
+	asyncLoad->samplers.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		asyncLoad->samplers[i] = getTextureSampler(gltfModel.textures[i]);
+	}
+
+	// Materials keep pointers into textures, so the slots have to exist before loadMaterials
+	textures.resize(count);
+	if (loadFlags & FileLoadingFlags::StreamTextures) {
+		streamedTextures.resize(count);
+	}
+	asyncLoad->handle->texturesTotal = count;
+
+	const uint32_t workerCount = std::max(1u, std::min(count, std::thread::hardware_concurrency()));
+	std::vector<std::future<void>> decoders;
+	for (uint32_t worker = 0; worker < workerCount; worker++) {
+		decoders.push_back(std::async(std::launch::async, [this, &gltfModel, count, workerCount, worker]() {
+			for (uint32_t i = worker; i < count; i += workerCount) {
+				const size_t source = size_t(getTextureSource(gltfModel.textures[i]));
+				decodeImage(gltfModel.images[source], source < mappedImages.size() ? mappedImages[source] : MappedRange{}, i, asyncLoad->images[i]);
+			}
+		}));
+	}
+	for (auto& decoder : decoders) {
+		decoder.get();
+	}
+	// Encoded bytes are not needed anymore
+	for (auto& image : gltfModel.images) {
+		std::vector<unsigned char>().swap(image.image);
+	}
+}
+
+std::shared_ptr<LoadHandle> VulkanglTFModel::loadFromFileAsync(const std::string& filename, Device* _device, uint32_t fileLoadingFlags, float scale, std::function<void(VulkanglTFModel*)> onComplete)
+{
+	device = _device;
+	copyQueue = device->getGraphicsQueue();
+
+	setLoadFlags(filename, fileLoadingFlags);
+
+	asyncLoad = std::make_unique<AsyncLoad>();
+	asyncLoad->handle = std::make_shared<LoadHandle>();
+	asyncLoad->onComplete = onComplete;
+
+	AsyncLoad* load = asyncLoad.get();
+	load->worker = std::async(std::launch::async, [this, load, filename, fileLoadingFlags, scale]() {
+		try {
+			tinygltf::Model    gltfModel;
+			tinygltf::TinyGLTF gltfContext;
+			std::string        error, warning;
+			gltfContext.SetImageLoader(keepEncodedImage, nullptr);
+
+			const bool binary = isBinaryFile(filename);
+			bool fileLoaded = binary && !(fileLoadingFlags & FileLoadingFlags::DontMapFile) ? loadMappedBinary(gltfContext, gltfModel, filename, keepEncodedImage, error, warning) :
+				binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename.c_str()) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename.c_str());
+			if (!fileLoaded) {
+				releaseMappedFile();
+				load->handle->error = error;
+				load->handle->state = LoadState::Failed;
+				return;
+			}
+
+			if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
+				loadTextureSamplers(gltfModel);
+				decodeImages(gltfModel);
+			}
+			loadScene(gltfModel, fileLoadingFlags, scale, load->indexBuffer, load->vertexBuffer);
+			releaseMappedFile();
+			load->handle->state = LoadState::Parsed;
+		}
+		catch (const std::exception& e) {
+			releaseMappedFile();
+			load->handle->error = e.what();
+			load->handle->state = LoadState::Failed;
+		}
+	});
+	return asyncLoad->handle;
+}
+
+LoadState VulkanglTFModel::pollLoad(uint32_t maxTextureUploads)
+{
+	if (!asyncLoad) {
+		return LoadState::Complete;
+	}
+	AsyncLoad* load = asyncLoad.get();
+	LoadHandle& handle = *load->handle;
+
+	// Proxies replaced by full textures may still be referenced by frames in flight
+	for (auto it = load->retired.begin(); it != load->retired.end();) {
+		if (it->framesLeft-- == 0) {
+			releaseTexture(it->texture);
+			it = load->retired.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	for (auto it = load->uploads.begin(); it != load->uploads.end();) {
+		const bool complete = it->batch.commandBuffer != VK_NULL_HANDLE ? it->batch.isComplete() : device->getStagingBelt().isComplete(it->token);
+		if (complete) {
+			finishUpload(*it);
+			it = load->uploads.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	if (handle.state == LoadState::Parsed) {
+		load->worker.get();
+
+		// Geometry goes through the staging belt and its transfer queue
+		PendingUpload geometry;
+		geometry.geometry = true;
+		recordGeometryUpload(load->indexBuffer, load->vertexBuffer);
+		geometry.token = device->getStagingBelt().flush();
+		load->uploads.push_back(std::move(geometry));
+		load->pendingGeometryUploads++;
+		std::vector<uint32_t>().swap(load->indexBuffer);
+		std::vector<Vertex>().swap(load->vertexBuffer);
+
+		// Proxy textures need blits for their mips, so they go through the graphics queue
+		if (!load->images.empty()) {
+			PendingUpload proxies;
+			proxies.geometry = true;
+			proxies.batch.begin(device);
+			for (size_t i = 0; i < load->images.size(); i++) {
+				DecodedImage& decoded = load->images[i];
+				if (decoded.cached.image != VK_NULL_HANDLE) {
+					textures[i] = decoded.cached;
+					textures[i].sampler = createTextureSampler(load->samplers[i]);
+					decoded.cached = TextureObject();
+					continue;
+				}
+				// Final textures are handed to the cache once the batch has completed
+				if (!decoded.mipChain.empty()) {
+					textures[i] = (loadFlags & FileLoadingFlags::StreamTextures) ? recordStreamedTexture(i, decoded.mipChain, load->samplers[i], proxies.batch) : recordMipChainUpload(decoded.mipChain, load->samplers[i], proxies.batch);
+					proxies.textureIndices.push_back(uint32_t(i));
+					decoded.mipChain = MipChain();
+					continue;
+				}
+				textures[i] = recordTextureUpload(decoded.proxyPixels.data(), decoded.proxyWidth, decoded.proxyHeight, load->samplers[i], textureUsages[i].srgb, proxies.batch);
+				if (decoded.pixels.empty()) {
+					proxies.textureIndices.push_back(uint32_t(i));
+				}
+				std::vector<unsigned char>().swap(decoded.proxyPixels);
+			}
+			if (mipGenerator) {
+				std::vector<TextureObject*> uploaded;
+				for (TextureObject& texture : textures) {
+					uploaded.push_back(&texture);
+				}
+				recordTextureMips(proxies.batch, uploaded);
+			}
+			proxies.batch.submit(device->getGraphicsQueue());
+			load->uploads.push_back(std::move(proxies));
+			load->pendingGeometryUploads++;
+		}
+		handle.state = LoadState::Uploading;
+	}
+
+	// Full resolution textures go up in batches of maxTextureUploads, one batch in flight at a time
+	if (handle.state == LoadState::Drawable && load->uploads.empty()) {
+		PendingUpload upload;
+		while (load->nextTexture < load->images.size() && upload.textures.size() < maxTextureUploads) {
+			DecodedImage& decoded = load->images[load->nextTexture];
+			if (!decoded.pixels.empty()) {
+				if (upload.batch.commandBuffer == VK_NULL_HANDLE) {
+					upload.batch.begin(device);
+				}
+				upload.textureIndices.push_back(load->nextTexture);
+				upload.textures.push_back(recordTextureUpload(decoded.pixels.data(), decoded.width, decoded.height, load->samplers[load->nextTexture], textureUsages[load->nextTexture].srgb, upload.batch));
+				std::vector<unsigned char>().swap(decoded.pixels);
+			}
+			load->nextTexture++;
+		}
+
+		if (!upload.textures.empty()) {
+			if (mipGenerator) {
+				std::vector<TextureObject*> uploaded;
+				for (TextureObject& texture : upload.textures) {
+					uploaded.push_back(&texture);
+				}
+				recordTextureMips(upload.batch, uploaded);
+			}
+			upload.batch.submit(device->getGraphicsQueue());
+			load->uploads.push_back(std::move(upload));
+		}
+		else if (load->nextTexture == load->images.size()) {
+			load->images.clear();
+			load->samplers.clear();
+			handle.state = LoadState::Complete;
+			if (load->onComplete) {
+				load->onComplete(this);
+			}
+		}
+	}
+	return handle.state;
+}
+
+void VulkanglTFModel::finishUpload(PendingUpload& upload)
+{
+	upload.batch.destroy();
+
+	LoadHandle& handle = *asyncLoad->handle;
+	TextureCache& textureCache = TextureCache::instance();
+	if (upload.geometry) {
+		for (uint32_t index : upload.textureIndices) {
+			textureCache.addImage(asyncLoad->images[index].key, textures[index]);
+		}
+		if (--asyncLoad->pendingGeometryUploads == 0) {
+			setGeometryMovable();
+			for (auto& decoded : asyncLoad->images) {
+				if (decoded.pixels.empty()) {
+					handle.texturesResident++;
+				}
+			}
+			handle.state = LoadState::Drawable;
+		}
+		return;
+	}
+
+	// Swap the full textures into the slots the materials point at and retire the proxies
+	for (size_t i = 0; i < upload.textures.size(); i++) {
+		uint32_t index = upload.textureIndices[i];
+		asyncLoad->retired.push_back({ textures[index], device->renderAhead + 1 });
+		textures[index] = upload.textures[i];
+		textureCache.addImage(asyncLoad->images[index].key, textures[index]);
+		handle.texturesResident++;
+	}
+	textureRevision++;
+}
+
+void VulkanglTFModel::releaseAsyncLoad()
+{
+	if (!asyncLoad) {
+		return;
+	}
+	if (asyncLoad->worker.valid()) {
+		asyncLoad->worker.wait();
+	}
+	for (auto& upload : asyncLoad->uploads) {
+		upload.batch.wait();
+		device->getStagingBelt().wait(upload.token);
+		upload.batch.destroy();
+		for (auto& texture : upload.textures) {
+			releaseTexture(texture);
+		}
+	}
+	for (auto& retired : asyncLoad->retired) {
+		releaseTexture(retired.texture);
+	}
+	// Cache hits a failed or abandoned load never used
+	for (auto& decoded : asyncLoad->images) {
+		releaseTexture(decoded.cached);
+	}
+	asyncLoad.reset();
+}
+
+bool VulkanglTFModel::isDrawable() const
 {
-	TextureObject texObj;
-	VkFormat format;
-	unsigned char* buffer = nullptr;
-	VkDeviceSize bufferSize = 0;
-	bool deleteBuffer = false;
-	if (gltfimage.component == 3) {
-		bufferSize = gltfimage.width * gltfimage.height * 4;
-		buffer = new unsigned char[bufferSize];
-		unsigned char* rgba = buffer;
-		unsigned char* rgb = &gltfimage.image[0];
-		for (size_t i = 0; i < gltfimage.width * gltfimage.height; ++i) {
-			for (int32_t j = 0; j < 3; ++j) {
-				rgba[j] = rgb[j];
-			}
-			rgba += 4;
-			rgb += 3;
+	return !asyncLoad || asyncLoad->handle->isDrawable();
+}
+
+VulkanglTFModel::MemoryStats VulkanglTFModel::getMemoryStats() const
+{
+	MemoryStats stats;
+	TextureCache& textureCache = TextureCache::instance();
+	for (size_t i = 0; i < textures.size(); i++) {
+		const TextureObject& texture = textures[i];
+		TextureMemory memory;
+		memory.hostBytes = texture.hostBytes();
+		if (i < streamedTextures.size()) {
+			memory.hostBytes += streamedTextures[i].chain.data.capacity();
 		}
-		deleteBuffer = true;
-	}
-	else {
-		buffer = &gltfimage.image[0];
-		bufferSize = gltfimage.image.size();
+		memory.deviceBytes = texture.deviceBytes();
+		memory.references = std::max(textureCache.getReferences(texture.image), 1u);
+		stats.textureHostBytes += memory.hostBytes;
+		stats.textureDeviceBytes += memory.deviceBytes;
+		if (memory.references > 1) {
+			stats.sharedTextureDeviceBytes += memory.deviceBytes;
+		}
+		stats.textures.push_back(memory);
 	}
 
-	format = VK_FORMAT_R8G8B8A8_UNORM;
+	auto bufferBytes = [this](VkBuffer buffer) -> VkDeviceSize {
+		if (buffer == VK_NULL_HANDLE) {
+			return 0;
+		}
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(device->getDevice(), buffer, &memReqs);
+		return memReqs.size;
+	};
+	stats.bufferDeviceBytes = bufferBytes(vertices.buffer) + bufferBytes(indices.buffer);
 
-	VkFormatProperties formatProperties;
+	// The decoders own the images until the load is parsed
+	if (asyncLoad && asyncLoad->handle->state != LoadState::Parsing) {
+		for (const DecodedImage& decoded : asyncLoad->images) {
+			stats.pendingHostBytes += decoded.pixels.capacity() + decoded.proxyPixels.capacity() + decoded.mipChain.data.capacity();
+		}
+	}
+	return stats;
+}
 
-	texObj.width = gltfimage.width;
-	texObj.height = gltfimage.height;
-	texObj.mipLevels = static_cast<uint32_t>(floor(log2(std::max(texObj.width, texObj.height))) + 1.0);
+/*
+	glTF texture streaming
+*/
 
-	vkGetPhysicalDeviceFormatProperties(device->getPhysicalDevice(), format, &formatProperties);
-	assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
-	assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
-
-	VkMemoryAllocateInfo memAllocInfo{};
-	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	VkMemoryRequirements memReqs{};
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingMemory;
-
-	VkBufferCreateInfo bufferCreateInfo{};
-	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferCreateInfo.size = bufferSize;
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	VK_CHECK(vkCreateBuffer(device->getDevice(), &bufferCreateInfo, nullptr, &stagingBuffer));
-	vkGetBufferMemoryRequirements(device->getDevice(), stagingBuffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK(vkAllocateMemory(device->getDevice(), &memAllocInfo, nullptr, &stagingMemory));
-	VK_CHECK(vkBindBufferMemory(device->getDevice(), stagingBuffer, stagingMemory, 0));
-
-	uint8_t* data;
-	VK_CHECK(vkMapMemory(device->getDevice(), stagingMemory, 0, memReqs.size, 0, (void**)&data));
-	memcpy(data, buffer, bufferSize);
-	vkUnmapMemory(device->getDevice(), stagingMemory);
+// Device memory of a chain from level on, staging copies the same bytes
+static VkDeviceSize chainBytes(const MipChain& chain, uint32_t level)
+{
+	return chain.data.size() - chain.levelOffsets[level];
+}
 
-	VkImageCreateInfo imageCreateInfo{};
-	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageCreateInfo.format = format;
-	imageCreateInfo.mipLevels = texObj.mipLevels;
-	imageCreateInfo.arrayLayers = 1;
-	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
-	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageCreateInfo.extent = { texObj.width, texObj.height, 1 };
-	imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-	VK_CHECK(vkCreateImage(device->getDevice(), &imageCreateInfo, nullptr, &texObj.image));
-	vkGetImageMemoryRequirements(device->getDevice(), texObj.image, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK(vkAllocateMemory(device->getDevice(), &memAllocInfo, nullptr, &texObj.image_memory));
-	VK_CHECK(vkBindImageMemory(device->getDevice(), texObj.image, texObj.image_memory, 0));
+TextureObject VulkanglTFModel::recordStreamedTexture(size_t textureIndex, MipChain& chain, TextureSampler sampler, UploadBatch& batch)
+{
+	// Only the tail goes up with the model, the chain stays behind for the larger levels
+	uint32_t tailLevel = 0;
+	while (tailLevel + 1 < chain.mipLevels() && std::max(chain.levelExtents[tailLevel].width, chain.levelExtents[tailLevel].height) > streamingTailSize) {
+		tailLevel++;
+	}
+	TextureObject texObj = recordMipChainUpload(chain, sampler, batch, tailLevel);
+
+	StreamedTexture& streamed = streamedTextures[textureIndex];
+	streamed.chain = std::move(chain);
+	streamed.sampler = sampler;
+	streamed.tailLevel = tailLevel;
+	streamed.residentLevel = tailLevel;
+	streamed.requiredLevel = tailLevel;
+	streamed.residentBytes = chainBytes(streamed.chain, tailLevel);
+	TextureStreamingBudget& budget = streamingBudget ? *streamingBudget : defaultStreamingBudget;
+	budget.residentBytes += streamed.residentBytes;
+	return texObj;
+}
 
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->getCommandPool(), true);
+void VulkanglTFModel::recordResidency(StreamedTexture& streamed, uint32_t textureIndex, uint32_t level, PendingUpload& upload)
+{
+	if (upload.batch.commandBuffer == VK_NULL_HANDLE) {
+		upload.batch.begin(device);
+	}
+	upload.textureIndices.push_back(textureIndex);
+	upload.textures.push_back(recordMipChainUpload(streamed.chain, streamed.sampler, upload.batch, level));
+	streamed.uploading = true;
+
+	// Counted when recorded, the replaced image is released a few frames after the swap
+	TextureStreamingBudget& budget = streamingBudget ? *streamingBudget : defaultStreamingBudget;
+	const VkDeviceSize bytes = chainBytes(streamed.chain, level);
+	budget.residentBytes = budget.residentBytes + bytes - streamed.residentBytes;
+	streamed.residentBytes = bytes;
+	streamingStats.bytesStreamed += bytes;
+}
 
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.levelCount = 1;
-	subresourceRange.layerCount = 1;
+void VulkanglTFModel::updateRequiredLevels()
+{
+	for (StreamedTexture& streamed : streamedTextures) {
+		streamed.screenSize = 0.0f;
+	}
 
-	{
-		VkImageMemoryBarrier imageMemoryBarrier{};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = 0;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.image = texObj.image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	if (lodProjectionScale > 0.0f) {
+		for (Node* node : linearNodes) {
+			if (!node->mesh || !node->mesh->bb.valid) {
+				continue;
+			}
+			const glm::vec3 center = (node->aabb.min + node->aabb.max) * 0.5f;
+			const float radius = glm::length(node->aabb.max - node->aabb.min) * 0.5f;
+			const float distance = std::max(glm::length(center - lodCameraPosition), radius);
+			const float meshSize = glm::length(node->mesh->bb.max - node->mesh->bb.min);
+			if (meshSize <= 0.0f) {
+				continue;
+			}
+			// Primitive boxes are in mesh space, the node transform scales them like the whole mesh
+			const float pixelsPerUnit = 2.0f * radius / meshSize * lodProjectionScale / std::max(distance, FLT_EPSILON);
+			for (Primitive* primitive : node->mesh->primitives) {
+				const BoundingBox& bb = primitive->bb.valid ? primitive->bb : node->mesh->bb;
+				const float size = glm::length(bb.max - bb.min) * pixelsPerUnit;
+				const Material& material = primitive->material;
+				for (const TextureObject* texture : { material.baseColorTexture, material.metallicRoughnessTexture, material.normalTexture, material.occlusionTexture,
+					material.emissiveTexture, material.extension.specularGlossinessTexture, material.extension.diffuseTexture }) {
+					if (texture) {
+						StreamedTexture& streamed = streamedTextures[texture - textures.data()];
+						streamed.screenSize = std::max(streamed.screenSize, size);
+					}
+				}
+			}
+		}
 	}
 
-	VkBufferImageCopy bufferCopyRegion = {};
-	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	bufferCopyRegion.imageSubresource.mipLevel = 0;
-	bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-	bufferCopyRegion.imageSubresource.layerCount = 1;
-	bufferCopyRegion.imageExtent.width = texObj.width;
-	bufferCopyRegion.imageExtent.height = texObj.height;
-	bufferCopyRegion.imageExtent.depth = 1;
+	// Texels roughly match pixels when the UVs span the primitive once
+	for (StreamedTexture& streamed : streamedTextures) {
+		if (streamed.chain.empty()) {
+			continue;
+		}
+		uint32_t level = streamed.tailLevel;
+		while (level > 0 && float(std::max(streamed.chain.levelExtents[level].width, streamed.chain.levelExtents[level].height)) < streamed.screenSize) {
+			level--;
+		}
+		streamed.requiredLevel = level;
+		if (level < streamed.tailLevel) {
+			streamed.lastRequiredFrame = streamingFrame;
+		}
+	}
+}
 
-	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, texObj.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+void VulkanglTFModel::updateTextureStreaming(VkDeviceSize maxUploadBytes)
+{
+	if (streamedTextures.empty() || !isDrawable()) {
+		return;
+	}
+	TextureStreamingBudget& budget = streamingBudget ? *streamingBudget : defaultStreamingBudget;
+	const VkDeviceSize bytesStreamed = streamingStats.bytesStreamed;
+	streamingFrame++;
 
-	{
-		VkImageMemoryBarrier imageMemoryBarrier{};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.image = texObj.image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	// Replaced images may still be referenced by frames in flight
+	for (auto it = streamingRetired.begin(); it != streamingRetired.end();) {
+		if (it->framesLeft-- == 0) {
+			releaseTexture(it->texture);
+			it = streamingRetired.erase(it);
+		}
+		else {
+			++it;
+		}
 	}
 
-	device->flushCommandBuffer(copyCmd, device->getGraphicsQueue(), true);
+	// Swap finished images into the slots the materials point at
+	for (auto it = streamingUploads.begin(); it != streamingUploads.end();) {
+		if (!it->batch.isComplete()) {
+			++it;
+			continue;
+		}
+		it->batch.destroy();
+		for (size_t i = 0; i < it->textures.size(); i++) {
+			const uint32_t index = it->textureIndices[i];
+			StreamedTexture& streamed = streamedTextures[index];
+			streamingRetired.push_back({ textures[index], device->renderAhead + 1 });
+			textures[index] = it->textures[i];
+			streamed.residentLevel = streamed.chain.mipLevels() - textures[index].mipLevels;
+			streamed.uploading = false;
+		}
+		textureRevision++;
+		it = streamingUploads.erase(it);
+	}
 
-	vkFreeMemory(device->getDevice(), stagingMemory, nullptr);
-	vkDestroyBuffer(device->getDevice(), stagingBuffer, nullptr);
+	updateRequiredLevels();
 
-	// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-	VkCommandBuffer blitCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->getCommandPool(), true);
-	for (uint32_t i = 1; i < texObj.mipLevels; i++) {
-		VkImageBlit imageBlit{};
+	PendingUpload upload;
+	std::vector<uint32_t> candidates;
 
-		imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageBlit.srcSubresource.layerCount = 1;
-		imageBlit.srcSubresource.mipLevel = i - 1;
-		imageBlit.srcOffsets[1].x = int32_t(texObj.width >> (i - 1));
-		imageBlit.srcOffsets[1].y = int32_t(texObj.height >> (i - 1));
-		imageBlit.srcOffsets[1].z = 1;
+	// Over budget, levels nobody needs go first, then the least recently needed and the smallest on screen
+	for (uint32_t i = 0; i < streamedTextures.size(); i++) {
+		const StreamedTexture& streamed = streamedTextures[i];
+		if (!streamed.chain.empty() && !streamed.uploading && streamed.residentLevel < streamed.tailLevel) {
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+		const StreamedTexture& ta = streamedTextures[a];
+		const StreamedTexture& tb = streamedTextures[b];
+		const bool surplusA = ta.residentLevel < ta.requiredLevel;
+		const bool surplusB = tb.residentLevel < tb.requiredLevel;
+		if (surplusA != surplusB) {
+			return surplusA;
+		}
+		if (ta.lastRequiredFrame != tb.lastRequiredFrame) {
+			return ta.lastRequiredFrame < tb.lastRequiredFrame;
+		}
+		return ta.screenSize < tb.screenSize;
+	});
+	for (uint32_t index : candidates) {
+		if (budget.residentBytes <= budget.budget) {
+			break;
+		}
+		StreamedTexture& streamed = streamedTextures[index];
+		// Unneeded levels are dropped at once, needed ones a level at a time
+		recordResidency(streamed, index, std::max(streamed.residentLevel + 1, streamed.requiredLevel), upload);
+	}
 
-		imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageBlit.dstSubresource.layerCount = 1;
-		imageBlit.dstSubresource.mipLevel = i;
-		imageBlit.dstOffsets[1].x = int32_t(texObj.width >> i);
-		imageBlit.dstOffsets[1].y = int32_t(texObj.height >> i);
-		imageBlit.dstOffsets[1].z = 1;
+	// Largest on screen first, as far as the budget and the bytes allowed per frame go
+	candidates.clear();
+	for (uint32_t i = 0; i < streamedTextures.size(); i++) {
+		const StreamedTexture& streamed = streamedTextures[i];
+		if (!streamed.chain.empty() && !streamed.uploading && streamed.requiredLevel < streamed.residentLevel) {
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+		return streamedTextures[a].screenSize > streamedTextures[b].screenSize;
+	});
+	VkDeviceSize uploadBytes = 0;
+	for (uint32_t index : candidates) {
+		StreamedTexture& streamed = streamedTextures[index];
+		uint32_t level = streamed.requiredLevel;
+		while (level < streamed.residentLevel && budget.residentBytes + chainBytes(streamed.chain, level) - streamed.residentBytes > budget.budget) {
+			level++;
+		}
+		if (level == streamed.residentLevel) {
+			continue;
+		}
+		const VkDeviceSize bytes = chainBytes(streamed.chain, level);
+		if (uploadBytes > 0 && uploadBytes + bytes > maxUploadBytes) {
+			break;
+		}
+		uploadBytes += bytes;
+		recordResidency(streamed, index, level, upload);
+	}
 
-		VkImageSubresourceRange mipSubRange = {};
-		mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		mipSubRange.baseMipLevel = i;
-		mipSubRange.levelCount = 1;
-		mipSubRange.layerCount = 1;
+	if (!upload.textures.empty()) {
+		upload.batch.submit(device->getGraphicsQueue());
+		streamingUploads.push_back(std::move(upload));
+	}
 
-		{
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = 0;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.image = texObj.image;
-			imageMemoryBarrier.subresourceRange = mipSubRange;
-			vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	streamingStats.levelsResident = 0;
+	streamingStats.levelsTotal = 0;
+	streamingStats.residentBytes = 0;
+	for (const StreamedTexture& streamed : streamedTextures) {
+		if (!streamed.chain.empty()) {
+			streamingStats.levelsResident += streamed.chain.mipLevels() - streamed.residentLevel;
+			streamingStats.levelsTotal += streamed.chain.mipLevels();
+			streamingStats.residentBytes += streamed.residentBytes;
 		}
+	}
+	streamingStats.budgetBytes = budget.budget;
+	streamingStats.budgetResidentBytes = budget.residentBytes;
 
-		vkCmdBlitImage(blitCmd, texObj.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texObj.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+	const auto now = std::chrono::steady_clock::now();
+	if (lastStreamingUpdate.time_since_epoch().count() != 0) {
+		const float seconds = std::chrono::duration<float>(now - lastStreamingUpdate).count();
+		if (seconds > 0.0f) {
+			const float bandwidth = float(streamingStats.bytesStreamed - bytesStreamed) / seconds;
+			streamingStats.bandwidth = glm::mix(streamingStats.bandwidth, bandwidth, 0.1f);
+		}
+	}
+	lastStreamingUpdate = now;
+}
 
-		{
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			imageMemoryBarrier.image = texObj.image;
-			imageMemoryBarrier.subresourceRange = mipSubRange;
-			vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+void VulkanglTFModel::releaseTextureStreaming()
+{
+	for (auto& upload : streamingUploads) {
+		upload.batch.wait();
+		upload.batch.destroy();
+		for (auto& texture : upload.textures) {
+			releaseTexture(texture);
 		}
 	}
+	streamingUploads.clear();
+	for (auto& retired : streamingRetired) {
+		releaseTexture(retired.texture);
+	}
+	streamingRetired.clear();
+	TextureStreamingBudget& budget = streamingBudget ? *streamingBudget : defaultStreamingBudget;
+	for (const StreamedTexture& streamed : streamedTextures) {
+		budget.residentBytes -= streamed.residentBytes;
+	}
+	streamedTextures.clear();
+}
 
-	subresourceRange.levelCount = texObj.mipLevels;
-	texObj.image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+/*
+	glTF bindless descriptors
+*/
 
-	{
-		VkImageMemoryBarrier imageMemoryBarrier{};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.image = texObj.image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-		vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+void VulkanglTFModel::createBindlessDescriptors(uint32_t frameCount)
+{
+	if (!device->supportsBindlessTextures()) {
+		throw std::runtime_error("device does not support descriptor indexed sampler arrays!");
+	}
+	if (textures.size() > maxBindlessTextures) {
+		throw std::runtime_error("model has more than " + std::to_string(maxBindlessTextures) + " textures!");
 	}
+	if (descriptorSetLayoutBindless == VK_NULL_HANDLE) {
+		std::vector<DescriptorSetLayoutBinding> bindings = {
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxBindlessTextures, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr,
+				VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT },
+		};
+		descriptorSetLayoutBindless = device->createDescriptorSetLayout(device->getDevice(), bindings);
+	}
+	releaseBindlessDescriptors();
 
-	device->flushCommandBuffer(copyCmd, device->getGraphicsQueue(), true);
+	auto textureIndex = [this](const TextureObject* texture) {
+		return texture ? static_cast<int>(texture - textures.data()) : -1;
+	};
+	std::vector<MaterialData> materialData;
+	for (const Material& material : materials) {
+		MaterialData data{};
+		data.emissiveFactor = material.emissiveFactor;
+		data.alphaMask = static_cast<float>(material.alphaMode == Material::ALPHAMODE_MASK);
+		data.alphaMaskCutoff = material.alphaCutoff;
+		data.normalTexture = textureIndex(material.normalTexture);
+		data.occlusionTexture = textureIndex(material.occlusionTexture);
+		data.emissiveTexture = textureIndex(material.emissiveTexture);
+		data.normalTextureSet = material.normalTexture ? material.texCoordSets.normal : -1;
+		data.occlusionTextureSet = material.occlusionTexture ? material.texCoordSets.occlusion : -1;
+		data.emissiveTextureSet = material.emissiveTexture ? material.texCoordSets.emissive : -1;
+		if (material.pbrWorkflows.specularGlossiness) {
+			data.workflow = 1.0f;
+			data.baseColorTexture = textureIndex(material.extension.diffuseTexture);
+			data.physicalDescriptorTexture = textureIndex(material.extension.specularGlossinessTexture);
+			data.baseColorTextureSet = material.extension.diffuseTexture ? material.texCoordSets.baseColor : -1;
+			data.physicalDescriptorTextureSet = material.extension.specularGlossinessTexture ? material.texCoordSets.specularGlossiness : -1;
+			data.diffuseFactor = material.extension.diffuseFactor;
+			data.specularFactor = glm::vec4(material.extension.specularFactor, 1.0f);
+		}
+		else {
+			data.workflow = 0.0f;
+			data.baseColorFactor = material.baseColorFactor;
+			data.metallicFactor = material.metallicFactor;
+			data.roughnessFactor = material.roughnessFactor;
+			data.baseColorTexture = textureIndex(material.baseColorTexture);
+			data.physicalDescriptorTexture = textureIndex(material.metallicRoughnessTexture);
+			data.baseColorTextureSet = material.baseColorTexture ? material.texCoordSets.baseColor : -1;
+			data.physicalDescriptorTextureSet = material.metallicRoughnessTexture ? material.texCoordSets.metallicRoughness : -1;
+		}
+		materialData.push_back(data);
+	}
+	const VkDeviceSize materialSize = materialData.size() * sizeof(MaterialData);
+	bindless.materials = buffer::createBuffer(device, materialSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	VK_CHECK(bindless.materials.map());
+	memcpy(bindless.materials.mapped, materialData.data(), materialSize);
+	bindless.materials.unmap();
+
+	const uint32_t textureCount = std::max(1u, static_cast<uint32_t>(textures.size()));
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCount * frameCount },
+	};
+	bindless.pool = device->createDescriptorPool(device->getDevice(), poolSizes, frameCount, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+
+	std::vector<VkDescriptorSetLayout> layouts(frameCount, descriptorSetLayoutBindless);
+	std::vector<uint32_t> counts(frameCount, textureCount);
+	VkDescriptorSetVariableDescriptorCountAllocateInfo countInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO };
+	countInfo.descriptorSetCount = frameCount;
+	countInfo.pDescriptorCounts = counts.data();
+	VkDescriptorSetAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	allocInfo.pNext = &countInfo;
+	allocInfo.descriptorPool = bindless.pool;
+	allocInfo.descriptorSetCount = frameCount;
+	allocInfo.pSetLayouts = layouts.data();
+	bindless.sets.resize(frameCount);
+	VK_CHECK(vkAllocateDescriptorSets(device->getDevice(), &allocInfo, bindless.sets.data()));
+	bindless.revisions.assign(frameCount, textureRevision);
+
+	VkDescriptorBufferInfo bufferInfo{ bindless.materials.buffer, 0, materialSize };
+	for (VkDescriptorSet set : bindless.sets) {
+		VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.dstSet = set;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(device->getDevice(), 1, &write, 0, nullptr);
+		writeBindlessTextures(set);
+	}
+}
 
-	VkSamplerCreateInfo samplerInfo{};
-	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = sampler.magFilter;
-	samplerInfo.minFilter = sampler.minFilter;
-	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerInfo.addressModeU = sampler.addressModeU;
-	samplerInfo.addressModeV = sampler.addressModeV;
-	samplerInfo.addressModeW = sampler.addressModeW;
-	samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
-	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	samplerInfo.maxAnisotropy = 1.0;
-	samplerInfo.anisotropyEnable = VK_FALSE;
-	samplerInfo.maxLod = (float)texObj.mipLevels;
-	samplerInfo.maxAnisotropy = 8.0f;
-	samplerInfo.anisotropyEnable = VK_TRUE;
-	VK_CHECK(vkCreateSampler(device->getDevice(), &samplerInfo, nullptr, &texObj.sampler));
+VkDescriptorSet VulkanglTFModel::getBindlessDescriptorSet(uint32_t frameIndex)
+{
+	// The frame's previous command buffer has completed, its set can be rewritten without waiting
+	if (bindless.revisions[frameIndex] != textureRevision) {
+		writeBindlessTextures(bindless.sets[frameIndex]);
+		bindless.revisions[frameIndex] = textureRevision;
+	}
+	return bindless.sets[frameIndex];
+}
 
-	VkImageViewCreateInfo viewInfo{};
-	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	viewInfo.image = texObj.image;
-	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	viewInfo.format = format;
-	viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
-	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	viewInfo.subresourceRange.layerCount = 1;
-	viewInfo.subresourceRange.levelCount = texObj.mipLevels;
-	VK_CHECK(vkCreateImageView(device->getDevice(), &viewInfo, nullptr, &texObj.view));
+void VulkanglTFModel::writeBindlessTextures(VkDescriptorSet set)
+{
+	// Slots of textures that are not uploaded yet stay unwritten, the binding is partially bound
+	std::vector<VkDescriptorImageInfo> imageInfos;
+	imageInfos.reserve(textures.size());
+	std::vector<VkWriteDescriptorSet> writes;
+	for (size_t i = 0; i < textures.size(); i++) {
+		if (textures[i].view == VK_NULL_HANDLE) {
+			continue;
+		}
+		imageInfos.push_back(textures[i].getDescriptorImageInfo());
+		VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.dstSet = set;
+		write.dstBinding = 1;
+		write.dstArrayElement = static_cast<uint32_t>(i);
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &imageInfos.back();
+		writes.push_back(write);
+	}
+	if (!writes.empty()) {
+		vkUpdateDescriptorSets(device->getDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
 
-	return texObj;
+void VulkanglTFModel::releaseBindlessDescriptors()
+{
+	if (bindless.pool != VK_NULL_HANDLE) {
+		vkDestroyDescriptorPool(device->getDevice(), bindless.pool, nullptr);
+		bindless.pool = VK_NULL_HANDLE;
+	}
+	bindless.materials.destroy();
+	bindless.sets.clear();
+	bindless.revisions.clear();
 }
 
 TextureObject* VulkanglTFModel::getTexture(uint32_t index)
@@ -814,10 +2063,12 @@ void VulkanglTFModel::loadMaterials(tinygltf::Model& gltfModel)
 				}
 			}
 		}
+		material.index = static_cast<uint32_t>(materials.size());
 		materials.push_back(material);
 	}
 	// Push a default material at the end of the list for meshes with no material assigned
 	materials.push_back(Material(device));
+	materials.back().index = static_cast<uint32_t>(materials.size() - 1);
 }
 
 // Helper functions for locating glTF nodes
@@ -828,7 +2079,7 @@ vkglTF::Node* VulkanglTFModel::findNode(Node* parent, uint32_t index)
 	{
 		return parent;
 	}
-	for (auto& child : parent->children)
+	for (Node* child : parent->children)
 	{
 		nodeFound = findNode(child, index);
 		if (nodeFound)
@@ -842,7 +2093,7 @@ vkglTF::Node* VulkanglTFModel::findNode(Node* parent, uint32_t index)
 vkglTF::Node* VulkanglTFModel::nodeFromIndex(uint32_t index)
 {
 	Node* nodeFound = nullptr;
-	for (auto& node : nodes) {
+	for (Node* node : nodes) {
 		nodeFound = findNode(node, index);
 		if (nodeFound) {
 			break;
@@ -873,10 +2124,8 @@ void VulkanglTFModel::loadSkins(tinygltf::Model& gltfModel)
 		// Get inverse bind matrices from buffer
 		if (source.inverseBindMatrices > -1) {
 			const tinygltf::Accessor& accessor = gltfModel.accessors[source.inverseBindMatrices];
-			const tinygltf::BufferView& bufferView = gltfModel.bufferViews[accessor.bufferView];
-			const tinygltf::Buffer& buffer = gltfModel.buffers[bufferView.buffer];
 			newSkin->inverseBindMatrices.resize(accessor.count);
-			memcpy(newSkin->inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
+			memcpy(newSkin->inverseBindMatrices.data(), getAccessorData(gltfModel, accessor), accessor.count * sizeof(glm::mat4));
 		}
 		
 		// Inverse Kinematics
@@ -911,13 +2160,11 @@ void VulkanglTFModel::loadAnimations(tinygltf::Model& gltfModel)
 			// Read sampler input time values
 			{
 				const tinygltf::Accessor& accessor = gltfModel.accessors[samp.input];
-				const tinygltf::BufferView& bufferView = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer& buffer = gltfModel.buffers[bufferView.buffer];
 
 				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
 				float* buf = new float[accessor.count];
-				memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(float));
+				memcpy(buf, getAccessorData(gltfModel, accessor), accessor.count * sizeof(float));
 				for (size_t index = 0; index < accessor.count; index++) {
 					sampler.inputs.push_back(buf[index]);
 				}
@@ -935,15 +2182,13 @@ void VulkanglTFModel::loadAnimations(tinygltf::Model& gltfModel)
 			// Read sampler output T/R/S values 
 			{
 				const tinygltf::Accessor& accessor = gltfModel.accessors[samp.output];
-				const tinygltf::BufferView& bufferView = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer& buffer = gltfModel.buffers[bufferView.buffer];
 
 				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
 				switch (accessor.type) {
 				case TINYGLTF_TYPE_VEC3: {
 					glm::vec3* buf = new glm::vec3[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec3));
+					memcpy(buf, getAccessorData(gltfModel, accessor), accessor.count * sizeof(glm::vec3));
 					for (size_t index = 0; index < accessor.count; index++) {
 						sampler.outputsVec4.push_back(glm::vec4(buf[index], 0.0f));
 					}
@@ -951,7 +2196,7 @@ void VulkanglTFModel::loadAnimations(tinygltf::Model& gltfModel)
 				}
 				case TINYGLTF_TYPE_VEC4: {
 					glm::vec4* buf = new glm::vec4[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec4));
+					memcpy(buf, getAccessorData(gltfModel, accessor), accessor.count * sizeof(glm::vec4));
 					for (size_t index = 0; index < accessor.count; index++) {
 						sampler.outputsVec4.push_back(buf[index]);
 					}
@@ -1005,9 +2250,26 @@ void VulkanglTFModel::bindBuffers(VkCommandBuffer commandBuffer)
 	buffersBound = true;
 }
 
-void VulkanglTFModel::loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale)
+bool VulkanglTFModel::isSharedMesh(const tinygltf::Node& node) const
+{
+	return node.mesh > -1 && node.skin < 0 && !(loadFlags & FileLoadingFlags::PreTransformVertices);
+}
+
+// Mirrors loadNode, so the arena is sized before anything is created in it
+void VulkanglTFModel::countNode(const tinygltf::Node& node, const tinygltf::Model& model, std::set<int>& sharedMeshes, SceneArena::Counts& counts) const
+{
+	counts.nodes++;
+	for (int child : node.children) {
+		countNode(model.nodes[child], model, sharedMeshes, counts);
+	}
+	if (node.mesh > -1 && (!isSharedMesh(node) || sharedMeshes.insert(node.mesh).second)) {
+		counts.meshes++;
+		counts.primitives += static_cast<uint32_t>(model.meshes[node.mesh].primitives.size());
+	}
+}
+
+void VulkanglTFModel::loadNode(vkglTF::Node* parent, vkglTF::Node* newNode, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale)
 {
-	vkglTF::Node* newNode = new Node{};
 	newNode->index = nodeIndex;
 	newNode->parent = parent;
 	newNode->name = node.name;
@@ -1036,15 +2298,21 @@ void VulkanglTFModel::loadNode(vkglTF::Node* parent, const tinygltf::Node& node,
 
 	// Node with children
 	if (node.children.size() > 0) {
+		newNode->children = arena.allocateNodes(static_cast<uint32_t>(node.children.size()));
 		for (size_t i = 0; i < node.children.size(); i++) {
-			loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, indexBuffer, vertexBuffer, globalscale);
+			loadNode(newNode, newNode->children[i], model.nodes[node.children[i]], node.children[i], model, indexBuffer, vertexBuffer, globalscale);
 		}
 	}
 
-	// Node contains mesh data
-	if (node.mesh > -1) {
-		const tinygltf::Mesh mesh = model.meshes[node.mesh];
-		Mesh* newMesh = new Mesh(device, newNode->matrix);
+	// Node contains mesh data, meshes without per node data are shared by every node referencing them
+	const bool sharedMesh = isSharedMesh(node);
+	if (sharedMesh && meshCache.count(node.mesh)) {
+		newNode->mesh = meshCache[node.mesh];
+	}
+	else if (node.mesh > -1) {
+		const tinygltf::Mesh& mesh = model.meshes[node.mesh];
+		Mesh* newMesh = arena.createMesh(device, newNode->matrix);
+		Primitive* firstPrimitive = nullptr;
 		for (size_t j = 0; j < mesh.primitives.size(); j++) {
 			const tinygltf::Primitive& primitive = mesh.primitives[j];
 			uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
@@ -1076,7 +2344,7 @@ void VulkanglTFModel::loadNode(vkglTF::Node* parent, const tinygltf::Node& node,
 
 				const tinygltf::Accessor& posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
 				const tinygltf::BufferView& posView = model.bufferViews[posAccessor.bufferView];
-				bufferPos = reinterpret_cast<const float*>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
+				bufferPos = reinterpret_cast<const float*>(getAccessorData(model, posAccessor));
 				posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
 				posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
 				vertexCount = static_cast<uint32_t>(posAccessor.count);
@@ -1085,20 +2353,20 @@ void VulkanglTFModel::loadNode(vkglTF::Node* parent, const tinygltf::Node& node,
 				if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
 					const tinygltf::Accessor& normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
 					const tinygltf::BufferView& normView = model.bufferViews[normAccessor.bufferView];
-					bufferNormals = reinterpret_cast<const float*>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
+					bufferNormals = reinterpret_cast<const float*>(getAccessorData(model, normAccessor));
 					normByteStride = normAccessor.ByteStride(normView) ? (normAccessor.ByteStride(normView) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
 				}
 
 				if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
 					const tinygltf::Accessor& uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
 					const tinygltf::BufferView& uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoordSet0 = reinterpret_cast<const float*>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+					bufferTexCoordSet0 = reinterpret_cast<const float*>(getAccessorData(model, uvAccessor));
 					uv0ByteStride = uvAccessor.ByteStride(uvView) ? (uvAccessor.ByteStride(uvView) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
 				}
 				if (primitive.attributes.find("TEXCOORD_1") != primitive.attributes.end()) {
 					const tinygltf::Accessor& uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_1")->second];
 					const tinygltf::BufferView& uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoordSet1 = reinterpret_cast<const float*>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+					bufferTexCoordSet1 = reinterpret_cast<const float*>(getAccessorData(model, uvAccessor));
 					uv1ByteStride = uvAccessor.ByteStride(uvView) ? (uvAccessor.ByteStride(uvView) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
 				}
 
@@ -1107,14 +2375,14 @@ void VulkanglTFModel::loadNode(vkglTF::Node* parent, const tinygltf::Node& node,
 				if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
 					const tinygltf::Accessor& jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
 					const tinygltf::BufferView& jointView = model.bufferViews[jointAccessor.bufferView];
-					bufferJoints = reinterpret_cast<const uint16_t*>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
+					bufferJoints = reinterpret_cast<const uint16_t*>(getAccessorData(model, jointAccessor));
 					jointByteStride = jointAccessor.ByteStride(jointView) ? (jointAccessor.ByteStride(jointView) / sizeof(bufferJoints[0])) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC4);
 				}
 
 				if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
 					const tinygltf::Accessor& weightAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
 					const tinygltf::BufferView& weightView = model.bufferViews[weightAccessor.bufferView];
-					bufferWeights = reinterpret_cast<const float*>(&(model.buffers[weightView.buffer].data[weightAccessor.byteOffset + weightView.byteOffset]));
+					bufferWeights = reinterpret_cast<const float*>(getAccessorData(model, weightAccessor));
 					weightByteStride = weightAccessor.ByteStride(weightView) ? (weightAccessor.ByteStride(weightView) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC4);
 				}
 
@@ -1140,11 +2408,9 @@ void VulkanglTFModel::loadNode(vkglTF::Node* parent, const tinygltf::Node& node,
 			if (hasIndices)
 			{
 				const tinygltf::Accessor& accessor = model.accessors[primitive.indices > -1 ? primitive.indices : 0];
-				const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
 
 				indexCount = static_cast<uint32_t>(accessor.count);
-				const void* dataPtr = &(buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+				const void* dataPtr = getAccessorData(model, accessor);
 
 				switch (accessor.componentType) {
 				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
@@ -1173,10 +2439,14 @@ void VulkanglTFModel::loadNode(vkglTF::Node* parent, const tinygltf::Node& node,
 					return;
 				}
 			}
-			Primitive* newPrimitive = new Primitive(indexStart, indexCount, vertexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
+			Primitive* newPrimitive = arena.createPrimitive(indexStart, indexCount, vertexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
+			newPrimitive->firstVertex = vertexStart;
 			newPrimitive->setBoundingBox(posMin, posMax);
-			newMesh->primitives.push_back(newPrimitive);
+			if (firstPrimitive == nullptr) {
+				firstPrimitive = newPrimitive;
+			}
 		}
+		newMesh->primitives = arena.getPrimitives(firstPrimitive);
 		// Mesh BB from BBs of primitives
 		for (auto p : newMesh->primitives) {
 			if (p->bb.valid && !newMesh->bb.valid) {
@@ -1187,22 +2457,73 @@ void VulkanglTFModel::loadNode(vkglTF::Node* parent, const tinygltf::Node& node,
 			newMesh->bb.max = glm::max(newMesh->bb.max, p->bb.max);
 		}
 		newNode->mesh = newMesh;
+		if (sharedMesh) {
+			meshCache[node.mesh] = newMesh;
+		}
 	}
-	if (parent) {
-		parent->children.push_back(newNode);
+	if (newNode->mesh) {
+		loadInstanceMatrices(newNode, node, model);
+		newNode->firstInstance = newNode->mesh->instanceCount;
+		newNode->mesh->instanceCount += std::max(1u, static_cast<uint32_t>(newNode->instanceMatrices.size()));
 	}
-	else {
-		nodes.push_back(newNode);
+}
+
+void VulkanglTFModel::loadInstanceMatrices(vkglTF::Node* node, const tinygltf::Node& gltfNode, const tinygltf::Model& model)
+{
+	auto extension = gltfNode.extensions.find("EXT_mesh_gpu_instancing");
+	if (extension == gltfNode.extensions.end() || !extension->second.Has("attributes")) {
+		return;
+	}
+	const tinygltf::Value& attributes = extension->second.Get("attributes");
+
+	auto readAttribute = [&](const char* name, uint32_t components, std::vector<float>& values) {
+		if (!attributes.Has(name)) {
+			return;
+		}
+		const tinygltf::Accessor& accessor = model.accessors[attributes.Get(name).GetNumberAsInt()];
+		if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
+			std::cerr << "EXT_mesh_gpu_instancing " << name << " component type " << accessor.componentType << " not supported!" << std::endl;
+			return;
+		}
+		const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+		const size_t stride = accessor.ByteStride(bufferView) ? accessor.ByteStride(bufferView) : components * sizeof(float);
+		const unsigned char* data = getAccessorData(model, accessor);
+		values.resize(accessor.count * components);
+		for (size_t i = 0; i < accessor.count; i++) {
+			memcpy(&values[i * components], data + i * stride, components * sizeof(float));
+		}
+	};
+	std::vector<float> translations, rotations, scales;
+	readAttribute("TRANSLATION", 3, translations);
+	readAttribute("ROTATION", 4, rotations);
+	readAttribute("SCALE", 3, scales);
+
+	const size_t count = std::max({ translations.size() / 3, rotations.size() / 4, scales.size() / 3 });
+	node->instanceMatrices.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 translation = i * 3 < translations.size() ? glm::make_vec3(&translations[i * 3]) : glm::vec3(0.0f);
+		glm::quat rotation = i * 4 < rotations.size() ? glm::make_quat(&rotations[i * 4]) : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		glm::vec3 scale = i * 3 < scales.size() ? glm::make_vec3(&scales[i * 3]) : glm::vec3(1.0f);
+		node->instanceMatrices[i] = glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale);
 	}
-	linearNodes.push_back(newNode);
 }
 
 void VulkanglTFModel::calculateBoundingBox(Node* node, Node* parent) {
-	BoundingBox parentBvh = parent ? parent->bvh : BoundingBox(dimensions.min, dimensions.max);
+	calculateNodeBounds(node, node->getGlobalMatrix());
+	for (Node* child : node->children) {
+		calculateBoundingBox(child, node);
+	}
+}
 
+void VulkanglTFModel::calculateNodeBounds(Node* node, const glm::mat4& globalMatrix) {
 	if (node->mesh) {
 		if (node->mesh->bb.valid) {
-			node->aabb = node->mesh->bb.getAABB(node->getGlobalMatrix());
+			node->aabb = node->mesh->bb.getAABB(node->instanceMatrices.empty() ? globalMatrix : globalMatrix * node->instanceMatrices[0]);
+			for (size_t i = 1; i < node->instanceMatrices.size(); i++) {
+				BoundingBox instance = node->mesh->bb.getAABB(globalMatrix * node->instanceMatrices[i]);
+				node->aabb.min = glm::min(node->aabb.min, instance.min);
+				node->aabb.max = glm::max(node->aabb.max, instance.max);
+			}
 			if (node->children.size() == 0) {
 				node->bvh.min = node->aabb.min;
 				node->bvh.max = node->aabb.max;
@@ -1210,20 +2531,14 @@ void VulkanglTFModel::calculateBoundingBox(Node* node, Node* parent) {
 			}
 		}
 	}
-
-	parentBvh.min = glm::min(parentBvh.min, node->bvh.min);
-	parentBvh.max = glm::min(parentBvh.max, node->bvh.max);
-
-	for (auto& child : node->children) {
-		calculateBoundingBox(child, node);
-	}
 }
 
 void VulkanglTFModel::getSceneDimensions()
 {
-	// Calculate binary volume hierarchy for all nodes in the scene
-	for (auto node : linearNodes) {
-		calculateBoundingBox(node, nullptr);
+	// Calculate binary volume hierarchy for all nodes in the scene, in pool order with the world matrices of updateNodes
+	for (Node* node : linearNodes) {
+		node->worldMatrix = node->parent ? node->parent->worldMatrix * node->localMatrix() : node->localMatrix();
+		calculateNodeBounds(node, node->worldMatrix);
 	}
 
 	dimensions.min = glm::vec3(FLT_MAX);
@@ -1286,59 +2601,159 @@ void VulkanglTFModel::updateAnimation(uint32_t index, float time)
 		}
 	}
 	if (updated) {
-		for (auto& node : nodes) {
-			node->update();
+		updateNodes();
+	}
+}
+
+void VulkanglTFModel::updateNodes()
+{
+	// Parents come first in the arena, their world matrix is always current when a child reads it
+	for (Node* node : linearNodes) {
+		node->worldMatrix = node->parent ? node->parent->worldMatrix * node->localMatrix() : node->localMatrix();
+	}
+	for (Node* node : linearNodes) {
+		if (node->mesh) {
+			node->updateMesh(node->worldMatrix, true);
+		}
+	}
+}
+
+/*
+	glTF LOD generation and selection
+*/
+
+// Levels including the full resolution one, each targets half the triangles of the previous
+static const uint32_t maxLodLevels = 4;
+// Primitives below this are not worth simplifying
+static const uint32_t minLodTriangles = 64;
+// Largest collapse error allowed, relative to the primitive's bounding box diagonal
+static const float maxLodError = 0.05f;
+
+void VulkanglTFModel::generateLods(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer)
+{
+	for (Mesh* mesh : meshes) {
+		for (Primitive* primitive : mesh->primitives) {
+			if (!primitive->hasIndices || primitive->indexCount / 3 < minLodTriangles * 2) {
+				continue;
+			}
+			const float maxError = glm::length(primitive->bb.max - primitive->bb.min) * maxLodError;
+			for (uint32_t level = 1; level < maxLodLevels; level++) {
+				const Primitive::Lod& previous = primitive->lods.back();
+				const size_t target = previous.indexCount / 6 * 3;
+				if (target / 3 < minLodTriangles) {
+					break;
+				}
+				std::vector<uint32_t> lodIndices = simplifyIndices(vertexBuffer, &indexBuffer[previous.firstIndex], previous.indexCount, target, maxError);
+				// Not enough of a reduction left to justify another level
+				if (lodIndices.size() > size_t(previous.indexCount) * 3 / 4) {
+					break;
+				}
+				primitive->lods.push_back({ static_cast<uint32_t>(indexBuffer.size()), static_cast<uint32_t>(lodIndices.size()) });
+				indexBuffer.insert(indexBuffer.end(), lodIndices.begin(), lodIndices.end());
+			}
 		}
 	}
 }
 
+void VulkanglTFModel::setLodView(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, const glm::mat4& model)
+{
+	// Distance and radius scale alike under a uniform model scale, so the projected size comes out the same in model space
+	lodCameraPosition = glm::vec3(glm::inverse(view * model)[3]);
+	// Pixels covered by a unit sized object at unit distance
+	lodProjectionScale = std::abs(projection[1][1]) * viewportHeight * 0.5f;
+}
+
+uint32_t VulkanglTFModel::selectLod(Node* node)
+{
+	if (!node->mesh || !node->mesh->bb.valid || !enableLod || lodProjectionScale <= 0.0f) {
+		return 0;
+	}
+	uint32_t levels = 1;
+	for (Primitive* primitive : node->mesh->primitives) {
+		levels = std::max(levels, static_cast<uint32_t>(primitive->lods.size()));
+	}
+	if (levels == 1) {
+		return 0;
+	}
+
+	// Projected diameter of the bounding sphere
+	const glm::vec3 center = (node->aabb.min + node->aabb.max) * 0.5f;
+	const float radius = glm::length(node->aabb.max - node->aabb.min) * 0.5f;
+	const float distance = std::max(glm::length(center - lodCameraPosition), radius);
+	const float size = 2.0f * radius * lodProjectionScale / std::max(distance, FLT_EPSILON);
+
+	auto threshold = [this](uint32_t level) { return lodScreenSize / float(1u << (level - 1)); };
+	uint32_t lod = std::min(node->lod, levels - 1);
+	while (lod + 1 < levels && size < threshold(lod + 1) * (1.0f - lodHysteresis)) {
+		lod++;
+	}
+	while (lod > 0 && size > threshold(lod) * (1.0f + lodHysteresis)) {
+		lod--;
+	}
+	node->lod = lod;
+	return lod;
+}
+
 void VulkanglTFModel::drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
 {
 	if (node->mesh) {
+		const uint32_t lod = selectLod(node);
+		const uint32_t instanceCount = std::max(1u, static_cast<uint32_t>(node->instanceMatrices.size()));
+		const VkBuffer instanceBuffer = device->getFrameAllocator().getBuffer();
+		const VkDeviceSize offsets[1] = { node->mesh->pushInstances(node->firstInstance, instanceCount) };
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, offsets);
 		for (Primitive* primitive : node->mesh->primitives) {
-			vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+			if (renderFlags & RenderFlags::PushMaterialIndex) {
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &primitive->material.index);
+			}
+			const Primitive::Lod& level = primitive->lods[std::min<size_t>(lod, primitive->lods.size() - 1)];
+			vkCmdDrawIndexed(commandBuffer, level.indexCount, instanceCount, level.firstIndex, 0, 0);
+			drawStats.triangles += level.indexCount / 3 * instanceCount;
+			drawStats.trianglesFullDetail += primitive->indexCount / 3 * instanceCount;
 		}
 	}
-	for (auto& child : node->children) {
-		drawNode(child, commandBuffer);
+	for (Node* child : node->children) {
+		drawNode(child, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
 	}
 }
 
 void VulkanglTFModel::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
 {
+	drawStats = {};
+	if (!isDrawable()) {
+		return;
+	}
 	if (!buffersBound) {
 		const VkDeviceSize offsets[1] = { 0 };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
 		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	}
-	for (auto& node : nodes) {
-		drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+	// A shared mesh is drawn once for all its instances, at the most detailed LOD any of them needs
+	for (Mesh* mesh : meshes) {
+		mesh->lod = UINT32_MAX;
 	}
-}
-
-void VulkanglTFModel::initNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout) 
-{
-	if (node->mesh) {
-		VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		descriptorSetAllocInfo.descriptorPool = device->getDescriptorPool();
-		descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-		descriptorSetAllocInfo.descriptorSetCount = 1;
-		auto res = vkAllocateDescriptorSets(device->getDevice(), &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet);
-		assert(res == VK_SUCCESS);
-
-		VkWriteDescriptorSet writeDescriptorSet{};
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-		writeDescriptorSet.dstBinding = 0;
-		writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptor;
-
-		vkUpdateDescriptorSets(device->getDevice(), 1, &writeDescriptorSet, 0, nullptr);
+	for (Node* node : linearNodes) {
+		if (node->mesh) {
+			node->mesh->lod = std::min(node->mesh->lod, selectLod(node));
+		}
 	}
-	for (auto& child : node->children) {
-		initNodeDescriptor(child, descriptorSetLayout);
+	const VkBuffer instanceBuffer = device->getFrameAllocator().getBuffer();
+	for (Mesh* mesh : meshes) {
+		// Skinned meshes need their joints in the UBONode block, pbr_instanced.vert has none
+		if (mesh->instanceCount == 0 || mesh->uniformBlock.jointcount > 0.0f) {
+			continue;
+		}
+		const VkDeviceSize offsets[1] = { mesh->pushInstances(0, mesh->instanceCount) };
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, offsets);
+		for (Primitive* primitive : mesh->primitives) {
+			if (renderFlags & RenderFlags::PushMaterialIndex) {
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &primitive->material.index);
+			}
+			const Primitive::Lod& level = primitive->lods[std::min<size_t>(mesh->lod, primitive->lods.size() - 1)];
+			vkCmdDrawIndexed(commandBuffer, level.indexCount, mesh->instanceCount, level.firstIndex, 0, 0);
+			drawStats.triangles += level.indexCount / 3 * mesh->instanceCount;
+			drawStats.trianglesFullDetail += primitive->indexCount / 3 * mesh->instanceCount;
+		}
 	}
 }
 
@@ -1363,14 +2778,14 @@ void vkglTF::VulkanglTFModel::setupIK_internal(vkglTF::Node* node)
 			}
 		}
 	}
-	for (auto& child : node->children) {
+	for (Node* child : node->children) {
 		setupIK_internal(child);
 	}
 }
 
 void vkglTF::VulkanglTFModel::setEnableIK(bool enable)
 {
-	for (auto& node : nodes)
+	for (Node* node : nodes)
 		setEnableIK_internal(node, enable);
 }
 
@@ -1378,7 +2793,7 @@ void vkglTF::VulkanglTFModel::setEnableIK_internal(vkglTF::Node* node, bool enab
 {
 	if (node->skin)
 		node->skin->enableIK = enable;
-	for (auto& child : node->children) {
+	for (Node* child : node->children) {
 		setupIK_internal(child);
 	}
 }
@@ -6,12 +6,16 @@
 
 #pragma once
 #include "line_segment.h"
+#include "scene_arena.h"
 #define MAX_NUM_JOINTS 128
 
 namespace vkglTF {
 
 	extern VkDescriptorSetLayout descriptorSetLayoutImage;
 	extern VkDescriptorSetLayout descriptorSetLayoutUbo;
+	// MaterialData at binding 0 and every texture of a model at binding 1, see createBindlessDescriptors
+	extern VkDescriptorSetLayout descriptorSetLayoutBindless;
+	const uint32_t maxBindlessTextures = 4096;
 	extern VkMemoryPropertyFlags memoryPropertyFlags;
 
 	struct Node; 
@@ -65,8 +69,8 @@ namespace vkglTF {
 		} texCoordSets;
 
 		struct Extension {
-			TextureObject* specularGlossinessTexture;
-			TextureObject* diffuseTexture;
+			TextureObject* specularGlossinessTexture = nullptr;
+			TextureObject* diffuseTexture = nullptr;
 			glm::vec4 diffuseFactor = glm::vec4(1.0f);
 			glm::vec3 specularFactor = glm::vec3(0.0f);
 		} extension;
@@ -77,6 +81,33 @@ namespace vkglTF {
 		} pbrWorkflows;
 
 		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		// Position in VulkanglTFModel::materials and in the bindless material buffer
+		uint32_t index = 0;
+	};
+
+	// Material as read by pbr.frag built with BINDLESS, std430 layout
+	struct MaterialData {
+		glm::vec4 baseColorFactor;
+		glm::vec4 emissiveFactor;
+		glm::vec4 diffuseFactor;
+		glm::vec4 specularFactor;
+		float workflow;
+		int baseColorTextureSet;
+		int physicalDescriptorTextureSet;
+		int normalTextureSet;
+		int occlusionTextureSet;
+		int emissiveTextureSet;
+		float metallicFactor;
+		float roughnessFactor;
+		float alphaMask;
+		float alphaMaskCutoff;
+		// Indices into the texture array, -1 when the material has no such texture
+		int baseColorTexture;
+		int physicalDescriptorTexture;
+		int normalTexture;
+		int occlusionTexture;
+		int emissiveTexture;
+		int padding;
 	};
 
 	/*
@@ -85,14 +116,22 @@ namespace vkglTF {
 	struct Primitive {
 		Primitive(uint32_t firstIndex, uint32_t indexCount, uint32_t vertexCount, Material& material) : firstIndex(firstIndex), indexCount(indexCount), vertexCount(vertexCount), material(material) {
 			hasIndices = indexCount > 0;
+			lods.push_back({ firstIndex, indexCount });
 		};
 		uint32_t firstIndex;
 		uint32_t indexCount;
-		uint32_t firstVertex;
+		uint32_t firstVertex = 0;
 		uint32_t vertexCount;
 		Material& material;
 		bool hasIndices;
 
+		// Index ranges into the shared index buffer, lods[0] is the full resolution primitive
+		struct Lod {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+		std::vector<Lod> lods;
+
 		BoundingBox bb;
 		void setBoundingBox(glm::vec3 min, glm::vec3 max);
 	};
@@ -102,32 +141,55 @@ namespace vkglTF {
 	*/
 	struct Mesh {
 		Mesh(Device* device, glm::mat4 matrix);
-		~Mesh();
 		Device* device;
 
-		std::vector<Primitive*> primitives;
+		// In the arena of the model
+		ArenaRange<Primitive> primitives;
 		std::string name;
 
 		BoundingBox bb;
 		BoundingBox aabb;
 
-		struct UniformBuffer {
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-			VkDescriptorBufferInfo descriptor;
-			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-			void* mapped;
-		} uniformBuffer;
-
+		// Matrix and joints of the last updateMesh, pushUniformBlock copies them into the frame allocator
 		struct UniformBlock {
 			glm::mat4 matrix;
 			glm::mat4 jointMatrix[MAX_NUM_JOINTS]{};
 			float jointcount{ 0 };
 		} uniformBlock;
 
+		// UBONode of pbr.vert, copied by every draw
+		struct NodeBlock {
+			glm::mat4 matrix;
+			float jointcount;
+		};
+		// UBOSkin of pbr.vert, only copied for skinned meshes
+		struct SkinBlock {
+			glm::mat4 jointMatrix[MAX_NUM_JOINTS];
+		};
+		// Dynamic offsets of UBONode and UBOSkin, in binding order
+		using DynamicOffsets = std::array<uint32_t, 2>;
+
+		// World matrices of every node (and EXT_mesh_gpu_instancing entry) drawing this mesh. Copied into the frame allocator
+		// when drawn, so frames in flight keep the matrices they were recorded with
+		uint32_t instanceCount = 0;
+		std::vector<glm::mat4> instances;
+		// Lowest LOD picked by any instance node this frame
+		uint32_t lod = UINT32_MAX;
+
 		void setBoundingBox(glm::vec3 min, glm::vec3 max);
+		// Dynamic offsets of this frame's copy of uniformBlock with the given matrix, for the set createNodeDescriptorSet returns
+		DynamicOffsets pushUniformBlock(const glm::mat4& matrix) const;
+		// Reuses the joints of pushJoints, for copies of the mesh drawn with other matrices in the same frame
+		DynamicOffsets pushUniformBlock(const glm::mat4& matrix, uint32_t jointsOffset) const;
+		// Offset of this frame's copy of the joints, 0 without a skin since pbr.vert does not read them then
+		uint32_t pushJoints() const;
+		// Offset of this frame's copy of count instances from firstInstance, to bind with the frame allocator buffer
+		VkDeviceSize pushInstances(uint32_t firstInstance, uint32_t count) const;
 	};
 
+	// One set for the UBONode and UBOSkin blocks of every mesh, bindings 0 and 1 of the layout have to be UNIFORM_BUFFER_DYNAMIC
+	VkDescriptorSet createNodeDescriptorSet(Device* device, VkDescriptorSetLayout descriptorSetLayout);
+
 	/*
 		glTF skin
 	*/
@@ -146,10 +208,10 @@ namespace vkglTF {
 		glTF node
 	*/
 	struct Node {
-		~Node();
 		Node* parent;
 		uint32_t index;
-		std::vector<Node*> children;
+		// Adjacent in the arena of the model
+		ArenaRange<Node> children;
 		glm::mat4 matrix;
 		std::string name;
 		Mesh* mesh;
@@ -160,10 +222,24 @@ namespace vkglTF {
 		glm::quat rotation{};
 		BoundingBox bvh;
 		BoundingBox aabb;
+		// LOD picked last frame, selection only moves away from it past the hysteresis band
+		uint32_t lod = 0;
+		// Slot in mesh->instances, followed by one slot per entry of instanceMatrices
+		uint32_t firstInstance = 0;
+		// Local transforms from EXT_mesh_gpu_instancing, empty for a plain node
+		std::vector<glm::mat4> instanceMatrices;
+		// Parent worldMatrix times localMatrix(), written by VulkanglTFModel::updateNodes and getSceneDimensions
+		glm::mat4 worldMatrix{ 1.0f };
+		// Matrix of the last updateMesh, a shared mesh is drawn with the matrix of the node drawing it
+		glm::mat4 meshMatrix{ 1.0f };
 
 		glm::mat4 localMatrix();
 		glm::mat4 getGlobalMatrix();
 		void update();
+		// Uniform block and instance matrices of the mesh. Joints use their worldMatrix when cachedJoints is set
+		void updateMesh(const glm::mat4& globalMatrix, bool cachedJoints);
+		// Mesh::pushUniformBlock with meshMatrix
+		Mesh::DynamicOffsets pushUniformBlock() const;
 	};
 
 	/*
@@ -222,17 +298,185 @@ namespace vkglTF {
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		GenerateLods = 0x00000010,
+		CompressTextures = 0x00000020,
+		BuildMipsOnCpu = 0x00000040,
+		// Replaces texture images while drawing, sets holding them must be rewritten whenever textureRevision moves, getBindlessDescriptorSet does
+		StreamTextures = 0x00000080,
+		// Reads .glb files through tinygltf instead of mapping them, kept to compare both paths
+		DontMapFile = 0x00000100
 	};
 
 	enum RenderFlags {
-		BindImages = 0x00000001
+		BindImages = 0x00000001,
+		// Pushes Material::index as a uint at offset 0 of the fragment stage before every draw
+		PushMaterialIndex = 0x00000002
+	};
+
+	// Per-instance world matrix at the given binding, four vec4 attributes starting at firstLocation
+	VkVertexInputBindingDescription getInstanceBindingDescription(uint32_t binding);
+	std::vector<VkVertexInputAttributeDescription> getInstanceAttributeDescriptions(uint32_t binding, uint32_t firstLocation);
+
+	/*
+		glTF asynchronous loading
+	*/
+	enum class LoadState { Parsing, Parsed, Uploading, Drawable, Complete, Failed };
+
+	// Returned by loadFromFileAsync, safe to query from any thread
+	struct LoadHandle {
+		std::atomic<LoadState> state{ LoadState::Parsing };
+		std::atomic<uint32_t> texturesTotal{ 0 };
+		std::atomic<uint32_t> texturesResident{ 0 };
+		std::string error;
+
+		bool isDrawable() const { LoadState s = state; return s == LoadState::Drawable || s == LoadState::Complete; }
+		bool isDone() const { LoadState s = state; return s == LoadState::Complete || s == LoadState::Failed; }
+	};
+
+	// RGBA8 pixels decoded on a worker thread, plus a small proxy uploaded first.
+	// Mip chains built on the CPU or loaded from DDS/KTX are uploaded whole with the geometry instead
+	struct DecodedImage {
+		// Set when the cache already held the image, nothing else is decoded then
+		TextureCache::ImageKey key;
+		TextureObject cached;
+		MipChain mipChain;
+		std::vector<unsigned char> pixels;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<unsigned char> proxyPixels;
+		uint32_t proxyWidth = 0;
+		uint32_t proxyHeight = 0;
+	};
+
+	/*
+		glTF texture streaming
+	*/
+	// Device memory of streamed textures, shared by every model that points at it
+	struct TextureStreamingBudget {
+		VkDeviceSize budget = VkDeviceSize(256) << 20;
+		VkDeviceSize residentBytes = 0;
+	};
+
+	struct MappedRange {
+		const unsigned char* data = nullptr;
+		size_t size = 0;
 	};
 
 	class VulkanglTFModel {
 	private:
 		TextureObject* getTexture(uint32_t index);
-		TextureObject fromglTfImage(tinygltf::Image& gltfimage, Device* device, VkQueue copyQueue, TextureSampler sampler);
+		TextureSampler getTextureSampler(const tinygltf::Texture& tex);
+		TextureObject recordTextureUpload(const unsigned char* pixels, uint32_t width, uint32_t height, TextureSampler sampler, bool srgb, UploadBatch& batch);
+		void recordTextureMips(UploadBatch& batch, std::vector<TextureObject*> textures);
+		TextureObject recordMipChainUpload(const MipChain& image, TextureSampler sampler, UploadBatch& batch, uint32_t firstLevel = 0);
+		VkSampler createTextureSampler(TextureSampler sampler);
+		// Invalid for streamed textures, their residency belongs to one model
+		TextureCache::ImageKey getImageKey(const tinygltf::Image& gltfimage, const MappedRange& mapped, size_t textureIndex) const;
+		void releaseTexture(TextureObject& texture);
+		// Through the staging belt of the device, flushed by the caller
+		void recordGeometryUpload(const std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer);
+		void setGeometryMovable();
+		void loadScene(tinygltf::Model& gltfModel, uint32_t fileLoadingFlags, float scale, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer);
+		void decodeImages(tinygltf::Model& gltfModel);
+		void generateLods(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer);
+
+		// Meshes without skin are shared by every node referencing the same glTF mesh
+		uint32_t loadFlags = 0;
+		// Set by CompressTextures when the device samples BC1 and BC3, encoded images are cached next to the model
+		bool compressTextures = false;
+		std::string textureCacheDirectory;
+		void setLoadFlags(const std::string& filename, uint32_t fileLoadingFlags);
+		// Base color and emissive textures hold sRGB data, base color of masked materials keeps its alpha coverage
+		struct TextureUsage {
+			bool srgb = false;
+			float alphaCutoff = -1.0f;
+		};
+		std::vector<TextureUsage> textureUsages;
+		void findTextureUsages(const tinygltf::Model& gltfModel);
+		bool buildMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, size_t textureIndex, uint32_t threadCount, MipChain& chain) const;
+		void decodeImage(const tinygltf::Image& gltfimage, const MappedRange& mapped, size_t textureIndex, DecodedImage& decoded) const;
+		std::unordered_map<int, Mesh*> meshCache;
+		SceneArena arena;
+		bool isSharedMesh(const tinygltf::Node& node) const;
+		void countNode(const tinygltf::Node& node, const tinygltf::Model& model, std::set<int>& sharedMeshes, SceneArena::Counts& counts) const;
+		void calculateNodeBounds(Node* node, const glm::mat4& globalMatrix);
+		void loadInstanceMatrices(vkglTF::Node* node, const tinygltf::Node& gltfNode, const tinygltf::Model& model);
+
+		glm::vec3 lodCameraPosition = glm::vec3(0.0f);
+		float lodProjectionScale = 0.0f;
+
+		struct PendingUpload {
+			UploadBatch batch;
+			// Geometry goes through the staging belt instead of a batch
+			StagingBelt::Token token = 0;
+			bool geometry = false;
+			std::vector<uint32_t> textureIndices;
+			std::vector<TextureObject> textures;
+		};
+		struct RetiredTexture {
+			TextureObject texture;
+			uint32_t framesLeft;
+		};
+		struct AsyncLoad {
+			std::shared_ptr<LoadHandle> handle;
+			std::future<void> worker;
+			std::function<void(VulkanglTFModel*)> onComplete;
+			std::vector<uint32_t> indexBuffer;
+			std::vector<Vertex> vertexBuffer;
+			std::vector<DecodedImage> images;
+			std::vector<TextureSampler> samplers;
+			uint32_t nextTexture = 0;
+			uint32_t pendingGeometryUploads = 0;
+			std::vector<PendingUpload> uploads;
+			std::vector<RetiredTexture> retired;
+		};
+		std::unique_ptr<AsyncLoad> asyncLoad;
+		void finishUpload(PendingUpload& upload);
+		void releaseAsyncLoad();
+
+		// StreamTextures keeps every level on the CPU, the image only holds residentLevel and below
+		struct StreamedTexture {
+			MipChain chain;
+			TextureSampler sampler;
+			uint32_t residentLevel = 0;
+			uint32_t requiredLevel = 0;
+			uint32_t tailLevel = 0;
+			// Largest projected size in pixels of the primitives sampling it, zero when none was visible
+			float screenSize = 0.0f;
+			uint32_t lastRequiredFrame = 0;
+			// Counted against the budget, levels from the last recorded upload on
+			VkDeviceSize residentBytes = 0;
+			bool uploading = false;
+		};
+		std::vector<StreamedTexture> streamedTextures;
+		std::vector<PendingUpload> streamingUploads;
+		std::vector<RetiredTexture> streamingRetired;
+		TextureStreamingBudget defaultStreamingBudget;
+		uint32_t streamingFrame = 0;
+		std::chrono::steady_clock::time_point lastStreamingUpdate;
+		TextureObject recordStreamedTexture(size_t textureIndex, MipChain& chain, TextureSampler sampler, UploadBatch& batch);
+		void recordResidency(StreamedTexture& streamed, uint32_t textureIndex, uint32_t level, PendingUpload& upload);
+		void updateRequiredLevels();
+		void releaseTextureStreaming();
+
+		// One set per frame in flight, each rewritten when it is handed out after textureRevision moved
+		struct BindlessDescriptors {
+			VkDescriptorPool pool = VK_NULL_HANDLE;
+			std::vector<VkDescriptorSet> sets;
+			std::vector<uint32_t> revisions;
+			Buffer materials;
+		} bindless;
+		void writeBindlessTextures(VkDescriptorSet set);
+		void releaseBindlessDescriptors();
+
+		// .glb files stay mapped while loading, accessors and embedded images are read straight from the BIN chunk
+		MappedFile mappedFile;
+		std::vector<const unsigned char*> mappedBuffers;
+		std::vector<MappedRange> mappedImages;
+		bool loadMappedBinary(tinygltf::TinyGLTF& gltfContext, tinygltf::Model& gltfModel, const std::string& filename, tinygltf::LoadImageDataFunction imageLoader, std::string& error, std::string& warning);
+		const unsigned char* getAccessorData(const tinygltf::Model& model, const tinygltf::Accessor& accessor) const;
+		void releaseMappedFile();
 	public:
 		VulkanglTFModel();
 		~VulkanglTFModel();
@@ -241,18 +485,20 @@ namespace vkglTF {
 
 		struct Vertices {
 			int count;
-			VkBuffer buffer;
-			VkDeviceMemory memory;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			memory::Allocation allocation;
 		} vertices;
 		struct Indices {
-			int count;
-			VkBuffer buffer;
-			VkDeviceMemory memory;
+			int count = 0;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			memory::Allocation allocation;
 		} indices;
 
 		glm::mat4 aabb;
-		std::vector<Node*> nodes;
-		std::vector<Node*> linearNodes;
+		// Roots, all nodes and all meshes, in pool order of the arena. Parents come before their children
+		ArenaRange<Node> nodes;
+		ArenaRange<Node> linearNodes;
+		ArenaRange<Mesh> meshes;
 		std::vector<Skin*> skins;
 		std::vector<TextureObject> textures;
 		std::vector<TextureSampler> textureSamplers;
@@ -271,23 +517,92 @@ namespace vkglTF {
 
 		LineSegment* debug_line_segment;
 
+		// Bumped every time a texture is replaced by its full version or another set of resident mips, descriptors referencing textures must be rewritten
+		uint32_t textureRevision = 0;
+
+		// When set, texture mips are written by this compute pass instead of one blit per level. Loading takes
+		// Device::getMipGenerator by itself when RGBA8 can't be blitted with linear filtering
+		MipGenerator* mipGenerator = nullptr;
+		// Filter of the CPU built mip chains, see BuildMipsOnCpu, CompressTextures and StreamTextures
+		texture::MipFilter mipFilter = texture::MipFilter::Kaiser;
+
+		// Budget of StreamTextures, the model uses its own when none is shared
+		TextureStreamingBudget* streamingBudget = nullptr;
+		// Mip levels larger than this are only resident when the screen size of the primitives sampling them asks for it
+		uint32_t streamingTailSize = 64;
+		struct StreamingStats {
+			uint32_t levelsResident = 0;
+			uint32_t levelsTotal = 0;
+			VkDeviceSize residentBytes = 0;
+			VkDeviceSize budgetBytes = 0;
+			VkDeviceSize budgetResidentBytes = 0;
+			VkDeviceSize bytesStreamed = 0;
+			// Bytes per second, averaged over the last frames
+			float bandwidth = 0.0f;
+		} streamingStats;
+
+		// LOD selection for models loaded with GenerateLods, needs setLodView every frame
+		bool enableLod = true;
+		// Projected size in pixels below which LOD 1 is used, halves for every further level
+		float lodScreenSize = 256.0f;
+		float lodHysteresis = 0.1f;
+		struct DrawStats {
+			uint32_t triangles = 0;
+			uint32_t trianglesFullDetail = 0;
+		} drawStats;
+
+		struct TextureMemory {
+			// Pixels kept on the CPU, the whole chain for StreamTextures
+			VkDeviceSize hostBytes = 0;
+			VkDeviceSize deviceBytes = 0;
+			// Holders of the image through the texture cache, the device bytes are shared between them
+			uint32_t references = 1;
+		};
+		struct MemoryStats {
+			std::vector<TextureMemory> textures;
+			VkDeviceSize textureHostBytes = 0;
+			VkDeviceSize textureDeviceBytes = 0;
+			// Part of textureDeviceBytes other holders of cached images use too
+			VkDeviceSize sharedTextureDeviceBytes = 0;
+			// Vertex and index buffers
+			VkDeviceSize bufferDeviceBytes = 0;
+			// Decoded pixels of an async load waiting for their upload
+			VkDeviceSize pendingHostBytes = 0;
+		};
+		MemoryStats getMemoryStats() const;
+
 		void destroy();
+		// Textures and their mip blits are submitted on the graphics queue of the device, transferQueue is not used
 		void loadFromFile(const std::string& filename, Device* device, VkQueue transferQueue, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
-		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale);
+		// Parses and decodes on worker threads, the model must not be touched until the handle reports it drawable
+		std::shared_ptr<LoadHandle> loadFromFileAsync(const std::string& filename, Device* device, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f, std::function<void(VulkanglTFModel*)> onComplete = nullptr);
+		// Call once per frame from the render thread, never blocks
+		LoadState pollLoad(uint32_t maxTextureUploads = 2);
+		bool isDrawable() const;
+		// Call once per frame after setLodView, streams levels in and out and never blocks
+		void updateTextureStreaming(VkDeviceSize maxUploadBytes = VkDeviceSize(8) << 20);
+		// model takes the model into the space of view, node bounds stay in model space and the camera is moved into it
+		void setLodView(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, const glm::mat4& model = glm::mat4(1.0f));
+		uint32_t selectLod(Node* node);
+		// newNode is a slot of the arena, the children get a sibling group of their own
+		void loadNode(vkglTF::Node* parent, vkglTF::Node* newNode, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale);
 		void loadSkins(tinygltf::Model& gltfModel);
-		void loadTextures(tinygltf::Model& gltfModel, Device* device, VkQueue transferQueue);
+		void loadTextures(tinygltf::Model& gltfModel, UploadBatch& batch);
 		void loadTextureSamplers(tinygltf::Model& gltfModel);
 		void loadMaterials(tinygltf::Model& gltfModel);
 		void loadAnimations(tinygltf::Model& gltfModel);
 		void bindBuffers(VkCommandBuffer commandBuffer);
 		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		// One instanced draw per static mesh, for pipelines built from pbr_instanced.vert.spv. Instance matrices are bound at
+		// binding 1, add getInstanceBindingDescription(1) and getInstanceAttributeDescriptions(1, 6) to the vertex input
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 		void calculateBoundingBox(Node* node, Node* parent);
 		void getSceneDimensions();
+		// Node::update for the whole scene in pool order, every world matrix is computed once
+		void updateNodes();
 		void updateAnimation(uint32_t index, float time);
 		Node* findNode(Node* parent, uint32_t index);
 		Node* nodeFromIndex(uint32_t index);
-		void initNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout);
 		VkFilter getVkFilterMode(int32_t filterMode);
 		VkSamplerAddressMode getVkWrapMode(int32_t wrapMode);
 		void setupIK();
@@ -295,5 +610,10 @@ namespace vkglTF {
 		void setEnableIK(bool enable);
 		void setEnableIK_internal(vkglTF::Node* node, bool enable);
 		void drawJoint(VkCommandBuffer commandBuffer);
+
+		// All materials in a storage buffer and all textures in one descriptor indexed array, a whole model draws with one set.
+		// Needs Device::supportsBindlessTextures, call once the model is drawable
+		void createBindlessDescriptors(uint32_t frameCount);
+		VkDescriptorSet getBindlessDescriptorSet(uint32_t frameIndex);
 	};
 }
\ No newline at end of file
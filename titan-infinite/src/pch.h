@@ -13,11 +13,18 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <thread>
 #include <vector>
 #include <set>
 #include <chrono>
 #include <assert.h>
 #include <unordered_map>
+#include <mutex>
+#include <map>
+#include <deque>
 
 #include <stb_image.h>
 #include <stb_image_write.h>
@@ -31,14 +38,29 @@
 #include <glm/gtx/quaternion.hpp>
 #include "transform.h"
 #include "timer.h"
+#include "mapped_file.h"
 
 #include "vkHelpers.h"
 #include "renderer.h"
+#include "memory.h"
+#include "frame_allocator.h"
+#include "staging_belt.h"
+#include "pipeline_cache.h"
+#include "pipeline_queue.h"
+#include "command_recorder.h"
 #include "device.h"
 #include "camera.h"
-#include "memory.h"
 #include "buffer.h"
 #include "texture.h"
+#include "mip_builder.h"
+#include "texture_compression.h"
+#include "hdr_format.h"
+#include "mip_generator.h"
+#include "texture_cache.h"
 #include "inverse_kinematics.h"
+#include "scene_arena.h"
 #include "model.h"
+#include "mesh_simplifier.h"
+#include "image_based_lighting.h"
+#include "virtual_texture.h"
 #include "skybox.h"
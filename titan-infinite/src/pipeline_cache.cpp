@@ -0,0 +1,140 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "pipeline_cache.h"
+#include <filesystem>
+
+void PipelineCache::create(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path)
+{
+    m_device = device;
+    m_path = path;
+    m_stats = {};
+    vkGetPhysicalDeviceProperties(physicalDevice, &m_properties);
+
+    std::vector<char> data;
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), data.size());
+        if (!file || !isCompatible(data)) {
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+    // Drivers may still reject data with a matching header, an empty cache costs a cold start and nothing else
+    if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache) != VK_SUCCESS) {
+        data.clear();
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        VK_CHECK(vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache));
+    }
+    m_stats.warm = !data.empty();
+    m_stats.loadedBytes = data.size();
+    m_stats.savedBytes = data.size();
+    m_lastSave = std::chrono::steady_clock::now();
+}
+
+void PipelineCache::destroy()
+{
+    if (m_cache == VK_NULL_HANDLE) {
+        return;
+    }
+    save();
+    vkDestroyPipelineCache(m_device, m_cache, nullptr);
+    m_cache = VK_NULL_HANDLE;
+    std::cout << "Pipeline cache " << (m_stats.warm ? "warm" : "cold") << " (" << (m_stats.loadedBytes >> 10) << " KiB loaded), "
+        << m_stats.pipelines << " pipelines created in " << m_stats.compileMilliseconds << " ms" << std::endl;
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data) const
+{
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    return header.headerSize >= sizeof(header) &&
+        header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header.vendorID == m_properties.vendorID &&
+        header.deviceID == m_properties.deviceID &&
+        memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache PipelineCache::createWorkerCache()
+{
+    VkPipelineCacheCreateInfo createInfo{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    VkPipelineCache cache;
+    VK_CHECK(vkCreatePipelineCache(m_device, &createInfo, nullptr, &cache));
+    return cache;
+}
+
+void PipelineCache::merge(VkPipelineCache workerCache)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        VK_CHECK(vkMergePipelineCaches(m_device, m_cache, 1, &workerCache));
+    }
+    vkDestroyPipelineCache(m_device, workerCache, nullptr);
+}
+
+void PipelineCache::save()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lastSave = std::chrono::steady_clock::now();
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(m_device, m_cache, &size, nullptr));
+    // Caches only grow, the same size means nothing was added
+    if (size == 0 || size == m_stats.savedBytes) {
+        return;
+    }
+    std::vector<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(m_device, m_cache, &size, data.data()));
+
+    // A cache that can't be written only costs the compiles next time
+    const std::string temporaryPath = m_path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), size);
+    file.close();
+    std::error_code error;
+    if (!file) {
+        std::cerr << "failed to write pipeline cache " << temporaryPath << std::endl;
+        std::filesystem::remove(temporaryPath, error);
+        return;
+    }
+    std::filesystem::rename(temporaryPath, m_path, error);
+    if (error) {
+        std::cerr << "failed to replace pipeline cache " << m_path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporaryPath, error);
+        return;
+    }
+    m_stats.savedBytes = size;
+    m_stats.saves++;
+}
+
+void PipelineCache::update()
+{
+    if (std::chrono::steady_clock::now() - m_lastSave >= saveInterval) {
+        save();
+    }
+}
+
+void PipelineCache::recordPipeline(double milliseconds)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.pipelines++;
+    m_stats.compileMilliseconds += milliseconds;
+}
+
+PipelineCache::Stats PipelineCache::getStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
@@ -0,0 +1,63 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+// VkPipelineCache kept on disk between runs. The file is only used when its header matches the vendor, device and cache
+// UUID of the physical device, otherwise the cache starts out empty and the file is replaced on the next save. Saves go
+// to a temporary file that is renamed over the old one, a crash never leaves a torn cache behind.
+// Pipelines can be created with get() from any thread. Threads compiling many pipelines at once may use a cache of their
+// own from createWorkerCache() and merge() it once they are done
+class PipelineCache {
+
+public:
+    struct Stats {
+        // The file on disk was accepted
+        bool warm = false;
+        size_t loadedBytes = 0;
+        size_t savedBytes = 0;
+        uint32_t saves = 0;
+        uint32_t pipelines = 0;
+        // Time spent in vkCreate*Pipelines for the pipelines above
+        double compileMilliseconds = 0.0;
+    };
+
+    PipelineCache() = default;
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    void create(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+    // Saves, then logs the stats
+    void destroy();
+
+    VkPipelineCache get() const { return m_cache; }
+    VkPipelineCache createWorkerCache();
+    // Destroys workerCache. No pipeline may be created with either cache meanwhile
+    void merge(VkPipelineCache workerCache);
+
+    // Writes the cache if it grew since the last save
+    void save();
+    // Once per frame, saves every saveInterval
+    void update();
+    // Called by the pipeline creation paths of Device
+    void recordPipeline(double milliseconds);
+
+    Stats getStats();
+
+    std::chrono::seconds saveInterval{ 30 };
+
+private:
+    bool isCompatible(const std::vector<char>& data) const;
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties m_properties{};
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+    std::string m_path;
+    std::chrono::steady_clock::time_point m_lastSave;
+    Stats m_stats;
+    std::mutex m_mutex;
+};
@@ -0,0 +1,178 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "pipeline_queue.h"
+
+void PipelineQueue::create(Device* device, uint32_t threadCount)
+{
+    m_device = device;
+    m_stop = false;
+    if (threadCount == 0) {
+        // The submitting thread keeps a core for itself
+        threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    m_workers.resize(threadCount);
+    for (Worker& worker : m_workers) {
+        worker.cache = m_device->getPersistentPipelineCache().createWorkerCache();
+    }
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_workers[i].thread = std::thread(&PipelineQueue::work, this, i);
+    }
+}
+
+void PipelineQueue::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_jobAvailable.notify_all();
+    for (Worker& worker : m_workers) {
+        if (worker.thread.joinable()) {
+            worker.thread.join();
+        }
+        if (worker.cache != VK_NULL_HANDLE) {
+            m_device->getPersistentPipelineCache().merge(worker.cache);
+        }
+    }
+    m_workers.clear();
+    m_shaderCode.clear();
+}
+
+PipelineQueue::Handle PipelineQueue::submit(const GraphicsPipelineDesc& desc)
+{
+    return push(Job([this, desc](VkPipelineCache cache) {
+        VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(desc.dynamicStates.size());
+        dynamicState.pDynamicStates = desc.dynamicStates.data();
+
+        std::vector<ShaderStage> shaderStages;
+        VkPipeline pipeline;
+        try {
+            shaderStages.push_back(createShaderStage(desc.vertexShaderFile, VK_SHADER_STAGE_VERTEX_BIT));
+            shaderStages.push_back(createShaderStage(desc.pixelShaderFile, VK_SHADER_STAGE_FRAGMENT_BIT));
+            pipeline = m_device->createGraphicsPipeline(m_device->getDevice(), cache, shaderStages,
+                desc.vertexInputState, desc.inputAssemblyState, desc.viewportState, desc.rasterizationState,
+                desc.multisampleState, desc.depthStencilState, desc.colorBlendState, dynamicState,
+                desc.pipelineLayout, desc.renderPass);
+        }
+        catch (...) {
+            destroyShaderStages(shaderStages);
+            throw;
+        }
+        destroyShaderStages(shaderStages);
+        return pipeline;
+    }));
+}
+
+PipelineQueue::Handle PipelineQueue::submit(const ComputePipelineDesc& desc)
+{
+    return push(Job([this, desc](VkPipelineCache cache) {
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(desc.specializationEntries.size());
+        specializationInfo.pMapEntries = desc.specializationEntries.data();
+        specializationInfo.dataSize = desc.specializationData.size();
+        specializationInfo.pData = desc.specializationData.data();
+
+        std::vector<ShaderStage> shaderStages;
+        VkPipeline pipeline;
+        try {
+            shaderStages.push_back(createShaderStage(desc.computeShaderFile, VK_SHADER_STAGE_COMPUTE_BIT));
+            pipeline = m_device->createComputePipeline(m_device->getDevice(), cache, shaderStages[0], desc.pipelineLayout,
+                desc.specializationEntries.empty() ? nullptr : &specializationInfo);
+        }
+        catch (...) {
+            destroyShaderStages(shaderStages);
+            throw;
+        }
+        destroyShaderStages(shaderStages);
+        return pipeline;
+    }));
+}
+
+void PipelineQueue::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [&]() { return m_jobs.empty() && m_running == 0; });
+    // Workers only pick up a cache under the lock, none of them can compile meanwhile
+    for (Worker& worker : m_workers) {
+        m_device->getPersistentPipelineCache().merge(worker.cache);
+        worker.cache = m_device->getPersistentPipelineCache().createWorkerCache();
+    }
+}
+
+PipelineQueue::Handle PipelineQueue::push(Job job)
+{
+    Handle handle;
+    handle.m_future = job.get_future().share();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_workers.empty() || m_stop) {
+            throw std::runtime_error("pipeline queue is not running!");
+        }
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobAvailable.notify_one();
+    return handle;
+}
+
+void PipelineQueue::work(uint32_t index)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_jobAvailable.wait(lock, [&]() { return m_stop || !m_jobs.empty(); });
+        if (m_jobs.empty()) {
+            return;
+        }
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        const VkPipelineCache cache = m_workers[index].cache;
+        m_running++;
+
+        // Failures end up in the future of the job
+        lock.unlock();
+        job(cache);
+        lock.lock();
+
+        m_running--;
+        if (m_running == 0 && m_jobs.empty()) {
+            m_idle.notify_all();
+        }
+    }
+}
+
+std::shared_ptr<const std::vector<char>> PipelineQueue::getShaderCode(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_shaderMutex);
+        auto it = m_shaderCode.find(path);
+        if (it != m_shaderCode.end()) {
+            return it->second;
+        }
+    }
+    // Read without the lock, workers racing for the same file both read it and keep the first copy
+    auto code = std::make_shared<const std::vector<char>>(vkHelper::readFile(path));
+    std::lock_guard<std::mutex> lock(m_shaderMutex);
+    return m_shaderCode.emplace(path, code).first->second;
+}
+
+ShaderStage PipelineQueue::createShaderStage(const std::string& path, VkShaderStageFlagBits stage)
+{
+    ShaderStage shaderStage{};
+    shaderStage.stage = stage;
+    shaderStage.module = m_device->createShaderModule(m_device->getDevice(), *getShaderCode(path));
+    shaderStage.pName = "main";
+    return shaderStage;
+}
+
+void PipelineQueue::destroyShaderStages(const std::vector<ShaderStage>& shaderStages)
+{
+    for (const ShaderStage& shaderStage : shaderStages) {
+        vkDestroyShaderModule(m_device->getDevice(), shaderStage.module, nullptr);
+    }
+}
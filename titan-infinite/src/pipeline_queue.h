@@ -0,0 +1,100 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <condition_variable>
+
+struct Device;
+
+// Compiles pipelines on worker threads, one per core but the one submitting. Descriptions are copied at submission and
+// every shader file is read once for the lifetime of the queue. Each worker compiles against a pipeline cache of its
+// own, wait() and destroy() merge them into the device cache.
+// A pipeline belongs to the caller once compiled, even when nobody asked for it before destroy()
+class PipelineQueue {
+
+public:
+    struct GraphicsPipelineDesc {
+        std::string vertexShaderFile;
+        std::string pixelShaderFile;
+        VertexInputState vertexInputState;
+        InputAssemblyState inputAssemblyState{};
+        ViewportState viewportState{};
+        RasterizationState rasterizationState{};
+        MultisampleState multisampleState{};
+        DepthStencilState depthStencilState{};
+        ColorBlendState colorBlendState{};
+        std::vector<VkDynamicState> dynamicStates;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+    };
+
+    struct ComputePipelineDesc {
+        std::string computeShaderFile;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        // No specialization when empty
+        std::vector<VkSpecializationMapEntry> specializationEntries;
+        std::vector<uint8_t> specializationData;
+    };
+
+    class Handle {
+
+    public:
+        bool valid() const { return m_future.valid(); }
+        bool isReady() const { return valid() && m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+        // fallback until the pipeline is compiled, draws skip or bind something else meanwhile
+        VkPipeline get(VkPipeline fallback = VK_NULL_HANDLE) const { return isReady() ? m_future.get() : fallback; }
+        // Blocks until compiled, rethrows when compiling failed
+        VkPipeline wait() const { return m_future.get(); }
+
+    private:
+        friend class PipelineQueue;
+        std::shared_future<VkPipeline> m_future;
+    };
+
+    PipelineQueue() = default;
+    PipelineQueue(const PipelineQueue&) = delete;
+    PipelineQueue& operator=(const PipelineQueue&) = delete;
+
+    // threadCount 0 picks one worker per core but one
+    void create(Device* device, uint32_t threadCount = 0);
+    // Compiles what is still queued, then merges
+    void destroy();
+
+    Handle submit(const GraphicsPipelineDesc& desc);
+    Handle submit(const ComputePipelineDesc& desc);
+    // Blocks until everything submitted so far is compiled, then merges the worker caches. Not while another thread
+    // creates pipelines with the device cache
+    void wait();
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(m_workers.size()); }
+
+private:
+    using Job = std::packaged_task<VkPipeline(VkPipelineCache)>;
+
+    struct Worker {
+        std::thread thread;
+        VkPipelineCache cache = VK_NULL_HANDLE;
+    };
+
+    Handle push(Job job);
+    void work(uint32_t index);
+    std::shared_ptr<const std::vector<char>> getShaderCode(const std::string& path);
+    ShaderStage createShaderStage(const std::string& path, VkShaderStageFlagBits stage);
+    void destroyShaderStages(const std::vector<ShaderStage>& shaderStages);
+
+    Device* m_device = nullptr;
+    std::vector<Worker> m_workers;
+    std::deque<Job> m_jobs;
+    uint32_t m_running = 0;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_jobAvailable;
+    std::condition_variable m_idle;
+
+    std::unordered_map<std::string, std::shared_ptr<const std::vector<char>>> m_shaderCode;
+    std::mutex m_shaderMutex;
+};
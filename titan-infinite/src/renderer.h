@@ -21,6 +21,8 @@ struct DescriptorSetLayoutBinding {
     uint32_t descriptorCount;
     VkShaderStageFlags stageFlags;
     const VkSampler* pImmutableSamplers;
+    // Descriptor indexing flags, UPDATE_AFTER_BIND makes the layout need an update after bind pool
+    VkDescriptorBindingFlags bindingFlags{ 0 };
 };
 
 struct ShaderStage {
@@ -0,0 +1,107 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "scene_arena.h"
+
+namespace vkglTF {
+
+    static size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    SceneArena::~SceneArena()
+    {
+        release();
+    }
+
+    void SceneArena::reserve(const Counts& counts)
+    {
+        release();
+
+        m_alignment = std::max({ alignof(Node), alignof(Mesh), alignof(Primitive), alignof(std::max_align_t) });
+        const size_t meshOffset = alignUp(sizeof(Node) * counts.nodes, m_alignment);
+        const size_t primitiveOffset = meshOffset + alignUp(sizeof(Mesh) * counts.meshes, m_alignment);
+        m_bytes = primitiveOffset + sizeof(Primitive) * counts.primitives;
+        if (m_bytes == 0) {
+            return;
+        }
+
+        m_data = static_cast<uint8_t*>(::operator new(m_bytes, std::align_val_t(m_alignment)));
+        m_capacity = counts;
+        m_nodes = reinterpret_cast<Node*>(m_data);
+        m_meshes = reinterpret_cast<Mesh*>(m_data + meshOffset);
+        m_primitives = reinterpret_cast<Primitive*>(m_data + primitiveOffset);
+    }
+
+    void SceneArena::release()
+    {
+        for (uint32_t i = 0; i < m_nodeCount; i++) {
+            m_nodes[i].~Node();
+        }
+        // Frees the instance matrices
+        for (uint32_t i = 0; i < m_meshCount; i++) {
+            m_meshes[i].~Mesh();
+        }
+        for (uint32_t i = 0; i < m_primitiveCount; i++) {
+            m_primitives[i].~Primitive();
+        }
+        if (m_data != nullptr) {
+            ::operator delete(m_data, std::align_val_t(m_alignment));
+        }
+        m_data = nullptr;
+        m_bytes = 0;
+        m_capacity = {};
+        m_nodes = nullptr;
+        m_nodeCount = 0;
+        m_meshes = nullptr;
+        m_meshCount = 0;
+        m_primitives = nullptr;
+        m_primitiveCount = 0;
+    }
+
+    ArenaRange<Node> SceneArena::allocateNodes(uint32_t count)
+    {
+        if (m_nodeCount + count > m_capacity.nodes) {
+            throw std::runtime_error("scene arena is out of nodes!");
+        }
+        ArenaRange<Node> range{ m_nodes + m_nodeCount, count };
+        for (uint32_t i = 0; i < count; i++) {
+            new (m_nodes + m_nodeCount) Node{};
+            m_nodeCount++;
+        }
+        return range;
+    }
+
+    Mesh* SceneArena::createMesh(Device* device, const glm::mat4& matrix)
+    {
+        if (m_meshCount == m_capacity.meshes) {
+            throw std::runtime_error("scene arena is out of meshes!");
+        }
+        Mesh* mesh = new (m_meshes + m_meshCount) Mesh(device, matrix);
+        m_meshCount++;
+        return mesh;
+    }
+
+    Primitive* SceneArena::createPrimitive(uint32_t firstIndex, uint32_t indexCount, uint32_t vertexCount, Material& material)
+    {
+        if (m_primitiveCount == m_capacity.primitives) {
+            throw std::runtime_error("scene arena is out of primitives!");
+        }
+        Primitive* primitive = new (m_primitives + m_primitiveCount) Primitive(firstIndex, indexCount, vertexCount, material);
+        m_primitiveCount++;
+        return primitive;
+    }
+
+    ArenaRange<Primitive> SceneArena::getPrimitives(Primitive* first) const
+    {
+        if (first == nullptr) {
+            return {};
+        }
+        return { first, static_cast<uint32_t>(m_primitives + m_primitiveCount - first) };
+    }
+}
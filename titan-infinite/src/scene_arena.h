@@ -0,0 +1,86 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+struct Device;
+
+namespace vkglTF {
+
+    struct Node;
+    struct Mesh;
+    struct Primitive;
+    struct Material;
+
+    // Adjacent objects of one pool of a SceneArena. Iterates pointers, so code walking children and primitives reads the
+    // same as with a vector of pointers
+    template <typename T>
+    struct ArenaRange {
+        T* first = nullptr;
+        uint32_t count = 0;
+
+        struct Iterator {
+            T* current;
+            T* operator*() const { return current; }
+            Iterator& operator++() { ++current; return *this; }
+            bool operator!=(const Iterator& other) const { return current != other.current; }
+        };
+
+        Iterator begin() const { return { first }; }
+        Iterator end() const { return { first + count }; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        T* operator[](size_t index) const { return first + index; }
+    };
+
+    // Nodes, meshes and primitives of a model in one allocation, a typed pool each, sized from the glTF file before any of
+    // them is created. Nodes are handed out a sibling group at a time and a group is only allocated once its parent exists,
+    // so children are a range of the node pool and a pass in pool order visits every parent before its children.
+    // Nothing is freed on its own, release() destroys everything at once
+    class SceneArena {
+
+    public:
+        struct Counts {
+            uint32_t nodes = 0;
+            uint32_t meshes = 0;
+            uint32_t primitives = 0;
+        };
+
+        SceneArena() = default;
+        ~SceneArena();
+        SceneArena(const SceneArena&) = delete;
+        SceneArena& operator=(const SceneArena&) = delete;
+
+        // Releases what the arena holds first
+        void reserve(const Counts& counts);
+        void release();
+
+        // Default constructed
+        ArenaRange<Node> allocateNodes(uint32_t count);
+        Mesh* createMesh(Device* device, const glm::mat4& matrix);
+        Primitive* createPrimitive(uint32_t firstIndex, uint32_t indexCount, uint32_t vertexCount, Material& material);
+
+        ArenaRange<Node> getNodes() const { return { m_nodes, m_nodeCount }; }
+        ArenaRange<Mesh> getMeshes() const { return { m_meshes, m_meshCount }; }
+        // From first to the last primitive created, the primitives of a mesh are created one after another.
+        // Empty for nullptr
+        ArenaRange<Primitive> getPrimitives(Primitive* first) const;
+        size_t getBytes() const { return m_bytes; }
+
+    private:
+        uint8_t* m_data = nullptr;
+        size_t m_bytes = 0;
+        size_t m_alignment = 0;
+        Counts m_capacity;
+        Node* m_nodes = nullptr;
+        uint32_t m_nodeCount = 0;
+        Mesh* m_meshes = nullptr;
+        uint32_t m_meshCount = 0;
+        Primitive* m_primitives = nullptr;
+        uint32_t m_primitiveCount = 0;
+    };
+}
@@ -6,6 +6,7 @@
 
 #include "pch.h"
 #include "skybox.h"
+#include <filesystem>
 
 Skybox::Skybox()
 {
@@ -19,12 +20,13 @@ void Skybox::create(Device* device, const std::string& cubeFilename, const std::
 {
 	m_device = device;
 	skyboxModel.loadFromFile(cubeFilename, device, device->getGraphicsQueue());
-	m_envCube = texture::loadTextureCube(envTextureFilename, VK_FORMAT_R8G8B8A8_UNORM, m_device, 4);
-	initUniformBuffer();
+	ibl.create(device, envTextureFilename, (std::filesystem::path(envTextureFilename).parent_path() / "ibl_cache").string());
+	updateUniformBuffer();
 }
 
 void Skybox::destroy()
 {
+	ibl.destroy();
 	vkDestroyPipelineLayout(m_device->getDevice(), pipelineLayout, nullptr);
 	vkDestroyPipeline(m_device->getDevice(), pipeline, nullptr);
 	delete m_device;
@@ -36,23 +38,12 @@ void Skybox::draw(VkCommandBuffer commandBuffer)
 			uboDescriptorSet,
 			envDescriptorSet,
 	};
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, (uint32_t)descriptorSets.size(), descriptorSets.data(), 0, nullptr);
+	const uint32_t dynamicOffset = m_device->getFrameAllocator().push(skyboxShaderData);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, (uint32_t)descriptorSets.size(), descriptorSets.data(), 1, &dynamicOffset);
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 	skyboxModel.draw(commandBuffer);
 }
 
-void Skybox::initUniformBuffer()
-{
-	skyboxUniformBuffer = buffer::createBuffer(
-		m_device,
-		sizeof(skyboxShaderData),
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	);
-	memory::map(m_device->getDevice(), skyboxUniformBuffer.memory, 0, VK_WHOLE_SIZE, &skyboxUniformBuffer.mapped);
-	updateUniformBuffer();
-}
-
 void Skybox::updateUniformBuffer()
 {
 	glm::mat4 projectionMatrix = glm::perspectiveFov(m_device->getWindow()->getCamera()->fov, (float)m_device->getSwapChainExtent().width, (float)m_device->getSwapChainExtent().height, 1.0f, 1000.0f);
@@ -60,21 +51,20 @@ void Skybox::updateUniformBuffer()
 	//const glm::mat4 viewRotationMatrix = glm::eulerAngleXY(glm::radians(m_device->getWindow()->getCamera()->pitch), glm::radians(m_device->getWindow()->getCamera()->yaw));
 	const glm::mat4 viewRotationMatrix = m_device->getWindow()->getCamera()->matrices.view;
 	skyboxShaderData.skyProjectionMatrix = projectionMatrix * viewRotationMatrix;
-	memcpy(skyboxUniformBuffer.mapped, &skyboxShaderData, sizeof(skyboxShaderData));
 }
 
 void Skybox::initDescriptorSet()
 {
 	{
 		const std::vector<DescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
-				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr }
+				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr }
 		};
 		uboDescriptorSetLayout = m_device->createDescriptorSetLayout(m_device->getDevice(), { descriptorSetLayoutBindings });
 		uboDescriptorSet = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), uboDescriptorSetLayout);
 	}
 	{
 		const std::vector<DescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
-			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, &m_envCube.sampler }
+			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, &ibl.environment.sampler }
 		};
 		envDescriptorSetLayout = m_device->createDescriptorSetLayout(m_device->getDevice(), { descriptorSetLayoutBindings });
 		envDescriptorSet = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), envDescriptorSetLayout);
@@ -95,19 +85,20 @@ void Skybox::initDescriptorSet()
 
 void Skybox::bindUniformbuffer(uint32_t dstBinding)
 {
+	const VkDescriptorBufferInfo bufferInfo = m_device->getFrameAllocator().getDescriptor(sizeof(skyboxShaderData));
 	VkWriteDescriptorSet writeDescriptorSet{};
 	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	writeDescriptorSet.descriptorCount = 1;
 	writeDescriptorSet.dstSet = uboDescriptorSet;
 	writeDescriptorSet.dstBinding = dstBinding;
-	writeDescriptorSet.pBufferInfo = &skyboxUniformBuffer.descriptor;
+	writeDescriptorSet.pBufferInfo = &bufferInfo;
 	vkUpdateDescriptorSets(m_device->getDevice(), 1, &writeDescriptorSet, 0, nullptr);
 }
 
 void Skybox::bindSkyboxTexture(uint32_t dstBinding)
 {
-	const VkDescriptorImageInfo skyboxTexture = { VK_NULL_HANDLE, m_envCube.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	const VkDescriptorImageInfo skyboxTexture = { VK_NULL_HANDLE, ibl.environment.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
 	VkWriteDescriptorSet writeDescriptorSet{};
 	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -185,5 +176,5 @@ void Skybox::initPipelines(const VkRenderPass& renderPass)
 	dynamicState.pDynamicStates = dynamicStates.data();
 	dynamicState.dynamicStateCount = 0;
 
-	pipeline = m_device->createGraphicsPipeline(m_device->getDevice(), nullptr, shaderStages_skybox, vertexInputState, inputAssembly, viewport, rasterizer, multisampling, depthStencil, colorBlending, dynamicState, pipelineLayout, renderPass);
+	pipeline = m_device->createGraphicsPipeline(m_device->getDevice(), m_device->getPipelineCache(), shaderStages_skybox, vertexInputState, inputAssembly, viewport, rasterizer, multisampling, depthStencil, colorBlending, dynamicState, pipelineLayout, renderPass);
 }
@@ -14,7 +14,7 @@ public:
 	~Skybox();
 	void create(Device* device, const std::string& cubeFilename, const std::string& envTextureFilename);
 	void destroy();
-	void initUniformBuffer();
+	// Only updates skyboxShaderData, draw() copies it into the frame allocator
 	void updateUniformBuffer();
 	void initDescriptorSet();
 	void bindUniformbuffer(uint32_t dstBinding);
@@ -27,7 +27,6 @@ public:
 	struct skyboxShaderData {
 		glm::mat4 skyProjectionMatrix;
 	}skyboxShaderData;
-	Buffer skyboxUniformBuffer;
 
 	VkDescriptorSetLayout uboDescriptorSetLayout;
 	VkDescriptorSetLayout envDescriptorSetLayout;
@@ -36,8 +35,10 @@ public:
 
 	VkPipelineLayout pipelineLayout;
 	VkPipeline pipeline;
+
+	// The skybox draws its environment cube, scenes bind the irradiance, prefiltered and BRDF LUT textures
+	ImageBasedLighting ibl;
 	
 private:
 	Device* m_device;
-	TextureObject m_envCube;
 };
\ No newline at end of file
@@ -26,10 +26,6 @@ Spline::~Spline()
 	vkDestroyDescriptorSetLayout(m_device->getDevice(), m_descriptorSetLayout, nullptr);
 	vkDestroyPipelineLayout(m_device->getDevice(), m_pipelineLayout, nullptr);
 	vkDestroyPipeline(m_device->getDevice(), m_pipeline, nullptr);
-	vkDestroyBuffer(m_device->getDevice(), buffers.controlPoints.buffer, nullptr);
-	vkDestroyBuffer(m_device->getDevice(), buffers.interpolatedPoints.buffer, nullptr);
-	for (auto buffer : m_uniformBuffers)
-		buffer.destroy();
 	buffers.controlPoints.destroy();
 	buffers.interpolatedPoints.destroy();
 }
@@ -39,23 +35,7 @@ void Spline::init()
 	if (initialized) return;
 	assert(m_device->getDescriptorPool() != VK_NULL_HANDLE);
 
-	struct StagingBuffer
-	{
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-	} vertexStaging_control, vertexStaging_interpolated;
-
-	// Vertex Buffer - Control Points
-	buffer::createBuffer(
-		m_device,
-		m_controlPoints.size() * sizeof(glm::vec3),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		VK_SHARING_MODE_EXCLUSIVE,
-		&vertexStaging_control.buffer,
-		&vertexStaging_control.memory,
-		m_controlPoints.data());
-	
+	// Vertex Buffers, through the staging belt
 	buffer::createBuffer(
 		m_device,
 		m_controlPoints.size() * sizeof(glm::vec3),
@@ -63,18 +43,8 @@ void Spline::init()
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		VK_SHARING_MODE_EXCLUSIVE,
 		&buffers.controlPoints.buffer,
-		&buffers.controlPoints.memory);
-
-	// Vertex Buffer - Interpolated Points
-	buffer::createBuffer(
-		m_device,
-		m_interpolatedPoints.size() * sizeof(glm::vec3),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		VK_SHARING_MODE_EXCLUSIVE,
-		&vertexStaging_interpolated.buffer,
-		&vertexStaging_interpolated.memory,
-		m_interpolatedPoints.data());
+		&buffers.controlPoints.allocation);
+	buffers.controlPoints.device = m_device->getDevice();
 
 	buffer::createBuffer(
 		m_device,
@@ -83,57 +53,32 @@ void Spline::init()
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		VK_SHARING_MODE_EXCLUSIVE,
 		&buffers.interpolatedPoints.buffer,
-		&buffers.interpolatedPoints.memory);
-
-	// Copy from staging buffers
-	VkCommandBuffer copyCmd_contorl = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_device->getCommandPool(), true);
-	VkBufferCopy copyRegion_contorl{};
-	copyRegion_contorl.size = m_controlPoints.size() * sizeof(glm::vec3);
-	vkCmdCopyBuffer(copyCmd_contorl, vertexStaging_control.buffer, buffers.controlPoints.buffer, 1, &copyRegion_contorl);
-	m_device->flushCommandBuffer(copyCmd_contorl, m_device->getGraphicsQueue());
-
-	// Copy from staging buffers
-	VkCommandBuffer copyCmd_interpolated = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_device->getCommandPool(), true);
-	VkBufferCopy copyRegion_interpolated{};
-	copyRegion_interpolated.size = m_interpolatedPoints.size() * sizeof(glm::vec3);
-	vkCmdCopyBuffer(copyCmd_interpolated, vertexStaging_interpolated.buffer, buffers.interpolatedPoints.buffer, 1, &copyRegion_interpolated);
-	m_device->flushCommandBuffer(copyCmd_interpolated, m_device->getGraphicsQueue());
-
-	vkDestroyBuffer(m_device->getDevice(), vertexStaging_control.buffer, nullptr);
-	vkFreeMemory(m_device->getDevice(), vertexStaging_control.memory, nullptr);
-	vkDestroyBuffer(m_device->getDevice(), vertexStaging_interpolated.buffer, nullptr);
-	vkFreeMemory(m_device->getDevice(), vertexStaging_interpolated.memory, nullptr);
-	// Uniform Buffer
-	m_uniformBuffers.resize(m_device->getSwapChainimages().size());
-	for (auto& uniformBuffer : m_uniformBuffers) {
-		uniformBuffer = buffer::createBuffer(
-			m_device,
-			sizeof(ubo),
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		);
-		memory::map(m_device->getDevice(), uniformBuffer.memory, 0, uniformBuffer.bufferSize, &uniformBuffer.mapped);
-	}
+		&buffers.interpolatedPoints.allocation);
+	buffers.interpolatedPoints.device = m_device->getDevice();
 
-	// Descriptor Set 
+	StagingBelt& stagingBelt = m_device->getStagingBelt();
+	stagingBelt.copyToBuffer(m_controlPoints.data(), m_controlPoints.size() * sizeof(glm::vec3), buffers.controlPoints.buffer);
+	stagingBelt.copyToBuffer(m_interpolatedPoints.data(), m_interpolatedPoints.size() * sizeof(glm::vec3), buffers.interpolatedPoints.buffer);
+	stagingBelt.flush();
+
+	// Descriptor Set, the uniform block comes from the frame allocator
 	{
 		std::vector<DescriptorSetLayoutBinding> layoutBindings = {
-			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
+			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
 		};
 		m_descriptorSetLayout = m_device->createDescriptorSetLayout(m_device->getDevice(), { layoutBindings });
 	}
-
-	m_descriptorsets.resize(m_device->getSwapChainimages().size());
-	for (auto i = 0; i < m_descriptorsets.size(); ++i) {
-		m_descriptorsets[i] = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), m_descriptorSetLayout);
+	{
+		m_descriptorSet = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), m_descriptorSetLayout);
+		const VkDescriptorBufferInfo bufferInfo = m_device->getFrameAllocator().getDescriptor(sizeof(ubo));
 		std::array<VkWriteDescriptorSet, 1> writeDescriptorSets{};
 
 		writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		writeDescriptorSets[0].descriptorCount = 1;
-		writeDescriptorSets[0].dstSet = m_descriptorsets[i];
+		writeDescriptorSets[0].dstSet = m_descriptorSet;
 		writeDescriptorSets[0].dstBinding = 0;
-		writeDescriptorSets[0].pBufferInfo = &m_uniformBuffers[i].descriptor;
+		writeDescriptorSets[0].pBufferInfo = &bufferInfo;
 		vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 	}
 
@@ -233,7 +178,8 @@ void Spline::addInterpolationPoint(glm::vec3 pos)
 void Spline::drawSpline(VkCommandBuffer commandBuffer)
 {
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, m_descriptorsets.data(), 0, NULL);
+	const uint32_t dynamicOffset = m_device->getFrameAllocator().push(ubo);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 1, &dynamicOffset);
 	const VkDeviceSize offsets[] = { 0 };
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffers.interpolatedPoints.buffer, offsets);
 	vkCmdDraw(commandBuffer, m_interpolatedPoints.size(), 1, 0, 0);
@@ -242,7 +188,8 @@ void Spline::drawSpline(VkCommandBuffer commandBuffer)
 void Spline::drawControlPoints(VkCommandBuffer commandBuffer)
 {
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, m_descriptorsets.data(), 0, NULL);
+	const uint32_t dynamicOffset = m_device->getFrameAllocator().push(ubo);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 1, &dynamicOffset);
 	const VkDeviceSize controlPointsOffsets[] = { 0 };
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffers.controlPoints.buffer, controlPointsOffsets);
 	vkCmdDraw(commandBuffer, m_controlPoints.size(), 1, 0, 0);
@@ -356,7 +303,4 @@ void Spline::updateUniformBuffer(Camera* camera, glm::mat4 model, bool controlPo
 	ubo.mvp = camera->matrices.perspective * camera->matrices.view * model;
 	ubo.color = m_splineColor;
 	ubo.controlPoint = controlPoint;
-
-	auto imageIndex = m_device->getCurrentFrame();
-	memcpy(m_uniformBuffers[imageIndex].mapped, &ubo, sizeof(ubo));
 }
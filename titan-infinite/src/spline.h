@@ -33,6 +33,7 @@ public:
 	glm::vec3 calculateBSplineDerivative(glm::mat4 matrix, float t);
 	TableValue findInTable(float distance);
 	void calculateAdaptiveTable(float& t1, float& t2, float& t3);
+	// Picked up by the next drawSpline or drawControlPoints
 	void updateUniformBuffer(Camera* camera, glm::mat4 model = glm::mat4(1.0), bool controlPoint = false);
 	
 private:
@@ -46,9 +47,8 @@ private:
 		bool controlPoint;
 	}ubo;
 
-	std::vector<Buffer> m_uniformBuffers;
 	VkDescriptorSetLayout m_descriptorSetLayout;
-	std::vector<VkDescriptorSet> m_descriptorsets;
+	VkDescriptorSet m_descriptorSet;
 	VkPipelineLayout m_pipelineLayout;
 	VkPipeline m_pipeline;
 
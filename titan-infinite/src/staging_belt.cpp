@@ -0,0 +1,376 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "staging_belt.h"
+
+// Satisfies the offset rules of buffer to image copies for every uncompressed format up to 16 bytes per texel
+static const VkDeviceSize stagingAlignment = 16;
+
+void StagingBelt::create(Device* device, VkDeviceSize size)
+{
+    m_device = device;
+    m_vkDevice = device->getDevice();
+
+    const QueueFamilyIndices& families = device->getQueueFamilies();
+    m_graphicsFamily = families.graphicsFamily.value();
+    m_transferFamily = families.transferFamily.value();
+    m_dedicated = m_transferFamily != m_graphicsFamily;
+    m_graphicsQueue = device->getGraphicsQueue();
+    m_transferQueue = device->getTransferQueue();
+    m_transferPool = device->createCommandPool(m_vkDevice, m_transferFamily);
+    if (m_dedicated) {
+        m_graphicsPool = device->createCommandPool(m_vkDevice, m_graphicsFamily);
+    }
+
+    m_size = (size + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(m_vkDevice, &bufferInfo, nullptr, &m_buffer));
+
+    m_allocation = memory::allocate(device, m_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, memory::Tag::Staging);
+    m_mapped = m_allocation.mapped;
+    m_head = 0;
+    m_tail = 0;
+    m_stats = {};
+    m_stats.dedicatedQueue = m_dedicated;
+}
+
+void StagingBelt::destroy()
+{
+    if (m_vkDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    if (m_isRecording) {
+        submit();
+    }
+    while (!m_inFlight.empty()) {
+        retire(true);
+    }
+    for (auto& batch : m_free) {
+        destroyBatch(batch);
+    }
+    m_free.clear();
+    if (m_graphicsPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(m_vkDevice, m_graphicsPool, nullptr);
+        m_graphicsPool = VK_NULL_HANDLE;
+    }
+    vkDestroyCommandPool(m_vkDevice, m_transferPool, nullptr);
+    m_transferPool = VK_NULL_HANDLE;
+    vkDestroyBuffer(m_vkDevice, m_buffer, nullptr);
+    m_buffer = VK_NULL_HANDLE;
+    memory::free(m_allocation);
+    m_mapped = nullptr;
+    m_vkDevice = VK_NULL_HANDLE;
+}
+
+void StagingBelt::copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+    if (size == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Staging staging = stage(data, size);
+    Batch& batch = getRecording();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = staging.offset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(batch.transferCommandBuffer, staging.buffer, dstBuffer, 1, &copyRegion);
+
+    // With a single family the barrier at submit covers every buffer
+    if (m_dedicated) {
+        VkBufferMemoryBarrier barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = m_transferFamily;
+        barrier.dstQueueFamilyIndex = m_graphicsFamily;
+        barrier.buffer = dstBuffer;
+        barrier.offset = dstOffset;
+        barrier.size = size;
+        batch.bufferBarriers.push_back(barrier);
+    }
+}
+
+void StagingBelt::copyToImage(const void* data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& range, VkImageLayout finalLayout)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Staging staging = stage(data, size);
+    Batch& batch = getRecording();
+
+    VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    vkCmdPipelineBarrier(batch.transferCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    std::vector<VkBufferImageCopy> copyRegions = regions;
+    for (auto& region : copyRegions) {
+        region.bufferOffset += staging.offset;
+    }
+    vkCmdCopyBufferToImage(batch.transferCommandBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+    // Layout change and release to the graphics family at submit
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = m_dedicated ? 0 : VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = finalLayout;
+    if (m_dedicated) {
+        barrier.srcQueueFamilyIndex = m_transferFamily;
+        barrier.dstQueueFamilyIndex = m_graphicsFamily;
+    }
+    batch.imageBarriers.push_back(barrier);
+}
+
+StagingBelt::Token StagingBelt::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_isRecording) {
+        return m_nextToken - 1;
+    }
+    return submit();
+}
+
+bool StagingBelt::isComplete(Token token)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    retire(false);
+    return token <= m_completedToken;
+}
+
+void StagingBelt::wait(Token token)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (m_completedToken < token && !m_inFlight.empty()) {
+        retire(true);
+    }
+}
+
+void StagingBelt::update()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_isRecording) {
+        submit();
+    }
+    retire(false);
+    m_stats.lastFrameBytes = m_frameBytes;
+    m_stats.peakFrameBytes = std::max(m_stats.peakFrameBytes, m_frameBytes);
+    m_frameBytes = 0;
+}
+
+StagingBelt::Stats StagingBelt::getStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.capacity = m_size;
+    m_stats.inFlightBytes = m_head - m_tail;
+    return m_stats;
+}
+
+StagingBelt::Staging StagingBelt::stage(const void* data, VkDeviceSize size)
+{
+    m_stats.copies++;
+    m_stats.totalBytes += size;
+    m_frameBytes += size;
+
+    // The ring only takes up to half of itself at once, so an empty ring always fits a copy
+    if (size + stagingAlignment > m_size / 2) {
+        Oversized oversized;
+        buffer::createBuffer(
+            m_device,
+            size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_SHARING_MODE_EXCLUSIVE,
+            &oversized.buffer,
+            &oversized.allocation,
+            const_cast<void*>(data));
+        getRecording().oversized.push_back(oversized);
+        m_stats.oversizedCopies++;
+        return { oversized.buffer, 0 };
+    }
+
+    // May submit the batch being recorded, so the space is reserved before the batch is looked up
+    VkDeviceSize offset = reserve(size);
+    memcpy(m_mapped + offset, data, size);
+    getRecording();
+    return { m_buffer, offset };
+}
+
+VkDeviceSize StagingBelt::reserve(VkDeviceSize size)
+{
+    for (;;) {
+        const VkDeviceSize position = m_head % m_size;
+        VkDeviceSize start = (position + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+        // Doesn't fit before the end of the ring, continue at its beginning
+        if (start + size > m_size) {
+            start = m_size;
+        }
+        const VkDeviceSize end = m_head - position + start + size;
+        if (end - m_tail <= m_size) {
+            m_head = end;
+            return (end - size) % m_size;
+        }
+
+        // The rest of the ring belongs to the batch being recorded
+        if (m_inFlight.empty()) {
+            assert(m_isRecording);
+            submit();
+        }
+        else if (!retire(false)) {
+            m_stats.stalls++;
+            retire(true);
+        }
+    }
+}
+
+StagingBelt::Batch& StagingBelt::getRecording()
+{
+    if (m_isRecording) {
+        return m_recording;
+    }
+
+    if (!m_free.empty()) {
+        m_recording = std::move(m_free.back());
+        m_free.pop_back();
+    }
+    else {
+        m_recording = Batch();
+        m_recording.transferCommandBuffer = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_transferPool);
+        if (m_dedicated) {
+            m_recording.acquireCommandBuffer = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_graphicsPool);
+            VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+            VK_CHECK(vkCreateSemaphore(m_vkDevice, &semaphoreInfo, nullptr, &m_recording.semaphore));
+        }
+        VkFenceCreateInfo fenceInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        VK_CHECK(vkCreateFence(m_vkDevice, &fenceInfo, nullptr, &m_recording.fence));
+    }
+
+    VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(m_recording.transferCommandBuffer, &beginInfo));
+    m_isRecording = true;
+    return m_recording;
+}
+
+StagingBelt::Token StagingBelt::submit()
+{
+    Batch& batch = m_recording;
+    batch.token = m_nextToken++;
+    batch.ringEnd = m_head;
+
+    VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.transferCommandBuffer;
+
+    if (m_dedicated) {
+        if (!batch.bufferBarriers.empty() || !batch.imageBarriers.empty()) {
+            vkCmdPipelineBarrier(batch.transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr,
+                static_cast<uint32_t>(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+                static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+        }
+        VK_CHECK(vkEndCommandBuffer(batch.transferCommandBuffer));
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &batch.semaphore;
+        VK_CHECK(vkQueueSubmit(m_transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+        // The acquiring half repeats the release barriers, its access masks are the ones that count now
+        for (auto& barrier : batch.bufferBarriers) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        }
+        for (auto& barrier : batch.imageBarriers) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        }
+        VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK(vkBeginCommandBuffer(batch.acquireCommandBuffer, &beginInfo));
+        if (!batch.bufferBarriers.empty() || !batch.imageBarriers.empty()) {
+            vkCmdPipelineBarrier(batch.acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                0, nullptr,
+                static_cast<uint32_t>(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+                static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+        }
+        VK_CHECK(vkEndCommandBuffer(batch.acquireCommandBuffer));
+
+        const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo acquireInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+        acquireInfo.waitSemaphoreCount = 1;
+        acquireInfo.pWaitSemaphores = &batch.semaphore;
+        acquireInfo.pWaitDstStageMask = &waitStage;
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &batch.acquireCommandBuffer;
+        VK_CHECK(vkQueueSubmit(m_graphicsQueue, 1, &acquireInfo, batch.fence));
+    }
+    else {
+        // Same queue as the frames, later submissions are ordered behind the barrier
+        VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        vkCmdPipelineBarrier(batch.transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            1, &memoryBarrier,
+            0, nullptr,
+            static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+        VK_CHECK(vkEndCommandBuffer(batch.transferCommandBuffer));
+        VK_CHECK(vkQueueSubmit(m_transferQueue, 1, &submitInfo, batch.fence));
+    }
+
+    m_stats.batches++;
+    const Token token = batch.token;
+    m_inFlight.push_back(std::move(batch));
+    m_recording = Batch();
+    m_isRecording = false;
+    return token;
+}
+
+bool StagingBelt::retire(bool wait)
+{
+    bool retired = false;
+    while (!m_inFlight.empty()) {
+        Batch& batch = m_inFlight.front();
+        if (!m_device->isFenceSignaled(batch.fence)) {
+            if (!wait || retired) {
+                break;
+            }
+            vkWaitForFences(m_vkDevice, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        }
+
+        m_tail = batch.ringEnd;
+        m_completedToken = batch.token;
+        for (auto& oversized : batch.oversized) {
+            vkDestroyBuffer(m_vkDevice, oversized.buffer, nullptr);
+            memory::free(oversized.allocation);
+        }
+        batch.oversized.clear();
+        batch.bufferBarriers.clear();
+        batch.imageBarriers.clear();
+        vkResetFences(m_vkDevice, 1, &batch.fence);
+        m_free.push_back(std::move(batch));
+        m_inFlight.pop_front();
+        retired = true;
+    }
+    return retired;
+}
+
+void StagingBelt::destroyBatch(Batch& batch)
+{
+    // Command buffers go with their pools
+    if (batch.semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(m_vkDevice, batch.semaphore, nullptr);
+    }
+    vkDestroyFence(m_vkDevice, batch.fence, nullptr);
+    batch = Batch();
+}
@@ -0,0 +1,123 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+struct Device;
+
+// Uploads to device local memory through one persistently mapped ring buffer. Copies are recorded into a batch that
+// flush() submits to the transfer queue of the device without waiting; the returned token tells when the batch completed
+// and its part of the ring can be reused. When the transfer queue is of a family of its own, the batch releases every
+// destination to the graphics family and a second submit on the graphics queue, ordered behind the copies with a
+// semaphore, acquires them, so anything submitted to the graphics queue later sees the data without a host wait.
+// Destinations must not be in use by the GPU, images start out UNDEFINED.
+class StagingBelt {
+
+public:
+    using Token = uint64_t;
+
+    struct Stats {
+        VkDeviceSize capacity = 0;
+        // Ring bytes of batches not completed yet
+        VkDeviceSize inFlightBytes = 0;
+        VkDeviceSize totalBytes = 0;
+        // Staged between the last two update() calls
+        VkDeviceSize lastFrameBytes = 0;
+        VkDeviceSize peakFrameBytes = 0;
+        uint64_t copies = 0;
+        uint64_t batches = 0;
+        // Copies larger than half the ring, staged in a buffer of their own
+        uint64_t oversizedCopies = 0;
+        // Times a copy waited for the GPU because the ring was full
+        uint64_t stalls = 0;
+        bool dedicatedQueue = false;
+    };
+
+    StagingBelt() = default;
+    StagingBelt(const StagingBelt&) = delete;
+    StagingBelt& operator=(const StagingBelt&) = delete;
+
+    void create(Device* device, VkDeviceSize size);
+    // Waits for everything in flight
+    void destroy();
+
+    void copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+    // Regions are relative to data, their buffer offsets a multiple of 16 bytes. The subresources of range go from
+    // UNDEFINED to finalLayout
+    void copyToImage(const void* data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& range, VkImageLayout finalLayout);
+
+    // Submits the copies recorded so far, returns the token of the last batch if there are none
+    Token flush();
+    bool isComplete(Token token);
+    void wait(Token token);
+    // Once per frame, flushes what was recorded during the last one and recycles completed batches
+    void update();
+
+    Stats getStats();
+
+private:
+    struct Oversized {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        memory::Allocation allocation;
+    };
+
+    struct Batch {
+        VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+        // Acquire barriers on the graphics queue, only with a dedicated transfer family
+        VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        Token token = 0;
+        // Ring position after the last copy, everything before it is free once the batch completed
+        VkDeviceSize ringEnd = 0;
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        std::vector<Oversized> oversized;
+    };
+
+    struct Staging {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+    };
+
+    Staging stage(const void* data, VkDeviceSize size);
+    VkDeviceSize reserve(VkDeviceSize size);
+    Batch& getRecording();
+    Token submit();
+    // Retires completed batches from the front, waiting for the oldest one if wait is set. Returns false if none retired
+    bool retire(bool wait);
+    void destroyBatch(Batch& batch);
+
+    Device* m_device = nullptr;
+    VkDevice m_vkDevice = VK_NULL_HANDLE;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+    uint32_t m_transferFamily = 0;
+    uint32_t m_graphicsFamily = 0;
+    bool m_dedicated = false;
+    VkCommandPool m_transferPool = VK_NULL_HANDLE;
+    VkCommandPool m_graphicsPool = VK_NULL_HANDLE;
+
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    memory::Allocation m_allocation;
+    uint8_t* m_mapped = nullptr;
+    VkDeviceSize m_size = 0;
+    // Monotonic byte counters, their difference is the part of the ring in use
+    VkDeviceSize m_head = 0;
+    VkDeviceSize m_tail = 0;
+
+    Batch m_recording;
+    bool m_isRecording = false;
+    std::deque<Batch> m_inFlight;
+    std::vector<Batch> m_free;
+    Token m_nextToken = 1;
+    Token m_completedToken = 0;
+
+    VkDeviceSize m_frameBytes = 0;
+    Stats m_stats;
+    std::mutex m_mutex;
+};
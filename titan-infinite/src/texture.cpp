@@ -18,49 +18,83 @@ namespace texture {
         int num_requested_components,
         VkFilter filter,
         VkImageUsageFlags imageUsageFlags,
-        VkImageLayout imageLayout) {
+        VkImageLayout imageLayout,
+        bool retainData) {
+
+        UploadBatch batch;
+        batch.begin(device);
+        TextureObject texObj = loadTexture(filename, format, device, batch, filter, imageUsageFlags, imageLayout, retainData);
+        batch.submit(device->getGraphicsQueue());
+        batch.wait();
+        batch.destroy();
+        return texObj;
+    }
+
+    // Float texels are not blitted, the chain is filtered on the CPU and stored in the smallest format that keeps the content
+    static TextureObject loadHdrTexture(const TextureObject& source, Device* device, UploadBatch& batch, VkFilter filter, bool retainData)
+    {
+        const float* texels = reinterpret_cast<const float*>(source.data.data());
+        const size_t texelCount = static_cast<size_t>(source.width) * source.height;
+
+        MipChain chain;
+        buildHdrMipChain(texels, source.width, source.height, chooseHdrFormat(device, texels, texelCount), chain);
+
+        TextureObject texObj = recordMipChainUpload(device, chain, batch);
+        texObj.is_hdr = true;
+        texObj.num_components = source.num_components;
+        if (retainData) {
+            texObj.data.assign(chain.data.begin(), chain.data.begin() + texelCount * hdrTexelSize(chain.format));
+        }
+        texObj.sampler = texture::createSampler(device->getDevice(),
+            filter,
+            filter,
+            VK_SAMPLER_MIPMAP_MODE_LINEAR,
+            VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            0.0,
+            VK_TRUE,
+            1.0f,
+            VK_FALSE,
+            VK_COMPARE_OP_NEVER,
+            0.0,
+            (float)texObj.mipLevels,
+            VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+            VK_FALSE);
+        return texObj;
+    }
+
+    TextureObject loadTexture(
+        const std::string& filename,
+        VkFormat format,
+        Device* device,
+        UploadBatch& batch,
+        VkFilter filter,
+        VkImageUsageFlags imageUsageFlags,
+        VkImageLayout imageLayout,
+        bool retainData) {
 
         // Load data, width, height and num_components
         TextureObject texObj = loadTexture(filename);
+        if (texObj.is_hdr) {
+            return loadHdrTexture(texObj, device, batch, filter, retainData);
+        }
         texObj.device = device;
         texObj.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texObj.width, texObj.height)))) + 1;
         auto image_data_size = texObj.data.size();
 
         VkFormatProperties formatProps;
         vkGetPhysicalDeviceFormatProperties(device->getPhysicalDevice(), format, &formatProps);
-
-        VkBuffer stage_buffer;
-        VkDeviceMemory stage_buffer_memory;
-
-        stage_buffer = buffer::createBuffer(
-            device->getDevice(),
-            image_data_size,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-        );
-
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements(device->getDevice(), stage_buffer, &memReqs);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-        if (vkAllocateMemory(device->getDevice(), &allocInfo, nullptr, &stage_buffer_memory) != VK_SUCCESS) {
-            throw std::runtime_error("No mappable, coherent memory!");
+        if (texObj.mipLevels > 1 && !(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+            throw std::runtime_error("texture image format does not support linear blitting!");
         }
 
-        if (vkBindBufferMemory(device->getDevice(), stage_buffer, stage_buffer_memory, 0) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to bind buffer memory");
+        // copy texture data to the batch staging memory, the CPU copy is not needed after that
+        UploadBatch::Allocation staging = batch.stage(texObj.data.data(), image_data_size);
+        if (!retainData) {
+            texObj.releaseData();
         }
 
-        // copy texture data to staging buffer
-        void* data;
-        memory::map(device->getDevice(), stage_buffer_memory, 0, memReqs.size, &data);
-        memcpy(data, texObj.data.data(), image_data_size);
-        memory::unmap(device->getDevice(), stage_buffer_memory);
-
         // Image
         texObj.image = device->createImage(
             device->getDevice(),
@@ -77,23 +111,8 @@ namespace texture {
             VK_IMAGE_LAYOUT_UNDEFINED
         );
 
-        vkGetImageMemoryRequirements(device->getDevice(), texObj.image, &memReqs);
-        texObj.buffer_size = memReqs.size;
-
-        // VkMemoryAllocateInfo
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        if (vkAllocateMemory(device->getDevice(), &allocInfo, nullptr, &texObj.image_memory) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to allocate buffer memory!");
-        }
-
-        if (vkBindImageMemory(device->getDevice(), texObj.image, texObj.image_memory, 0) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to bind image memory");
-        }
-
-        // Use a separate command buffer for texture loading
-        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->getCommandPool(), true);
+        texObj.allocation = memory::allocate(device, texObj.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        texObj.buffer_size = texObj.allocation.size;
 
         VkImageSubresourceRange subresourceRange{};
         subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -103,7 +122,7 @@ namespace texture {
 
         /* Since we're going to blit to the texture image, set its layout to DESTINATION_OPTIMAL */
         texture::setImageLayout(
-            copyCmd,
+            batch.commandBuffer,
             texObj.image,
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -114,44 +133,35 @@ namespace texture {
             VK_ACCESS_TRANSFER_WRITE_BIT);
 
         //Generate first one and setup each mipmap later
-        std::vector<VkBufferImageCopy> bufferImgCopyList;
-        for (uint32_t i = 0; i < 1; ++i)
-        {
-            VkBufferImageCopy copy_region{};
-            copy_region.bufferOffset = 0;
-            copy_region.bufferRowLength = 0;
-            copy_region.bufferImageHeight = 0;
-            copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            copy_region.imageSubresource.mipLevel = i;
-            copy_region.imageSubresource.baseArrayLayer = 0;
-            copy_region.imageSubresource.layerCount = 1;
-            copy_region.imageOffset = { 0, 0, 0 };
-            copy_region.imageExtent = { 
-                static_cast<uint32_t>(texObj.width),
-                static_cast<uint32_t>(texObj.height),
-                1 
-            };
-            bufferImgCopyList.push_back(copy_region);
-        }
+        VkBufferImageCopy copy_region{};
+        copy_region.bufferOffset = staging.offset;
+        copy_region.bufferRowLength = 0;
+        copy_region.bufferImageHeight = 0;
+        copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy_region.imageSubresource.mipLevel = 0;
+        copy_region.imageSubresource.baseArrayLayer = 0;
+        copy_region.imageSubresource.layerCount = 1;
+        copy_region.imageOffset = { 0, 0, 0 };
+        copy_region.imageExtent = {
+            static_cast<uint32_t>(texObj.width),
+            static_cast<uint32_t>(texObj.height),
+            1
+        };
+
         /* Put the copy command into the command buffer */
         vkCmdCopyBufferToImage(
-            copyCmd,
-            stage_buffer,
+            batch.commandBuffer,
+            staging.buffer,
             texObj.image,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            uint32_t(bufferImgCopyList.size()),
-            bufferImgCopyList.data()
+            1,
+            &copy_region
         );
 
         /* Set the layout for the texture image from DESTINATION_OPTIMAL to SHADER_READ_ONLY */
         texObj.image_layout = imageLayout;
 
-        device->flushCommandBuffer(copyCmd, device->getGraphicsQueue(), true);
-
-        vkFreeMemory(device->getDevice(), stage_buffer_memory, NULL);
-        vkDestroyBuffer(device->getDevice(), stage_buffer, NULL);
-
-        generateMipmaps(device, texObj, format);
+        recordMipmaps(batch.commandBuffer, texObj);
 
         texObj.view = device->createImageView(device->getDevice(),
             texObj.image,
@@ -198,51 +208,34 @@ namespace texture {
         height = static_cast<uint32_t>(texCube.extent().y);
         cube_size = texCube.size();
         mip_levels = static_cast<uint32_t>(texCube.levels());
-        auto cube_data = texCube.data();
+        const void* cube_data = texCube.data();
+
+        // Float cubes go to a smaller HDR format, the texels keep their face and level order
+        std::vector<unsigned char> converted;
+        size_t sourceTexelSize = 1;
+        size_t texelSize = 1;
+        if (texCube.format() == gli::FORMAT_RGBA32_SFLOAT_PACK32) {
+            const float* texels = static_cast<const float*>(cube_data);
+            const size_t texelCount = cube_size / (4 * sizeof(float));
+            format = chooseHdrFormat(device, texels, texelCount);
+            sourceTexelSize = 4 * sizeof(float);
+            texelSize = hdrTexelSize(format);
+            converted.resize(texelCount * texelSize);
+            encodeHdr(texels, texelCount, format, converted.data());
+            cube_data = converted.data();
+            cube_size = converted.size();
+            texObj.is_hdr = true;
+        }
 
         texObj.width = width;
         texObj.height = height;
         texObj.mipLevels = mip_levels;
         texObj.device = device;
+        texObj.format = format;
 
         VkFormatProperties formatProps;
         vkGetPhysicalDeviceFormatProperties(device->getPhysicalDevice(), format, &formatProps);
 
-        // Use a separate command buffer for texture loading
-        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->getCommandPool(), true);
-
-        VkBuffer stage_buffer;
-        VkDeviceMemory stage_buffer_memory;
-
-        stage_buffer = buffer::createBuffer(
-            device->getDevice(),
-            cube_size,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-        );
-
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements(device->getDevice(), stage_buffer, &memReqs);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-        if (vkAllocateMemory(device->getDevice(), &allocInfo, nullptr, &stage_buffer_memory) != VK_SUCCESS) {
-            throw std::runtime_error("No mappable, coherent memory!");
-        }
-
-        if (vkBindBufferMemory(device->getDevice(), stage_buffer, stage_buffer_memory, 0) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to bind buffer memory");
-        }
-
-        // copy texture data to staging buffer
-        void* data;
-        memory::map(device->getDevice(), stage_buffer_memory, 0, memReqs.size, &data);
-        memcpy(data, cube_data, cube_size);
-        memory::unmap(device->getDevice(), stage_buffer_memory);
-
         // Image
         texObj.image = device->createImage(
             device->getDevice(),
@@ -259,20 +252,8 @@ namespace texture {
             VK_IMAGE_LAYOUT_UNDEFINED
         );
 
-        vkGetImageMemoryRequirements(device->getDevice(), texObj.image, &memReqs);
-        texObj.buffer_size = memReqs.size;
-
-        // VkMemoryAllocateInfo
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        if (vkAllocateMemory(device->getDevice(), &allocInfo, nullptr, &texObj.image_memory) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to allocate buffer memory!");
-        }
-
-        if (vkBindImageMemory(device->getDevice(), texObj.image, texObj.image_memory, 0) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to bind image memory");
-        }
+        texObj.allocation = memory::allocate(device, texObj.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        texObj.buffer_size = texObj.allocation.size;
 
         std::vector<VkBufferImageCopy> bufferCopyRegions;
         size_t offset = 0;
@@ -293,7 +274,7 @@ namespace texture {
                 copy_region.bufferOffset = offset;
 
                 bufferCopyRegions.push_back(copy_region);
-                offset += texCube[layer][level].size();
+                offset += texCube[layer][level].size() / sourceTexelSize * texelSize;
             }
         }
 
@@ -303,43 +284,10 @@ namespace texture {
         subresourceRange.levelCount = texObj.mipLevels;
         subresourceRange.layerCount = 6;
 
-        /* Since we're going to blit to the texture image, set its layout to DESTINATION_OPTIMAL */
-        texture::setImageLayout(
-            copyCmd,
-            texObj.image,
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            subresourceRange,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            0,
-            VK_ACCESS_TRANSFER_WRITE_BIT);
-
-        /* Put the copy command into the command buffer */
-        vkCmdCopyBufferToImage(
-            copyCmd,
-            stage_buffer,
-            texObj.image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            static_cast<uint32_t>(bufferCopyRegions.size()),
-            bufferCopyRegions.data()
-        );
-
-        /* Set the layout for the texture image from DESTINATION_OPTIMAL to SHADER_READ_ONLY */
+        // Every face and level goes up at once, the view below is usable as soon as the graphics queue gets to it
         texObj.image_layout = imageLayout;
-        setImageLayout(
-            copyCmd,
-            texObj.image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            texObj.image_layout,
-            subresourceRange,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT
-        );
-
-        device->flushCommandBuffer(copyCmd, device->getGraphicsQueue());
+        device->getStagingBelt().copyToImage(cube_data, cube_size, texObj.image, bufferCopyRegions, subresourceRange, texObj.image_layout);
+        device->getStagingBelt().flush();
 
         texObj.view = device->createImageView(device->getDevice(),
             texObj.image,
@@ -365,9 +313,6 @@ namespace texture {
             VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
             VK_FALSE);
 
-        vkFreeMemory(device->getDevice(), stage_buffer_memory, NULL);
-        vkDestroyBuffer(device->getDevice(), stage_buffer, NULL);
-        
         return texObj;
     }
 
@@ -392,7 +337,6 @@ namespace texture {
         uint32_t texWidth,
         uint32_t texHeight,
         Device* device,
-        VkQueue copyQueue,
         VkFilter filter,
         VkImageUsageFlags imageUsageFlags,
         VkImageLayout image_layout)
@@ -403,40 +347,6 @@ namespace texture {
         texObj.width = texWidth;
         texObj.height = texHeight;
 
-        VkMemoryAllocateInfo memAllocInfo{};
-        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        VkMemoryRequirements memReqs;
-
-        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->getCommandPool(), 1);
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingMemory;
-
-        stagingBuffer = buffer::createBuffer(
-            device->getDevice(),
-            bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-        );
-
-        vkGetBufferMemoryRequirements(device->getDevice(), stagingBuffer, &memReqs);
-
-        memAllocInfo.allocationSize = memReqs.size;
-        memAllocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-        if (vkAllocateMemory(device->getDevice(), &memAllocInfo, nullptr, &stagingMemory) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to allocate staging buffer memory!");
-        }
-
-        if (vkBindBufferMemory(device->getDevice(), stagingBuffer, stagingMemory, 0) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to bind staging buffer memory");
-        }
-
-        void* data;
-        memory::map(device->getDevice(), stagingMemory, 0, memReqs.size, &data);
-        memcpy(data, buffer, bufferSize);
-        memory::unmap(device->getDevice(), stagingMemory);
-
         VkBufferImageCopy bufferCopyRegion{};
         bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         bufferCopyRegion.imageSubresource.mipLevel = 0;
@@ -447,21 +357,6 @@ namespace texture {
         bufferCopyRegion.imageExtent.depth = 1;
         bufferCopyRegion.bufferOffset = 0;
 
-        VkBufferImageCopy copy_region;
-        copy_region.bufferOffset = 0;
-        copy_region.bufferRowLength = texObj.width;
-        copy_region.bufferImageHeight = texObj.height;
-        copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copy_region.imageSubresource.mipLevel = 0;
-        copy_region.imageSubresource.baseArrayLayer = 0;
-        copy_region.imageSubresource.layerCount = 1;
-        copy_region.imageOffset.x = 0;
-        copy_region.imageOffset.y = 0;
-        copy_region.imageOffset.z = 0;
-        copy_region.imageExtent.width = texObj.width;
-        copy_region.imageExtent.height = texObj.height;
-        copy_region.imageExtent.depth = 1;
-
         texObj.image = device->createImage(
             device->getDevice(),
             0,
@@ -477,56 +372,12 @@ namespace texture {
             VK_IMAGE_LAYOUT_UNDEFINED
         );
 
-        vkGetImageMemoryRequirements(device->getDevice(), texObj.image, &memReqs);
-
-        memAllocInfo.allocationSize = memReqs.size;
-        memAllocInfo.memoryTypeIndex = device->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        if (vkAllocateMemory(device->getDevice(), &memAllocInfo, nullptr, &texObj.image_memory) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to allocate buffer memory!");
-        }
-
-        if (vkBindImageMemory(device->getDevice(), texObj.image, texObj.image_memory, 0) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to bind image memory");
-        }
-
-        // Image barrier for optimal image (target)
-        // Optimal image will be used as destination for the copy
-        // Create an image barrier object
-        texture::setImageLayout(copyCmd,
-            texObj.image,
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
-            VK_PIPELINE_STAGE_TRANSFER_BIT
-        );
+        texObj.allocation = memory::allocate(device, texObj.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        texObj.buffer_size = texObj.allocation.size;
 
-        // Copy mip levels from staging buffer
-        vkCmdCopyBufferToImage(
-            copyCmd,
-            stagingBuffer,
-            texObj.image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &bufferCopyRegion
-        );
-
-        // Change texture image layout to shader read after all mip levels have been copied
         texObj.image_layout = image_layout;
-        texture::setImageLayout(copyCmd,
-            texObj.image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            texObj.image_layout,
-            { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT
-        );
-
-        device->flushCommandBuffer(copyCmd, copyQueue);
-
-        vkFreeMemory(device->getDevice(), stagingMemory, nullptr);
-        vkDestroyBuffer(device->getDevice(), stagingBuffer, nullptr);
+        device->getStagingBelt().copyToImage(buffer, bufferSize, texObj.image, { bufferCopyRegion }, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }, texObj.image_layout);
+        device->getStagingBelt().flush();
 
         // view
         texObj.view = device->createImageView(device->getDevice(),
@@ -733,7 +584,14 @@ namespace texture {
         }
 
         VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->getCommandPool(), true);
+        recordMipmaps(commandBuffer, texture);
+        device->flushCommandBuffer(commandBuffer, device->getGraphicsQueue(), true);
+    }
 
+    void recordMipmaps(
+        VkCommandBuffer commandBuffer,
+        TextureObject& texture)
+    {
         VkImageMemoryBarrier barrier = {};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
         barrier.image = texture.image;
@@ -794,7 +652,6 @@ namespace texture {
                 0, nullptr,
                 1, &barrier);
         }
-        device->flushCommandBuffer(commandBuffer, device->getGraphicsQueue(), true);
     }
 
     bool loadTextureData(char const* filename,
@@ -899,6 +756,31 @@ namespace texture {
             texObj.num_components = comp;
             texObj.format = VK_FORMAT_R8G8B8A8_UNORM;
         }
+        else if (extension == "hdr")
+        {
+            int width;
+            int height;
+            int comp;
+            int req_comp = 4;
+
+            auto data_buffer = reinterpret_cast<const stbi_uc*>(data.data());
+            auto data_size = static_cast<int>(data.size());
+            auto raw_data = stbi_loadf_from_memory(data_buffer, data_size, &width, &height, &comp, req_comp);
+
+            if (!raw_data) {
+                throw std::runtime_error{ "Failed to load " + filename + ": " + stbi_failure_reason() };
+            }
+
+            auto bytes = reinterpret_cast<const uint8_t*>(raw_data);
+            texObj.data = { bytes, bytes + width * height * req_comp * sizeof(float) };
+            stbi_image_free(raw_data);
+
+            texObj.width = width;
+            texObj.height = height;
+            texObj.num_components = comp;
+            texObj.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            texObj.is_hdr = true;
+        }
         else if (extension == "ktx")
         {
             gli::texture2d tex(gli::load(filename));
@@ -914,6 +796,29 @@ namespace texture {
     }
 }
 
+int TextureObject::bytesPerPixel() const
+{
+    if (is_hdr) {
+        return static_cast<int>(texture::hdrTexelSize(format));
+    }
+    return num_components * sizeof(unsigned char);
+}
+
+void TextureObject::releaseData()
+{
+    std::vector<uint8_t>().swap(data);
+    std::vector<std::vector<VkDeviceSize>>().swap(offsets);
+}
+
+VkDeviceSize TextureObject::hostBytes() const
+{
+    VkDeviceSize bytes = data.capacity();
+    for (const auto& layer : offsets) {
+        bytes += layer.capacity() * sizeof(VkDeviceSize);
+    }
+    return bytes;
+}
+
 void TextureObject::destroy(const VkDevice& device)
 {
     if (sampler != VK_NULL_HANDLE) {
@@ -925,7 +830,5 @@ void TextureObject::destroy(const VkDevice& device)
     if (image != VK_NULL_HANDLE) {
         vkDestroyImage(device, image, nullptr);
     }
-    if (image_memory != VK_NULL_HANDLE) {
-        vkFreeMemory(device, image_memory, nullptr);
-    }
+    memory::free(allocation);
 }
\ No newline at end of file
@@ -10,29 +10,37 @@ class TextureObject
 {
 public:
     Device* device;
-    VkSampler sampler;
-    VkImageView view;
-    VkImage image;
-    VkDeviceMemory image_memory;
+    VkSampler sampler{ VK_NULL_HANDLE };
+    VkImageView view{ VK_NULL_HANDLE };
+    VkImage image{ VK_NULL_HANDLE };
+    memory::Allocation allocation;
     VkImageLayout image_layout;
-    VkDeviceSize buffer_size;
+    // Size of the image memory
+    VkDeviceSize buffer_size{ 0 };
     VkFormat format{ VK_FORMAT_UNDEFINED };
     VkDescriptorImageInfo getDescriptorImageInfo() { return { sampler, view, image_layout }; }
 
     bool is_hdr{false};
+    // sRGB encoded data in a UNORM image, mips are filtered in linear space
+    bool is_srgb{false};
 
     uint32_t width, height;
     uint32_t num_components{4};
     uint32_t layers{ 1 };
     uint32_t mipLevels;
 
+    // CPU copy of the pixels, loaders that upload release it once the staging copy is recorded unless told to retain it
     //offsets[array_layer][mipmap_layer]
     std::vector<std::vector<VkDeviceSize>> offsets;
     std::vector<uint8_t> data;
 
 public:
-    int bytesPerPixel() const { return num_components * (is_hdr ? sizeof(float) : sizeof(unsigned char)); }
+    int bytesPerPixel() const;
     int pitch() const { return width * bytesPerPixel(); }
+    // Frees data and offsets including their capacity
+    void releaseData();
+    VkDeviceSize hostBytes() const;
+    VkDeviceSize deviceBytes() const { return allocation.valid() ? buffer_size : 0; }
     void destroy(const VkDevice& device);
 };
 
@@ -84,7 +92,19 @@ namespace texture {
         int num_requested_components,
         VkFilter filter = VK_FILTER_LINEAR,
         VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
-        VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        bool retainData = false);
+
+    // From file, recorded into a batch the caller submits
+    TextureObject loadTexture(
+        const std::string& filename,
+        VkFormat format,
+        Device* device,
+        UploadBatch& batch,
+        VkFilter filter = VK_FILTER_LINEAR,
+        VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+        VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        bool retainData = false);
 
     // From file - Cube
     TextureObject loadTextureCube(
@@ -94,7 +114,7 @@ namespace texture {
         VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
         VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-    // From buffer
+    // From buffer, through the staging belt of the device. Usable by anything submitted to the graphics queue later
     TextureObject loadTexture(
         void* buffer,
         VkDeviceSize bufferSize, 
@@ -102,7 +122,6 @@ namespace texture {
         uint32_t texWidth,
         uint32_t texHeight,
         Device* device,
-        VkQueue copyQueue, 
         VkFilter filter = VK_FILTER_LINEAR,
         VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, 
         VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -150,5 +169,10 @@ namespace texture {
         TextureObject& texture,
         VkFormat format);
 
+    // Expects level 0 in TRANSFER_DST_OPTIMAL, leaves every level in SHADER_READ_ONLY_OPTIMAL
+    void recordMipmaps(
+        VkCommandBuffer commandBuffer,
+        TextureObject& texture);
+
     TextureObject loadTexture(const std::string& filename);
 }
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "texture_cache.h"
+
+TextureCache& TextureCache::instance()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+static inline uint64_t mixWord(uint64_t lane, uint64_t word)
+{
+    lane ^= word * 0x87c37b91114253d5ull;
+    lane = (lane << 31) | (lane >> 33);
+    return lane * 0x4cf5ad432745937full;
+}
+
+uint64_t TextureCache::hashContent(const void* data, size_t size, uint64_t seed)
+{
+    // Four independent lanes over 64 bit words, images are too large for the bytewise FNV-1a used elsewhere
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t lanes[4] = { seed ^ 0x9e3779b97f4a7c15ull, seed ^ 0xc2b2ae3d27d4eb4full, seed ^ 0x165667b19e3779f9ull, seed ^ 0x27d4eb2f165667c5ull };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        uint64_t words[4];
+        memcpy(words, bytes + i, sizeof(words));
+        for (int lane = 0; lane < 4; ++lane) {
+            lanes[lane] = mixWord(lanes[lane], words[lane]);
+        }
+    }
+    uint64_t hash = size;
+    for (int lane = 0; lane < 4; ++lane) {
+        hash = mixWord(hash, lanes[lane]);
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool TextureCache::acquireImage(const ImageKey& key, TextureObject& texture)
+{
+    if (!key.valid()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_images.find(key);
+    if (it == m_images.end()) {
+        return false;
+    }
+    it->second.references++;
+    texture = it->second.texture;
+    m_stats.imageHits++;
+    m_stats.bytesShared += texture.buffer_size;
+    return true;
+}
+
+void TextureCache::addImage(const ImageKey& key, const TextureObject& texture)
+{
+    if (!key.valid() || texture.image == VK_NULL_HANDLE) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_images.count(key) || m_imageKeys.count(texture.image)) {
+        return;
+    }
+
+    // Later users get the layout every upload path ends in, not the one the texture had while it was recorded
+    ImageEntry entry{ texture, 1 };
+    entry.texture.sampler = VK_NULL_HANDLE;
+    entry.texture.image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    entry.texture.releaseData();
+    m_images.emplace(key, std::move(entry));
+    m_imageKeys.emplace(texture.image, key);
+    m_stats.images++;
+    m_stats.imageBytes += texture.buffer_size;
+}
+
+static bool sameSamplerInfo(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b)
+{
+    return a.flags == b.flags &&
+        a.magFilter == b.magFilter &&
+        a.minFilter == b.minFilter &&
+        a.mipmapMode == b.mipmapMode &&
+        a.addressModeU == b.addressModeU &&
+        a.addressModeV == b.addressModeV &&
+        a.addressModeW == b.addressModeW &&
+        a.mipLodBias == b.mipLodBias &&
+        a.anisotropyEnable == b.anisotropyEnable &&
+        a.maxAnisotropy == b.maxAnisotropy &&
+        a.compareEnable == b.compareEnable &&
+        a.compareOp == b.compareOp &&
+        a.minLod == b.minLod &&
+        a.maxLod == b.maxLod &&
+        a.borderColor == b.borderColor &&
+        a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
+VkSampler TextureCache::acquireSampler(VkDevice device, const VkSamplerCreateInfo& samplerInfo)
+{
+    // Chained structs can't be compared, those samplers are not shared
+    assert(samplerInfo.pNext == nullptr);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (SamplerEntry& entry : m_samplers) {
+        if (sameSamplerInfo(entry.info, samplerInfo)) {
+            entry.references++;
+            m_stats.samplerHits++;
+            return entry.sampler;
+        }
+    }
+    VkSampler sampler;
+    VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &sampler));
+    m_samplers.push_back({ samplerInfo, sampler, 1 });
+    m_stats.samplers++;
+    return sampler;
+}
+
+void TextureCache::release(VkDevice device, TextureObject& texture)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (texture.sampler != VK_NULL_HANDLE) {
+            auto sampler = std::find_if(m_samplers.begin(), m_samplers.end(), [&texture](const SamplerEntry& entry) { return entry.sampler == texture.sampler; });
+            if (sampler != m_samplers.end()) {
+                if (--sampler->references == 0) {
+                    vkDestroySampler(device, sampler->sampler, nullptr);
+                    m_samplers.erase(sampler);
+                    m_stats.samplers--;
+                }
+                texture.sampler = VK_NULL_HANDLE;
+            }
+        }
+        auto key = m_imageKeys.find(texture.image);
+        if (key != m_imageKeys.end()) {
+            auto image = m_images.find(key->second);
+            if (--image->second.references == 0) {
+                m_stats.images--;
+                m_stats.imageBytes -= image->second.texture.buffer_size;
+                image->second.texture.destroy(device);
+                m_images.erase(image);
+                m_imageKeys.erase(key);
+            }
+            texture.view = VK_NULL_HANDLE;
+            texture.image = VK_NULL_HANDLE;
+            texture.allocation = memory::Allocation{};
+        }
+    }
+    // Whatever is left was never cached
+    texture.destroy(device);
+    texture.sampler = VK_NULL_HANDLE;
+    texture.view = VK_NULL_HANDLE;
+    texture.image = VK_NULL_HANDLE;
+    texture.allocation = memory::Allocation{};
+}
+
+uint32_t TextureCache::getReferences(VkImage image)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto key = m_imageKeys.find(image);
+    return key != m_imageKeys.end() ? m_images.at(key->second).references : 0;
+}
+
+TextureCache::Stats TextureCache::getStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
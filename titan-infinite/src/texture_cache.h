@@ -0,0 +1,71 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+
+// Process wide, images are keyed by the content they were built from and samplers by their create info.
+// Both are reference counted and destroyed with their last release, so models loading the same images share one copy.
+class TextureCache {
+
+public:
+    struct ImageKey {
+        uint64_t contentHash{ 0 };
+        uint64_t contentSize{ 0 };
+        // Format and build options the content went through on its way to the image
+        uint64_t variant{ 0 };
+
+        bool valid() const { return contentSize != 0; }
+        bool operator==(const ImageKey& other) const { return contentHash == other.contentHash && contentSize == other.contentSize && variant == other.variant; }
+    };
+
+    struct Stats {
+        uint32_t images{ 0 };
+        uint32_t samplers{ 0 };
+        uint32_t imageHits{ 0 };
+        uint32_t samplerHits{ 0 };
+        VkDeviceSize imageBytes{ 0 };
+        // Device memory the hits would have allocated again
+        VkDeviceSize bytesShared{ 0 };
+    };
+
+    static TextureCache& instance();
+    static uint64_t hashContent(const void* data, size_t size, uint64_t seed = 0);
+
+    // Copies image, memory and view of a cached image into texture and takes a reference, the sampler is left alone
+    bool acquireImage(const ImageKey& key, TextureObject& texture);
+    // Only images whose upload has been recorded belong here, texture keeps its handles and holds the first reference.
+    // Does nothing when the key is already taken, texture then stays uncached
+    void addImage(const ImageKey& key, const TextureObject& texture);
+    VkSampler acquireSampler(VkDevice device, const VkSamplerCreateInfo& samplerInfo);
+
+    // Drops the references texture holds, handles that are not cached are destroyed right away
+    void release(VkDevice device, TextureObject& texture);
+
+    // Holders of a cached image, 0 for images the cache doesn't know
+    uint32_t getReferences(VkImage image);
+    Stats getStats();
+
+private:
+    struct ImageKeyHash {
+        size_t operator()(const ImageKey& key) const { return static_cast<size_t>(key.contentHash ^ (key.variant * 0x9e3779b97f4a7c15ull)); }
+    };
+    struct ImageEntry {
+        TextureObject texture;
+        uint32_t references;
+    };
+    struct SamplerEntry {
+        VkSamplerCreateInfo info;
+        VkSampler sampler;
+        uint32_t references;
+    };
+
+    // Loaders decode on worker threads and look images up from there
+    std::mutex m_mutex;
+    std::unordered_map<ImageKey, ImageEntry, ImageKeyHash> m_images;
+    std::unordered_map<VkImage, ImageKey> m_imageKeys;
+    std::vector<SamplerEntry> m_samplers;
+    Stats m_stats;
+};
@@ -0,0 +1,343 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "texture_compression.h"
+#include <filesystem>
+#include <gli.hpp>
+
+namespace texture {
+
+    static void fromGli(const gli::texture2d& tex, MipChain& image)
+    {
+        // gli formats share their values with VkFormat
+        image.format = static_cast<VkFormat>(tex.format());
+        image.width = static_cast<uint32_t>(tex.extent().x);
+        image.height = static_cast<uint32_t>(tex.extent().y);
+        image.levelOffsets.clear();
+        image.levelExtents.clear();
+        image.data.resize(tex.size());
+
+        VkDeviceSize offset = 0;
+        for (size_t level = 0; level < tex.levels(); ++level) {
+            image.levelOffsets.push_back(offset);
+            image.levelExtents.push_back({ static_cast<uint32_t>(tex[level].extent().x), static_cast<uint32_t>(tex[level].extent().y) });
+            memcpy(image.data.data() + offset, tex[level].data(), tex[level].size());
+            offset += tex[level].size();
+        }
+    }
+
+    bool isCompressedContainer(const unsigned char* bytes, size_t size)
+    {
+        static const unsigned char ktxMagic[] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB };
+        if (size >= 4 && memcmp(bytes, "DDS ", 4) == 0) {
+            return true;
+        }
+        return size >= sizeof(ktxMagic) && memcmp(bytes, ktxMagic, sizeof(ktxMagic)) == 0;
+    }
+
+    bool loadCompressedImage(const unsigned char* bytes, size_t size, MipChain& image)
+    {
+        if (!isCompressedContainer(bytes, size)) {
+            return false;
+        }
+        gli::texture2d tex(gli::load(reinterpret_cast<const char*>(bytes), size));
+        if (tex.empty()) {
+            return false;
+        }
+        fromGli(tex, image);
+        return true;
+    }
+
+    bool loadCompressedImage(const std::string& filename, MipChain& image)
+    {
+        gli::texture2d tex(gli::load(filename));
+        if (tex.empty()) {
+            return false;
+        }
+        fromGli(tex, image);
+        return true;
+    }
+
+    void saveCompressedImage(const std::string& filename, const MipChain& image)
+    {
+        gli::texture2d tex(static_cast<gli::format>(image.format), gli::extent2d(image.width, image.height), image.mipLevels());
+        for (uint32_t level = 0; level < image.mipLevels(); ++level) {
+            memcpy(tex[level].data(), image.data.data() + image.levelOffsets[level], tex[level].size());
+        }
+        // Written next to the target and renamed over it, so a reader never sees a partial file
+        const std::string temporaryPath = filename + ".tmp";
+        std::error_code error;
+        if (!gli::save_dds(tex, temporaryPath)) {
+            std::filesystem::remove(temporaryPath, error);
+            throw std::runtime_error("failed to write compressed texture \"" + temporaryPath + "\"!");
+        }
+        std::filesystem::rename(temporaryPath, filename, error);
+        if (error) {
+            std::filesystem::remove(temporaryPath, error);
+            throw std::runtime_error("failed to replace compressed texture \"" + filename + "\"!");
+        }
+    }
+
+    static uint16_t toRGB565(const float color[3])
+    {
+        uint32_t r = static_cast<uint32_t>(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+        uint32_t g = static_cast<uint32_t>(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+        uint32_t b = static_cast<uint32_t>(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    static void fromRGB565(uint16_t color, int rgb[3])
+    {
+        rgb[0] = ((color >> 11) & 31) * 255 / 31;
+        rgb[1] = ((color >> 5) & 63) * 255 / 63;
+        rgb[2] = (color & 31) * 255 / 31;
+    }
+
+    // Endpoints are the extremes along the bounding box diagonal, pulled in slightly to reduce error
+    static void encodeColorBlock(const unsigned char block[64], unsigned char* out)
+    {
+        float minColor[3] = { 255.0f, 255.0f, 255.0f };
+        float maxColor[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                minColor[c] = std::min(minColor[c], float(block[i * 4 + c]));
+                maxColor[c] = std::max(maxColor[c], float(block[i * 4 + c]));
+            }
+        }
+        float axis[3] = { maxColor[0] - minColor[0], maxColor[1] - minColor[1], maxColor[2] - minColor[2] };
+        float minProjection = FLT_MAX, maxProjection = -FLT_MAX;
+        int minIndex = 0, maxIndex = 0;
+        for (int i = 0; i < 16; ++i) {
+            float projection = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+            if (projection < minProjection) {
+                minProjection = projection;
+                minIndex = i;
+            }
+            if (projection > maxProjection) {
+                maxProjection = projection;
+                maxIndex = i;
+            }
+        }
+        float endpoint0[3], endpoint1[3];
+        for (int c = 0; c < 3; ++c) {
+            float low = block[minIndex * 4 + c];
+            float high = block[maxIndex * 4 + c];
+            float inset = (high - low) / 16.0f;
+            endpoint0[c] = high - inset;
+            endpoint1[c] = low + inset;
+        }
+
+        uint16_t color0 = toRGB565(endpoint0);
+        uint16_t color1 = toRGB565(endpoint1);
+        // color0 > color1 selects the four color mode
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            fromRGB565(color0, palette[0]);
+            fromRGB565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; ++i) {
+                int best = 0, bestDistance = INT_MAX;
+                for (int p = 0; p < 4; ++p) {
+                    int distance = 0;
+                    for (int c = 0; c < 3; ++c) {
+                        int d = int(block[i * 4 + c]) - palette[p][c];
+                        distance += d * d;
+                    }
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= uint32_t(best) << (i * 2);
+            }
+        }
+
+        out[0] = color0 & 0xff;
+        out[1] = color0 >> 8;
+        out[2] = color1 & 0xff;
+        out[3] = color1 >> 8;
+        memcpy(out + 4, &indices, 4);
+    }
+
+    static void encodeAlphaBlock(const unsigned char block[64], unsigned char* out)
+    {
+        int alpha0 = 0, alpha1 = 255;
+        for (int i = 0; i < 16; ++i) {
+            alpha0 = std::max(alpha0, int(block[i * 4 + 3]));
+            alpha1 = std::min(alpha1, int(block[i * 4 + 3]));
+        }
+
+        uint64_t indices = 0;
+        if (alpha0 != alpha1) {
+            // alpha0 > alpha1 selects eight interpolated values
+            int palette[8] = { alpha0, alpha1 };
+            for (int p = 1; p < 7; ++p) {
+                palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+            }
+            for (int i = 0; i < 16; ++i) {
+                int best = 0, bestDistance = INT_MAX;
+                for (int p = 0; p < 8; ++p) {
+                    int distance = std::abs(int(block[i * 4 + 3]) - palette[p]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= uint64_t(best) << (i * 3);
+            }
+        }
+
+        out[0] = static_cast<unsigned char>(alpha0);
+        out[1] = static_cast<unsigned char>(alpha1);
+        for (int i = 0; i < 6; ++i) {
+            out[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+        }
+    }
+
+    void compressMipChain(const MipChain& source, MipChain& image)
+    {
+        bool translucent = false;
+        const size_t texelCount = size_t(source.width) * source.height;
+        for (size_t i = 0; i < texelCount && !translucent; ++i) {
+            translucent = source.data[i * 4 + 3] != 255;
+        }
+        const uint32_t blockSize = translucent ? 16 : 8;
+
+        image.format = translucent ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        image.width = source.width;
+        image.height = source.height;
+        image.levelOffsets.clear();
+        image.levelExtents = source.levelExtents;
+        image.data.clear();
+
+        for (uint32_t level = 0; level < source.mipLevels(); ++level) {
+            const unsigned char* pixels = source.data.data() + source.levelOffsets[level];
+            const uint32_t levelWidth = source.levelExtents[level].width;
+            const uint32_t levelHeight = source.levelExtents[level].height;
+            image.levelOffsets.push_back(image.data.size());
+
+            const uint32_t blocksX = (levelWidth + 3) / 4;
+            const uint32_t blocksY = (levelHeight + 3) / 4;
+            size_t offset = image.data.size();
+            image.data.resize(offset + size_t(blocksX) * blocksY * blockSize);
+            for (uint32_t by = 0; by < blocksY; ++by) {
+                for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                    // Partial blocks at the edges repeat the last row and column
+                    unsigned char block[64];
+                    for (uint32_t y = 0; y < 4; ++y) {
+                        for (uint32_t x = 0; x < 4; ++x) {
+                            uint32_t px = std::min(bx * 4 + x, levelWidth - 1);
+                            uint32_t py = std::min(by * 4 + y, levelHeight - 1);
+                            memcpy(&block[(y * 4 + x) * 4], &pixels[(size_t(py) * levelWidth + px) * 4], 4);
+                        }
+                    }
+                    unsigned char* out = &image.data[offset];
+                    if (translucent) {
+                        encodeAlphaBlock(block, out);
+                        out += 8;
+                    }
+                    encodeColorBlock(block, out);
+                    offset += blockSize;
+                }
+            }
+        }
+    }
+
+    bool isFormatSupported(Device* device, VkFormat format)
+    {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(device->getPhysicalDevice(), format, &formatProperties);
+        return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+    }
+
+    TextureObject recordMipChainUpload(Device* device, const MipChain& image, UploadBatch& batch, uint32_t firstLevel)
+    {
+        TextureObject texObj;
+        texObj.device = device;
+        texObj.format = image.format;
+        texObj.width = image.levelExtents[firstLevel].width;
+        texObj.height = image.levelExtents[firstLevel].height;
+        texObj.mipLevels = image.mipLevels() - firstLevel;
+
+        // Block sizes are 8 or 16 bytes, copies have to start on a block boundary
+        const VkDeviceSize firstOffset = image.levelOffsets[firstLevel];
+        UploadBatch::Allocation staging = batch.stage(image.data.data() + firstOffset, image.data.size() - firstOffset, 16);
+
+        texObj.image = device->createImage(
+            device->getDevice(),
+            0,
+            VK_IMAGE_TYPE_2D,
+            image.format,
+            { texObj.width, texObj.height, 1 },
+            texObj.mipLevels,
+            1,
+            VK_SAMPLE_COUNT_1_BIT,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+        );
+
+        texObj.allocation = memory::allocate(device, texObj.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        texObj.buffer_size = texObj.allocation.size;
+
+        VkImageSubresourceRange subresourceRange{};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.levelCount = texObj.mipLevels;
+        subresourceRange.layerCount = 1;
+
+        texture::setImageLayout(
+            batch.commandBuffer,
+            texObj.image,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            subresourceRange,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            VK_ACCESS_TRANSFER_WRITE_BIT);
+
+        std::vector<VkBufferImageCopy> regions;
+        for (uint32_t level = 0; level < texObj.mipLevels; ++level) {
+            VkBufferImageCopy region{};
+            region.bufferOffset = staging.offset + image.levelOffsets[firstLevel + level] - firstOffset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = { image.levelExtents[firstLevel + level].width, image.levelExtents[firstLevel + level].height, 1 };
+            regions.push_back(region);
+        }
+        vkCmdCopyBufferToImage(batch.commandBuffer, staging.buffer, texObj.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+        texture::setImageLayout(
+            batch.commandBuffer,
+            texObj.image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            subresourceRange,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT);
+        texObj.image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        texObj.view = device->createImageView(device->getDevice(),
+            texObj.image,
+            VK_IMAGE_VIEW_TYPE_2D,
+            image.format,
+            { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
+            { VK_IMAGE_ASPECT_COLOR_BIT, 0, texObj.mipLevels, 0, 1 });
+
+        return texObj;
+    }
+}
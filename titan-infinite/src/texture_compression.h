@@ -0,0 +1,24 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+
+namespace texture {
+
+    // DDS and KTX containers, these are uploaded as they are
+    bool isCompressedContainer(const unsigned char* bytes, size_t size);
+    bool loadCompressedImage(const unsigned char* bytes, size_t size, MipChain& image);
+    bool loadCompressedImage(const std::string& filename, MipChain& image);
+    void saveCompressedImage(const std::string& filename, const MipChain& image);
+
+    // Encodes every level of an RGBA8 chain as BC1, or BC3 if any texel is translucent
+    void compressMipChain(const MipChain& source, MipChain& image);
+
+    bool isFormatSupported(Device* device, VkFormat format);
+
+    // Image, copies for every level from firstLevel on and the view, the sampler is left to the caller
+    TextureObject recordMipChainUpload(Device* device, const MipChain& image, UploadBatch& batch, uint32_t firstLevel = 0);
+}
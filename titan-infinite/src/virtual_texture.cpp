@@ -0,0 +1,508 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#include "pch.h"
+#include "virtual_texture.h"
+
+static bool isPowerOfTwo(uint32_t value)
+{
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+static uint32_t wrap(int64_t value, uint32_t size)
+{
+	return static_cast<uint32_t>(((value % size) + size) % size);
+}
+
+void VirtualTexture::buildPageFile(const std::string& imageFilename, const std::string& pageFilename, bool srgb, uint32_t pageSize, uint32_t border)
+{
+	std::vector<unsigned char> pixels;
+	int width = 0, height = 0;
+	if (!texture::loadTextureData(imageFilename.c_str(), 4, pixels, &width, &height)) {
+		throw std::runtime_error("failed to load virtual texture source " + imageFilename);
+	}
+	if (!isPowerOfTwo(width) || !isPowerOfTwo(height) || !isPowerOfTwo(pageSize) ||
+		static_cast<uint32_t>(std::min(width, height)) < pageSize || border >= pageSize) {
+		throw std::runtime_error("virtual texture sides have to be powers of two of at least one page: " + imageFilename);
+	}
+
+	texture::MipBuildOptions options;
+	options.srgb = srgb;
+	MipChain chain;
+	texture::buildMipChain(pixels.data(), width, height, options, chain);
+	pixels.clear();
+
+	FileHeader header{};
+	header.magic = fileMagic;
+	header.version = fileVersion;
+	header.width = width;
+	header.height = height;
+	header.pageSize = pageSize;
+	header.border = border;
+	header.mipLevels = std::min(static_cast<uint32_t>(std::log2(std::min(width, height) / pageSize)) + 1, maxMipLevels);
+	header.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+
+	uint32_t pageCount = 0;
+	for (uint32_t level = 0; level < header.mipLevels; level++) {
+		pageCount += (header.width / pageSize >> level) * (header.height / pageSize >> level);
+	}
+	const uint32_t padded = pageSize + 2 * border;
+	const size_t pageBytes = size_t(padded) * padded * 4;
+	std::vector<uint64_t> offsets(pageCount);
+	for (uint32_t page = 0; page < pageCount; page++) {
+		offsets[page] = sizeof(FileHeader) + sizeof(uint64_t) * pageCount + pageBytes * page;
+	}
+
+	std::ofstream file(pageFilename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("failed to create page file " + pageFilename);
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(offsets.data()), sizeof(uint64_t) * offsets.size());
+
+	// Borders repeat the opposite edge, virtual_texture.glsl wraps its coordinates
+	std::vector<unsigned char> page(pageBytes);
+	for (uint32_t level = 0; level < header.mipLevels; level++) {
+		const VkExtent2D extent = chain.levelExtents[level];
+		const unsigned char* source = chain.data.data() + chain.levelOffsets[level];
+		for (uint32_t y = 0; y < extent.height / pageSize; y++) {
+			for (uint32_t x = 0; x < extent.width / pageSize; x++) {
+				for (uint32_t py = 0; py < padded; py++) {
+					const uint32_t sy = wrap(int64_t(y) * pageSize + py - border, extent.height);
+					for (uint32_t px = 0; px < padded; px++) {
+						const uint32_t sx = wrap(int64_t(x) * pageSize + px - border, extent.width);
+						memcpy(&page[(size_t(py) * padded + px) * 4], source + (size_t(sy) * extent.width + sx) * 4, 4);
+					}
+				}
+				file.write(reinterpret_cast<const char*>(page.data()), page.size());
+			}
+		}
+	}
+	if (!file) {
+		throw std::runtime_error("failed to write page file " + pageFilename);
+	}
+}
+
+void VirtualTexture::create(Device* device, const std::string& pageFilename, const Settings& settings)
+{
+	m_device = device;
+	m_settings = settings;
+	if (!m_device->supportsFragmentStores()) {
+		throw std::runtime_error("virtual textures need fragmentStoresAndAtomics for their feedback");
+	}
+
+	m_file.open(pageFilename);
+	if (m_file.size() < sizeof(FileHeader)) {
+		throw std::runtime_error("invalid page file " + pageFilename);
+	}
+	memcpy(&m_header, m_file.data(), sizeof(FileHeader));
+	if (m_header.magic != fileMagic || m_header.version != fileVersion || m_header.mipLevels == 0 || m_header.mipLevels > maxMipLevels ||
+		(m_header.format != VK_FORMAT_R8G8B8A8_UNORM && m_header.format != VK_FORMAT_R8G8B8A8_SRGB)) {
+		throw std::runtime_error("unsupported page file " + pageFilename);
+	}
+
+	m_pagesX = m_header.width / m_header.pageSize;
+	m_pagesY = m_header.height / m_header.pageSize;
+	m_levelOffsets.resize(m_header.mipLevels);
+	m_pageCount = 0;
+	for (uint32_t level = 0; level < m_header.mipLevels; level++) {
+		m_levelOffsets[level] = m_pageCount;
+		m_pageCount += pagesX(level) * pagesY(level);
+	}
+	if (m_file.size() < sizeof(FileHeader) + sizeof(uint64_t) * m_pageCount) {
+		throw std::runtime_error("truncated page file " + pageFilename);
+	}
+	m_pageOffsets = reinterpret_cast<const uint64_t*>(m_file.data() + sizeof(FileHeader));
+
+	// Slot coordinates are stored in 8 bits of the page table
+	const uint32_t lastLevel = m_header.mipLevels - 1;
+	const uint32_t cacheSize = m_settings.cachePages * (m_header.pageSize + 2 * m_header.border);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_device->getPhysicalDevice(), &properties);
+	if (m_settings.cachePages > 256 || cacheSize > properties.limits.maxImageDimension2D ||
+		m_settings.cachePages * m_settings.cachePages <= pagesX(lastLevel) * pagesY(lastLevel)) {
+		throw std::runtime_error("virtual texture cache doesn't fit the device or the last level of " + pageFilename);
+	}
+
+	cache = createImage(m_header.format, cacheSize, cacheSize, 1, VK_FILTER_LINEAR);
+	pageTable = createImage(VK_FORMAT_R8G8B8A8_UINT, m_pagesX, m_pagesY, m_header.mipLevels, VK_FILTER_NEAREST);
+
+	m_slots.assign(m_settings.cachePages * m_settings.cachePages, Slot{});
+	m_pageSlots.assign(m_pageCount, UINT32_MAX);
+	m_loading.assign(m_pageCount, false);
+	m_tableTexels.assign(m_pageCount, 0);
+
+	Params params{};
+	params.virtualSize = glm::vec4(m_header.width, m_header.height, m_header.pageSize, lastLevel);
+	params.cacheLayout = glm::vec4(1.0f / cacheSize, 1.0f / cacheSize, m_header.pageSize + 2 * m_header.border, m_header.border);
+	params.pages = glm::uvec4(m_pagesX, m_pagesY, 0, 0);
+	for (uint32_t level = 0; level < m_header.mipLevels; level++) {
+		params.levelOffsets[level].x = m_levelOffsets[level];
+	}
+	for (uint32_t frame = 0; frame < m_device->renderAhead; frame++) {
+		m_feedback.push_back(buffer::createBuffer(m_device, sizeof(uint32_t) * m_pageCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+		VK_CHECK(m_feedback.back().map());
+		memset(m_feedback.back().mapped, 0, sizeof(uint32_t) * m_pageCount);
+
+		m_params.push_back(buffer::createBuffer(m_device, sizeof(Params),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+		VK_CHECK(m_params.back().map());
+		memcpy(m_params.back().mapped, &params, sizeof(Params));
+	}
+
+	// The last level never leaves the cache, every lookup falls back to it
+	UploadBatch batch;
+	batch.begin(m_device, pageBytes() * pagesX(lastLevel) * pagesY(lastLevel) + sizeof(uint32_t) * m_pageCount);
+	beginCopies(batch.commandBuffer);
+	for (uint32_t page = m_levelOffsets[lastLevel]; page < m_pageCount; page++) {
+		const uint32_t slot = allocateSlot();
+		recordPage(batch, page, slot, readPage(page));
+		m_slots[slot].pinned = true;
+	}
+	recordPageTable(batch);
+	endCopies(batch.commandBuffer);
+	batch.submit(m_device->getGraphicsQueue());
+	batch.wait();
+	batch.destroy();
+}
+
+void VirtualTexture::destroy()
+{
+	for (PendingLoad& load : m_loads) {
+		load.pixels.wait();
+	}
+	m_loads.clear();
+	for (UploadBatch& batch : m_uploads) {
+		batch.wait();
+		batch.destroy();
+	}
+	m_uploads.clear();
+	for (Buffer& buffer : m_feedback) {
+		buffer.destroy();
+	}
+	m_feedback.clear();
+	for (Buffer& buffer : m_params) {
+		buffer.destroy();
+	}
+	m_params.clear();
+	for (TextureObject* texture : { &cache, &pageTable }) {
+		texture->destroy(m_device->getDevice());
+		*texture = TextureObject{};
+	}
+	m_file.close();
+	m_pageOffsets = nullptr;
+	m_slots.clear();
+	m_pageSlots.clear();
+	m_loading.clear();
+	m_tableTexels.clear();
+	m_stats = Stats{};
+}
+
+void VirtualTexture::update(uint32_t frameIndex)
+{
+	m_frame++;
+
+	for (auto it = m_uploads.begin(); it != m_uploads.end();) {
+		if (it->isComplete()) {
+			it->destroy();
+			it = m_uploads.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	// Written by the last frame that used this index, its fence has been waited for
+	uint32_t* feedback = static_cast<uint32_t*>(m_feedback[frameIndex].mapped);
+	std::vector<uint32_t> missing;
+	m_stats.requestedPages = 0;
+	for (uint32_t page = 0; page < m_pageCount; page++) {
+		if (feedback[page] == 0) {
+			continue;
+		}
+		m_stats.requestedPages++;
+		// Up to the level the lookup fell back to, that one is in use and every level below it is wanted
+		uint32_t resident = page;
+		while (m_pageSlots[resident] == UINT32_MAX) {
+			missing.push_back(resident);
+			resident = parentPage(resident);
+		}
+		m_slots[m_pageSlots[resident]].lastUsed = m_frame;
+	}
+	memset(feedback, 0, sizeof(uint32_t) * m_pageCount);
+
+	// Coarse pages first, they cover the most screen and are what finer ones fall back to
+	std::sort(missing.begin(), missing.end(), [this](uint32_t a, uint32_t b) {
+		const uint32_t levelA = pageLevel(a);
+		const uint32_t levelB = pageLevel(b);
+		return levelA != levelB ? levelA > levelB : a < b;
+	});
+	missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+	for (uint32_t page : missing) {
+		if (m_loads.size() >= m_settings.maxLoadsInFlight) {
+			break;
+		}
+		if (!m_loading[page]) {
+			m_loading[page] = true;
+			m_loads.push_back({ page, std::async(std::launch::async, [this, page]() { return readPage(page); }) });
+		}
+	}
+
+	UploadBatch batch;
+	uint32_t uploads = 0;
+	for (auto it = m_loads.begin(); it != m_loads.end() && uploads < m_settings.maxUploadsPerFrame;) {
+		if (it->pixels.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++it;
+			continue;
+		}
+		const uint32_t page = it->page;
+		const std::vector<unsigned char> pixels = it->pixels.get();
+		m_loading[page] = false;
+		it = m_loads.erase(it);
+
+		const uint32_t slot = allocateSlot();
+		if (slot == UINT32_MAX) {
+			// Every slot was used by the last frame, the page is requested again as long as it is wanted
+			continue;
+		}
+		if (batch.commandBuffer == VK_NULL_HANDLE) {
+			batch.begin(m_device, pageBytes() * m_settings.maxUploadsPerFrame + sizeof(uint32_t) * m_pageCount);
+			beginCopies(batch.commandBuffer);
+		}
+		recordPage(batch, page, slot, pixels);
+		uploads++;
+	}
+	if (batch.commandBuffer != VK_NULL_HANDLE) {
+		recordPageTable(batch);
+		endCopies(batch.commandBuffer);
+		batch.submit(m_device->getGraphicsQueue());
+		m_uploads.push_back(std::move(batch));
+	}
+
+	// Rotates the fragments that report their pages
+	static_cast<Params*>(m_params[frameIndex].mapped)->pages.z = m_frame;
+
+	m_stats.cacheSlots = static_cast<uint32_t>(m_slots.size());
+	m_stats.residentPages = static_cast<uint32_t>(std::count_if(m_slots.begin(), m_slots.end(), [](const Slot& slot) { return slot.page != UINT32_MAX; }));
+	m_stats.loadsInFlight = static_cast<uint32_t>(m_loads.size());
+}
+
+std::vector<DescriptorSetLayoutBinding> VirtualTexture::getLayoutBindings(uint32_t firstBinding, VkShaderStageFlags stages) const
+{
+	return {
+		{ firstBinding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, stages, nullptr },
+		{ firstBinding + 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, stages, nullptr },
+		{ firstBinding + 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, nullptr },
+		{ firstBinding + 3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, stages, nullptr },
+	};
+}
+
+void VirtualTexture::writeDescriptorSet(VkDescriptorSet set, uint32_t firstBinding, uint32_t frameIndex)
+{
+	const VkDescriptorImageInfo imageInfos[] = { cache.getDescriptorImageInfo(), pageTable.getDescriptorImageInfo() };
+	const VkDescriptorBufferInfo bufferInfos[] = { m_feedback[frameIndex].descriptor, m_params[frameIndex].descriptor };
+	const VkDescriptorType bufferTypes[] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER };
+
+	std::vector<VkWriteDescriptorSet> writes(4, { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET });
+	for (uint32_t i = 0; i < 4; i++) {
+		writes[i].dstSet = set;
+		writes[i].dstBinding = firstBinding + i;
+		writes[i].descriptorCount = 1;
+		if (i < 2) {
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[i].pImageInfo = &imageInfos[i];
+		}
+		else {
+			writes[i].descriptorType = bufferTypes[i - 2];
+			writes[i].pBufferInfo = &bufferInfos[i - 2];
+		}
+	}
+	vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+uint32_t VirtualTexture::pageLevel(uint32_t page) const
+{
+	uint32_t level = m_header.mipLevels - 1;
+	while (page < m_levelOffsets[level]) {
+		level--;
+	}
+	return level;
+}
+
+uint32_t VirtualTexture::parentPage(uint32_t page) const
+{
+	const uint32_t level = pageLevel(page);
+	assert(level + 1 < m_header.mipLevels);
+	const uint32_t local = page - m_levelOffsets[level];
+	return pageIndex(level + 1, local % pagesX(level) / 2, local / pagesX(level) / 2);
+}
+
+VkDeviceSize VirtualTexture::pageBytes() const
+{
+	const VkDeviceSize padded = m_header.pageSize + 2 * m_header.border;
+	return padded * padded * 4;
+}
+
+TextureObject VirtualTexture::createImage(VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkFilter filter)
+{
+	VkDevice device = m_device->getDevice();
+
+	TextureObject texture{};
+	texture.device = m_device;
+	texture.width = width;
+	texture.height = height;
+	texture.mipLevels = mipLevels;
+	texture.format = format;
+	texture.is_srgb = format == VK_FORMAT_R8G8B8A8_SRGB;
+	texture.image_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	texture.image = m_device->createImage(device,
+		0,
+		VK_IMAGE_TYPE_2D,
+		format,
+		{ width, height, 1 },
+		mipLevels,
+		1,
+		VK_SAMPLE_COUNT_1_BIT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		VK_SHARING_MODE_EXCLUSIVE,
+		VK_IMAGE_LAYOUT_UNDEFINED);
+
+	texture.allocation = memory::allocate(m_device, texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	texture.buffer_size = texture.allocation.size;
+
+	texture.view = m_device->createImageView(device, texture.image, VK_IMAGE_VIEW_TYPE_2D, format,
+		{ VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
+		{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 });
+
+	texture.sampler = texture::createSampler(device,
+		filter,
+		filter,
+		VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		0.0f,
+		VK_FALSE,
+		1.0f,
+		VK_FALSE,
+		VK_COMPARE_OP_NEVER,
+		0.0f,
+		static_cast<float>(mipLevels),
+		VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+		VK_FALSE);
+	return texture;
+}
+
+std::vector<unsigned char> VirtualTexture::readPage(uint32_t page) const
+{
+	// Runs on loader threads, the mapping is read only and outlives every load
+	const uint64_t offset = m_pageOffsets[page];
+	const VkDeviceSize size = pageBytes();
+	if (offset + size > m_file.size()) {
+		throw std::runtime_error("page outside of the page file");
+	}
+	return std::vector<unsigned char>(m_file.data() + offset, m_file.data() + offset + size);
+}
+
+uint32_t VirtualTexture::allocateSlot()
+{
+	// A free slot, otherwise the least recently used one the last frame didn't need
+	uint32_t victim = UINT32_MAX;
+	for (uint32_t i = 0; i < m_slots.size(); i++) {
+		const Slot& slot = m_slots[i];
+		if (slot.page == UINT32_MAX) {
+			return i;
+		}
+		if (!slot.pinned && slot.lastUsed < m_frame && (victim == UINT32_MAX || slot.lastUsed < m_slots[victim].lastUsed)) {
+			victim = i;
+		}
+	}
+	if (victim != UINT32_MAX) {
+		m_pageSlots[m_slots[victim].page] = UINT32_MAX;
+		m_slots[victim] = Slot{};
+		m_stats.pagesEvicted++;
+	}
+	return victim;
+}
+
+void VirtualTexture::beginCopies(VkCommandBuffer commandBuffer)
+{
+	// Also orders the copies after the fragment shaders of frames submitted earlier that still sample old slots
+	const VkImageMemoryBarrier barriers[] = {
+		ImageMemoryBarrier(cache, 0, VK_ACCESS_TRANSFER_WRITE_BIT, cache.image_layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL),
+		ImageMemoryBarrier(pageTable, 0, VK_ACCESS_TRANSFER_WRITE_BIT, pageTable.image_layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+	};
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		2, barriers);
+}
+
+void VirtualTexture::endCopies(VkCommandBuffer commandBuffer)
+{
+	const VkImageMemoryBarrier barriers[] = {
+		ImageMemoryBarrier(cache, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		ImageMemoryBarrier(pageTable, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	};
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		2, barriers);
+}
+
+void VirtualTexture::recordPage(UploadBatch& batch, uint32_t page, uint32_t slot, const std::vector<unsigned char>& pixels)
+{
+	const uint32_t padded = m_header.pageSize + 2 * m_header.border;
+	UploadBatch::Allocation staging = batch.stage(pixels.data(), pixels.size());
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = staging.offset;
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageOffset = { static_cast<int32_t>(slot % m_settings.cachePages * padded), static_cast<int32_t>(slot / m_settings.cachePages * padded), 0 };
+	region.imageExtent = { padded, padded, 1 };
+	vkCmdCopyBufferToImage(batch.commandBuffer, staging.buffer, cache.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	m_slots[slot].page = page;
+	m_slots[slot].lastUsed = m_frame;
+	m_pageSlots[page] = slot;
+	m_stats.pagesLoaded++;
+	m_stats.bytesUploaded += pixels.size();
+}
+
+void VirtualTexture::recordPageTable(UploadBatch& batch)
+{
+	// Coarse to fine, pages that aren't resident take the texel of their parent
+	for (uint32_t level = m_header.mipLevels; level-- > 0;) {
+		for (uint32_t y = 0; y < pagesY(level); y++) {
+			for (uint32_t x = 0; x < pagesX(level); x++) {
+				const uint32_t page = pageIndex(level, x, y);
+				const uint32_t slot = m_pageSlots[page];
+				if (slot != UINT32_MAX) {
+					m_tableTexels[page] = (slot % m_settings.cachePages) | (slot / m_settings.cachePages) << 8 | level << 16 | 0xffu << 24;
+				}
+				else {
+					m_tableTexels[page] = level + 1 < m_header.mipLevels ? m_tableTexels[pageIndex(level + 1, x / 2, y / 2)] : 0;
+				}
+			}
+		}
+	}
+
+	UploadBatch::Allocation staging = batch.stage(m_tableTexels.data(), sizeof(uint32_t) * m_tableTexels.size());
+	std::vector<VkBufferImageCopy> regions(m_header.mipLevels);
+	for (uint32_t level = 0; level < m_header.mipLevels; level++) {
+		regions[level].bufferOffset = staging.offset + sizeof(uint32_t) * m_levelOffsets[level];
+		regions[level].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+		regions[level].imageExtent = { pagesX(level), pagesY(level), 1 };
+	}
+	vkCmdCopyBufferToImage(batch.commandBuffer, staging.buffer, pageTable.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+}
@@ -0,0 +1,129 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+// Virtual texture kept in a software page table, no sparse binding involved. Pages of a page file are loaded
+// on worker threads and copied into slots of a physical cache texture. The page table texture has one texel per
+// page of every level and points at the slot holding it, or at the closest coarser level that is resident.
+// virtual_texture.glsl samples through the table and records the pages it wanted in a feedback buffer, update()
+// reads that buffer back once the frame has completed. Needs fragmentStoresAndAtomics.
+class VirtualTexture {
+
+public:
+	static const uint32_t maxMipLevels = 16;
+
+	// Page file: this header, one 64 bit offset per page level by level row by row, then the pages.
+	// Each page holds pageSize texels plus border texels on every side
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t pageSize;
+		uint32_t border;
+		uint32_t mipLevels;
+		VkFormat format;
+	};
+	static const uint32_t fileMagic = 0x58455456;
+	static const uint32_t fileVersion = 1;
+
+	// Image sides must be powers of two and at least pageSize, the last level is one page on its shorter side
+	static void buildPageFile(const std::string& imageFilename, const std::string& pageFilename, bool srgb = true, uint32_t pageSize = 128, uint32_t border = 4);
+
+	struct Settings {
+		// Slots per side of the cache texture
+		uint32_t cachePages = 16;
+		uint32_t maxLoadsInFlight = 16;
+		uint32_t maxUploadsPerFrame = 32;
+	};
+
+	void create(Device* device, const std::string& pageFilename, const Settings& settings = {});
+	void destroy();
+
+	// Call after the fence of frameIndex was waited for and before that frame is submitted to the graphics
+	// queue, the copies are submitted there and have to come first
+	void update(uint32_t frameIndex);
+
+	// Bindings firstBinding to firstBinding + 3 as virtual_texture.glsl declares them
+	std::vector<DescriptorSetLayoutBinding> getLayoutBindings(uint32_t firstBinding, VkShaderStageFlags stages) const;
+	// Feedback and parameter buffers differ per frame in flight, one set per frame
+	void writeDescriptorSet(VkDescriptorSet set, uint32_t firstBinding, uint32_t frameIndex);
+
+	struct Stats {
+		uint32_t residentPages = 0;
+		uint32_t cacheSlots = 0;
+		uint32_t requestedPages = 0;
+		uint32_t loadsInFlight = 0;
+		uint64_t pagesLoaded = 0;
+		uint64_t pagesEvicted = 0;
+		uint64_t bytesUploaded = 0;
+	};
+	Stats getStats() const { return m_stats; }
+
+	uint32_t width() const { return m_header.width; }
+	uint32_t height() const { return m_header.height; }
+
+	TextureObject cache;
+	TextureObject pageTable;
+
+private:
+	// Layout of VtParams in virtual_texture.glsl
+	struct Params {
+		glm::vec4 virtualSize;
+		glm::vec4 cacheLayout;
+		glm::uvec4 pages;
+		glm::uvec4 levelOffsets[maxMipLevels];
+	};
+	struct Slot {
+		uint32_t page = UINT32_MAX;
+		uint32_t lastUsed = 0;
+		bool pinned = false;
+	};
+	struct PendingLoad {
+		uint32_t page;
+		std::future<std::vector<unsigned char>> pixels;
+	};
+
+	uint32_t pagesX(uint32_t level) const { return std::max(1u, m_pagesX >> level); }
+	uint32_t pagesY(uint32_t level) const { return std::max(1u, m_pagesY >> level); }
+	uint32_t pageIndex(uint32_t level, uint32_t x, uint32_t y) const { return m_levelOffsets[level] + y * pagesX(level) + x; }
+	uint32_t pageLevel(uint32_t page) const;
+	uint32_t parentPage(uint32_t page) const;
+	VkDeviceSize pageBytes() const;
+
+	TextureObject createImage(VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkFilter filter);
+	std::vector<unsigned char> readPage(uint32_t page) const;
+	uint32_t allocateSlot();
+	void beginCopies(VkCommandBuffer commandBuffer);
+	void endCopies(VkCommandBuffer commandBuffer);
+	void recordPage(UploadBatch& batch, uint32_t page, uint32_t slot, const std::vector<unsigned char>& pixels);
+	void recordPageTable(UploadBatch& batch);
+
+	Device* m_device = nullptr;
+	Settings m_settings;
+	MappedFile m_file;
+	FileHeader m_header{};
+	const uint64_t* m_pageOffsets = nullptr;
+	uint32_t m_pagesX = 0;
+	uint32_t m_pagesY = 0;
+	uint32_t m_pageCount = 0;
+	std::vector<uint32_t> m_levelOffsets;
+
+	// Slot of every page, UINT32_MAX while it is not resident
+	std::vector<uint32_t> m_pageSlots;
+	std::vector<Slot> m_slots;
+	// Packed RGBA8 texels of every level, slot x, slot y, resident level
+	std::vector<uint32_t> m_tableTexels;
+	std::vector<PendingLoad> m_loads;
+	std::vector<bool> m_loading;
+	std::vector<UploadBatch> m_uploads;
+	std::vector<Buffer> m_feedback;
+	std::vector<Buffer> m_params;
+	uint32_t m_frame = 0;
+	Stats m_stats;
+};
@@ -20,6 +20,8 @@ struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
     std::optional<uint32_t> computeFamily;
+    // A transfer only family when the device has one, the graphics family otherwise
+    std::optional<uint32_t> transferFamily;
 
     bool isComplete() {
         return graphicsFamily.has_value() && presentFamily.has_value() && computeFamily.has_value();
@@ -91,6 +93,16 @@ namespace vkHelper {
             ++i;
         }
 
+        // DMA engines run copies beside graphics and compute work
+        indices.transferFamily = indices.graphicsFamily;
+        for (uint32_t family = 0; family < queueFamilyCount; ++family) {
+            const VkQueueFlags flags = queueFamilies[family].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                indices.transferFamily = family;
+                break;
+            }
+        }
+
         return indices;
     }
 
@@ -64,36 +64,35 @@ private:
     Device* m_device;
     Camera* m_camera;
 
+    // Uniform blocks come from the frame allocator, one set of each serves every frame
     struct DescriptorSets {
         VkDescriptorSet scene;
         VkDescriptorSet debug;
-    };
+        VkDescriptorSet node;
+    } descriptorSets;
 
-    VkPipelineLayout m_pipelineLayout;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
 
-    // glTF
+    // glTF, loaded in the background. Everything that depends on its materials is created once it is drawable
     vkglTF::VulkanglTFModel meshModel;
+    std::shared_ptr<vkglTF::LoadHandle> meshLoad;
+    bool meshReady = false;
     //vkglTF::VulkanglTFModel cubeModel;
 
+    // Submitted to the pipeline queue once the model is drawable, the model is left out until they are ready
     struct Pipelines
     {
-        VkPipeline solid;
-        VkPipeline enable_wireframe = VK_NULL_HANDLE;
+        PipelineQueue::Handle solid;
+        PipelineQueue::Handle enable_wireframe;
     } pipelines;
 
     struct DescriptorSetLayouts
     {
         VkDescriptorSetLayout scene;
-        VkDescriptorSetLayout materials;
+        VkDescriptorSetLayout materials = VK_NULL_HANDLE;
         VkDescriptorSetLayout node;
     } descriptorSetLayouts;
 
-    struct UniformBufferSet {
-        Buffer scene;
-        Buffer params;
-        Buffer debug;
-    };
-
     struct UBOMatrices {
         glm::mat4 projection = glm::mat4(1.0f);
         glm::mat4 model = glm::mat4(1.0f);
@@ -101,8 +100,20 @@ private:
         glm::vec3 camPos = glm::vec3(0.0f);
     }shaderValuesScene, shaderValuesDebug;
 
-    std::vector<DescriptorSets> descriptorSets;
-    std::vector<UniformBufferSet> uniformBuffers;
+    // Frame allocator offsets of shaderValuesScene and shaderValuesParams for the command buffer being recorded
+    std::array<uint32_t, 2> sceneDynamicOffsets;
+
+    // Opaque primitives in draw order, recorded in chunks on the command recorder of the device
+    struct Draw
+    {
+        vkglTF::Node* node;
+        vkglTF::Primitive* primitive;
+        // Picked on the render thread before recording
+        uint32_t lod;
+        // Joints pushed once per frame and shared by every copy in the crowd
+        uint32_t jointsOffset;
+    };
+    std::vector<Draw> drawList;
 
     struct shaderValuesParams {
         glm::vec4 lightDir = glm::vec4(10.0f, 10.0f, 10.0f, 1.0f);
@@ -135,6 +146,15 @@ private:
         float alphaMaskCutoff;
     } pushConstBlockMaterial;
 
+    // All materials and textures in one descriptor indexed set, pbr_bindless.frag only takes the material index
+    bool bindless = false;
+
+    // Without bindless, one set per material and swap chain image. A set is rewritten when the image is recorded
+    // again after the model swapped textures, so sets of frames in flight are never touched
+    VkDescriptorPool materialDescriptorPool = VK_NULL_HANDLE;
+    std::vector<std::vector<VkDescriptorSet>> materialDescriptorSets;
+    std::vector<uint32_t> materialRevisions;
+
     TextureObject emptyTexture;
     //TextureObject textureCube;
     VkSampler m_defaultSampler;
@@ -162,6 +182,10 @@ private:
     // Values show on UI
     Gui* gui;
     bool enable_wireframe = false;
+    bool enable_parallel_recording = true;
+    float recordTime = 0.0f;
+    // The draw list is repeated on a crowdSize x crowdSize grid, so recording is long enough to be split
+    int32_t crowdSize = 1;
     bool enable_animate = false;
     bool enable_slerp = true;
     bool enable_debug_joints = false;
@@ -192,27 +216,22 @@ private:
         // Gui
         gui = new Gui();
         gui->init(m_device);
-       
-        uniformBuffers.resize(m_device->getSwapChainimages().size());
-        descriptorSets.resize(m_device->getSwapChainimages().size());
 
         loadAssets();
-        initUniformBuffers();
         initDescriptorPool();
+        initDescriptorSetLayout();
 
-        // Skybox
+        // Skybox, created while the model is parsed on a worker thread
         m_skybox.create(m_device, "../../data/models/glTF-Embedded/cube.gltf", "../../data/textures/cubemap_yokohama_rgba.ktx");
+        shaderValuesParams.prefilteredCubeMipLevels = m_skybox.ibl.prefilteredMaxLod();
         m_skybox.initDescriptorSet();
         m_skybox.initPipelines(m_device->getRenderPass());
 
-        initDescriptorSetLayout();
         initDescriptorSet();
-        initPipelines();
-        buildCommandBuffers();
     }
 
     void loadAssets() {
-        meshModel.loadFromFile("../../data/models/glTF-Embedded/CesiumMan.gltf", m_device, m_device->getGraphicsQueue());
+        meshLoad = meshModel.loadFromFileAsync("../../data/models/glTF-Embedded/CesiumMan.gltf", m_device, vkglTF::FileLoadingFlags::GenerateLods | vkglTF::FileLoadingFlags::StreamTextures);
 
         m_defaultSampler = texture::createSampler(
             m_device->getDevice(),
@@ -235,33 +254,6 @@ private:
         emptyTexture = texture::loadTexture("../../data/textures/empty.jpg", VK_FORMAT_R8G8B8A8_UNORM, m_device, 4);
     }
 
-    void initUniformBuffers() {
-
-        for (auto& uniformBuffer : uniformBuffers) {
-            uniformBuffer.scene = buffer::createBuffer(
-                m_device,
-                sizeof(shaderValuesScene),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-            );
-            memory::map(m_device->getDevice(), uniformBuffer.scene.memory, 0, uniformBuffer.scene.bufferSize, &uniformBuffer.scene.mapped);
-            uniformBuffer.debug = buffer::createBuffer(
-                m_device,
-                sizeof(shaderValuesDebug),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-            );
-            memory::map(m_device->getDevice(), uniformBuffer.debug.memory, 0, uniformBuffer.debug.bufferSize, &uniformBuffer.debug.mapped);
-            uniformBuffer.params = buffer::createBuffer(
-                m_device,
-                sizeof(shaderValuesParams),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-            );
-            memory::map(m_device->getDevice(), uniformBuffer.params.memory, 0, uniformBuffer.params.bufferSize, &uniformBuffer.params.mapped);
-        }
-    }
-
     float ParametricBlend(float t)
     {
         float sqt = t * t;
@@ -275,7 +267,10 @@ private:
         shaderValuesScene.view = m_camera->matrices.view;
         shaderValuesScene.camPos = m_camera->position;
 
-        // Mesh
+        // Mesh, its bounds are known once it is parsed
+        if (!meshReady) {
+            return;
+        }
         float scale = (1.0f / (std::max)(meshModel.aabb[0][0], (std::max)(meshModel.aabb[1][1], meshModel.aabb[2][2]))) * 0.5f;
         //glm::vec3 translate = -glm::vec3(meshModel.aabb[3][0], meshModel.aabb[3][1], meshModel.aabb[3][2]);
         //translate += -0.5f * glm::vec3(meshModel.aabb[0][0], meshModel.aabb[1][1], meshModel.aabb[2][2]);
@@ -285,6 +280,12 @@ private:
         shaderValuesScene.model[1][1] = scale;
         shaderValuesScene.model[2][2] = scale;
         //shaderValuesScene.model = glm::translate(shaderValuesScene.model, translate);
+
+        // pbr.vert flips y after the model matrix
+        const glm::mat4 flipY = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+        meshModel.setLodView(shaderValuesScene.view, shaderValuesScene.projection, static_cast<float>(m_device->getSwapChainExtent().height), flipY * shaderValuesScene.model);
+        // Swapped images bump textureRevision, the material sets of an image are rewritten before it records
+        meshModel.updateTextureStreaming();
     }
     void updateDebugUniformBuffer(glm::mat4 model) {
         shaderValuesDebug.projection = m_camera->matrices.perspective;
@@ -295,32 +296,19 @@ private:
 
     void initDescriptorPool()
     {
-        uint32_t imageSamplerCount = 0;
-        uint32_t materialCount = 0;
-        uint32_t meshCount = 0;
-
-        std::vector<vkglTF::VulkanglTFModel*> modellist = { &meshModel };
-        for (auto& model : modellist) {
-            for (auto& material : model->materials) {
-                imageSamplerCount += 5;
-                materialCount++;
-            }
-            for (auto node : model->linearNodes) {
-                if (node->mesh) {
-                    meshCount++;
-                }
-            }
-        }
+        // Irradiance, prefiltered and BRDF LUT of the scene set, environment of the skybox
+        const uint32_t imageSamplerCount = 4;
 
+        // Scene, debug, node and skybox sets. Materials get a pool of their own once the model is parsed
         std::vector<VkDescriptorPoolSize> poolSizes = {
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, (4 + meshCount) * (uint32_t)m_device->getSwapChainimages().size() },
-            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageSamplerCount * (uint32_t)m_device->getSwapChainimages().size()}
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 7 },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageSamplerCount }
         };
 
         m_device->m_descriptorPool = m_device->createDescriptorPool(
             m_device->getDevice(),
             poolSizes,
-            (2 + materialCount + meshCount) * (uint32_t)m_device->getSwapChainimages().size()
+            5
         );
     }
 
@@ -328,13 +316,41 @@ private:
         // Scene
         {
             std::vector<DescriptorSetLayoutBinding> sceneLayoutBindings = {
-                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
-                { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
             };
             descriptorSetLayouts.scene = m_device->createDescriptorSetLayout(m_device->getDevice(), { sceneLayoutBindings });
         }
-        // Material
+        // Model node (matrices and joints)
         {
+            std::vector<DescriptorSetLayoutBinding> nodeSetLayoutBindings = {
+                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+                { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+            };
+            descriptorSetLayouts.node = m_device->createDescriptorSetLayout(m_device->getDevice(), { nodeSetLayoutBindings });
+
+            // Shared by every mesh, each draw passes the offset of its own block
+            descriptorSets.node = vkglTF::createNodeDescriptorSet(m_device, descriptorSetLayouts.node);
+        }
+    }
+
+    // Material layouts, sets and pipelines need the materials and textures of the model, they are created once it is drawable
+    void initModelResources()
+    {
+        for (auto node : meshModel.nodes) {
+            collectDraws(node, vkglTF::Material::ALPHAMODE_OPAQUE);
+        }
+
+        const uint32_t frameCount = static_cast<uint32_t>(m_device->getCommandBuffers().size());
+        bindless = m_device->supportsBindlessTextures();
+        if (bindless) {
+            meshModel.createBindlessDescriptors(frameCount);
+            descriptorSetLayouts.materials = vkglTF::descriptorSetLayoutBindless;
+        }
+        else {
             std::vector<DescriptorSetLayoutBinding> materialLayoutBindings = {
                 { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
                 { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
@@ -343,116 +359,159 @@ private:
                 { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
             };
             descriptorSetLayouts.materials = m_device->createDescriptorSetLayout(m_device->getDevice(), { materialLayoutBindings });
-        }
-        // Model node (matrices)
-        {
-            std::vector<DescriptorSetLayoutBinding> nodeSetLayoutBindings = {
-                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
-            };
-            descriptorSetLayouts.node = m_device->createDescriptorSetLayout(m_device->getDevice(), { nodeSetLayoutBindings });
 
-            // Per-Node descriptor set
-            for (auto& node : meshModel.nodes) {
-                meshModel.initNodeDescriptor(node, descriptorSetLayouts.node);
+            const uint32_t setCount = std::max(1u, static_cast<uint32_t>(meshModel.materials.size())) * frameCount;
+            std::vector<VkDescriptorPoolSize> poolSizes = {
+                { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount * 5 }
+            };
+            materialDescriptorPool = m_device->createDescriptorPool(m_device->getDevice(), poolSizes, setCount);
+
+            materialDescriptorSets.resize(frameCount);
+            materialRevisions.assign(frameCount, meshModel.textureRevision);
+            for (auto& sets : materialDescriptorSets) {
+                for (auto& material : meshModel.materials) {
+                    sets.push_back(m_device->createDescriptorSet(m_device->getDevice(), materialDescriptorPool, descriptorSetLayouts.materials));
+                    writeMaterialDescriptorSet(material, sets.back());
+                }
             }
         }
 
         VkPushConstantRange pushConstantRange{};
         pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        pushConstantRange.size = sizeof(PushConstBlockMaterial);
+        pushConstantRange.size = bindless ? sizeof(uint32_t) : sizeof(PushConstBlockMaterial);
         pushConstantRange.offset = 0;
 
         m_pipelineLayout = m_device->createPipelineLayout(m_device->getDevice(), { descriptorSetLayouts.scene, descriptorSetLayouts.materials, descriptorSetLayouts.node }, { pushConstantRange });
+        initPipelines();
+    }
+
+    // Advances the background load, full resolution textures replace the proxies a few at a time
+    void updateModelLoad()
+    {
+        const vkglTF::LoadState state = meshModel.pollLoad();
+        if (state == vkglTF::LoadState::Failed) {
+            throw std::runtime_error("failed to load model: " + meshLoad->error);
+        }
+        if (!meshReady && meshModel.isDrawable()) {
+            initModelResources();
+            meshReady = true;
+        }
+    }
+
+    // Only called for an image whose previous command buffer has completed
+    void updateMaterialDescriptorSets(uint32_t imageIndex)
+    {
+        if (bindless || materialRevisions[imageIndex] == meshModel.textureRevision) {
+            return;
+        }
+        for (auto& material : meshModel.materials) {
+            writeMaterialDescriptorSet(material, materialDescriptorSets[imageIndex][material.index]);
+        }
+        materialRevisions[imageIndex] = meshModel.textureRevision;
     }
 
     void initDescriptorSet()
     {
+        const VkDescriptorBufferInfo sceneBufferInfo = m_device->getFrameAllocator().getDescriptor(sizeof(shaderValuesScene));
+        const VkDescriptorBufferInfo paramsBufferInfo = m_device->getFrameAllocator().getDescriptor(sizeof(shaderValuesParams));
+
         // Scene
-        for (auto i = 0; i < descriptorSets.size(); i++) {
-            descriptorSets[i].scene = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.scene);
-            std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+        {
+            descriptorSets.scene = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.scene);
+            std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
 
             writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeDescriptorSets[0].descriptorCount = 1;
-            writeDescriptorSets[0].dstSet = descriptorSets[i].scene;
+            writeDescriptorSets[0].dstSet = descriptorSets.scene;
             writeDescriptorSets[0].dstBinding = 0;
-            writeDescriptorSets[0].pBufferInfo = &uniformBuffers[i].scene.descriptor;
+            writeDescriptorSets[0].pBufferInfo = &sceneBufferInfo;
 
             writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeDescriptorSets[1].descriptorCount = 1;
-            writeDescriptorSets[1].dstSet = descriptorSets[i].scene;
+            writeDescriptorSets[1].dstSet = descriptorSets.scene;
             writeDescriptorSets[1].dstBinding = 1;
-            writeDescriptorSets[1].pBufferInfo = &uniformBuffers[i].params.descriptor;
+            writeDescriptorSets[1].pBufferInfo = &paramsBufferInfo;
+
+            const std::array<VkDescriptorImageInfo, 3> iblImageInfos = {
+                m_skybox.ibl.irradiance.getDescriptorImageInfo(),
+                m_skybox.ibl.prefiltered.getDescriptorImageInfo(),
+                m_skybox.ibl.brdfLut.getDescriptorImageInfo(),
+            };
+            for (uint32_t j = 0; j < iblImageInfos.size(); j++) {
+                writeDescriptorSets[2 + j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writeDescriptorSets[2 + j].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                writeDescriptorSets[2 + j].descriptorCount = 1;
+                writeDescriptorSets[2 + j].dstSet = descriptorSets.scene;
+                writeDescriptorSets[2 + j].dstBinding = 2 + j;
+                writeDescriptorSets[2 + j].pImageInfo = &iblImageInfos[j];
+            }
 
             vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
         }
         // Debug Bone
-        for (auto i = 0; i < descriptorSets.size(); i++) {
-            descriptorSets[i].debug = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.scene);
+        {
+            descriptorSets.debug = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.scene);
             std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
 
             writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeDescriptorSets[0].descriptorCount = 1;
-            writeDescriptorSets[0].dstSet = descriptorSets[i].debug;
+            writeDescriptorSets[0].dstSet = descriptorSets.debug;
             writeDescriptorSets[0].dstBinding = 0;
-            writeDescriptorSets[0].pBufferInfo = &uniformBuffers[i].debug.descriptor;
+            writeDescriptorSets[0].pBufferInfo = &sceneBufferInfo;
 
             writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeDescriptorSets[1].descriptorCount = 1;
-            writeDescriptorSets[1].dstSet = descriptorSets[i].debug;
+            writeDescriptorSets[1].dstSet = descriptorSets.debug;
             writeDescriptorSets[1].dstBinding = 1;
-            writeDescriptorSets[1].pBufferInfo = &uniformBuffers[i].params.descriptor;
+            writeDescriptorSets[1].pBufferInfo = &paramsBufferInfo;
 
             vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
         }
-        // Material
-        {
-            // Per-Material descriptor sets
-            for (auto& material : meshModel.materials) {
-                material.descriptorSet = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.materials);
-                VkDescriptorImageInfo emptyDescriptorImageInfo{ m_defaultSampler, emptyTexture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-
-                std::vector<VkDescriptorImageInfo> imageDescriptors = {
-                    emptyDescriptorImageInfo,
-                    emptyDescriptorImageInfo,
-                    material.normalTexture ? material.normalTexture->getDescriptorImageInfo() : emptyDescriptorImageInfo,
-                    material.occlusionTexture ? material.occlusionTexture->getDescriptorImageInfo() : emptyDescriptorImageInfo,
-                    material.emissiveTexture ? material.emissiveTexture->getDescriptorImageInfo() : emptyDescriptorImageInfo
-                };
+    }
 
-                if (material.pbrWorkflows.metallicRoughness) {
-                    if (material.baseColorTexture) {
-                        imageDescriptors[0] = material.baseColorTexture->getDescriptorImageInfo();
-                    }
-                    if (material.metallicRoughnessTexture) {
-                        imageDescriptors[1] = material.metallicRoughnessTexture->getDescriptorImageInfo();
-                    }
-                }
-                else if (material.pbrWorkflows.specularGlossiness) {
-                    if (material.extension.diffuseTexture) {
-                        imageDescriptors[0] = material.extension.diffuseTexture->getDescriptorImageInfo();
-                    }
-                    if (material.extension.specularGlossinessTexture) {
-                        imageDescriptors[1] = material.extension.specularGlossinessTexture->getDescriptorImageInfo();
-                    }
-                }
+    void writeMaterialDescriptorSet(const vkglTF::Material& material, VkDescriptorSet descriptorSet)
+    {
+        VkDescriptorImageInfo emptyDescriptorImageInfo{ m_defaultSampler, emptyTexture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+        std::vector<VkDescriptorImageInfo> imageDescriptors = {
+            emptyDescriptorImageInfo,
+            emptyDescriptorImageInfo,
+            material.normalTexture ? material.normalTexture->getDescriptorImageInfo() : emptyDescriptorImageInfo,
+            material.occlusionTexture ? material.occlusionTexture->getDescriptorImageInfo() : emptyDescriptorImageInfo,
+            material.emissiveTexture ? material.emissiveTexture->getDescriptorImageInfo() : emptyDescriptorImageInfo
+        };
 
-                std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
-                for (size_t i = 0; i < imageDescriptors.size(); i++) {
-                    writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                    writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                    writeDescriptorSets[i].descriptorCount = 1;
-                    writeDescriptorSets[i].dstSet = material.descriptorSet;
-                    writeDescriptorSets[i].dstBinding = static_cast<uint32_t>(i);
-                    writeDescriptorSets[i].pImageInfo = &imageDescriptors[i];
-                }
-                vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+        if (material.pbrWorkflows.metallicRoughness) {
+            if (material.baseColorTexture) {
+                imageDescriptors[0] = material.baseColorTexture->getDescriptorImageInfo();
             }
+            if (material.metallicRoughnessTexture) {
+                imageDescriptors[1] = material.metallicRoughnessTexture->getDescriptorImageInfo();
+            }
+        }
+        else if (material.pbrWorkflows.specularGlossiness) {
+            if (material.extension.diffuseTexture) {
+                imageDescriptors[0] = material.extension.diffuseTexture->getDescriptorImageInfo();
+            }
+            if (material.extension.specularGlossinessTexture) {
+                imageDescriptors[1] = material.extension.specularGlossinessTexture->getDescriptorImageInfo();
+            }
+        }
+
+        std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
+        for (size_t i = 0; i < imageDescriptors.size(); i++) {
+            writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writeDescriptorSets[i].descriptorCount = 1;
+            writeDescriptorSets[i].dstSet = descriptorSet;
+            writeDescriptorSets[i].dstBinding = static_cast<uint32_t>(i);
+            writeDescriptorSets[i].pImageInfo = &imageDescriptors[i];
         }
+        vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
     }
 
     void initPipelines()
@@ -518,30 +577,35 @@ private:
         colorBlending.blendConstants[2] = 0.0f;
         colorBlending.blendConstants[3] = 0.0f;
 
-        std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.pDynamicStates = dynamicStates.data();
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());;
+        PipelineQueue::GraphicsPipelineDesc desc;
+        desc.vertexShaderFile = "../../data/shaders/pbr.vert.spv";
+        desc.pixelShaderFile = bindless ? "../../data/shaders/pbr_bindless.frag.spv" : "../../data/shaders/pbr.frag.spv";
+        desc.vertexInputState = vertexInputState;
+        desc.inputAssemblyState = inputAssembly;
+        desc.viewportState = viewport;
+        desc.rasterizationState = rasterizer;
+        desc.multisampleState = multisampling;
+        desc.depthStencilState = depthStencil;
+        desc.colorBlendState = colorBlending;
+        desc.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        desc.pipelineLayout = m_pipelineLayout;
+        desc.renderPass = m_device->getRenderPass();
 
         // Solid rendering pipeline
-        std::vector<ShaderStage> shaderStages_mesh = m_device->createShader(m_device->getDevice(), "../../data/shaders/pbr.vert.spv", "../../data/shaders/pbr.frag.spv");
-        pipelines.solid = m_device->createGraphicsPipeline(m_device->getDevice(), m_device->getPipelineCache(), shaderStages_mesh, vertexInputState, inputAssembly, viewport, rasterizer, multisampling, depthStencil, colorBlending, dynamicState, m_pipelineLayout, m_device->getRenderPass());
+        pipelines.solid = m_device->getPipelineQueue().submit(desc);
 
         // Wire frame rendering pipeline
-        //if (enable_wireframe) {
-        rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
-        rasterizer.lineWidth = 1.0f;
-        pipelines.enable_wireframe = m_device->createGraphicsPipeline(m_device->getDevice(), m_device->getPipelineCache(), shaderStages_mesh, vertexInputState, inputAssembly, viewport, rasterizer, multisampling, depthStencil, colorBlending, dynamicState, m_pipelineLayout, m_device->getRenderPass());
-        //}
-        for (auto shaderStage : shaderStages_mesh)
-            vkDestroyShaderModule(m_device->getDevice(), shaderStage.module, nullptr);
+        desc.rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
+        desc.rasterizationState.lineWidth = 1.0f;
+        pipelines.enable_wireframe = m_device->getPipelineQueue().submit(desc);
     }
 
-    void buildCommandBuffers()
+    // Records the command buffer of the current frame, drawing to imageIndex
+    void buildCommandBuffer(uint32_t imageIndex)
     {
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
         beginInfo.pInheritanceInfo = nullptr;
 
         VkRenderPassBeginInfo renderPassInfo{};
@@ -557,120 +621,209 @@ private:
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
 
-        for (size_t i = 0; i < m_device->getCommandBuffers().size(); ++i)
-        {
-            renderPassInfo.framebuffer = m_device->getFramebuffers()[i];
-            VkDeviceSize offsets[1] = { 0 };
+        const auto recordStart = std::chrono::high_resolution_clock::now();
+        renderPassInfo.framebuffer = m_device->getFramebuffers()[imageIndex];
+        VkDeviceSize offsets[1] = { 0 };
 
-            VkCommandBuffer currentCB = m_device->m_commandBuffers[i];
-            if (vkBeginCommandBuffer(currentCB, &beginInfo) != VK_SUCCESS) {
-                throw std::runtime_error("failed to begin recording command buffer!");
-            }
+        VkCommandBuffer currentCB = m_device->getCurrentCommandBuffer();
+        if (vkBeginCommandBuffer(currentCB, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+        sceneDynamicOffsets = {
+            m_device->getFrameAllocator().push(shaderValuesScene),
+            m_device->getFrameAllocator().push(shaderValuesParams),
+        };
 
-            vkCmdBeginRenderPass(currentCB, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(currentCB, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-            VkViewport viewport{};
-            viewport.width = (float)WIDTH;
-            viewport.height = (float)HEIGHT;
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            viewport.x = 0;
-            viewport.y = 0;
-            //viewport.y = viewport.height;
-            vkCmdSetViewport(currentCB, 0, 1, &viewport);
+        VkViewport viewport{};
+        viewport.width = (float)WIDTH;
+        viewport.height = (float)HEIGHT;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        viewport.x = 0;
+        viewport.y = 0;
 
-            VkRect2D scissor{};
-            scissor.extent = { WIDTH, HEIGHT };
-            vkCmdSetScissor(currentCB, 0, 1, &scissor);
+        VkRect2D scissor{};
+        scissor.extent = { WIDTH, HEIGHT };
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = m_device->getRenderPass();
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
+
+        // Item 0 is the skybox, the rest the draw list. The model is left out while it loads and its pipelines compile
+        const VkPipeline pipeline = enable_wireframe ? pipelines.enable_wireframe.get() : pipelines.solid.get();
+        const uint32_t drawCount = pipeline != VK_NULL_HANDLE ? static_cast<uint32_t>(drawList.size()) * crowdSize * crowdSize : 0;
+        // getBindlessDescriptorSet may rewrite the set, so it is fetched here and not on the recording threads
+        VkDescriptorSet bindlessSet = VK_NULL_HANDLE;
+        if (drawCount > 0) {
+            updateMaterialDescriptorSets(imageIndex);
+            selectLods();
+            if (bindless) {
+                bindlessSet = meshModel.getBindlessDescriptorSet(imageIndex);
+            }
+        }
+        m_device->getCommandRecorder().record(currentCB, inheritanceInfo, drawCount + 1, [&](VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end) {
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
             // Skybox
-            m_skybox.draw(currentCB);
+            if (begin == 0) {
+                m_skybox.draw(commandBuffer);
+                begin++;
+            }
+            if (begin == end) {
+                return;
+            }
 
             // Model
-            {
-                vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, enable_wireframe ? pipelines.enable_wireframe : pipelines.solid);
-                vkCmdBindVertexBuffers(currentCB, 0, 1, &meshModel.vertices.buffer, offsets);
-                if (meshModel.indices.count > 0) {
-                    vkCmdBindIndexBuffer(currentCB, meshModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-                }
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &meshModel.vertices.buffer, offsets);
+            if (meshModel.indices.count > 0) {
+                vkCmdBindIndexBuffer(commandBuffer, meshModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            }
 
-                for (auto node : meshModel.nodes) {
-                    renderNode(node, i, vkglTF::Material::ALPHAMODE_OPAQUE);
-                }
+            if (bindless) {
+                // Scene and every material of the model, bound once per chunk
+                const std::vector<VkDescriptorSet> descriptorsets = {
+                    descriptorSets.scene,
+                    bindlessSet,
+                };
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), static_cast<uint32_t>(sceneDynamicOffsets.size()), sceneDynamicOffsets.data());
             }
+            const uint32_t drawListSize = static_cast<uint32_t>(drawList.size());
+            for (uint32_t draw = begin; draw < end; draw++) {
+                recordDraw(commandBuffer, drawList[(draw - 1) % drawListSize], (draw - 1) / drawListSize, imageIndex);
+            }
+        }, enable_parallel_recording ? 256 : UINT32_MAX);
 
-            auto update_gui = std::bind(&Test_Animiation::updateGUI, this);
-            vkCmdEndRenderPass(currentCB);
-            gui->render(update_gui);
-            vkEndCommandBuffer(currentCB);
-        }
+        auto update_gui = std::bind(&Test_Animiation::updateGUI, this);
+        vkCmdEndRenderPass(currentCB);
+        gui->render(update_gui);
+        vkEndCommandBuffer(currentCB);
+        recordTime = static_cast<float>(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count());
     }
 
-    void renderNode(vkglTF::Node* node, uint32_t cbIndex, vkglTF::Material::AlphaMode alphaMode) {
+    void collectDraws(vkglTF::Node* node, vkglTF::Material::AlphaMode alphaMode) {
         if (node->mesh) {
-            // Render mesh primitives
             for (vkglTF::Primitive* primitive : node->mesh->primitives) {
                 if (primitive->material.alphaMode == alphaMode) {
-
-                    const std::vector<VkDescriptorSet> descriptorsets = {
-                        descriptorSets[cbIndex].scene,
-                        primitive->material.descriptorSet,
-                        node->mesh->uniformBuffer.descriptorSet,
-                    };
-                    auto commandBuffers = m_device->getCommandBuffers();
-                    vkCmdBindDescriptorSets(commandBuffers[cbIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 0, NULL);
-
-                    // Pass material parameters as push constants
-                    PushConstBlockMaterial pushConstBlockMaterial{};
-                    pushConstBlockMaterial.emissiveFactor = primitive->material.emissiveFactor;
-                    // To save push constant space, availabilty and texture coordiante set are combined
-                    // -1 = texture not used for this material, >= 0 texture used and index of texture coordinate set
-                    pushConstBlockMaterial.colorTextureSet = primitive->material.baseColorTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
-                    pushConstBlockMaterial.normalTextureSet = primitive->material.normalTexture != nullptr ? primitive->material.texCoordSets.normal : -1;
-                    pushConstBlockMaterial.occlusionTextureSet = primitive->material.occlusionTexture != nullptr ? primitive->material.texCoordSets.occlusion : -1;
-                    pushConstBlockMaterial.emissiveTextureSet = primitive->material.emissiveTexture != nullptr ? primitive->material.texCoordSets.emissive : -1;
-                    pushConstBlockMaterial.alphaMask = static_cast<float>(primitive->material.alphaMode == vkglTF::Material::ALPHAMODE_MASK);
-                    pushConstBlockMaterial.alphaMaskCutoff = primitive->material.alphaCutoff;
-
-                    if (primitive->material.pbrWorkflows.metallicRoughness) {
-                        // Metallic roughness workflow
-                        pushConstBlockMaterial.workflow = static_cast<float>(PBR_WORKFLOW_METALLIC_ROUGHNESS);
-                        pushConstBlockMaterial.baseColorFactor = primitive->material.baseColorFactor;
-                        pushConstBlockMaterial.metallicFactor = primitive->material.metallicFactor;
-                        pushConstBlockMaterial.roughnessFactor = primitive->material.roughnessFactor;
-                        pushConstBlockMaterial.PhysicalDescriptorTextureSet = primitive->material.metallicRoughnessTexture != nullptr ? primitive->material.texCoordSets.metallicRoughness : -1;
-                        pushConstBlockMaterial.colorTextureSet = primitive->material.baseColorTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
-                    }
-
-                    if (primitive->material.pbrWorkflows.specularGlossiness) {
-                        // Specular glossiness workflow
-                        pushConstBlockMaterial.workflow = static_cast<float>(PBR_WORKFLOW_SPECULAR_GLOSINESS);
-                        pushConstBlockMaterial.PhysicalDescriptorTextureSet = primitive->material.extension.specularGlossinessTexture != nullptr ? primitive->material.texCoordSets.specularGlossiness : -1;
-                        pushConstBlockMaterial.colorTextureSet = primitive->material.extension.diffuseTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
-                        pushConstBlockMaterial.diffuseFactor = primitive->material.extension.diffuseFactor;
-                        pushConstBlockMaterial.specularFactor = glm::vec4(primitive->material.extension.specularFactor, 1.0f);
-                    }
-
-                    vkCmdPushConstants(commandBuffers[cbIndex], m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlockMaterial), &pushConstBlockMaterial);
-
-                    if (primitive->hasIndices) {
-                        vkCmdDrawIndexed(commandBuffers[cbIndex], primitive->indexCount, 1, primitive->firstIndex, 0, 0);
-                    }
-                    else {
-                        vkCmdDraw(commandBuffers[cbIndex], primitive->vertexCount, 1, 0, 0);
-                    }
+                    drawList.push_back({ node, primitive, 0, 0 });
                 }
             }
-        };
+        }
         for (auto child : node->children) {
-            renderNode(child, cbIndex, alphaMode);
+            collectDraws(child, alphaMode);
+        }
+    }
+
+    // selectLod updates the hysteresis of the node, so it is not left to the recording threads. Copies in the crowd
+    // use the LOD and the joints of the original
+    void selectLods() {
+        meshModel.drawStats = {};
+        const uint32_t copies = crowdSize * crowdSize;
+        for (Draw& draw : drawList) {
+            draw.lod = std::min(meshModel.selectLod(draw.node), static_cast<uint32_t>(draw.primitive->lods.size()) - 1);
+            draw.jointsOffset = draw.node->mesh->pushJoints();
+            meshModel.drawStats.triangles += draw.primitive->lods[draw.lod].indexCount / 3 * copies;
+            meshModel.drawStats.trianglesFullDetail += draw.primitive->indexCount / 3 * copies;
+        }
+    }
+
+    // Every draw copies a node block into the frame allocator, the crowd may take half of it. Offsets are aligned to at
+    // most 256 bytes
+    int32_t getMaxCrowdSize() const {
+        const VkDeviceSize blocks = (m_device->frameAllocatorSize / 2) / std::max<VkDeviceSize>(sizeof(vkglTF::Mesh::NodeBlock), 256);
+        const VkDeviceSize copies = blocks / std::max<size_t>(drawList.size(), 1);
+        return std::max(1, static_cast<int32_t>(std::sqrt(static_cast<double>(copies))));
+    }
+
+    // Model space translation of a copy, the crowd is centered on the original
+    glm::mat4 getCrowdMatrix(uint32_t copy) const {
+        const float spacing = (std::max)(meshModel.aabb[0][0], meshModel.aabb[2][2]) * 1.5f;
+        const float x = static_cast<float>(copy % crowdSize) - (crowdSize - 1) * 0.5f;
+        const float z = static_cast<float>(copy / crowdSize) - (crowdSize - 1) * 0.5f;
+        return glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z) * spacing);
+    }
+
+    // Called from the threads of the command recorder
+    void recordDraw(VkCommandBuffer commandBuffer, const Draw& draw, uint32_t copy, uint32_t imageIndex) {
+        const vkglTF::Node* node = draw.node;
+        const vkglTF::Mesh::DynamicOffsets nodeOffsets = node->mesh->pushUniformBlock(getCrowdMatrix(copy) * node->meshMatrix, draw.jointsOffset);
+        const vkglTF::Primitive* primitive = draw.primitive;
+        const vkglTF::Primitive::Lod& level = primitive->lods[draw.lod];
+        if (bindless) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 2, 1, &descriptorSets.node, static_cast<uint32_t>(nodeOffsets.size()), nodeOffsets.data());
+            vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &primitive->material.index);
+            if (primitive->hasIndices) {
+                vkCmdDrawIndexed(commandBuffer, level.indexCount, 1, level.firstIndex, 0, 0);
+            }
+            else {
+                vkCmdDraw(commandBuffer, primitive->vertexCount, 1, 0, 0);
+            }
+        }
+        else {
+            const std::vector<VkDescriptorSet> descriptorsets = {
+                descriptorSets.scene,
+                materialDescriptorSets[imageIndex][primitive->material.index],
+                descriptorSets.node,
+            };
+            const std::array<uint32_t, 4> dynamicOffsets = { sceneDynamicOffsets[0], sceneDynamicOffsets[1], nodeOffsets[0], nodeOffsets[1] };
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+            // Pass material parameters as push constants
+            PushConstBlockMaterial pushConstBlockMaterial{};
+            pushConstBlockMaterial.emissiveFactor = primitive->material.emissiveFactor;
+            // To save push constant space, availabilty and texture coordiante set are combined
+            // -1 = texture not used for this material, >= 0 texture used and index of texture coordinate set
+            pushConstBlockMaterial.colorTextureSet = primitive->material.baseColorTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
+            pushConstBlockMaterial.normalTextureSet = primitive->material.normalTexture != nullptr ? primitive->material.texCoordSets.normal : -1;
+            pushConstBlockMaterial.occlusionTextureSet = primitive->material.occlusionTexture != nullptr ? primitive->material.texCoordSets.occlusion : -1;
+            pushConstBlockMaterial.emissiveTextureSet = primitive->material.emissiveTexture != nullptr ? primitive->material.texCoordSets.emissive : -1;
+            pushConstBlockMaterial.alphaMask = static_cast<float>(primitive->material.alphaMode == vkglTF::Material::ALPHAMODE_MASK);
+            pushConstBlockMaterial.alphaMaskCutoff = primitive->material.alphaCutoff;
+
+            if (primitive->material.pbrWorkflows.metallicRoughness) {
+                // Metallic roughness workflow
+                pushConstBlockMaterial.workflow = static_cast<float>(PBR_WORKFLOW_METALLIC_ROUGHNESS);
+                pushConstBlockMaterial.baseColorFactor = primitive->material.baseColorFactor;
+                pushConstBlockMaterial.metallicFactor = primitive->material.metallicFactor;
+                pushConstBlockMaterial.roughnessFactor = primitive->material.roughnessFactor;
+                pushConstBlockMaterial.PhysicalDescriptorTextureSet = primitive->material.metallicRoughnessTexture != nullptr ? primitive->material.texCoordSets.metallicRoughness : -1;
+                pushConstBlockMaterial.colorTextureSet = primitive->material.baseColorTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
+            }
+
+            if (primitive->material.pbrWorkflows.specularGlossiness) {
+                // Specular glossiness workflow
+                pushConstBlockMaterial.workflow = static_cast<float>(PBR_WORKFLOW_SPECULAR_GLOSINESS);
+                pushConstBlockMaterial.PhysicalDescriptorTextureSet = primitive->material.extension.specularGlossinessTexture != nullptr ? primitive->material.texCoordSets.specularGlossiness : -1;
+                pushConstBlockMaterial.colorTextureSet = primitive->material.extension.diffuseTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
+                pushConstBlockMaterial.diffuseFactor = primitive->material.extension.diffuseFactor;
+                pushConstBlockMaterial.specularFactor = glm::vec4(primitive->material.extension.specularFactor, 1.0f);
+            }
+
+            vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlockMaterial), &pushConstBlockMaterial);
+
+            if (primitive->hasIndices) {
+                vkCmdDrawIndexed(commandBuffer, level.indexCount, 1, level.firstIndex, 0, 0);
+            }
+            else {
+                vkCmdDraw(commandBuffer, primitive->vertexCount, 1, 0, 0);
+            }
         }
     }
 
     void render() override {
         auto tStart = std::chrono::high_resolution_clock::now();
 
-        buildCommandBuffers();
+        updateModelLoad();
+
+        // Uniform data is copied into the frame allocator while recording
+        updateUniformBuffer();
+        m_skybox.updateUniformBuffer();
+        m_device->beginFrame();
         drawFrame();
         frameCounter++;
         auto tEnd = std::chrono::high_resolution_clock::now();
@@ -687,9 +840,6 @@ private:
     }
 
     void drawFrame() {
-        vkWaitForFences(m_device->getDevice(), 1, &m_device->m_waitFences[m_device->getCurrentFrame()], VK_TRUE, UINT64_MAX);
-        vkResetFences(m_device->getDevice(), 1, &m_device->m_waitFences[m_device->getCurrentFrame()]);
-
         uint32_t imageIndex;
         VkResult result = vkAcquireNextImageKHR(m_device->getDevice(), m_device->getSwapChain(), UINT64_MAX, m_device->m_imageAvailableSemaphores[m_device->getCurrentFrame()], VK_NULL_HANDLE, &imageIndex);
 
@@ -704,6 +854,10 @@ private:
             vkWaitForFences(m_device->getDevice(), 1, &m_device->m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
         }
         m_device->m_imagesInFlight[imageIndex] = m_device->m_waitFences[m_device->getCurrentFrame()];
+        vkResetFences(m_device->getDevice(), 1, &m_device->m_waitFences[m_device->getCurrentFrame()]);
+
+        buildCommandBuffer(imageIndex);
+        const VkCommandBuffer commandBuffer = m_device->getCurrentCommandBuffer();
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -714,18 +868,12 @@ private:
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &m_device->m_commandBuffers[imageIndex];
+        submitInfo.pCommandBuffers = &commandBuffer;
 
         VkSemaphore signalSemaphores[] = { m_device->m_renderFinishedSemaphores[m_device->getCurrentFrame()] };
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        // Model Mesh
-        updateUniformBuffer();
-        UniformBufferSet currentUB = uniformBuffers[imageIndex];
-        memcpy(currentUB.scene.mapped, &shaderValuesScene, sizeof(shaderValuesScene));
-        memcpy(currentUB.params.mapped, &shaderValuesParams, sizeof(shaderValuesParams));
-        m_skybox.updateUniformBuffer();
         m_device->submitCommandBuffer(m_device->getGraphicsQueue(), &submitInfo, m_device->m_waitFences[m_device->getCurrentFrame()]);
 
         VkPresentInfoKHR presentInfo{};
@@ -749,32 +897,34 @@ private:
         m_device->m_currentFrame = (m_device->m_currentFrame + 1) % 2;
 
         // Update Animation
-        if ((enable_animate) && (meshModel.animations.size() > 0)) {
+        if (meshReady && enable_animate && meshModel.animations.size() > 0) {
             animationTimer += frameTimer * animationSpeed;
             if (animationTimer > meshModel.animations[animationIndex].end) {
                 animationTimer -= meshModel.animations[animationIndex].end;
             }
             meshModel.updateAnimation(animationIndex, animationTimer);
         }
-        updateUniformBuffer();
     }
 
     void destroy() {
         gui->destroy();
         meshModel.destroy();
+        m_skybox.ibl.destroy();
         emptyTexture.destroy(m_device->getDevice());
         vkDestroySampler(m_device->getDevice(), m_defaultSampler, nullptr);
         vkDestroyDescriptorSetLayout(m_device->getDevice(), descriptorSetLayouts.scene, nullptr);
-        vkDestroyDescriptorSetLayout(m_device->getDevice(), descriptorSetLayouts.materials, nullptr);
+        // The bindless layout belongs to vkglTF and went with the model
+        if (!bindless) {
+            vkDestroyDescriptorSetLayout(m_device->getDevice(), descriptorSetLayouts.materials, nullptr);
+        }
         vkDestroyDescriptorSetLayout(m_device->getDevice(), descriptorSetLayouts.node, nullptr);
+        vkDestroyDescriptorPool(m_device->getDevice(), materialDescriptorPool, nullptr);
 
-        for (auto ubo : uniformBuffers) {
-            vkDestroyBuffer(m_device->getDevice(), ubo.scene.buffer, nullptr);
-            vkDestroyBuffer(m_device->getDevice(), ubo.params.buffer, nullptr);
-            vkDestroyBuffer(m_device->getDevice(), ubo.debug.buffer, nullptr);
+        // Never submitted when the window closed before the model was drawable
+        if (meshReady) {
+            vkDestroyPipeline(m_device->getDevice(), pipelines.solid.wait(), nullptr);
+            vkDestroyPipeline(m_device->getDevice(), pipelines.enable_wireframe.wait(), nullptr);
         }
-        vkDestroyPipeline(m_device->getDevice(), pipelines.solid, nullptr);
-        vkDestroyPipeline(m_device->getDevice(), pipelines.enable_wireframe, nullptr);
         vkDestroyPipelineLayout(m_device->getDevice(), m_pipelineLayout, nullptr);
     }
 
@@ -787,7 +937,26 @@ private:
             ImGui::Checkbox("Enable slerp", &enable_slerp);
             ImGui::SliderFloat("Animation Speed", &animationSpeed, 0.1f, 10.0f);
         }
+        if (!meshLoad->isDrawable()) {
+            ImGui::Text("Loading model...");
+        }
+        else if (!meshLoad->isDone()) {
+            ImGui::Text("Textures %u / %u", meshLoad->texturesResident.load(), meshLoad->texturesTotal.load());
+        }
         ImGui::Checkbox("Show Wireframe", &enable_wireframe);
+        ImGui::Checkbox("Parallel Recording", &enable_parallel_recording);
+        if (meshReady) {
+            ImGui::SliderInt("Crowd Size", &crowdSize, 1, getMaxCrowdSize());
+        }
+        ImGui::Checkbox("Enable LOD", &meshModel.enableLod);
+        if (meshModel.enableLod) {
+            ImGui::SliderFloat("LOD Screen Size", &meshModel.lodScreenSize, 32.0f, 1024.0f);
+        }
+        ImGui::Text("Triangles %u of %u", meshModel.drawStats.triangles, meshModel.drawStats.trianglesFullDetail);
+        const auto& streaming = meshModel.streamingStats;
+        ImGui::Text("Texture levels %u of %u, %.1f MB", streaming.levelsResident, streaming.levelsTotal, streaming.residentBytes / (1024.0f * 1024.0f));
+        ImGui::Text("Streamed %.1f MB/s", streaming.bandwidth / (1024.0f * 1024.0f));
+        ImGui::Text("Record Time %.2f ms, %u draws on %u threads", recordTime, static_cast<uint32_t>(drawList.size()) * crowdSize * crowdSize, m_device->getCommandRecorder().getThreadCount());
         ImGui::End();
     }
 
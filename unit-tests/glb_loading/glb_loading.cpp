@@ -0,0 +1,263 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+// Enable the WSI extensions
+#if defined(__ANDROID__)
+#define VK_USE_PLATFORM_ANDROID_KHR
+#elif defined(__linux__)
+#define VK_USE_PLATFORM_XLIB_KHR
+#elif defined(_WIN32)
+#define VK_USE_PLATFORM_WIN32_KHR
+#endif
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include "pch.h"
+#include "app.h"
+#include <filesystem>
+#include <fstream>
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+#define MESH_COUNT 64
+#define GRID_SIZE 256
+
+// Writes a .glb of about 230 MB and prints load time and peak RSS of the memory mapped path against the std::ifstream path of tinygltf
+class Test_GlbLoading : public App {
+public:
+    Test_GlbLoading() {
+        vkHelper::addDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    ~Test_GlbLoading() {
+        delete m_device;
+        m_window->destroy();
+        delete m_window;
+    }
+
+    void getEnabledFeatures() override {
+
+    }
+
+    bool init() override {
+        m_window = new Window();
+        m_window->create(WIDTH, HEIGHT);
+
+        std::function<void()> getfeatures = [&]() { getEnabledFeatures(); };
+        m_device = new Device();
+        m_device->create(m_window, vkHelper::getInstanceExtensions(), vkHelper::getDeviceExtensions(), getfeatures);
+        return true;
+    }
+
+    void update(float deltaTime) override {
+
+    }
+
+    void render() override {
+
+    }
+
+    void run() override {
+        const std::string filename = (std::filesystem::temp_directory_path() / "glb_loading.glb").string();
+        writeScene(filename);
+        std::cout << MESH_COUNT << " meshes, " << std::filesystem::file_size(filename) / (1024 * 1024) << " MB" << std::endl;
+
+        // The high water mark can not be reset on Windows, the mapped path runs first as it is expected to stay lower
+        const LoadResult mapped = measureLoad(filename, vkglTF::FileLoadingFlags::DontLoadImages);
+        const LoadResult streamed = measureLoad(filename, vkglTF::FileLoadingFlags::DontLoadImages | vkglTF::FileLoadingFlags::DontMapFile);
+
+        std::cout << "mapped:   " << mapped.milliseconds << " ms, peak RSS " << mapped.peakBytes / (1024 * 1024) << " MB (+"
+            << (mapped.peakBytes - mapped.baselineBytes) / (1024 * 1024) << " MB)" << std::endl;
+        std::cout << "ifstream: " << streamed.milliseconds << " ms, peak RSS " << streamed.peakBytes / (1024 * 1024) << " MB (+"
+            << (streamed.peakBytes - streamed.baselineBytes) / (1024 * 1024) << " MB)" << std::endl;
+
+        std::filesystem::remove(filename);
+    }
+
+private:
+    Window* m_window;
+    Device* m_device;
+
+    struct LoadResult {
+        double milliseconds = 0.0;
+        size_t baselineBytes = 0;
+        size_t peakBytes = 0;
+    };
+
+    LoadResult measureLoad(const std::string& filename, uint32_t fileLoadingFlags) {
+        LoadResult result;
+        resetPeakMemory();
+        result.baselineBytes = getResidentMemory();
+
+        vkglTF::VulkanglTFModel model;
+        const auto start = std::chrono::high_resolution_clock::now();
+        model.loadFromFile(filename, m_device, m_device->getGraphicsQueue(), fileLoadingFlags);
+        result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        result.peakBytes = getPeakMemory();
+
+        vkDeviceWaitIdle(m_device->getDevice());
+        model.destroy();
+        return result;
+    }
+
+#if defined(_WIN32)
+    void resetPeakMemory() {
+
+    }
+
+    size_t getResidentMemory() {
+        PROCESS_MEMORY_COUNTERS counters{};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.WorkingSetSize;
+    }
+
+    size_t getPeakMemory() {
+        PROCESS_MEMORY_COUNTERS counters{};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize;
+    }
+#else
+    // Writing 5 to clear_refs resets VmHWM
+    void resetPeakMemory() {
+        std::ofstream("/proc/self/clear_refs") << "5";
+    }
+
+    size_t getResidentMemory() {
+        return readStatus("VmRSS:");
+    }
+
+    size_t getPeakMemory() {
+        return readStatus("VmHWM:");
+    }
+
+    size_t readStatus(const std::string& field) {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, field.size(), field) == 0) {
+                return std::stoull(line.substr(field.size())) * 1024;
+            }
+        }
+        return 0;
+    }
+#endif
+
+    // MESH_COUNT grids with their own positions, normals, uvs and indices. The BIN chunk is written one mesh at a time
+    // so writing the file never holds all of it
+    void writeScene(const std::string& filename) {
+        const uint32_t vertexCount = GRID_SIZE * GRID_SIZE;
+        const uint32_t indexCount = (GRID_SIZE - 1) * (GRID_SIZE - 1) * 6;
+        const size_t positionBytes = size_t(vertexCount) * sizeof(glm::vec3);
+        const size_t uvBytes = size_t(vertexCount) * sizeof(glm::vec2);
+        const size_t indexBytes = size_t(indexCount) * sizeof(uint32_t);
+        const size_t meshBytes = positionBytes * 2 + uvBytes + indexBytes;
+
+        nlohmann::json bufferViews = nlohmann::json::array();
+        nlohmann::json accessors = nlohmann::json::array();
+        auto addAccessor = [&](size_t offset, size_t length, int target, int componentType, uint32_t count, const char* type) {
+            nlohmann::json bufferView;
+            bufferView["buffer"] = 0;
+            bufferView["byteOffset"] = offset;
+            bufferView["byteLength"] = length;
+            bufferView["target"] = target;
+            bufferViews.push_back(bufferView);
+
+            nlohmann::json accessor;
+            accessor["bufferView"] = bufferViews.size() - 1;
+            accessor["componentType"] = componentType;
+            accessor["count"] = count;
+            accessor["type"] = type;
+            accessors.push_back(accessor);
+            return accessors.size() - 1;
+        };
+
+        nlohmann::json meshes = nlohmann::json::array();
+        nlohmann::json nodes = nlohmann::json::array();
+        nlohmann::json sceneNodes = nlohmann::json::array();
+        for (uint32_t i = 0; i < MESH_COUNT; i++) {
+            const size_t base = i * meshBytes;
+            const size_t position = addAccessor(base, positionBytes, TINYGLTF_TARGET_ARRAY_BUFFER, TINYGLTF_COMPONENT_TYPE_FLOAT, vertexCount, "VEC3");
+            accessors[position]["min"] = { 0.0f, 0.0f, 0.0f };
+            accessors[position]["max"] = { 1.0f, 1.0f, float(i) };
+            const size_t normal = addAccessor(base + positionBytes, positionBytes, TINYGLTF_TARGET_ARRAY_BUFFER, TINYGLTF_COMPONENT_TYPE_FLOAT, vertexCount, "VEC3");
+            const size_t uv = addAccessor(base + positionBytes * 2, uvBytes, TINYGLTF_TARGET_ARRAY_BUFFER, TINYGLTF_COMPONENT_TYPE_FLOAT, vertexCount, "VEC2");
+            const size_t index = addAccessor(base + positionBytes * 2 + uvBytes, indexBytes, TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER, TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, indexCount, "SCALAR");
+
+            nlohmann::json primitive;
+            primitive["attributes"]["POSITION"] = position;
+            primitive["attributes"]["NORMAL"] = normal;
+            primitive["attributes"]["TEXCOORD_0"] = uv;
+            primitive["indices"] = index;
+            primitive["mode"] = TINYGLTF_MODE_TRIANGLES;
+            nlohmann::json mesh;
+            mesh["primitives"].push_back(primitive);
+            meshes.push_back(mesh);
+
+            nlohmann::json node;
+            node["mesh"] = i;
+            nodes.push_back(node);
+            sceneNodes.push_back(i);
+        }
+
+        nlohmann::json json;
+        json["asset"]["version"] = "2.0";
+        json["scene"] = 0;
+        json["scenes"].push_back({ { "nodes", sceneNodes } });
+        json["nodes"] = nodes;
+        json["meshes"] = meshes;
+        json["accessors"] = accessors;
+        json["bufferViews"] = bufferViews;
+        json["buffers"].push_back({ { "byteLength", meshBytes * MESH_COUNT } });
+
+        // Both chunks are 4 byte aligned, the JSON chunk is padded with spaces
+        std::string jsonChunk = json.dump();
+        jsonChunk.resize((jsonChunk.size() + 3) & ~size_t(3), ' ');
+        const size_t binLength = meshBytes * MESH_COUNT;
+
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("failed to write the generated scene!");
+        }
+        const uint32_t header[5] = { 0x46546C67, 2, uint32_t(12 + 8 + jsonChunk.size() + 8 + binLength), uint32_t(jsonChunk.size()), 0x4E4F534A };
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(jsonChunk.data(), jsonChunk.size());
+        const uint32_t binHeader[2] = { uint32_t(binLength), 0x004E4942 };
+        file.write(reinterpret_cast<const char*>(binHeader), sizeof(binHeader));
+
+        std::vector<glm::vec3> positions(vertexCount);
+        std::vector<glm::vec3> normals(vertexCount, glm::vec3(0.0f, 0.0f, 1.0f));
+        std::vector<glm::vec2> uvs(vertexCount);
+        std::vector<uint32_t> indices;
+        indices.reserve(indexCount);
+        for (uint32_t y = 0; y < GRID_SIZE - 1; y++) {
+            for (uint32_t x = 0; x < GRID_SIZE - 1; x++) {
+                const uint32_t corner = y * GRID_SIZE + x;
+                indices.insert(indices.end(), { corner, corner + 1, corner + GRID_SIZE, corner + 1, corner + GRID_SIZE + 1, corner + GRID_SIZE });
+            }
+        }
+        for (uint32_t i = 0; i < MESH_COUNT; i++) {
+            for (uint32_t v = 0; v < vertexCount; v++) {
+                uvs[v] = glm::vec2(v % GRID_SIZE, v / GRID_SIZE) / float(GRID_SIZE - 1);
+                positions[v] = glm::vec3(uvs[v], float(i));
+            }
+            file.write(reinterpret_cast<const char*>(positions.data()), positionBytes);
+            file.write(reinterpret_cast<const char*>(normals.data()), positionBytes);
+            file.write(reinterpret_cast<const char*>(uvs.data()), uvBytes);
+            file.write(reinterpret_cast<const char*>(indices.data()), indexBytes);
+        }
+        if (!file) {
+            throw std::runtime_error("failed to write the generated scene!");
+        }
+    }
+};
+
+App* create_application()
+{
+    return new Test_GlbLoading();
+}
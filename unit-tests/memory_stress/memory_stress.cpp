@@ -0,0 +1,137 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+// Enable the WSI extensions
+#if defined(__ANDROID__)
+#define VK_USE_PLATFORM_ANDROID_KHR
+#elif defined(__linux__)
+#define VK_USE_PLATFORM_XLIB_KHR
+#elif defined(_WIN32)
+#define VK_USE_PLATFORM_WIN32_KHR
+#endif
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include "pch.h"
+#include "app.h"
+#include <random>
+
+#define THREAD_COUNT 16
+#define BUFFER_COUNT 100000
+
+// Creates and destroys small buffers from many threads at once, then from one, and prints the throughput of both
+class Test_MemoryStress : public App {
+public:
+    Test_MemoryStress() {
+        vkHelper::addDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    ~Test_MemoryStress() {
+        delete m_device;
+        m_window->destroy();
+        delete m_window;
+    }
+
+    void getEnabledFeatures() override {
+
+    }
+
+    bool init() override {
+        m_window = new Window();
+        m_window->create(WIDTH, HEIGHT);
+
+        std::function<void()> getfeatures = [&]() { getEnabledFeatures(); };
+        m_device = new Device();
+        m_device->create(m_window, vkHelper::getInstanceExtensions(), vkHelper::getDeviceExtensions(), getfeatures);
+        return true;
+    }
+
+    void update(float deltaTime) override {
+
+    }
+
+    void render() override {
+
+    }
+
+    void run() override {
+        runPass("1 thread", 1);
+        runPass(std::to_string(THREAD_COUNT) + " threads", THREAD_COUNT);
+        std::cout << m_device->getAllocator().getMemoryReport();
+        vkDeviceWaitIdle(m_device->getDevice());
+    }
+
+private:
+    Window* m_window;
+    Device* m_device;
+
+    struct Resource {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        memory::Allocation allocation;
+    };
+
+    // Every thread creates its share of the buffers, a third of them host visible and written through the mapping
+    void createBuffers(std::vector<Resource>& resources, uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<uint32_t> sizeDist(256, 4096);
+        for (size_t i = 0; i < resources.size(); i++) {
+            const VkDeviceSize size = sizeDist(rng);
+            const bool hostVisible = i % 3 == 0;
+            buffer::createBuffer(
+                m_device,
+                size,
+                hostVisible ? VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT : VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                hostVisible ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                VK_SHARING_MODE_EXCLUSIVE,
+                &resources[i].buffer,
+                &resources[i].allocation);
+            if (hostVisible) {
+                memset(resources[i].allocation.mapped, static_cast<int>(i), size);
+            }
+        }
+    }
+
+    void destroyBuffers(std::vector<Resource>& resources) {
+        for (Resource& resource : resources) {
+            vkDestroyBuffer(m_device->getDevice(), resource.buffer, nullptr);
+            memory::free(resource.allocation);
+        }
+    }
+
+    void runPass(const std::string& name, uint32_t threadCount) {
+        std::vector<std::vector<Resource>> resources(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++) {
+            resources[i].resize(BUFFER_COUNT / threadCount);
+        }
+
+        auto runThreads = [&](std::function<void(uint32_t)> work) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            std::vector<std::thread> threads;
+            for (uint32_t i = 0; i < threadCount; i++) {
+                threads.emplace_back(work, i);
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        };
+
+        const double createSeconds = runThreads([&](uint32_t i) { createBuffers(resources[i], i + 1); });
+        const memory::Allocator::Stats stats = m_device->getAllocator().getStats();
+        const double destroySeconds = runThreads([&](uint32_t i) { destroyBuffers(resources[i]); });
+
+        const double count = double(BUFFER_COUNT / threadCount * threadCount);
+        std::cout << name << ": created " << uint64_t(count) << " buffers in " << createSeconds * 1000.0 << " ms ("
+            << uint64_t(count / createSeconds) << " buffers/s), destroyed in " << destroySeconds * 1000.0 << " ms ("
+            << uint64_t(count / destroySeconds) << " buffers/s), " << stats.blocks << " blocks, "
+            << stats.deviceMemoryCount << " device memory allocations" << std::endl;
+    }
+};
+
+App* create_application()
+{
+    return new Test_MemoryStress();
+}
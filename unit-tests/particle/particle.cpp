@@ -72,7 +72,8 @@ private:
     float animStart = 20.0f;
 
     VkPipelineLayout m_pipelineLayout;
-    VkPipeline m_pipeline;
+    // Compiles on the pipeline queue along with the compute pipeline
+    PipelineQueue::Handle m_pipeline;
 
     struct DescriptorSetLayouts
     {
@@ -166,7 +167,6 @@ private:
         initDescriptorSet();
         initPipelines();
         initCompute();
-        buildCommandBuffers();
     }
 
     void loadAssets() {
@@ -237,8 +237,11 @@ private:
             vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
         }
 
-        // Create pipeline
-        compute.pipeline = m_device->createComputePipeline(m_device->getDevice(), "../../data/shaders/particle.comp.spv", compute.pipelineLayout);
+        // Create pipeline, collected before the dispatch is recorded
+        PipelineQueue::ComputePipelineDesc computePipelineDesc;
+        computePipelineDesc.computeShaderFile = "../../data/shaders/particle.comp.spv";
+        computePipelineDesc.pipelineLayout = compute.pipelineLayout;
+        PipelineQueue::Handle computePipeline = m_device->getPipelineQueue().submit(computePipelineDesc);
 
         // Separate command pool as queue family for compute
         VkCommandPoolCreateInfo cmdPoolInfo{};
@@ -262,6 +265,7 @@ private:
         VK_CHECK(vkQueueWaitIdle(m_device->getGraphicsQueue()));
 
         // Build a single command buffer containing the compute dispatch commands
+        compute.pipeline = computePipeline.wait();
         buildComputeCommandBuffer();
 
         // If graphics and compute queue family indices differ, acquire and immediately release the storage buffer, so that the initial acquire from the graphics command buffers are matched up properly
@@ -606,24 +610,31 @@ private:
         colorBlending.blendConstants[2] = 0.0f;
         colorBlending.blendConstants[3] = 0.0f;
 
-        std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.pDynamicStates = dynamicStates.data();
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());;
+        PipelineQueue::GraphicsPipelineDesc desc;
+        desc.vertexShaderFile = "../../data/shaders/particle.vert.spv";
+        desc.pixelShaderFile = "../../data/shaders/particle.frag.spv";
+        desc.vertexInputState = vertexInputState;
+        desc.inputAssemblyState = inputAssembly;
+        desc.viewportState = viewport;
+        desc.rasterizationState = rasterizer;
+        desc.multisampleState = multisampling;
+        desc.depthStencilState = depthStencil;
+        desc.colorBlendState = colorBlending;
+        desc.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        desc.pipelineLayout = m_pipelineLayout;
+        desc.renderPass = m_device->getRenderPass();
 
         // Solid rendering pipeline
-        std::vector<ShaderStage> shaderStages_particle = m_device->createShader(m_device->getDevice(), "../../data/shaders/particle.vert.spv", "../../data/shaders/particle.frag.spv");
-        m_pipeline = m_device->createGraphicsPipeline(m_device->getDevice(), m_device->getPipelineCache(), shaderStages_particle, vertexInputState, inputAssembly, viewport, rasterizer, multisampling, depthStencil, colorBlending, dynamicState, m_pipelineLayout, m_device->getRenderPass());
-
-        for (auto shaderStage : shaderStages_particle)
-            vkDestroyShaderModule(m_device->getDevice(), shaderStage.module, nullptr);
+        m_pipeline = m_device->getPipelineQueue().submit(desc);
     }
 
-    void buildCommandBuffers()
+    // Records the command buffer of the current frame, drawing to imageIndex. Only the queue family barriers change
+    // from frame to frame, the particle draw is static
+    void buildCommandBuffer(uint32_t imageIndex)
     {
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
         beginInfo.pInheritanceInfo = nullptr;
 
         VkRenderPassBeginInfo renderPassInfo{};
@@ -638,44 +649,49 @@ private:
 
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
+        renderPassInfo.framebuffer = m_device->getFramebuffers()[imageIndex];
+
+        VkCommandBuffer currentCB = m_device->getCurrentCommandBuffer();
+        if (vkBeginCommandBuffer(currentCB, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
 
-        for (size_t i = 0; i < m_device->getCommandBuffers().size(); ++i)
+        // Acquire barrier
+        if (graphicsFamilyIndex != compute.queueFamilyIndex)
         {
-            renderPassInfo.framebuffer = m_device->getFramebuffers()[i];
-            VkDeviceSize offsets[1] = { 0 };
+            VkBufferMemoryBarrier buffer_barrier =
+            {
+                VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                nullptr,
+                0,
+                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                compute.queueFamilyIndex,
+                graphicsFamilyIndex,
+                compute.storageBuffer.buffer,
+                0,
+                compute.storageBuffer.bufferSize
+            };
 
-            VkCommandBuffer currentCB = m_device->m_commandBuffers[i];
-            if (vkBeginCommandBuffer(currentCB, &beginInfo) != VK_SUCCESS) {
-                throw std::runtime_error("failed to begin recording command buffer!");
-            }
+            vkCmdPipelineBarrier(
+                currentCB,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                0,
+                0, nullptr,
+                1, &buffer_barrier,
+                0, nullptr);
+        }
 
-            // Acquire barrier
-            if (graphicsFamilyIndex != compute.queueFamilyIndex)
-            {
-                VkBufferMemoryBarrier buffer_barrier =
-                {
-                    VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-                    nullptr,
-                    0,
-                    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                    compute.queueFamilyIndex,
-                    graphicsFamilyIndex,
-                    compute.storageBuffer.buffer,
-                    0,
-                    compute.storageBuffer.bufferSize
-                };
-
-                vkCmdPipelineBarrier(
-                    currentCB,
-                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-                    0,
-                    0, nullptr,
-                    1, &buffer_barrier,
-                    0, nullptr);
-            }
+        vkCmdBeginRenderPass(currentCB, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-            vkCmdBeginRenderPass(currentCB, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = m_device->getRenderPass();
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
+
+        m_device->executeStaticCommands(currentCB, imageIndex, inheritanceInfo, [&](VkCommandBuffer commandBuffer) {
+            VkDeviceSize offsets[1] = { 0 };
 
             VkViewport viewport{};
             viewport.width = (float)WIDTH;
@@ -684,64 +700,62 @@ private:
             viewport.maxDepth = 1.0f;
             viewport.x = 0;
             viewport.y = 0;
-            //viewport.y = viewport.height;
-            vkCmdSetViewport(currentCB, 0, 1, &viewport);
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
             VkRect2D scissor{};
             scissor.extent = { WIDTH, HEIGHT };
-            vkCmdSetScissor(currentCB, 0, 1, &scissor);
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-            {
-                vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-                vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, NULL);
-
-                glm::vec2 screendim = glm::vec2((float)WIDTH, (float)HEIGHT);
-                vkCmdPushConstants(
-                    currentCB,
-                    m_pipelineLayout,
-                    VK_SHADER_STAGE_VERTEX_BIT,
-                    0,
-                    sizeof(glm::vec2),
-                    &screendim);
-                vkCmdBindVertexBuffers(currentCB, PARTICLE_VERTEX_BUFFER_BIND_ID, 1, &compute.storageBuffer.buffer, offsets);
-                vkCmdDraw(currentCB, PARTICLE_COUNT, 1, 0, 0);
-            }
+            // Recorded once per image, the first recording waits for the compile
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline.wait());
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, NULL);
+
+            glm::vec2 screendim = glm::vec2((float)WIDTH, (float)HEIGHT);
+            vkCmdPushConstants(
+                commandBuffer,
+                m_pipelineLayout,
+                VK_SHADER_STAGE_VERTEX_BIT,
+                0,
+                sizeof(glm::vec2),
+                &screendim);
+            vkCmdBindVertexBuffers(commandBuffer, PARTICLE_VERTEX_BUFFER_BIND_ID, 1, &compute.storageBuffer.buffer, offsets);
+            vkCmdDraw(commandBuffer, PARTICLE_COUNT, 1, 0, 0);
+        });
+
+        vkCmdEndRenderPass(currentCB);
 
-            //auto update_gui = std::bind(&Test_Particle::updateGUI, this);
-            vkCmdEndRenderPass(currentCB);
-            
-            // Release barrier
-            if (graphicsFamilyIndex != compute.queueFamilyIndex)
+        // Release barrier
+        if (graphicsFamilyIndex != compute.queueFamilyIndex)
+        {
+            VkBufferMemoryBarrier buffer_barrier =
             {
-                VkBufferMemoryBarrier buffer_barrier =
-                {
-                    VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-                    nullptr,
-                    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                    0,
-                    graphicsFamilyIndex,
-                    compute.queueFamilyIndex,
-                    compute.storageBuffer.buffer,
-                    0,
-                    compute.storageBuffer.bufferSize
-                };
-
-                vkCmdPipelineBarrier(
-                    currentCB,
-                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                    0,
-                    0, nullptr,
-                    1, &buffer_barrier,
-                    0, nullptr);
-            }
-            VK_CHECK(vkEndCommandBuffer(currentCB));
+                VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                nullptr,
+                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                0,
+                graphicsFamilyIndex,
+                compute.queueFamilyIndex,
+                compute.storageBuffer.buffer,
+                0,
+                compute.storageBuffer.bufferSize
+            };
+
+            vkCmdPipelineBarrier(
+                currentCB,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0,
+                0, nullptr,
+                1, &buffer_barrier,
+                0, nullptr);
         }
+        VK_CHECK(vkEndCommandBuffer(currentCB));
     }
 
     void render() override {
         auto tStart = std::chrono::high_resolution_clock::now();
 
+        m_device->beginFrame();
         drawFrame();
         frameCounter++;
         auto tEnd = std::chrono::high_resolution_clock::now();
@@ -771,9 +785,6 @@ private:
     }
 
     void drawFrame() {
-        vkWaitForFences(m_device->getDevice(), 1, &m_device->m_waitFences[m_device->getCurrentFrame()], VK_TRUE, UINT64_MAX);
-        vkResetFences(m_device->getDevice(), 1, &m_device->m_waitFences[m_device->getCurrentFrame()]);
-
         uint32_t imageIndex;
         VkResult result = vkAcquireNextImageKHR(m_device->getDevice(), m_device->getSwapChain(), UINT64_MAX, m_device->m_imageAvailableSemaphores[m_device->getCurrentFrame()], VK_NULL_HANDLE, &imageIndex);
 
@@ -788,6 +799,10 @@ private:
             vkWaitForFences(m_device->getDevice(), 1, &m_device->m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
         }
         m_device->m_imagesInFlight[imageIndex] = m_device->m_waitFences[m_device->getCurrentFrame()];
+        vkResetFences(m_device->getDevice(), 1, &m_device->m_waitFences[m_device->getCurrentFrame()]);
+
+        buildCommandBuffer(imageIndex);
+        VkCommandBuffer commandBuffer = m_device->getCurrentCommandBuffer();
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -798,7 +813,7 @@ private:
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &m_device->m_commandBuffers[imageIndex];
+        submitInfo.pCommandBuffers = &commandBuffer;
 
         VkSemaphore signalSemaphores[] = { m_device->m_renderFinishedSemaphores[m_device->getCurrentFrame()] };
         submitInfo.signalSemaphoreCount = 1;
@@ -833,7 +848,7 @@ private:
         vkDestroySampler(m_device->getDevice(), m_defaultSampler, nullptr);
         vkDestroyDescriptorSetLayout(m_device->getDevice(), descriptorSetLayouts.particle, nullptr);
 
-        vkDestroyPipeline(m_device->getDevice(), m_pipeline, nullptr);
+        vkDestroyPipeline(m_device->getDevice(), m_pipeline.wait(), nullptr);
         vkDestroyPipelineLayout(m_device->getDevice(), m_pipelineLayout, nullptr);
     }
 
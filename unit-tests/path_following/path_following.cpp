@@ -61,10 +61,12 @@ private:
     Device* m_device;
     Camera* m_camera;
 
+    // Uniform blocks come from the frame allocator, one set of each serves every frame
     struct DescriptorSets {
         VkDescriptorSet scene;
         VkDescriptorSet debug;
-    };
+        VkDescriptorSet node;
+    } descriptorSets;
 
     VkPipelineLayout m_pipelineLayout;
 
@@ -72,10 +74,11 @@ private:
     vkglTF::VulkanglTFModel meshModel;
     vkglTF::VulkanglTFModel cubeModel;
 
+    // Compiled on the pipeline queue while the debug geometry is set up, the model is left out until they are ready
     struct Pipelines
     {
-        VkPipeline solid;
-        VkPipeline enable_wireframe = VK_NULL_HANDLE;
+        PipelineQueue::Handle solid;
+        PipelineQueue::Handle enable_wireframe;
     } pipelines;
 
     struct DescriptorSetLayouts
@@ -85,12 +88,6 @@ private:
         VkDescriptorSetLayout node;
     } descriptorSetLayouts;
 
-    struct UniformBufferSet {
-        Buffer scene;
-        Buffer params;
-        Buffer debug;
-    };
-
     struct UBOMatrices {
         glm::mat4 projection = glm::mat4(1.0f);
         glm::mat4 model = glm::mat4(1.0f);
@@ -98,8 +95,8 @@ private:
         glm::vec3 camPos = glm::vec3(0.0f);
     }shaderValuesScene, shaderValuesDebug;
 
-    std::vector<DescriptorSets> descriptorSets;
-    std::vector<UniformBufferSet> uniformBuffers;
+    // Frame allocator offsets of shaderValuesScene and shaderValuesParams for the command buffer being recorded
+    std::array<uint32_t, 2> sceneDynamicOffsets;
 
     struct shaderValuesParams {
         glm::vec4 lightDir = glm::vec4(10.0f, 10.0f, 10.0f, 1.0f);
@@ -136,6 +133,9 @@ private:
     TextureObject checkerboardTexture;
     VkSampler m_defaultSampler;
 
+    // No skybox here, the scene is still lit by the environment
+    ImageBasedLighting m_ibl;
+
     struct SpecularFilterPushConstants
     {
         uint32_t level = 1;
@@ -207,12 +207,10 @@ private:
         gui = new Gui();
         gui->init(m_device);
 
-        uniformBuffers.resize(m_device->getSwapChainimages().size());
-        descriptorSets.resize(m_device->getSwapChainimages().size());
-
         loadAssets();
-        initUniformBuffers();
         initDescriptorPool();
+        initDescriptorSetLayout();
+        initPipelines();
 
         // Debug Line Segment
         meshModel.debug_line_segment = new LineSegment(m_device);
@@ -225,13 +223,13 @@ private:
         spline->calculateAdaptiveTable(_t1, _t2, _t3);
         spline->init();
 
-        initDescriptorSetLayout();
         initDescriptorSet();
-        initPipelines();
-        buildCommandBuffers();
     }
 
     void loadAssets() {
+        // Mips of the textures come from the compute downsampler where the device has it, blits otherwise
+        meshModel.mipGenerator = m_device->getMipGenerator();
+        cubeModel.mipGenerator = m_device->getMipGenerator();
         meshModel.loadFromFile("../../data/models/glTF-Embedded/CesiumMan.gltf", m_device, m_device->getGraphicsQueue());
         cubeModel.loadFromFile("../../data/models/glTF-Embedded/Box.gltf", m_device, m_device->getGraphicsQueue());
 
@@ -255,6 +253,9 @@ private:
 
         emptyTexture = texture::loadTexture("../../data/textures/empty.jpg", VK_FORMAT_R8G8B8A8_UNORM, m_device, 4);
         checkerboardTexture = texture::loadTexture("../../data/textures/checkerboard.png", VK_FORMAT_R8G8B8A8_UNORM, m_device, 4);
+
+        m_ibl.create(m_device, "../../data/textures/cubemap_yokohama_rgba.ktx", "../../data/textures/ibl_cache");
+        shaderValuesParams.prefilteredCubeMipLevels = m_ibl.prefilteredMaxLod();
     }
 
     void initSpline() {
@@ -286,33 +287,6 @@ private:
 
     }
 
-    void initUniformBuffers() {
-
-        for (auto& uniformBuffer : uniformBuffers) {
-            uniformBuffer.scene = buffer::createBuffer(
-                m_device,
-                sizeof(shaderValuesScene),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-            );
-            memory::map(m_device->getDevice(), uniformBuffer.scene.memory, 0, uniformBuffer.scene.bufferSize, &uniformBuffer.scene.mapped);
-            uniformBuffer.debug = buffer::createBuffer(
-                m_device,
-                sizeof(shaderValuesDebug),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-            );
-            memory::map(m_device->getDevice(), uniformBuffer.debug.memory, 0, uniformBuffer.debug.bufferSize, &uniformBuffer.debug.mapped);
-            uniformBuffer.params = buffer::createBuffer(
-                m_device,
-                sizeof(shaderValuesParams),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-            );
-            memory::map(m_device->getDevice(), uniformBuffer.params.memory, 0, uniformBuffer.params.bufferSize, &uniformBuffer.params.mapped);
-        }
-    }
-
     float ParametricBlend(float t)
     {
         float sqt = t * t;
@@ -401,7 +375,6 @@ private:
     {
         uint32_t imageSamplerCount = 0;
         uint32_t materialCount = 0;
-        uint32_t meshCount = 0;
 
         std::vector<vkglTF::VulkanglTFModel*> modellist = { &meshModel, &cubeModel };
         for (auto& model : modellist) {
@@ -409,22 +382,21 @@ private:
                 imageSamplerCount += 5;
                 materialCount++;
             }
-            for (auto node : model->linearNodes) {
-                if (node->mesh) {
-                    meshCount++;
-                }
-            }
         }
 
+        // Irradiance, prefiltered and BRDF LUT of the scene set
+        imageSamplerCount += 3;
+
+        // Scene, debug, node, spline and line segment sets
         std::vector<VkDescriptorPoolSize> poolSizes = {
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, (4 + meshCount) * (uint32_t)m_device->getSwapChainimages().size() },
-            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageSamplerCount * (uint32_t)m_device->getSwapChainimages().size()}
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 8 },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageSamplerCount }
         };
 
         m_device->m_descriptorPool = m_device->createDescriptorPool(
             m_device->getDevice(),
             poolSizes,
-            (2 + materialCount + meshCount) * (uint32_t)m_device->getSwapChainimages().size()
+            5 + materialCount
         );
     }
 
@@ -432,8 +404,11 @@ private:
         // Scene
         {
             std::vector<DescriptorSetLayoutBinding> sceneLayoutBindings = {
-                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
-                { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
             };
             descriptorSetLayouts.scene = m_device->createDescriptorSetLayout(m_device->getDevice(), { sceneLayoutBindings });
         }
@@ -448,21 +423,16 @@ private:
             };
             descriptorSetLayouts.materials = m_device->createDescriptorSetLayout(m_device->getDevice(), { materialLayoutBindings });
         }
-        // Model node (matrices)
+        // Model node (matrices and joints)
         {
             std::vector<DescriptorSetLayoutBinding> nodeSetLayoutBindings = {
-                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+                { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
             };
             descriptorSetLayouts.node = m_device->createDescriptorSetLayout(m_device->getDevice(), { nodeSetLayoutBindings });
 
-            // Per-Node descriptor set
-            for (auto& node : meshModel.nodes) {
-                meshModel.initNodeDescriptor(node, descriptorSetLayouts.node);
-            }
-
-            for (auto& node : cubeModel.nodes) {
-                cubeModel.initNodeDescriptor(node, descriptorSetLayouts.node);
-            }
+            // Shared by the meshes of both models, each draw passes the offset of its own block
+            descriptorSets.node = vkglTF::createNodeDescriptorSet(m_device, descriptorSetLayouts.node);
         }
 
         VkPushConstantRange pushConstantRange{};
@@ -475,45 +445,62 @@ private:
 
     void initDescriptorSet()
     {
+        const VkDescriptorBufferInfo sceneBufferInfo = m_device->getFrameAllocator().getDescriptor(sizeof(shaderValuesScene));
+        const VkDescriptorBufferInfo paramsBufferInfo = m_device->getFrameAllocator().getDescriptor(sizeof(shaderValuesParams));
+
         // Scene
-        for (auto i = 0; i < descriptorSets.size(); i++) {
-            descriptorSets[i].scene = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.scene);
-            std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+        {
+            descriptorSets.scene = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.scene);
+            std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
 
             writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeDescriptorSets[0].descriptorCount = 1;
-            writeDescriptorSets[0].dstSet = descriptorSets[i].scene;
+            writeDescriptorSets[0].dstSet = descriptorSets.scene;
             writeDescriptorSets[0].dstBinding = 0;
-            writeDescriptorSets[0].pBufferInfo = &uniformBuffers[i].scene.descriptor;
+            writeDescriptorSets[0].pBufferInfo = &sceneBufferInfo;
 
             writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeDescriptorSets[1].descriptorCount = 1;
-            writeDescriptorSets[1].dstSet = descriptorSets[i].scene;
+            writeDescriptorSets[1].dstSet = descriptorSets.scene;
             writeDescriptorSets[1].dstBinding = 1;
-            writeDescriptorSets[1].pBufferInfo = &uniformBuffers[i].params.descriptor;
+            writeDescriptorSets[1].pBufferInfo = &paramsBufferInfo;
+
+            const std::array<VkDescriptorImageInfo, 3> iblImageInfos = {
+                m_ibl.irradiance.getDescriptorImageInfo(),
+                m_ibl.prefiltered.getDescriptorImageInfo(),
+                m_ibl.brdfLut.getDescriptorImageInfo(),
+            };
+            for (uint32_t j = 0; j < iblImageInfos.size(); j++) {
+                writeDescriptorSets[2 + j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writeDescriptorSets[2 + j].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                writeDescriptorSets[2 + j].descriptorCount = 1;
+                writeDescriptorSets[2 + j].dstSet = descriptorSets.scene;
+                writeDescriptorSets[2 + j].dstBinding = 2 + j;
+                writeDescriptorSets[2 + j].pImageInfo = &iblImageInfos[j];
+            }
 
             vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
         }
         // Debug Bone
-        for (auto i = 0; i < descriptorSets.size(); i++) {
-            descriptorSets[i].debug = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.scene);
+        {
+            descriptorSets.debug = m_device->createDescriptorSet(m_device->getDevice(), m_device->getDescriptorPool(), descriptorSetLayouts.scene);
             std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
 
             writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeDescriptorSets[0].descriptorCount = 1;
-            writeDescriptorSets[0].dstSet = descriptorSets[i].debug;
+            writeDescriptorSets[0].dstSet = descriptorSets.debug;
             writeDescriptorSets[0].dstBinding = 0;
-            writeDescriptorSets[0].pBufferInfo = &uniformBuffers[i].debug.descriptor;
+            writeDescriptorSets[0].pBufferInfo = &sceneBufferInfo;
 
             writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeDescriptorSets[1].descriptorCount = 1;
-            writeDescriptorSets[1].dstSet = descriptorSets[i].debug;
+            writeDescriptorSets[1].dstSet = descriptorSets.debug;
             writeDescriptorSets[1].dstBinding = 1;
-            writeDescriptorSets[1].pBufferInfo = &uniformBuffers[i].params.descriptor;
+            writeDescriptorSets[1].pBufferInfo = &paramsBufferInfo;
 
             vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
         }
@@ -667,30 +654,35 @@ private:
         colorBlending.blendConstants[2] = 0.0f;
         colorBlending.blendConstants[3] = 0.0f;
 
-        std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.pDynamicStates = dynamicStates.data();
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());;
+        PipelineQueue::GraphicsPipelineDesc desc;
+        desc.vertexShaderFile = "../../data/shaders/pbr.vert.spv";
+        desc.pixelShaderFile = "../../data/shaders/pbr.frag.spv";
+        desc.vertexInputState = vertexInputState;
+        desc.inputAssemblyState = inputAssembly;
+        desc.viewportState = viewport;
+        desc.rasterizationState = rasterizer;
+        desc.multisampleState = multisampling;
+        desc.depthStencilState = depthStencil;
+        desc.colorBlendState = colorBlending;
+        desc.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        desc.pipelineLayout = m_pipelineLayout;
+        desc.renderPass = m_device->getRenderPass();
 
         // Solid rendering pipeline
-        std::vector<ShaderStage> shaderStages_mesh = m_device->createShader(m_device->getDevice(), "../../data/shaders/pbr.vert.spv", "../../data/shaders/pbr.frag.spv");
-        pipelines.solid = m_device->createGraphicsPipeline(m_device->getDevice(), m_device->getPipelineCache(), shaderStages_mesh, vertexInputState, inputAssembly, viewport, rasterizer, multisampling, depthStencil, colorBlending, dynamicState, m_pipelineLayout, m_device->getRenderPass());
+        pipelines.solid = m_device->getPipelineQueue().submit(desc);
 
         // Wire frame rendering pipeline
-        //if (enable_wireframe) {
-        rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
-        rasterizer.lineWidth = 1.0f;
-        pipelines.enable_wireframe = m_device->createGraphicsPipeline(m_device->getDevice(), m_device->getPipelineCache(), shaderStages_mesh, vertexInputState, inputAssembly, viewport, rasterizer, multisampling, depthStencil, colorBlending, dynamicState, m_pipelineLayout, m_device->getRenderPass());
-        //}
-        for (auto shaderStage : shaderStages_mesh)
-            vkDestroyShaderModule(m_device->getDevice(), shaderStage.module, nullptr);
+        desc.rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
+        desc.rasterizationState.lineWidth = 1.0f;
+        pipelines.enable_wireframe = m_device->getPipelineQueue().submit(desc);
     }
 
-    void buildCommandBuffers()
+    // Records the command buffer of the current frame, drawing to imageIndex
+    void buildCommandBuffer(uint32_t imageIndex)
     {
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
         beginInfo.pInheritanceInfo = nullptr;
 
         VkRenderPassBeginInfo renderPassInfo{};
@@ -706,34 +698,38 @@ private:
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
 
-        for (size_t i = 0; i < m_device->getCommandBuffers().size(); ++i)
-        {
-            renderPassInfo.framebuffer = m_device->getFramebuffers()[i];
-            VkDeviceSize offsets[1] = { 0 };
+        renderPassInfo.framebuffer = m_device->getFramebuffers()[imageIndex];
+        VkDeviceSize offsets[1] = { 0 };
 
-            VkCommandBuffer currentCB = m_device->m_commandBuffers[i];
-            if (vkBeginCommandBuffer(currentCB, &beginInfo) != VK_SUCCESS) {
-                throw std::runtime_error("failed to begin recording command buffer!");
-            }
+        VkCommandBuffer currentCB = m_device->getCurrentCommandBuffer();
+        if (vkBeginCommandBuffer(currentCB, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+        sceneDynamicOffsets = {
+            m_device->getFrameAllocator().push(shaderValuesScene),
+            m_device->getFrameAllocator().push(shaderValuesParams),
+        };
 
-            vkCmdBeginRenderPass(currentCB, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(currentCB, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-            VkViewport viewport{};
-            viewport.width = (float)WIDTH;
-            viewport.height = (float)HEIGHT;
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            viewport.x = 0;
-            viewport.y = 0;
-            //viewport.y = viewport.height;
-            vkCmdSetViewport(currentCB, 0, 1, &viewport);
+        VkViewport viewport{};
+        viewport.width = (float)WIDTH;
+        viewport.height = (float)HEIGHT;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        viewport.x = 0;
+        viewport.y = 0;
+        //viewport.y = viewport.height;
+        vkCmdSetViewport(currentCB, 0, 1, &viewport);
 
-            VkRect2D scissor{};
-            scissor.extent = { WIDTH, HEIGHT };
-            vkCmdSetScissor(currentCB, 0, 1, &scissor);
+        VkRect2D scissor{};
+        scissor.extent = { WIDTH, HEIGHT };
+        vkCmdSetScissor(currentCB, 0, 1, &scissor);
 
-            // Model
-            vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, enable_wireframe ? pipelines.enable_wireframe : pipelines.solid);
+        // Model
+        const VkPipeline pipeline = enable_wireframe ? pipelines.enable_wireframe.get() : pipelines.solid.get();
+        if (pipeline != VK_NULL_HANDLE) {
+            vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
             vkCmdBindVertexBuffers(currentCB, 0, 1, &meshModel.vertices.buffer, offsets);
             if (meshModel.indices.count > 0) {
                 vkCmdBindIndexBuffer(currentCB, meshModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
@@ -741,42 +737,43 @@ private:
 
             // Opaque primitives first
             for (auto node : meshModel.nodes) {
-                renderNode(node, i, vkglTF::Material::ALPHAMODE_OPAQUE);
+                renderNode(node, currentCB, vkglTF::Material::ALPHAMODE_OPAQUE);
             }
+        }
 
-            // Draw Spline
-            spline->updateUniformBuffer(m_camera, glm::mat4(1.0f), false);
-            if (enable_debug_spline)
-                spline->drawSpline(currentCB);
+        // Draw Spline
+        spline->updateUniformBuffer(m_camera, glm::mat4(1.0f), false);
+        if (enable_debug_spline)
+            spline->drawSpline(currentCB);
 
-            spline->updateUniformBuffer(m_camera, glm::mat4(1.0f), true);
-            if (enable_debug_control_points)
-                spline->drawControlPoints(currentCB);
+        spline->updateUniformBuffer(m_camera, glm::mat4(1.0f), true);
+        if (enable_debug_control_points)
+            spline->drawControlPoints(currentCB);
 
-            // Draw Joints
-            if (enable_debug_joints)
-                meshModel.drawJoint(currentCB);
+        // Draw Joints
+        if (enable_debug_joints)
+            meshModel.drawJoint(currentCB);
 
-            auto update_gui = std::bind(&Test_Path_Following::updateGUI, this);
-            vkCmdEndRenderPass(currentCB);
-            gui->render(update_gui);
-            vkEndCommandBuffer(currentCB);
-        }
+        auto update_gui = std::bind(&Test_Path_Following::updateGUI, this);
+        vkCmdEndRenderPass(currentCB);
+        gui->render(update_gui);
+        vkEndCommandBuffer(currentCB);
     }
 
-    void renderNode(vkglTF::Node* node, uint32_t cbIndex, vkglTF::Material::AlphaMode alphaMode) {
+    void renderNode(vkglTF::Node* node, VkCommandBuffer commandBuffer, vkglTF::Material::AlphaMode alphaMode) {
         if (node->mesh) {
             // Render mesh primitives
             for (vkglTF::Primitive* primitive : node->mesh->primitives) {
                 if (primitive->material.alphaMode == alphaMode) {
 
                     const std::vector<VkDescriptorSet> descriptorsets = {
-                        descriptorSets[cbIndex].scene,
+                        descriptorSets.scene,
                         primitive->material.descriptorSet,
-                        node->mesh->uniformBuffer.descriptorSet,
+                        descriptorSets.node,
                     };
-                    auto commandBuffers = m_device->getCommandBuffers();
-                    vkCmdBindDescriptorSets(commandBuffers[cbIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 0, NULL);
+                    const vkglTF::Mesh::DynamicOffsets nodeOffsets = node->pushUniformBlock();
+                    const std::array<uint32_t, 4> dynamicOffsets = { sceneDynamicOffsets[0], sceneDynamicOffsets[1], nodeOffsets[0], nodeOffsets[1] };
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
 
                     // Pass material parameters as push constants
                     PushConstBlockMaterial pushConstBlockMaterial{};
@@ -809,33 +806,32 @@ private:
                         pushConstBlockMaterial.specularFactor = glm::vec4(primitive->material.extension.specularFactor, 1.0f);
                     }
 
-                    vkCmdPushConstants(commandBuffers[cbIndex], m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlockMaterial), &pushConstBlockMaterial);
+                    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlockMaterial), &pushConstBlockMaterial);
 
                     if (primitive->hasIndices) {
-                        vkCmdDrawIndexed(commandBuffers[cbIndex], primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+                        vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
                     }
                     else {
-                        vkCmdDraw(commandBuffers[cbIndex], primitive->vertexCount, 1, 0, 0);
+                        vkCmdDraw(commandBuffer, primitive->vertexCount, 1, 0, 0);
                     }
                 }
             }
         };
         for (auto child : node->children) {
-            renderNode(child, cbIndex, alphaMode);
+            renderNode(child, commandBuffer, alphaMode);
         }
     }
 
-    void renderCube(vkglTF::Node* node, uint32_t cbIndex, vkglTF::Material::AlphaMode alphaMode) {
+    void renderCube(vkglTF::Node* node, VkCommandBuffer commandBuffer, vkglTF::Material::AlphaMode alphaMode) {
         if (node->mesh) {
             for (vkglTF::Primitive* primitive : node->mesh->primitives) {
                 if (primitive->material.alphaMode == alphaMode) {
                     const std::vector<VkDescriptorSet> descriptorsets = {
-                                descriptorSets[cbIndex].debug,
                                 primitive->material.descriptorSet,
-                                node->mesh->uniformBuffer.descriptorSet,
+                                descriptorSets.node,
                     };
-                    auto commandBuffers = m_device->getCommandBuffers();
-                    vkCmdBindDescriptorSets(commandBuffers[cbIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 0, NULL);
+                    const vkglTF::Mesh::DynamicOffsets nodeOffsets = node->pushUniformBlock();
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 1, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), static_cast<uint32_t>(nodeOffsets.size()), nodeOffsets.data());
 
                     // Pass material parameters as push constants
                     PushConstBlockMaterial pushConstBlockMaterial{};
@@ -868,37 +864,36 @@ private:
                         pushConstBlockMaterial.specularFactor = glm::vec4(primitive->material.extension.specularFactor, 1.0f);
                     }
 
-                    vkCmdPushConstants(commandBuffers[cbIndex], m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlockMaterial), &pushConstBlockMaterial);
+                    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlockMaterial), &pushConstBlockMaterial);
 
                     for (auto node : meshModel.nodes)
-                        drawDebugBone(node, cbIndex, primitive);
+                        drawDebugBone(node, commandBuffer, primitive);
                 }
             }
         };
         for (auto child : node->children) {
-            renderCube(child, cbIndex, alphaMode);
+            renderCube(child, commandBuffer, alphaMode);
         }
     }
 
-    void drawDebugBone(vkglTF::Node* node, uint32_t cbIndex, vkglTF::Primitive* primitive) {
+    void drawDebugBone(vkglTF::Node* node, VkCommandBuffer commandBuffer, vkglTF::Primitive* primitive) {
 
         if (node->skin) {
-            auto commandBuffers = m_device->getCommandBuffers();
-
             for (size_t i = 0; i < node->mesh->uniformBlock.jointcount; ++i) {
                 updateDebugUniformBuffer(node->getGlobalMatrix() * node->mesh->uniformBlock.jointMatrix[i]);
-                memcpy(uniformBuffers[m_device->getCurrentFrame()].debug.mapped, &shaderValuesDebug, sizeof(shaderValuesDebug));
+                const std::array<uint32_t, 2> debugOffsets = { m_device->getFrameAllocator().push(shaderValuesDebug), sceneDynamicOffsets[1] };
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &descriptorSets.debug, static_cast<uint32_t>(debugOffsets.size()), debugOffsets.data());
 
                 if (primitive->hasIndices) {
-                    vkCmdDrawIndexed(commandBuffers[cbIndex], primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+                    vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
                 }
                 else {
-                    vkCmdDraw(commandBuffers[cbIndex], cubeModel.vertices.count, 1, 0, 0);
+                    vkCmdDraw(commandBuffer, cubeModel.vertices.count, 1, 0, 0);
                 }
             }
         }
         for (auto child : node->children) {
-            drawDebugBone(child, cbIndex, primitive);
+            drawDebugBone(child, commandBuffer, primitive);
         }
     }
 
@@ -914,7 +909,10 @@ private:
     void render() {
         auto tStart = std::chrono::high_resolution_clock::now();
 
-        buildCommandBuffers();
+        // Uniform data is copied into the frame allocator while recording
+        updateUniformBuffer();
+        meshModel.debug_line_segment->updateUniformBuffer(m_camera, shaderValuesScene.model);
+        m_device->beginFrame();
         drawFrame();
         frameCounter++;
         auto tEnd = std::chrono::high_resolution_clock::now();
@@ -934,9 +932,6 @@ private:
     }
 
     void drawFrame() {
-        vkWaitForFences(m_device->getDevice(), 1, &m_device->waitFences[m_device->getCurrentFrame()], VK_TRUE, UINT64_MAX);
-        vkResetFences(m_device->getDevice(), 1, &m_device->waitFences[m_device->getCurrentFrame()]);
-
         uint32_t imageIndex;
         VkResult result = vkAcquireNextImageKHR(m_device->getDevice(), m_device->getSwapChain(), UINT64_MAX, m_device->m_imageAvailableSemaphores[m_device->getCurrentFrame()], VK_NULL_HANDLE, &imageIndex);
 
@@ -951,7 +946,11 @@ private:
         if (m_device->m_imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
             vkWaitForFences(m_device->getDevice(), 1, &m_device->m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
         }
-        m_device->m_imagesInFlight[imageIndex] = m_device->waitFences[m_device->getCurrentFrame()];
+        m_device->m_imagesInFlight[imageIndex] = m_device->m_waitFences[m_device->getCurrentFrame()];
+        vkResetFences(m_device->getDevice(), 1, &m_device->m_waitFences[m_device->getCurrentFrame()]);
+
+        buildCommandBuffer(imageIndex);
+        VkCommandBuffer commandBuffer = m_device->getCurrentCommandBuffer();
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -962,25 +961,13 @@ private:
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &m_device->m_commandBuffers[imageIndex];
+        submitInfo.pCommandBuffers = &commandBuffer;
 
         VkSemaphore signalSemaphores[] = { m_device->m_renderFinishedSemaphores[m_device->getCurrentFrame()] };
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        // Model Mesh
-        updateUniformBuffer();
-        UniformBufferSet currentUB = uniformBuffers[imageIndex];
-        memcpy(currentUB.scene.mapped, &shaderValuesScene, sizeof(shaderValuesScene));
-        memcpy(currentUB.params.mapped, &shaderValuesParams, sizeof(shaderValuesParams));
-
-        // Debug Line Segment
-        meshModel.debug_line_segment->updateUniformBuffer(m_camera, shaderValuesScene.model);
-
-        // Spline
-        //spline->updateUniformBuffer(m_camera, glm::mat4(1.0f));
-
-        m_device->submitCommandBuffer(m_device->getGraphicsQueue(), &submitInfo, m_device->waitFences[m_device->getCurrentFrame()]);
+        m_device->submitCommandBuffer(m_device->getGraphicsQueue(), &submitInfo, m_device->m_waitFences[m_device->getCurrentFrame()]);
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1012,11 +999,10 @@ private:
         }
         else if (enable_IK) {
             // Update IK
-            for (auto& node : meshModel.nodes) {
+            for (auto node : meshModel.nodes) {
                 updateIK(node);
             }
         }
-        updateUniformBuffer();
     }
 
     void updateIK(vkglTF::Node* node) {
@@ -1033,19 +1019,15 @@ private:
         gui->destroy();
         meshModel.destroy();
         cubeModel.destroy();
+        m_ibl.destroy();
         emptyTexture.destroy(m_device->getDevice());
         vkDestroySampler(m_device->getDevice(), m_defaultSampler, nullptr);
         vkDestroyDescriptorSetLayout(m_device->getDevice(), descriptorSetLayouts.scene, nullptr);
         vkDestroyDescriptorSetLayout(m_device->getDevice(), descriptorSetLayouts.materials, nullptr);
         vkDestroyDescriptorSetLayout(m_device->getDevice(), descriptorSetLayouts.node, nullptr);
 
-        for (auto ubo : uniformBuffers) {
-            vkDestroyBuffer(m_device->getDevice(), ubo.scene.buffer, nullptr);
-            vkDestroyBuffer(m_device->getDevice(), ubo.params.buffer, nullptr);
-            vkDestroyBuffer(m_device->getDevice(), ubo.debug.buffer, nullptr);
-        }
-        vkDestroyPipeline(m_device->getDevice(), pipelines.solid, nullptr);
-        vkDestroyPipeline(m_device->getDevice(), pipelines.enable_wireframe, nullptr);
+        vkDestroyPipeline(m_device->getDevice(), pipelines.solid.wait(), nullptr);
+        vkDestroyPipeline(m_device->getDevice(), pipelines.enable_wireframe.wait(), nullptr);
         vkDestroyPipelineLayout(m_device->getDevice(), m_pipelineLayout, nullptr);
     }
 
@@ -1053,6 +1035,7 @@ private:
         ImGui::Begin("Scene Settings");
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
         ImGui::Text("Frame Time %.2f", frameTimer);
+        ImGui::Text("Texture mips: %s", meshModel.mipGenerator ? "compute pass" : "blits");
         ImGui::Checkbox("Enable Animation Update", &enable_animate);
         if (enable_animate) {
             ImGui::Checkbox("Enable slerp", &enable_slerp);
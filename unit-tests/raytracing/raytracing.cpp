@@ -148,7 +148,7 @@ private:
 
     struct StorageImage
     {
-        VkDeviceMemory memory;
+        memory::Allocation allocation;
         VkImage        image = VK_NULL_HANDLE;
         VkImageView    view;
         VkFormat       format;
@@ -162,7 +162,7 @@ private:
     {
         uint64_t       device_address;
         VkBuffer       handle;
-        VkDeviceMemory memory;
+        memory::Allocation allocation;
     };
 
     struct AccelerationStructure
@@ -264,14 +264,7 @@ private:
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         VK_CHECK(vkCreateImage(m_device->getDevice(), &imageInfo, nullptr, &storage_image.image));
 
-        VkMemoryRequirements memory_requirements;
-        vkGetImageMemoryRequirements(m_device->getDevice(), storage_image.image, &memory_requirements);
-        VkMemoryAllocateInfo memory_allocate_info{};
-        memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memory_allocate_info.allocationSize = memory_requirements.size;
-        memory_allocate_info.memoryTypeIndex = m_device->findMemoryType(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK(vkAllocateMemory(m_device->getDevice(), &memory_allocate_info, nullptr, &storage_image.memory));
-        VK_CHECK(vkBindImageMemory(m_device->getDevice(), storage_image.image, storage_image.memory, 0));
+        storage_image.allocation = memory::allocate(m_device, storage_image.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
         storage_image.view = m_device->createImageView(
             m_device->getDevice(),
@@ -649,7 +642,7 @@ private:
         raytracing_pipeline_create_info.pGroups = shader_groups.data();
         raytracing_pipeline_create_info.maxPipelineRayRecursionDepth = 1;
         raytracing_pipeline_create_info.layout = pipeline_layout;
-        VK_CHECK(vkCreateRayTracingPipelinesKHR(m_device->getDevice(), VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &raytracing_pipeline_create_info, nullptr, &pipeline));
+        VK_CHECK(vkCreateRayTracingPipelinesKHR(m_device->getDevice(), VK_NULL_HANDLE, m_device->getPipelineCache(), 1, &raytracing_pipeline_create_info, nullptr, &pipeline));
     }
 
     void initShaderBindingTables()
@@ -748,7 +741,7 @@ private:
             // If the view port size has changed, we need to recreate the storage image
             vkDestroyImageView(m_device->getDevice(), storage_image.view, nullptr);
             vkDestroyImage(m_device->getDevice(), storage_image.image, nullptr);
-            vkFreeMemory(m_device->getDevice(), storage_image.memory, nullptr);
+            memory::free(storage_image.allocation);
             initStorageImage();
             // The descriptor also needs to be updated to reference the new image
             VkDescriptorImageInfo image_descriptor{};
@@ -994,18 +987,8 @@ private:
         bufferCreateInfo.size = buildSizeInfo.accelerationStructureSize;
         bufferCreateInfo.usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
         VK_CHECK(vkCreateBuffer(m_device->getDevice(), &bufferCreateInfo, nullptr, &accelerationStructure.buffer.buffer));
-        VkMemoryRequirements memoryRequirements{};
-        vkGetBufferMemoryRequirements(m_device->getDevice(), accelerationStructure.buffer.buffer, &memoryRequirements);
-        VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
-        memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-        memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-        VkMemoryAllocateInfo memoryAllocateInfo{};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
-        memoryAllocateInfo.allocationSize = memoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = m_device->findMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK(vkAllocateMemory(m_device->getDevice(), &memoryAllocateInfo, nullptr, &accelerationStructure.buffer.memory));
-        VK_CHECK(vkBindBufferMemory(m_device->getDevice(), accelerationStructure.buffer.buffer, accelerationStructure.buffer.memory, 0));
+        accelerationStructure.buffer.device = m_device->getDevice();
+        accelerationStructure.buffer.allocation = memory::allocate(m_device, accelerationStructure.buffer.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR);
     }
 
     ScratchBuffer createScratchBuffer(VkDeviceSize size)
@@ -1018,20 +1001,7 @@ private:
         bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
         VK_CHECK(vkCreateBuffer(m_device->getDevice(), &bufferCreateInfo, nullptr, &scratchBuffer.handle));
 
-        VkMemoryRequirements memoryRequirements{};
-        vkGetBufferMemoryRequirements(m_device->getDevice(), scratchBuffer.handle, &memoryRequirements);
-
-        VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
-        memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-        memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-
-        VkMemoryAllocateInfo memoryAllocateInfo = {};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
-        memoryAllocateInfo.allocationSize = memoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = m_device->findMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK(vkAllocateMemory(m_device->getDevice(), &memoryAllocateInfo, nullptr, &scratchBuffer.memory));
-        VK_CHECK(vkBindBufferMemory(m_device->getDevice(), scratchBuffer.handle, scratchBuffer.memory, 0));
+        scratchBuffer.allocation = memory::allocate(m_device, scratchBuffer.handle, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR);
 
         VkBufferDeviceAddressInfoKHR bufferDeviceAddressInfo{};
         bufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
@@ -1043,12 +1013,10 @@ private:
 
     void deleteScratchBuffer(ScratchBuffer& scratch_buffer)
     {
-        if (scratch_buffer.memory != VK_NULL_HANDLE) {
-            vkFreeMemory(m_device->getDevice(), scratch_buffer.memory, nullptr);
-        }
         if (scratch_buffer.handle != VK_NULL_HANDLE) {
             vkDestroyBuffer(m_device->getDevice(), scratch_buffer.handle, nullptr);
         }
+        memory::free(scratch_buffer.allocation);
     }
 
     uint32_t alignedSize(uint32_t value, uint32_t alignment)
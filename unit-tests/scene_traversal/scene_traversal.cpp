@@ -0,0 +1,172 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+// Enable the WSI extensions
+#if defined(__ANDROID__)
+#define VK_USE_PLATFORM_ANDROID_KHR
+#elif defined(__linux__)
+#define VK_USE_PLATFORM_XLIB_KHR
+#elif defined(_WIN32)
+#define VK_USE_PLATFORM_WIN32_KHR
+#endif
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include "pch.h"
+#include "app.h"
+#include <random>
+#include <filesystem>
+
+#define NODE_COUNT 50000
+#define ROOT_COUNT 16
+#define ITERATIONS 20
+
+// Loads a generated scene of 50k nodes and times the recursive traversals against the passes in arena order
+class Test_SceneTraversal : public App {
+public:
+    Test_SceneTraversal() {
+        vkHelper::addDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    ~Test_SceneTraversal() {
+        delete m_device;
+        m_window->destroy();
+        delete m_window;
+    }
+
+    void getEnabledFeatures() override {
+
+    }
+
+    bool init() override {
+        m_window = new Window();
+        m_window->create(WIDTH, HEIGHT);
+
+        std::function<void()> getfeatures = [&]() { getEnabledFeatures(); };
+        m_device = new Device();
+        m_device->create(m_window, vkHelper::getInstanceExtensions(), vkHelper::getDeviceExtensions(), getfeatures);
+        return true;
+    }
+
+    void update(float deltaTime) override {
+
+    }
+
+    void render() override {
+
+    }
+
+    void run() override {
+        const std::string filename = (std::filesystem::temp_directory_path() / "scene_traversal.gltf").string();
+        writeScene(filename);
+
+        vkglTF::VulkanglTFModel model;
+        model.loadFromFile(filename, m_device, m_device->getGraphicsQueue(), vkglTF::FileLoadingFlags::DontLoadImages);
+
+        const double recursiveUpdate = measure([&]() {
+            for (vkglTF::Node* node : model.nodes) {
+                node->update();
+            }
+        });
+        const double poolUpdate = measure([&]() { model.updateNodes(); });
+        const double recursiveBounds = measure([&]() {
+            for (vkglTF::Node* node : model.nodes) {
+                model.calculateBoundingBox(node, nullptr);
+            }
+        });
+        const double poolBounds = measure([&]() { model.getSceneDimensions(); });
+
+        std::cout << model.linearNodes.size() << " nodes, " << model.meshes.size() << " meshes" << std::endl;
+        std::cout << "update: recursive " << recursiveUpdate << " ms, arena order " << poolUpdate << " ms, "
+            << recursiveUpdate / poolUpdate << "x" << std::endl;
+        std::cout << "bounds: recursive " << recursiveBounds << " ms, arena order " << poolBounds << " ms, "
+            << recursiveBounds / poolBounds << "x" << std::endl;
+
+        vkDeviceWaitIdle(m_device->getDevice());
+        model.destroy();
+        std::filesystem::remove(filename);
+    }
+
+private:
+    Window* m_window;
+    Device* m_device;
+
+    // Milliseconds per call, averaged
+    double measure(std::function<void()> pass) {
+        pass();
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < ITERATIONS; i++) {
+            pass();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / ITERATIONS;
+    }
+
+    // Random hierarchy, every node parented to an earlier one, a quarter of them drawing one shared triangle
+    void writeScene(const std::string& filename) {
+        tinygltf::Model gltfModel;
+
+        const float positions[9] = { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+        tinygltf::Buffer buffer;
+        buffer.data.resize(sizeof(positions));
+        memcpy(buffer.data.data(), positions, sizeof(positions));
+        gltfModel.buffers.push_back(buffer);
+
+        tinygltf::BufferView bufferView;
+        bufferView.buffer = 0;
+        bufferView.byteLength = sizeof(positions);
+        bufferView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+        gltfModel.bufferViews.push_back(bufferView);
+
+        tinygltf::Accessor accessor;
+        accessor.bufferView = 0;
+        accessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+        accessor.type = TINYGLTF_TYPE_VEC3;
+        accessor.count = 3;
+        accessor.minValues = { 0.0, 0.0, 0.0 };
+        accessor.maxValues = { 1.0, 1.0, 0.0 };
+        gltfModel.accessors.push_back(accessor);
+
+        tinygltf::Primitive primitive;
+        primitive.attributes["POSITION"] = 0;
+        primitive.mode = TINYGLTF_MODE_TRIANGLES;
+        tinygltf::Mesh mesh;
+        mesh.primitives.push_back(primitive);
+        gltfModel.meshes.push_back(mesh);
+
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+        gltfModel.nodes.resize(NODE_COUNT);
+        tinygltf::Scene scene;
+        for (int i = 0; i < NODE_COUNT; i++) {
+            tinygltf::Node& node = gltfModel.nodes[i];
+            node.translation = { offset(rng), offset(rng), offset(rng) };
+            const double angle = offset(rng);
+            node.rotation = { 0.0, 0.0, std::sin(angle * 0.5), std::cos(angle * 0.5) };
+            if (i % 4 == 0) {
+                node.mesh = 0;
+            }
+            if (i < ROOT_COUNT) {
+                scene.nodes.push_back(i);
+            }
+            else {
+                gltfModel.nodes[std::uniform_int_distribution<int>(0, i - 1)(rng)].children.push_back(i);
+            }
+        }
+        gltfModel.scenes.push_back(scene);
+        gltfModel.defaultScene = 0;
+        gltfModel.asset.version = "2.0";
+
+        tinygltf::TinyGLTF gltfContext;
+        if (!gltfContext.WriteGltfSceneToFile(&gltfModel, filename, false, true, false, false)) {
+            throw std::runtime_error("failed to write the generated scene!");
+        }
+    }
+};
+
+App* create_application()
+{
+    return new Test_SceneTraversal();
+}
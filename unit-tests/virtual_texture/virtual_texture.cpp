@@ -0,0 +1,374 @@
+/*
+ * Vulkan Renderer Program
+ *
+ * Copyright (C) 2020 Kyle Wang
+ */
+
+// Enable the WSI extensions
+#if defined(__ANDROID__)
+#define VK_USE_PLATFORM_ANDROID_KHR
+#elif defined(__linux__)
+#define VK_USE_PLATFORM_XLIB_KHR
+#elif defined(_WIN32)
+#define VK_USE_PLATFORM_WIN32_KHR
+#endif
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include "pch.h"
+#include "gui.h"
+#include "app.h"
+#include <filesystem>
+
+#define IMAGE_SIZE 8192
+#define PLANE_SIZE 8.0f
+
+// Draws a plane with a generated 8k texture through VirtualTexture and virtual_texture_plane.frag. The page file is
+// built once in the temp directory, pages stream in as the camera moves over the plane
+class Test_VirtualTexture : public App {
+public:
+    Test_VirtualTexture() {
+        vkHelper::addDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    ~Test_VirtualTexture() {
+        delete m_camera;
+        delete m_device;
+        m_window->destroy();
+        delete m_window;
+    }
+
+    void getEnabledFeatures() override {
+
+    }
+
+    bool init() override {
+        initResource();
+        return true;
+    }
+
+    void update(float deltaTime) override {
+
+    }
+
+    void run() override {
+        int64_t lastCounter = getUSec();
+        while (!m_window->getWindowShouldClose()) {
+            int64_t counter = getUSec();
+            float deltaTime = counterToSecondsElapsed(lastCounter, counter);
+            lastCounter = counter;
+            glfwPollEvents();
+            update(deltaTime);
+            render();
+        }
+        vkDeviceWaitIdle(m_device->getDevice());
+        destroy();
+    }
+
+private:
+    Window* m_window;
+    Device* m_device;
+    Camera* m_camera;
+
+    VirtualTexture m_virtualTexture;
+
+    // Feedback and parameters of the virtual texture differ per frame in flight
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> m_descriptorSets;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+    struct PushConstants {
+        glm::mat4 mvp;
+        float uvScale = 1.0f;
+    } pushConstants;
+
+    // Values show on UI
+    Gui* gui;
+    float frameTimer = 0.0f;
+    float uvScale = 1.0f;
+
+    void initResource()
+    {
+        m_camera = new Camera();
+        m_camera->fov = 45.0f;
+        m_camera->type = Camera::CameraType::lookat;
+        m_camera->setPerspective(45.0f, (float)WIDTH / (float)HEIGHT, 0.01f, 100.0f);
+        m_camera->rotationSpeed = 0.25f;
+        m_camera->movementSpeed = 1.0f;
+        m_camera->setPosition({ 0.0f, 0.3f, 1.0f });
+        m_camera->setRotation({ 0.0f, 0.0f, 0.0f });
+
+        m_window = new Window();
+        m_window->setCamera(m_camera);
+        m_window->create(WIDTH, HEIGHT);
+
+        std::function<void()> getfeatures = [&]() { getEnabledFeatures(); };
+        m_device = new Device();
+        m_device->create(m_window, vkHelper::getInstanceExtensions(), vkHelper::getDeviceExtensions(), getfeatures);
+
+        gui = new Gui();
+        gui->init(m_device);
+
+        const std::string pageFilename = (std::filesystem::temp_directory_path() / "virtual_texture.vtex").string();
+        if (!std::filesystem::exists(pageFilename)) {
+            const std::string imageFilename = (std::filesystem::temp_directory_path() / "virtual_texture.tga").string();
+            writeImage(imageFilename);
+            VirtualTexture::buildPageFile(imageFilename, pageFilename);
+            std::filesystem::remove(imageFilename);
+        }
+        m_virtualTexture.create(m_device, pageFilename);
+
+        initDescriptorSets();
+        initPipeline();
+    }
+
+    // Grid lines every page and a colour per 1024 texel block, so the resident level is easy to tell apart
+    void writeImage(const std::string& filename)
+    {
+        std::vector<unsigned char> pixels(size_t(IMAGE_SIZE) * IMAGE_SIZE * 4);
+        for (uint32_t y = 0; y < IMAGE_SIZE; y++) {
+            for (uint32_t x = 0; x < IMAGE_SIZE; x++) {
+                unsigned char* texel = &pixels[(size_t(y) * IMAGE_SIZE + x) * 4];
+                const uint32_t block = (x / 1024) + (y / 1024) * (IMAGE_SIZE / 1024);
+                const bool line = (x % 128) < 2 || (y % 128) < 2;
+                texel[0] = line ? 255 : static_cast<unsigned char>(64 + (block * 37) % 192);
+                texel[1] = line ? 255 : static_cast<unsigned char>(64 + (block * 91) % 192);
+                texel[2] = line ? 255 : static_cast<unsigned char>(64 + ((x ^ y) & 63));
+                texel[3] = 255;
+            }
+        }
+        // TGA, PNG compression of 256 MB takes far longer than building the page file
+        if (!stbi_write_tga(filename.c_str(), IMAGE_SIZE, IMAGE_SIZE, 4, pixels.data())) {
+            throw std::runtime_error("failed to write " + filename);
+        }
+    }
+
+    void initDescriptorSets()
+    {
+        const uint32_t frameCount = m_device->renderAhead;
+        const std::vector<VkDescriptorPoolSize> poolSizes = {
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * frameCount },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount },
+        };
+        m_descriptorPool = m_device->createDescriptorPool(m_device->getDevice(), poolSizes, frameCount);
+        m_descriptorSetLayout = m_device->createDescriptorSetLayout(m_device->getDevice(), m_virtualTexture.getLayoutBindings(0, VK_SHADER_STAGE_FRAGMENT_BIT));
+        for (uint32_t frame = 0; frame < frameCount; frame++) {
+            m_descriptorSets.push_back(m_device->createDescriptorSet(m_device->getDevice(), m_descriptorPool, m_descriptorSetLayout));
+            m_virtualTexture.writeDescriptorSet(m_descriptorSets.back(), 0, frame);
+        }
+
+        const std::vector<VkPushConstantRange> pushConstantRanges = {
+            { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants) },
+        };
+        m_pipelineLayout = m_device->createPipelineLayout(m_device->getDevice(), { m_descriptorSetLayout }, pushConstantRanges);
+    }
+
+    void initPipeline()
+    {
+        InputAssemblyState inputAssembly{};
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        ViewportState viewport{};
+        viewport.x = 0;
+        viewport.y = 0;
+        viewport.width = m_device->getSwapChainExtent().width;
+        viewport.height = m_device->getSwapChainExtent().height;
+
+        RasterizationState rasterizer{};
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        MultisampleState multisampling{};
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        DepthStencilState depthStencil{};
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        ColorBlendState colorBlending{};
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachments = { colorBlendAttachment };
+
+        PipelineQueue::GraphicsPipelineDesc desc;
+        desc.vertexShaderFile = "../../data/shaders/virtual_texture_plane.vert.spv";
+        desc.pixelShaderFile = "../../data/shaders/virtual_texture_plane.frag.spv";
+        desc.vertexInputState = {};
+        desc.inputAssemblyState = inputAssembly;
+        desc.viewportState = viewport;
+        desc.rasterizationState = rasterizer;
+        desc.multisampleState = multisampling;
+        desc.depthStencilState = depthStencil;
+        desc.colorBlendState = colorBlending;
+        desc.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        desc.pipelineLayout = m_pipelineLayout;
+        desc.renderPass = m_device->getRenderPass();
+        m_pipeline = m_device->getPipelineQueue().submit(desc).wait();
+    }
+
+    void buildCommandBuffer(uint32_t imageIndex)
+    {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        std::array<VkClearValue, 2> clearValues{};
+        clearValues[0].color = { 0.2f, 0.2f, 0.2f, 1.0f };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = m_device->getRenderPass();
+        renderPassInfo.framebuffer = m_device->getFramebuffers()[imageIndex];
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = m_device->getSwapChainExtent();
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+        VkCommandBuffer currentCB = m_device->getCurrentCommandBuffer();
+        if (vkBeginCommandBuffer(currentCB, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+        vkCmdBeginRenderPass(currentCB, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport{};
+        viewport.width = (float)WIDTH;
+        viewport.height = (float)HEIGHT;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(currentCB, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.extent = { WIDTH, HEIGHT };
+        vkCmdSetScissor(currentCB, 0, 1, &scissor);
+
+        // The camera starts just above the plane, looking along it so every level is on screen
+        const glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(PLANE_SIZE, 1.0f, PLANE_SIZE));
+        pushConstants.mvp = m_camera->matrices.perspective * m_camera->matrices.view * model;
+        pushConstants.uvScale = uvScale;
+        vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+        vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSets[m_device->getCurrentFrame()], 0, nullptr);
+        vkCmdPushConstants(currentCB, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pushConstants);
+        vkCmdDraw(currentCB, 6, 1, 0, 0);
+
+        auto update_gui = std::bind(&Test_VirtualTexture::updateGUI, this);
+        vkCmdEndRenderPass(currentCB);
+        gui->render(update_gui);
+        vkEndCommandBuffer(currentCB);
+    }
+
+    void render() override {
+        auto tStart = std::chrono::high_resolution_clock::now();
+
+        // The fence of the frame was waited for, its feedback can be read and the page copies go ahead of it
+        m_device->beginFrame();
+        m_virtualTexture.update(static_cast<uint32_t>(m_device->getCurrentFrame()));
+        drawFrame();
+
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        frameTimer = (float)(std::chrono::duration<double, std::milli>(tEnd - tStart).count() / 1000.0);
+        m_camera->update(frameTimer);
+    }
+
+    void drawFrame() {
+        uint32_t imageIndex;
+        VkResult result = vkAcquireNextImageKHR(m_device->getDevice(), m_device->getSwapChain(), UINT64_MAX, m_device->m_imageAvailableSemaphores[m_device->getCurrentFrame()], VK_NULL_HANDLE, &imageIndex);
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            return;
+        }
+        else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("failed to acquire swap chain image!");
+        }
+
+        if (m_device->m_imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+            vkWaitForFences(m_device->getDevice(), 1, &m_device->m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+        }
+        m_device->m_imagesInFlight[imageIndex] = m_device->m_waitFences[m_device->getCurrentFrame()];
+        vkResetFences(m_device->getDevice(), 1, &m_device->m_waitFences[m_device->getCurrentFrame()]);
+
+        buildCommandBuffer(imageIndex);
+        const VkCommandBuffer commandBuffer = m_device->getCurrentCommandBuffer();
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        VkSemaphore waitSemaphores[] = { m_device->m_imageAvailableSemaphores[m_device->getCurrentFrame()] };
+        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        VkSemaphore signalSemaphores[] = { m_device->m_renderFinishedSemaphores[m_device->getCurrentFrame()] };
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        m_device->submitCommandBuffer(m_device->getGraphicsQueue(), &submitInfo, m_device->m_waitFences[m_device->getCurrentFrame()]);
+
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = signalSemaphores;
+
+        VkSwapchainKHR swapChains[] = { m_device->getSwapChain() };
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = swapChains;
+        presentInfo.pImageIndices = &imageIndex;
+
+        result = vkQueuePresentKHR(m_device->getPresentQueue(), &presentInfo);
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_window->getFramebufferResized()) {
+            m_window->setFramebufferResized(false);
+        }
+        else if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to present swap chain image!");
+        }
+        m_device->m_currentFrame = (m_device->m_currentFrame + 1) % 2;
+    }
+
+    void updateGUI() {
+        const VirtualTexture::Stats stats = m_virtualTexture.getStats();
+        ImGui::Begin("Virtual Texture");
+        ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::SliderFloat("UV Scale", &uvScale, 1.0f, 8.0f);
+        ImGui::Text("%u x %u texels", m_virtualTexture.width(), m_virtualTexture.height());
+        ImGui::Text("Pages resident %u of %u slots", stats.residentPages, stats.cacheSlots);
+        ImGui::Text("Pages requested %u, loading %u", stats.requestedPages, stats.loadsInFlight);
+        ImGui::Text("Loaded %llu, evicted %llu, %.1f MB uploaded", static_cast<unsigned long long>(stats.pagesLoaded),
+            static_cast<unsigned long long>(stats.pagesEvicted), stats.bytesUploaded / (1024.0f * 1024.0f));
+        ImGui::End();
+    }
+
+    void destroy() {
+        gui->destroy();
+        m_virtualTexture.destroy();
+        vkDestroyPipeline(m_device->getDevice(), m_pipeline, nullptr);
+        vkDestroyPipelineLayout(m_device->getDevice(), m_pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(m_device->getDevice(), m_descriptorSetLayout, nullptr);
+        vkDestroyDescriptorPool(m_device->getDevice(), m_descriptorPool, nullptr);
+    }
+};
+
+App* create_application()
+{
+    return new Test_VirtualTexture();
+}